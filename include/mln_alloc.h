@@ -30,9 +30,19 @@ typedef int (*mln_alloc_shm_lock_cb_t)(void *);
 #define M_ALLOC_SHM_LARGE_SIZE   (1*1024+512)*1024
 #define M_ALLOC_SHM_DEFAULT_SIZE 2*1024*1024
 
+#define M_ALLOC_TCACHE_MAG_SIZE  64
+#define M_ALLOC_TCACHE_BATCH     16
+#define M_ALLOC_TCACHE_MAX_SIZE  32*1024
+
+#define M_ALLOC_ARENA_SLAB_SIZE  32*1024
+#define M_ALLOC_ARENA_ALIGN      8
+
+#define M_ALLOC_STATS_SITE_NUM   32
+
 typedef struct mln_alloc_s       mln_alloc_t;
 typedef struct mln_alloc_mgr_s   mln_alloc_mgr_t;
 typedef struct mln_alloc_chunk_s mln_alloc_chunk_t;
+typedef struct mln_alloc_tcache_s mln_alloc_tcache_t;
 
 struct mln_alloc_shm_attr_s {
     mln_size_t                size;
@@ -48,9 +58,11 @@ struct mln_alloc_shm_attr_s {
  * It seems that we can not set bit variables those summary not enough aligned bytes
  * at the end of structure.
  * But in Linux, no such kind of problem.
+ *
+ * pool must be the last member, it is shared with mln_alloc_arena_hdr_t,
+ * so mln_alloc_free can tell which kind of pool the memory belongs to.
  */
 typedef struct mln_alloc_blk_s {
-    mln_alloc_t              *pool;
     void                     *data;
     mln_alloc_chunk_t        *chunk;
     mln_size_t                blk_size;
@@ -59,8 +71,74 @@ typedef struct mln_alloc_blk_s {
     mln_size_t                padding:30;
     struct mln_alloc_blk_s   *prev;
     struct mln_alloc_blk_s   *next;
+    mln_alloc_t              *pool;
 } mln_alloc_blk_t;
 
+/*
+ * Arena pool.
+ * Memory is bumped out of slabs, every allocation is only preceded by this header.
+ */
+typedef struct {
+    mln_size_t                size;
+    mln_alloc_t              *pool;
+} mln_alloc_arena_hdr_t;
+
+typedef struct mln_alloc_slab_s {
+    struct mln_alloc_slab_s  *next;
+    mln_size_t                size;
+} mln_alloc_slab_t;
+
+/*
+ * Statistics.
+ * Counters are only maintained after mln_alloc_stats_enable is called,
+ * the others in mln_alloc_snapshot_t are calculated from the pool on demand.
+ */
+typedef struct {
+    mln_u64_t                 nalloc;
+    mln_u64_t                 nfree;
+} mln_alloc_stats_cnt_t;
+
+typedef struct {
+    void                     *site;
+    mln_u64_t                 count;
+    mln_u64_t                 bytes;
+} mln_alloc_stats_site_t;
+
+typedef struct {
+    mln_u32_t                 sample;
+    mln_u32_t                 tick;
+    mln_size_t                in_use;
+    mln_size_t                peak;
+    mln_alloc_stats_cnt_t     cls[M_ALLOC_MGR_LEN];
+    mln_alloc_stats_cnt_t     large;
+    mln_alloc_stats_site_t    sites[M_ALLOC_STATS_SITE_NUM];
+} mln_alloc_stats_t;
+
+typedef struct {
+    mln_size_t                blk_size;
+    mln_u64_t                 nalloc;
+    mln_u64_t                 nfree;
+    mln_size_t                nused;
+    mln_size_t                nidle;
+    mln_size_t                nchunk;
+} mln_alloc_class_info_t;
+
+typedef struct {
+    mln_size_t                in_use;
+    mln_size_t                reserved;
+    mln_size_t                peak;
+    mln_u64_t                 large_nalloc;
+    mln_u64_t                 large_nfree;
+    mln_size_t                large_num;
+    mln_size_t                large_bytes;
+    mln_size_t                slab_num;
+    mln_size_t                shm_num;
+    mln_size_t                shm_bits_used;
+    mln_size_t                shm_bits_total;
+    mln_alloc_class_info_t    classes[M_ALLOC_MGR_LEN];
+    mln_alloc_stats_site_t    sites[M_ALLOC_STATS_SITE_NUM];
+} mln_alloc_snapshot_t;
+
 struct mln_alloc_chunk_s {
     struct mln_alloc_chunk_s *prev;
     struct mln_alloc_chunk_s *next;
@@ -104,21 +182,65 @@ struct mln_alloc_s {
     void                     *locker;
     mln_alloc_shm_lock_cb_t   lock;
     mln_alloc_shm_lock_cb_t   unlock;
+    mln_alloc_slab_t         *slab_head;
+    mln_u8ptr_t               slab_pos;
+    mln_u8ptr_t               slab_end;
+    mln_size_t                slab_size;
+    mln_alloc_stats_t        *stats;
 #if defined(WIN32)
     HANDLE                    map_handle;
 #endif
 };
 
+/*
+ * Thread cache.
+ * Each thread owns one magazine per size class. Blocks are taken from
+ * and returned to the parent pool in batches of M_ALLOC_TCACHE_BATCH,
+ * so the parent's lock is only acquired when a magazine is empty or full.
+ */
+typedef struct {
+    mln_u32_t                 nr;
+    void                     *blks[M_ALLOC_TCACHE_MAG_SIZE];
+} mln_alloc_mag_t;
+
+typedef struct mln_alloc_tcache_local_s {
+    mln_alloc_tcache_t              *tc;
+    mln_alloc_mag_t                  mags[M_ALLOC_MGR_LEN];
+    struct mln_alloc_tcache_local_s *prev;
+    struct mln_alloc_tcache_local_s *next;
+} mln_alloc_tcache_local_t;
+
+struct mln_alloc_tcache_s {
+    mln_alloc_t                     *pool;
+    pthread_mutex_t                  lock;
+    pthread_key_t                    key;
+    mln_alloc_tcache_local_t        *local_head;
+    mln_alloc_tcache_local_t        *local_tail;
+};
+
 
 #define mln_alloc_is_shm(pool) (pool->mem != NULL)
+#define mln_alloc_is_arena(pool) ((pool)->slab_size != 0)
 
 extern mln_alloc_t *mln_alloc_shm_init(struct mln_alloc_shm_attr_s *attr);
 extern mln_alloc_t *mln_alloc_init(mln_alloc_t *parent);
+extern mln_alloc_t *mln_alloc_arena_init(mln_alloc_t *parent, mln_size_t slab_size);
+extern void mln_alloc_arena_reset(mln_alloc_t *pool);
 extern void mln_alloc_destroy(mln_alloc_t *pool);
 extern void *mln_alloc_m(mln_alloc_t *pool, mln_size_t size);
 extern void *mln_alloc_c(mln_alloc_t *pool, mln_size_t size);
 extern void *mln_alloc_re(mln_alloc_t *pool, void *ptr, mln_size_t size);
 extern void mln_alloc_free(void *ptr);
+extern int mln_alloc_stats_enable(mln_alloc_t *pool, mln_u32_t sample);
+extern void mln_alloc_stats_disable(mln_alloc_t *pool);
+extern void mln_alloc_stats_snapshot(mln_alloc_t *pool, mln_alloc_snapshot_t *snap);
+extern void mln_alloc_stats_dump(mln_alloc_t *pool);
+extern mln_alloc_tcache_t *mln_alloc_tcache_init(mln_alloc_t *pool);
+extern void mln_alloc_tcache_destroy(mln_alloc_tcache_t *tc);
+extern void *mln_alloc_tcache_m(mln_alloc_tcache_t *tc, mln_size_t size);
+extern void *mln_alloc_tcache_c(mln_alloc_tcache_t *tc, mln_size_t size);
+extern void *mln_alloc_tcache_re(mln_alloc_tcache_t *tc, void *ptr, mln_size_t size);
+extern void mln_alloc_tcache_free(mln_alloc_tcache_t *tc, void *ptr);
 
 #endif
 
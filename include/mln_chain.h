@@ -22,6 +22,8 @@ typedef struct mln_buf_s {
     mln_off_t           file_pos;
     mln_off_t           file_last;
     mln_file_t         *file;
+    struct mln_buf_s   *origin;/*the buf which owns the data, only set in slices*/
+    mln_u32_t           refs;/*number of slices referring to this buf*/
     mln_u32_t           temporary:1;
 #if !defined(WIN32)
     mln_u32_t           mmap:1;
@@ -63,6 +65,16 @@ extern mln_chain_t *mln_chain_new(mln_alloc_t *pool);
 extern void mln_buf_pool_release(mln_buf_t *b);
 extern void mln_chain_pool_release(mln_chain_t *c);
 extern void mln_chain_pool_release_all(mln_chain_t *c);
+/*
+ * Slices are views of a part of another buf without copying. The data is freed
+ * after the original buf and all its slices are released. Offsets are counted from
+ * left_pos (file_left_pos), i.e. mln_buf_left_size bytes are available.
+ */
+extern mln_buf_t *mln_buf_slice(mln_alloc_t *pool, mln_buf_t *b, mln_size_t off, mln_size_t len) __NONNULL1(1);
+extern mln_chain_t *mln_chain_slice(mln_alloc_t *pool, mln_chain_t *c, mln_size_t off, mln_size_t len) __NONNULL1(1);
+extern int mln_chain_split(mln_alloc_t *pool, mln_chain_t *c, mln_size_t size, mln_chain_t **rest) __NONNULL2(1,4);
+extern mln_chain_t *mln_chain_concat(mln_chain_t *c1, mln_chain_t *c2);
+extern int mln_chain_splice(mln_alloc_t *pool, mln_chain_t **c, mln_size_t off, mln_chain_t *in) __NONNULL2(1,2);
 
 
 #endif
@@ -0,0 +1,66 @@
+
+/*
+ * Copyright (C) Niklaus F.Schen.
+ */
+#ifndef __MLN_CHASH_H
+#define __MLN_CHASH_H
+
+#ifdef MLN_USE_UNIX98
+  #ifndef __USE_UNIX98
+  #define __USE_UNIX98
+  #endif
+#endif
+#include <pthread.h>
+#include "mln_types.h"
+#include "mln_hash.h"
+
+#define M_CHASH_DFL_SHARDS 16
+#define M_CHASH_MAX_SHARDS 256
+#define M_CHASH_BULK_BATCH 256
+
+typedef struct mln_chash_s mln_chash_t;
+
+struct mln_chash_attr {
+    hash_calc_handler        hash;
+    hash_cmp_handler         cmp;
+    hash_free_handler        free_key;
+    hash_free_handler        free_val;
+    mln_u64_t                len_base;/*expected number of entries of the whole map*/
+    mln_u32_t                nr_shards;/*rounded up to a power of 2, 0 means M_CHASH_DFL_SHARDS*/
+};
+
+/*
+ * Each shard is padded to its own cache lines,
+ * so that writers on one shard do not slow down readers of the next one.
+ */
+typedef struct {
+    pthread_rwlock_t         lock;
+    mln_hash_t              *tbl;
+} __attribute__((aligned(64))) mln_chash_shard_t;
+
+struct mln_chash_s {
+    mln_chash_shard_t       *shards;
+    void                    *mem;
+    mln_u32_t                nr_shards;
+    mln_u32_t                mask;
+};
+
+extern mln_chash_t *mln_chash_new(struct mln_chash_attr *attr) __NONNULL1(1);
+extern void mln_chash_free(mln_chash_t *m, mln_hash_flag_t flg) __NONNULL1(1);
+extern void *mln_chash_search(mln_chash_t *m, void *key) __NONNULL2(1,2);
+extern int
+mln_chash_search_apply(mln_chash_t *m, void *key, hash_iterate_handler handler, void *udata) __NONNULL3(1,2,3);
+extern int mln_chash_insert(mln_chash_t *m, void *key, void *val) __NONNULL2(1,2);
+extern int mln_chash_replace(mln_chash_t *m, void *key, void *val) __NONNULL3(1,2,3);
+extern void mln_chash_remove(mln_chash_t *m, void *key, mln_hash_flag_t flg) __NONNULL2(1,2);
+extern int mln_chash_iterate(mln_chash_t *m, hash_iterate_handler handler, void *udata) __NONNULL1(1);
+extern mln_u64_t mln_chash_count(mln_chash_t *m) __NONNULL1(1);
+extern void
+mln_chash_search_bulk(mln_chash_t *m, void **keys, void **vals, mln_size_t n) __NONNULL3(1,2,3);
+extern mln_size_t
+mln_chash_insert_bulk(mln_chash_t *m, void **keys, void **vals, mln_size_t n) __NONNULL3(1,2,3);
+extern void
+mln_chash_remove_bulk(mln_chash_t *m, void **keys, mln_size_t n, mln_hash_flag_t flg) __NONNULL2(1,2);
+
+#endif
+
@@ -33,6 +33,14 @@
 #define M_C_TYPE_FOLLOW 0x8
 #define M_C_TYPE_MEMORY 0x1
 #define M_C_TYPE_FILE   0x2
+#define M_C_TYPE_ADAPTIVE 0x10
+
+/*
+ * receive buffer size of M_C_TYPE_ADAPTIVE, it grows when a recv fills the whole
+ * buffer and shrinks after two reads in a row used less than half of it.
+ */
+#define M_C_RECV_MIN_SIZE 1024
+#define M_C_RECV_MAX_SIZE 65536
 
 typedef struct {
     mln_alloc_t *pool;
@@ -43,6 +51,8 @@ typedef struct {
     mln_chain_t *sent_head;
     mln_chain_t *sent_tail;
     int          sockfd;
+    mln_u32_t    rcv_size;
+    mln_u32_t    rcv_shrink;
 } mln_tcp_conn_t;
 
 
@@ -53,6 +63,7 @@ typedef struct {
 #define mln_tcp_conn_set_fd(pconn,fd) (pconn)->sockfd = (fd)
 #define mln_tcp_conn_get_pool(pconn) ((pconn)->pool)
 extern int mln_tcp_conn_init(mln_tcp_conn_t *tc, int sockfd) __NONNULL1(1);
+extern int mln_tcp_conn_pool_init(mln_tcp_conn_t *tc, int sockfd, mln_alloc_t *pool) __NONNULL2(1,3);
 extern void mln_tcp_conn_destroy(mln_tcp_conn_t *tc);
 extern void
 mln_tcp_conn_append_chain(mln_tcp_conn_t *tc, \
@@ -64,6 +75,8 @@ mln_tcp_conn_append(mln_tcp_conn_t *tc, mln_chain_t *c, int type) __NONNULL2(1,2
 extern mln_chain_t *mln_tcp_conn_get_head(mln_tcp_conn_t *tc, int type) __NONNULL1(1);
 extern mln_chain_t *mln_tcp_conn_remove(mln_tcp_conn_t *tc, int type) __NONNULL1(1);
 extern mln_chain_t *mln_tcp_conn_pop(mln_tcp_conn_t *tc, int type) __NONNULL1(1);
+extern void
+mln_tcp_conn_move(mln_tcp_conn_t *dst, int dst_type, mln_tcp_conn_t *src, int src_type) __NONNULL2(1,3);
 extern mln_chain_t *mln_tcp_conn_get_tail(mln_tcp_conn_t *tc, int type) __NONNULL1(1);
 extern int mln_tcp_conn_send(mln_tcp_conn_t *tc) __NONNULL1(1);
 extern int mln_tcp_conn_recv(mln_tcp_conn_t *tc, mln_u32_t flag) __NONNULL1(1);
@@ -47,10 +47,18 @@
 #define M_EV_NOLOCK_TIMEOUT_US 3000 /*3ms*/
 #define M_EV_NOLOCK_TIMEOUT_MS 3
 #define M_EV_NOLOCK_TIMEOUT_NS 3000000/*3ms*/
+/*for timing wheel, tick is 1ms, 4 levels cover about 4.6 hours, longer ones will be cascaded again*/
+#define M_EV_WHEEL_BITS        6
+#define M_EV_WHEEL_SLOTS       (1 << M_EV_WHEEL_BITS)
+#define M_EV_WHEEL_MASK        (M_EV_WHEEL_SLOTS - 1)
+#define M_EV_WHEEL_LEVELS      4
+#define M_EV_WHEEL_PENDING     (M_EV_WHEEL_LEVELS * M_EV_WHEEL_SLOTS)
+#define M_EV_WHEEL_NONE        ((mln_u32_t)-1)
 
 typedef struct mln_event_s      mln_event_t;
+typedef struct mln_event_uring_s mln_event_uring_t;
 typedef struct mln_event_desc_s mln_event_desc_t;
-typedef mln_fheap_node_t        mln_event_timer_t;
+typedef struct mln_event_desc_s mln_event_timer_t;
 
 typedef void (*ev_fd_handler)  (mln_event_t *, int, void *);
 typedef void (*ev_tm_handler)  (mln_event_t *, void *);
@@ -83,13 +91,17 @@ typedef struct mln_event_fd_s {
     mln_u32_t                rd_oneshot:1;
     mln_u32_t                wr_oneshot:1;
     mln_u32_t                err_oneshot:1;
-    mln_u32_t                padding:26;
+    mln_u32_t                in_ring:1;/*poll request is in io_uring*/
+    mln_u32_t                ring_cancel:1;/*poll remove request is in io_uring*/
+    mln_u32_t                ring_mask:3;/*events of the poll request in io_uring*/
+    mln_u32_t                padding:21;
 } mln_event_fd_t;
 
 typedef struct mln_event_tm_s {
     void                    *data;
     ev_tm_handler            handler;
     mln_uauto_t              end_tm;/*us*/
+    mln_fheap_node_t        *node;/*only used by fheap*/
 } mln_event_tm_t;
 
 struct mln_event_desc_s {
@@ -103,8 +115,18 @@ struct mln_event_desc_s {
     struct mln_event_desc_s *next;
     struct mln_event_desc_s *act_prev;
     struct mln_event_desc_s *act_next;
+    struct mln_event_desc_s *tw_prev;
+    struct mln_event_desc_s *tw_next;
+    mln_u32_t                tw_index;/*bucket in timing wheel, M_EV_WHEEL_NONE if not in wheel*/
 };
 
+typedef struct {
+    mln_u64_t                tick;/*next tick (ms) to be processed*/
+    mln_size_t               nr;
+    mln_event_desc_t        *heads[M_EV_WHEEL_PENDING + 1];
+    mln_event_desc_t        *tails[M_EV_WHEEL_PENDING + 1];
+} mln_event_wheel_t;
+
 struct mln_event_s {
     dispatch_callback        callback;
     void                    *callback_data;
@@ -115,8 +137,11 @@ struct mln_event_s {
     mln_event_desc_t        *ev_fd_active_tail;
     mln_fheap_t             *ev_fd_timeout_heap;
     mln_fheap_t             *ev_timer_heap;
+    mln_event_wheel_t       *ev_fd_timeout_wheel;
+    mln_event_wheel_t       *ev_timer_wheel;
     mln_u32_t                is_break:1;
-    mln_u32_t                padding:31;
+    mln_u32_t                nolock:1;
+    mln_u32_t                padding:30;
     int                      rd_fd;
     int                      wr_fd;
     pthread_mutex_t          fd_lock;
@@ -125,6 +150,9 @@ struct mln_event_s {
 #if defined(MLN_EPOLL)
     int                      epollfd;
     int                      unusedfd;
+#if defined(MLN_IOURING)
+    mln_event_uring_t       *uring;/*NULL if io_uring is unavailable, then epoll is used*/
+#endif
 #elif defined(MLN_KQUEUE)
     int                      kqfd;
     int                      unusedfd;
@@ -138,8 +166,19 @@ struct mln_event_s {
 
 #define mln_event_break_set(ev) ((ev)->is_break = 1);
 #define mln_event_break_reset(ev) ((ev)->is_break = 0);
+/*
+ * nolock mode: the event is owned by only one thread, all mutexes are skipped and
+ * mln_event_dispatch sleeps until the nearest timer or fd timeout instead of polling.
+ */
+#define mln_event_nolock_set(ev) ((ev)->nolock = 1);
+#define mln_event_nolock_reset(ev) ((ev)->nolock = 0);
 #define mln_event_signal_set signal
 extern mln_event_t *mln_event_new(void);
+/*
+ * Same as mln_event_new, but timers and fd timeouts are managed by
+ * hierarchical timing wheels instead of fibonacci heaps.
+ */
+extern mln_event_t *mln_event_wheel_new(void);
 extern void mln_event_free(mln_event_t *ev);
 extern void mln_event_dispatch(mln_event_t *event) __NONNULL1(1);
 /*
@@ -8,6 +8,12 @@
 
 #include "mln_types.h"
 
+/*
+ * Open addressing tables hand this value to the hash callback as h->len,
+ * so callbacks written as 'x % h->len' produce full 32-bit hash values.
+ */
+#define M_HASH_OPEN_RANGE 4294967291ULL
+
 typedef struct mln_hash_s mln_hash_t;
 
 typedef int (*hash_iterate_handler)(void * /*key*/, void * /*val*/, void *);
@@ -38,6 +44,7 @@ struct mln_hash_attr {
     mln_u64_t                len_base;
     mln_u32_t                expandable:1;
     mln_u32_t                calc_prime:1;
+    mln_u32_t                incremental:1;
 };
 
 typedef struct mln_hash_entry_s {
@@ -52,6 +59,12 @@ typedef struct {
     mln_hash_entry_t        *tail;
 } mln_hash_mgr_t;
 
+typedef struct {
+    void                    *key;
+    void                    *val;
+    mln_u64_t                hash;
+} mln_hash_slot_t;
+
 struct mln_hash_s {
     void                    *pool;
     hash_pool_alloc_handler  pool_alloc;
@@ -66,11 +79,34 @@ struct mln_hash_s {
     mln_u32_t                threshold;
     mln_u32_t                expandable:1;
     mln_u32_t                calc_prime:1;
+    mln_u32_t                incremental:1;
+    mln_u32_t                open_addr:1;
+    /*
+     * old_tbl and old_len are the buckets being migrated by an incremental
+     * resize, buckets before 'migrated' have been moved.
+     */
+    mln_hash_mgr_t          *old_tbl;
+    mln_u64_t                old_len;
+    mln_u64_t                migrated;
+    /*
+     * open addressing only, see mln_hash_open_new().
+     * old_* is the table being migrated by a pending resize,
+     * slots before 'migrated' have been moved.
+     */
+    mln_hash_slot_t         *slots;
+    mln_u8ptr_t              ctrl;
+    mln_u64_t                cap;
+    mln_u64_t                nr_deleted;
+    mln_hash_slot_t         *old_slots;
+    mln_u8ptr_t              old_ctrl;
+    mln_u64_t                old_cap;
 };
 
 
 extern mln_hash_t *
 mln_hash_new(struct mln_hash_attr *attr) __NONNULL1(1);
+extern mln_hash_t *
+mln_hash_open_new(struct mln_hash_attr *attr) __NONNULL1(1);
 extern void
 mln_hash_free(mln_hash_t *h, mln_hash_flag_t flg) __NONNULL1(1);
 extern void *
@@ -5,6 +5,7 @@
 #ifndef __MLN_HTTP_H
 #define __MLN_HTTP_H
 
+#include <time.h>
 #include "mln_connection.h"
 #include "mln_hash.h"
 #include "mln_string.h"
@@ -12,6 +13,11 @@
 
 #define M_HTTP_HASH_LEN                        31
 #define M_HTTP_GENERATE_ALLOC_SIZE             1024
+#define M_HTTP_TEMPLATE_VAR_SIZE               96
+
+/*template flags, the fields generated for each response*/
+#define M_HTTP_TEMPLATE_CONTENT_LENGTH         0x1
+#define M_HTTP_TEMPLATE_DATE                   0x2
 
 /*http type*/
 #define M_HTTP_UNKNOWN                         0
@@ -96,6 +102,22 @@
 typedef struct mln_http_s mln_http_t;
 typedef int (*mln_http_handler)(mln_http_t *, mln_chain_t **, mln_chain_t **);
 
+/*
+ * State of the streaming chunked body decoder.
+ */
+typedef struct {
+    mln_u64_t               size;/*bytes left in the current chunk*/
+    mln_u32_t               state;
+    mln_u32_t               digits;
+} mln_http_chunk_t;
+
+#define mln_http_chunk_init(ck) \
+{\
+    (ck)->size = 0;\
+    (ck)->state = 0;\
+    (ck)->digits = 0;\
+}
+
 typedef struct {
     mln_string_t            msg_str;
     mln_string_t            code_str;
@@ -113,6 +135,11 @@ struct mln_http_s {
     mln_string_t           *uri;
     mln_string_t           *args;
     mln_string_t           *response_msg;
+    mln_chain_t            *pinned;/*slices keeping the receive bufs which parsed strings refer to*/
+    mln_size_t              scanned;/*bytes of the pending line already scanned*/
+    mln_http_chunk_t        chunk;
+    mln_u64_t               body_left;/*bytes of a Content-Length body not received yet*/
+    mln_u32_t               body_type;
     mln_u32_t               error;
     mln_u32_t               status;
     mln_u32_t               method;
@@ -121,6 +148,17 @@ struct mln_http_s {
     mln_u32_t               done:1;
 };
 
+/*
+ * A header block serialized once and shared by many responses.
+ */
+typedef struct {
+    mln_buf_t              *head;/*the start line and the fixed fields*/
+    time_t                  date_sec;
+    mln_u32_t               date_len;
+    mln_u32_t               flags;
+    mln_u8_t                date[48];/*the formatted Date field of date_sec*/
+} mln_http_template_t;
+
 /*for internal*/
 #define mln_http_get_Done(h)             ((h)->done)
 #define mln_http_set_Done(h,hd)          (h)->done = (hd)
@@ -151,6 +189,9 @@ struct mln_http_s {
 #define mln_http_get_error(h)            ((h)->error)
 #define mln_http_set_error(h,e)          (h)->error = (e)
 #define mln_http_get_header(h)           ((h)->header_fields)
+#define mln_http_get_body_head(h)        ((h)->body_head)
+#define mln_http_get_body_tail(h)        ((h)->body_tail)
+#define mln_http_set_body(h,hd,tl)       ((h)->body_head = (hd), (h)->body_tail = (tl))
 
 extern mln_http_t *
 mln_http_init(mln_tcp_conn_t *connection, void *data, mln_http_handler body_handler);
@@ -168,6 +209,11 @@ extern void mln_http_reset(mln_http_t *http);
  * you have processed should be freed in this callback function.
  * And the third argument of this callback function will be
  * set NULL. Just ignore it.
+ * The URI, arguments, response message and header fields parsed
+ * from an in-memory buf refer to the data of that buf rather than
+ * copies, so they are not NUL-terminated. The buf is kept until
+ * mln_http_reset() or mln_http_destroy() even if it was released.
+ * Lines spanning bufs and bufs marked temporary are copied.
  */
 extern int mln_http_parse(mln_http_t *http, mln_chain_t **in);
 /*
@@ -178,10 +224,59 @@ extern int mln_http_parse(mln_http_t *http, mln_chain_t **in);
  * via the second and third arguments of 'body_handler'.
  */
 extern int mln_http_generate(mln_http_t *http, mln_chain_t **out_head, mln_chain_t **out_tail);
+/*
+ * mln_http_template_new():
+ * Serialize the start line and the header fields of 'http' once into
+ * memory allocated from 'pool'. The fields selected by 'flags' are
+ * skipped and generated for each message instead.
+ * mln_http_template_generate():
+ * Output the template followed by the fields selected by the flags
+ * and the body chain of 'http' (see mln_http_set_body()). The template
+ * data is not copied but referred to, and it is kept until the last
+ * message referring to it is released, even after mln_http_template_free().
+ * Return value is the same as mln_http_generate().
+ */
+extern mln_http_template_t *
+mln_http_template_new(mln_alloc_t *pool, mln_http_t *http, mln_u32_t flags) __NONNULL2(1,2);
+extern void mln_http_template_free(mln_http_template_t *tpl);
+extern int
+mln_http_template_generate(mln_http_template_t *tpl, mln_http_t *http, mln_chain_t **out_head, mln_chain_t **out_tail) __NONNULL4(1,2,3,4);
 extern int mln_http_set_field(mln_http_t *http, mln_string_t *key, mln_string_t *val);
 extern mln_string_t *mln_http_get_field(mln_http_t *http, mln_string_t *key);
 extern mln_string_t *mln_http_field_iterator(mln_http_t *http, mln_string_t *key);
 extern void mln_http_drop_field(mln_http_t *http, mln_string_t *key);
+/*
+ * mln_http_body_receive():
+ * A body handler which receives the body framed by Content-Length or
+ * Transfer-Encoding: chunked into the body chain of http (see
+ * mln_http_get_body_head()). The data is sliced from the input bufs
+ * without copying. Everything behind the message is left in 'in', so
+ * pipelined requests can be parsed by calling mln_http_reset() and
+ * mln_http_parse() again with the same chain.
+ * A response without both fields is received until the connection is
+ * closed, so this function keeps returning M_HTTP_RET_OK for it.
+ * When called by mln_http_generate(), it does nothing and the body
+ * chain set by mln_http_set_body() is sent.
+ */
+extern int mln_http_body_receive(mln_http_t *http, mln_chain_t **in, mln_chain_t **nil);
+/*
+ * mln_http_chunk_decode():
+ * Decode the chunked body in 'in' and append the data slices to the chain
+ * 'head' and 'tail'. Consumed bufs are released. Trailer fields are discarded.
+ * Return M_HTTP_RET_DONE after the last chunk, M_HTTP_RET_OK if more input
+ * is needed, M_HTTP_RET_ERROR on malformed input or no memory.
+ * mln_http_chunk_encode():
+ * Wrap the chain 'head' and 'tail' (may be empty) into one chunk.
+ * If 'last' is set, the last chunk is appended as well.
+ */
+extern int
+mln_http_chunk_decode(mln_http_chunk_t *ck, mln_alloc_t *pool, mln_chain_t **in, mln_chain_t **head, mln_chain_t **tail) __NONNULL5(1,2,3,4,5);
+extern int
+mln_http_chunk_encode(mln_alloc_t *pool, mln_chain_t **head, mln_chain_t **tail, int last) __NONNULL3(1,2,3);
+/*
+ * Return 1 if the connection should be kept after this message, otherwise 0.
+ */
+extern int mln_http_keepalive(mln_http_t *http);
 
 extern void mln_http_dump(mln_http_t *http);
 
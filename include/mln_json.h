@@ -10,14 +10,18 @@
 #include "mln_alloc.h"
 #include "mln_hash.h"
 #include "mln_rbtree.h"
+#include "mln_chain.h"
 
 #define M_JSON_HASH_LEN         31
+#define M_JSON_GENERATE_ALLOC_SIZE 4096
+#define M_JSON_COMPACT_HASH_MIN 8 /*objects with more members are indexed by key hash*/
 
 #define M_JSON_V_FALSE          0
 #define M_JSON_V_TRUE           1
 #define M_JSON_V_NULL           NULL
 
 typedef struct mln_json_s mln_json_t;
+typedef struct mln_json_vec_s mln_json_vec_t;
 
 enum json_type {
     M_JSON_NONE = 0,
@@ -33,14 +37,20 @@ enum json_type {
 typedef struct {
     mln_json_t                  *key;
     mln_json_t                  *val;
+    mln_alloc_t                 *pool;
 } mln_json_obj_t;
 
 struct mln_json_s {
     mln_uauto_t                  index;
     enum json_type               type;
+    mln_u32_t                    compact:1;
+    mln_u32_t                    arena:1;/*the document root owning the arena*/
+    mln_u32_t                    padding:30;
+    mln_alloc_t                 *pool;
     union {
         mln_hash_t       *m_j_obj;
         mln_rbtree_t     *m_j_array;
+        mln_json_vec_t   *m_j_vec;
         mln_string_t     *m_j_string;
         double            m_j_number;
         mln_u8_t          m_j_true;
@@ -49,6 +59,66 @@ struct mln_json_s {
     }                            data;
 };
 
+/*
+ * The container of objects and arrays in compact documents. Members are stored
+ * contiguously, keys[i] is the key of vals[i].
+ */
+struct mln_json_vec_s {
+    mln_json_t                  *vals;
+    mln_string_t                *keys;/*NULL in arrays*/
+    mln_u32_t                   *index;/*key hash index, NULL if nelts <= M_JSON_COMPACT_HASH_MIN*/
+    mln_u32_t                    mask;
+    mln_u32_t                    nelts;
+};
+
+/*
+ * stream
+ */
+#define M_JSON_STREAM_ERROR     -1
+#define M_JSON_STREAM_AGAIN     0 /*all input consumed, need more*/
+#define M_JSON_STREAM_DONE      1 /*the top-level object/array is closed*/
+#define M_JSON_STREAM_STOP      2 /*stopped by handler*/
+
+enum json_stream_event {
+    M_JSON_STREAM_OBJ_BEGIN = 0,
+    M_JSON_STREAM_OBJ_END,
+    M_JSON_STREAM_ARRAY_BEGIN,
+    M_JSON_STREAM_ARRAY_END,
+    M_JSON_STREAM_KEY,
+    M_JSON_STREAM_VALUE
+};
+
+typedef struct mln_json_stream_s mln_json_stream_t;
+/*
+ * val is a temporary node owned by the stream, for KEY and VALUE events it
+ * carries a string, number, true, false or null. Its string is only valid
+ * during the call. Return non-zero to stop parsing.
+ */
+typedef int (*mln_json_stream_handler)(mln_json_stream_t *, enum json_stream_event, mln_json_t *, void *);
+
+struct mln_json_stream_s {
+    mln_alloc_t                 *pool;
+    mln_json_stream_handler      handler;
+    void                        *data;
+    mln_u8ptr_t                  stack;/*container types of all levels*/
+    mln_size_t                   depth;
+    mln_size_t                   stack_size;
+    mln_u8ptr_t                  buf;/*token split by fragments*/
+    mln_size_t                   buf_len;
+    mln_size_t                   buf_size;
+    const char                  *lit;
+    mln_u32_t                    lit_pos;
+    mln_u32_t                    state:8;
+    mln_u32_t                    is_key:1;
+    mln_u32_t                    escape:1;
+    mln_u32_t                    has_esc:1;
+    mln_u32_t                    padding:21;
+    mln_string_t                 str;
+    mln_json_t                   val;
+};
+
+#define mln_json_stream_depth(s)               ((s)->depth)
+
 #define M_JSON_IS_OBJECT(json)                 ((json)->type == M_JSON_OBJECT)
 #define M_JSON_IS_ARRAY(json)                  ((json)->type == M_JSON_ARRAY)
 #define M_JSON_IS_STRING(json)                 ((json)->type == M_JSON_STRING)
@@ -57,9 +127,11 @@ struct mln_json_s {
 #define M_JSON_IS_FALSE(json)                  ((json)->type == M_JSON_FALSE)
 #define M_JSON_IS_NULL(json)                   ((json)->type == M_JSON_NULL)
 #define M_JSON_IS_NONE(json)                   ((json)->type == M_JSON_NONE)
+#define M_JSON_IS_COMPACT(json)                ((json)->compact)
 
 #define M_JSON_GET_DATA_OBJECT(json)           ((json)->data.m_j_obj)
 #define M_JSON_GET_DATA_ARRAY(json)            ((json)->data.m_j_array)
+#define M_JSON_GET_DATA_VEC(json)              ((json)->data.m_j_vec)
 #define M_JSON_GET_DATA_STRING(json)           ((json)->data.m_j_string)
 #define M_JSON_GET_DATA_NUMBER(json)           ((json)->data.m_j_number)
 #define M_JSON_GET_DATA_TRUE(json)             ((json)->data.m_j_true)
@@ -85,9 +157,22 @@ struct mln_json_s {
 
 extern mln_json_t *mln_json_new(void);
 extern mln_json_t *mln_json_parse(mln_string_t *jstr);
+/*
+ * All nodes, containers and strings of a json created by the pool version
+ * are allocated from pool, and the child nodes inherit the pool of their parent.
+ */
+extern mln_json_t *mln_json_pool_new(mln_alloc_t *pool);
+extern mln_json_t *mln_json_pool_parse(mln_alloc_t *pool, mln_string_t *jstr);
+/*
+ * Compact documents are read-only. Objects and arrays are vectors, and the whole
+ * document lives in one arena created from pool (or heap if NULL) that is
+ * released by mln_json_free on the root.
+ */
+extern mln_json_t *mln_json_compact_parse(mln_alloc_t *pool, mln_string_t *jstr);
 extern void mln_json_free(void *json);
 extern void mln_json_dump(mln_json_t *j, int n_space, char *prefix);
 extern mln_string_t *mln_json_generate(mln_json_t *j);
+extern mln_chain_t *mln_json_generate_chain(mln_alloc_t *pool, mln_json_t *j) __NONNULL1(1);
 extern mln_json_t *mln_json_search_value(mln_json_t *j, mln_string_t *key);
 extern mln_json_t *mln_json_search_element(mln_json_t *j, mln_uauto_t index);
 extern mln_uauto_t mln_json_get_array_length(mln_json_t *j);
@@ -97,6 +182,18 @@ extern int mln_json_update_element(mln_json_t *j, mln_json_t *value, mln_uauto_t
 extern void mln_json_reset(mln_json_t *j);
 extern mln_json_t *mln_json_remove_object(mln_json_t *j, mln_string_t *key);
 extern mln_json_t *mln_json_remove_element(mln_json_t *j, mln_uauto_t index);
+extern mln_json_stream_t *
+mln_json_stream_new(mln_alloc_t *pool, mln_json_stream_handler handler, void *data);
+extern void mln_json_stream_free(mln_json_stream_t *s);
+extern void mln_json_stream_reset(mln_json_stream_t *s);
+/*
+ * *len is the input size and is set to the number of bytes consumed.
+ */
+extern int mln_json_stream_feed(mln_json_stream_t *s, mln_u8ptr_t data, mln_size_t *len) __NONNULL3(1,2,3);
+/*
+ * Only in-memory bufs are accepted, left_pos of each buf is moved forward.
+ */
+extern int mln_json_stream_feed_chain(mln_json_stream_t *s, mln_chain_t *c) __NONNULL1(1);
 
 #endif
 
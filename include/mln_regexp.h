@@ -39,9 +39,125 @@ typedef struct mln_reg_match_s {
     struct mln_reg_match_s *next;
 } mln_reg_match_t;
 
+/*
+ * Compiled regular expression.
+ * The pattern is parsed once into a Thompson NFA program. Matching simulates
+ * the program with a lazily built DFA (no captures) or a Pike VM (captures),
+ * so the time is linear in the text length for any pattern.
+ */
+#define M_REG_MAX_INST        65536
+#define M_REG_MAX_REPEAT      1000
+#define M_REG_MAX_DEPTH       1000
+#define M_REG_DFA_MAX_STATES  2048
+#define M_REG_PREFIX_MAX      32
+
+typedef struct {
+    mln_u32_t                op:8;
+    mln_u32_t                c:8;
+    mln_u32_t                x;
+    mln_u32_t                y;
+} mln_reg_inst_t;
+
+typedef struct {
+    mln_u32_t                off;/*offset of the sorted instruction set in pcs*/
+    mln_u32_t                npcs;
+    mln_u32_t                nids;/*indexes of the patterns matched in this state follow the instructions*/
+    mln_u32_t                hash;
+} mln_reg_dfa_state_t;
+
+typedef struct {
+    mln_reg_dfa_state_t     *states;
+    mln_s32_t               *trans;/*a row of nbyte_classes+1 per state: next rows (-1 means not built yet) and flags*/
+    mln_s32_t               *slots;/*hash table of state indexes*/
+    mln_u32_t               *pcs;
+    mln_u32_t                nstates;
+    mln_u32_t                cap;
+    mln_u32_t                npcs;
+    mln_u32_t                pcs_cap;
+    mln_s32_t                start[2];/*start state in the middle and at the beginning of the text*/
+    mln_u32_t                max_states;/*a power of 2, 0 means M_REG_DFA_MAX_STATES*/
+    /*
+     * An unanchored DFA restarts the program at every byte. The instructions
+     * of that restart are in every state, so they are kept here only once.
+     */
+    mln_u32_t               *start_pcs;
+    mln_u32_t                nstart_pcs;
+    mln_u8_t                *in_start;
+    mln_u32_t                unanchored:1;
+} mln_reg_dfa_t;
+
+typedef struct {
+    mln_reg_inst_t          *insts;
+    mln_u32_t                ninst;
+    mln_u32_t                ngroups;
+    mln_u8_t               (*classes)[32];
+    mln_u32_t                nclasses;
+    mln_u32_t                nbyte_classes;
+    mln_u8_t                 byte_class[256];
+    mln_u8_t                 prefix[M_REG_PREFIX_MAX];
+    mln_u32_t                prefix_len;
+    mln_u32_t                prefix_rare;/*offset of the byte looked for by memchr*/
+    mln_u32_t                anchored:1;
+    mln_reg_dfa_t            search;
+    mln_reg_dfa_t            equal;
+    void                    *scratch;/*work memory of the simulations*/
+} mln_reg_t;
+
 extern int mln_reg_match(mln_string_t *exp, mln_string_t *text, mln_reg_match_t **head, mln_reg_match_t **tail);
 extern int mln_reg_equal(mln_string_t *exp, mln_string_t *text);
 extern void mln_reg_match_result_free(mln_reg_match_t *results);
+/*
+ * A compiled expression caches DFA states while matching,
+ * so it should not be used by several threads at the same time.
+ */
+extern mln_reg_t *mln_reg_compile(mln_string_t *exp) __NONNULL1(1);
+extern void mln_reg_free(mln_reg_t *reg);
+extern int mln_reg_exec(mln_reg_t *reg, mln_string_t *text, mln_string_t *caps, mln_u32_t ncaps) __NONNULL2(1,2);
+extern int mln_reg_exec_equal(mln_reg_t *reg, mln_string_t *text) __NONNULL2(1,2);
+#define mln_reg_group_num(reg) ((reg)->ngroups)
+
+/*
+ * Pattern set.
+ * The literals are matched by one Aho-Corasick automaton and the regular
+ * expressions by one DFA built from all of their programs, so the text is
+ * scanned once for each kind of pattern, whatever the number of patterns.
+ */
+#define M_REG_SET_LITERAL         0x1
+#define M_REG_SET_DFA_MAX_STATES  131072
+
+typedef struct {
+    mln_s32_t               *trans;/*a row of nbyte_classes+1 per node: next rows and whether there is an output*/
+    mln_u32_t               *out;/*first output of each node*/
+    mln_u32_t               *dict;/*nearest node having outputs on the failure path*/
+    mln_u32_t               *out_id;
+    mln_u32_t               *out_next;
+    mln_u32_t                nnodes;
+    mln_u32_t                nbyte_classes;
+    mln_u8_t                 byte_class[256];
+} mln_reg_ac_t;
+
+typedef struct {
+    mln_string_t            *literal;
+    mln_reg_t               *reg;
+} mln_reg_pattern_t;
+
+typedef struct {
+    mln_reg_pattern_t       *patterns;
+    mln_u32_t                n;
+    mln_u32_t                cap;
+    mln_reg_ac_t             ac;
+    mln_reg_t               *prog;/*all regular expressions, MATCH holds the pattern index*/
+    mln_u64_t               *matched;
+    mln_u32_t                compiled:1;
+} mln_reg_set_t;
+
+extern mln_reg_set_t *mln_reg_set_new(void);
+extern void mln_reg_set_free(mln_reg_set_t *set);
+extern int mln_reg_set_add(mln_reg_set_t *set, mln_string_t *exp, mln_u32_t flags) __NONNULL2(1,2);
+extern int mln_reg_set_compile(mln_reg_set_t *set) __NONNULL1(1);
+extern int mln_reg_set_match(mln_reg_set_t *set, mln_string_t *text, mln_u32_t *ids, mln_u32_t nids) __NONNULL2(1,2);
+#define mln_reg_set_num(set) ((set)->n)
+#define mln_reg_set_pattern(set,id) ((set)->patterns[(id)].reg)
 
 #endif
 
@@ -18,6 +18,38 @@ typedef struct {
     mln_uauto_t  ref:30;
 } mln_string_t;
 
+/*
+ * A pattern prepared once for many searches.
+ */
+typedef struct {
+    mln_u8ptr_t  data;
+    mln_u64_t    len;
+    mln_u32_t   *next;/*prefix function of KMP*/
+    mln_u64_t    skip[256];/*bad character shifts of BMH*/
+    mln_u64_t    rare[2];/*offsets of the two bytes checked first by mln_string_pattern_search*/
+    mln_u32_t    pool:1;
+} mln_string_pattern_t;
+
+/*
+ * An intern table keeps one copy of each distinct string,
+ * so interned strings can be compared by address.
+ */
+#define M_STRING_INTERN_ICASE    0x1 /*ASCII case is ignored, the first spelling seen is kept*/
+#define M_STRING_INTERN_INIT_LEN 64
+
+typedef struct {
+    mln_u64_t      hash;
+    mln_string_t  *str;
+} mln_string_intern_slot_t;
+
+typedef struct {
+    mln_alloc_t              *pool;
+    mln_string_intern_slot_t *slots;
+    mln_u64_t                 mask;
+    mln_u64_t                 nr;
+    mln_u32_t                 icase:1;
+} mln_string_intern_t;
+
 /*
  * init & free
  */
@@ -108,6 +140,22 @@ extern char *mln_string_const_kmp(mln_string_t *text, char *pattern) __NONNULL1(
  */
 extern mln_string_t *mln_string_new_kmp(mln_string_t *text, mln_string_t *pattern) __NONNULL2(1,2);
 extern mln_string_t *mln_string_new_const_kmp(mln_string_t *text, char *pattern) __NONNULL2(1,2);
+extern mln_string_pattern_t *mln_string_pattern_new(mln_string_t *pattern) __NONNULL1(1);
+extern mln_string_pattern_t *mln_string_pattern_pool_new(mln_alloc_t *pool, mln_string_t *pattern) __NONNULL2(1,2);
+extern void mln_string_pattern_free(mln_string_pattern_t *pat);
+extern char *mln_string_pattern_search(mln_string_pattern_t *pat, mln_string_t *text) __NONNULL2(1,2);
+extern char *mln_string_pattern_kmp(mln_string_pattern_t *pat, mln_string_t *text) __NONNULL2(1,2);
+extern char *mln_string_pattern_bmh(mln_string_pattern_t *pat, mln_string_t *text) __NONNULL2(1,2);
+/*
+ * Strings returned by mln_string_intern and mln_string_const_intern belong to the table,
+ * use mln_string_ref to keep one after the table is freed.
+ */
+extern mln_string_intern_t *mln_string_intern_new(mln_alloc_t *pool, mln_u32_t flags);
+extern void mln_string_intern_free(mln_string_intern_t *tbl);
+extern mln_string_t *mln_string_intern(mln_string_intern_t *tbl, mln_string_t *s) __NONNULL2(1,2);
+extern mln_string_t *mln_string_const_intern(mln_string_intern_t *tbl, char *s) __NONNULL2(1,2);
+extern mln_string_t *mln_string_intern_search(mln_string_intern_t *tbl, mln_string_t *s) __NONNULL2(1,2);
+#define mln_string_intern_num(tbl) ((tbl)->nr)
 /*
  * mln_string_slice will modify s.
  * So if you want to get avoid this side-effect,
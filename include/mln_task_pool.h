@@ -0,0 +1,110 @@
+
+/*
+ * Copyright (C) Niklaus F.Schen.
+ */
+#ifndef __MLN_TASK_POOL_H
+#define __MLN_TASK_POOL_H
+
+#ifdef MLN_USE_UNIX98
+  #ifndef __USE_UNIX98
+  #define __USE_UNIX98
+  #endif
+#endif
+#include <pthread.h>
+#include "mln_types.h"
+#include "mln_thread_pool.h"
+
+#define M_TASK_POOL_PRIO_HIGH   0
+#define M_TASK_POOL_PRIO_NORMAL 1
+#define M_TASK_POOL_PRIO_NUM    2
+#define M_TASK_POOL_ANY         -1 /*no affinity, any worker may run the task*/
+#define M_TASK_POOL_DEQUE_LEN   256 /*initial capacity of each deque, it grows when full*/
+#define M_TASK_POOL_SPIN        64 /*rounds of searching for a task before a worker sleeps*/
+
+typedef struct mln_task_pool_s mln_task_pool_t;
+
+/*
+ * A Chase-Lev deque. Its owner pushes and takes at bottom without locking,
+ * other threads steal from top with a CAS. A full deque is copied into one
+ * twice as large, replaced arrays are kept in prev until the pool is freed,
+ * because a thief may still be reading them.
+ */
+typedef struct mln_task_pool_array_s {
+    mln_s64_t                          mask;
+    struct mln_task_pool_array_s      *prev;
+    void                              *slots[];
+} mln_task_pool_array_t;
+
+typedef struct {
+    mln_s64_t                          top __attribute__((aligned(64)));
+    mln_s64_t                          bottom __attribute__((aligned(64)));
+    mln_task_pool_array_t             *array;
+} mln_task_pool_deque_t;
+
+/*
+ * Tasks bound to one worker wait in its mailbox, which is never stolen from.
+ */
+typedef struct {
+    void                             **slots;
+    mln_size_t                         head;
+    mln_size_t                         tail;
+    mln_size_t                         mask;
+} mln_task_pool_ring_t;
+
+typedef struct {
+    mln_task_pool_deque_t              deque[M_TASK_POOL_PRIO_NUM];
+    pthread_mutex_t                    mbox_lock;
+    mln_task_pool_ring_t               mbox[M_TASK_POOL_PRIO_NUM];
+    mln_size_t                         n_mbox;/*read without mbox_lock to skip an empty mailbox*/
+    mln_task_pool_t                   *pool;
+    pthread_t                          tid;
+    mln_u64_t                          seed;/*picks the first victim to steal from*/
+    mln_u64_t                          n_stolen;
+    mln_s32_t                          id;/*-1 for the main thread*/
+    mln_u32_t                          started:1;
+} __attribute__((aligned(64))) mln_task_pool_member_t;
+
+/*
+ * members[0] belongs to the main thread, it only submits tasks.
+ * Workers are members[1] to members[nr_workers].
+ */
+struct mln_task_pool_s {
+    mln_task_pool_member_t            *members;
+    mln_u32_t                          nr_workers;
+    mln_u32_t                          sleepers;
+    mln_u32_t                          n_high;/*high priority tasks waiting in deques*/
+    mln_u32_t                          quit;
+    pthread_mutex_t                    mutex;
+    pthread_cond_t                     cond;
+    mln_u64_t                          cond_timeout;/*ms*/
+    mln_thread_process                 process_handler;
+    mln_thread_data_free               free_handler;
+};
+
+struct mln_task_pool_attr {
+    void                              *main_data;
+    mln_thread_process                 child_process_handler;
+    mln_thread_process                 main_process_handler;
+    mln_thread_data_free               free_handler;
+    mln_u64_t                          cond_timeout; /*ms, 0 means an idle worker sleeps until woken up*/
+    mln_u32_t                          nr_workers;/*0 means the number of online CPUs*/
+    mln_u32_t                          pin_cpu:1;/*bind worker i to CPU i % CPUs, Linux only*/
+};
+
+struct mln_task_pool_info {
+    mln_u32_t                          nr_workers;
+    mln_u32_t                          idle_num;
+    mln_size_t                         res_num;
+    mln_u64_t                          stolen_num;
+};
+
+extern int mln_task_pool_run(struct mln_task_pool_attr *tpattr) __NONNULL1(1);
+extern int mln_task_pool_resource_add(void *data) __NONNULL1(1);
+extern int mln_task_pool_resource_add_ex(void *data, mln_u32_t prio, mln_s32_t worker) __NONNULL1(1);
+extern int
+mln_task_pool_resource_add_batch(void **data, mln_size_t n, mln_u32_t prio, mln_s32_t worker) __NONNULL1(1);
+extern mln_s32_t mln_task_pool_worker_id(void);
+extern void mln_task_pool_quit(void);
+extern void mln_task_pool_resource_info(struct mln_task_pool_info *info);
+#endif
+
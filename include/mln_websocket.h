@@ -56,6 +56,21 @@
 
 typedef struct mln_websocket_s mln_websocket_t;
 typedef int (*mln_ws_extension_handle)(mln_websocket_t *);
+typedef struct mln_websocket_deflate_s mln_websocket_deflate_t;
+
+/*
+ * permessage-deflate (RFC 7692), available if configured with --enable-zlib.
+ */
+struct mln_websocket_deflate_attr {
+    mln_u32_t                server_no_context_takeover:1;
+    mln_u32_t                client_no_context_takeover:1;
+    mln_u32_t                server_max_window_bits;/*9~15, 0 means 15*/
+    mln_u32_t                client_max_window_bits;/*9~15, 0 means 15*/
+    int                      level;/*compression level 0~9, -1 means the zlib default*/
+    int                      mem_level;/*1~9, 0 means 8, lower ones use less memory per connection*/
+    mln_size_t               threshold;/*unfragmented messages shorter than this are sent uncompressed*/
+    mln_u64_t                max_message_size;/*limit of the inflated size of a message, 0 means no limit*/
+};
 
 struct mln_websocket_s {
     mln_http_t              *http;
@@ -80,6 +95,16 @@ struct mln_websocket_s {
     mln_u16_t                padding:6;
     mln_u16_t                status;
     mln_u32_t                masking_key;
+
+    mln_chain_t             *pinned;/*slices keeping the receive bufs which content refers to*/
+    mln_chain_t             *msg_head;/*payload of the message assembled by mln_websocket_message_parse*/
+    mln_chain_t             *msg_tail;
+    mln_u64_t                msg_len;
+    mln_u32_t                msg_opcode:4;
+    mln_u32_t                msg_rsv:3;
+    mln_u32_t                msg_done:1;
+
+    mln_websocket_deflate_t *deflate;
 };
 
 #define mln_websocket_get_http(ws)             ((ws)->http)
@@ -124,6 +149,9 @@ struct mln_websocket_s {
 #define mln_websocket_get_maskbit(ws)          ((ws)->mask)
 #define mln_websocket_set_masking_key(ws,k)    ((ws)->masking_key = (k))
 #define mln_websocket_get_masking_key(ws)      ((ws)->masking_key)
+#define mln_websocket_get_message(ws)          ((ws)->msg_head)
+#define mln_websocket_get_message_len(ws)      ((ws)->msg_len)
+#define mln_websocket_get_deflate(ws)          ((ws)->deflate)
 
 extern int mln_websocket_init(mln_websocket_t *ws, mln_http_t *http) __NONNULL2(1,2);
 extern mln_websocket_t *mln_websocket_new(mln_http_t *http) __NONNULL1(1);
@@ -160,6 +188,55 @@ extern int mln_websocket_close_generate(mln_websocket_t *ws, \
 extern int mln_websocket_ping_generate(mln_websocket_t *ws, mln_chain_t **out_cnode, mln_u32_t flags) __NONNULL2(1,2);
 extern int mln_websocket_pong_generate(mln_websocket_t *ws, mln_chain_t **out_cnode, mln_u32_t flags) __NONNULL2(1,2);
 extern int mln_websocket_generate(mln_websocket_t *ws, mln_chain_t **out_cnode) __NONNULL1(1);
+/*
+ * mln_websocket_parse():
+ * Parse one frame. If the payload lies in one in-memory buf, it is
+ * unmasked in place and the content refers to it, the buf is kept
+ * until the next parsing or the websocket is reset or destroyed.
+ * Otherwise the payload is copied.
+ */
 extern int mln_websocket_parse(mln_websocket_t *ws, mln_chain_t **in) __NONNULL1(1);
+/*
+ * mln_websocket_message_parse():
+ * Parse frames until a whole text or binary message is received.
+ * The payloads of its fragments are unmasked in place and chained
+ * without copying (see mln_websocket_get_message()), and the chain is
+ * released at the next call. A control frame interleaved with the
+ * fragments is returned at once, just like mln_websocket_parse().
+ * The extension handler is called once the message is complete.
+ */
+extern int mln_websocket_message_parse(mln_websocket_t *ws, mln_chain_t **in) __NONNULL1(1);
+/*
+ * mln_websocket_deflate_enable():
+ * Offer (client) or accept (server) permessage-deflate in the following
+ * handshake. If the peer does not agree, the state is freed and
+ * mln_websocket_get_deflate() returns NULL after the handshake.
+ * Once negotiated, text and binary messages are compressed by
+ * mln_websocket_generate and decompressed by the parse functions.
+ */
+extern int
+mln_websocket_deflate_enable(mln_websocket_t *ws, struct mln_websocket_deflate_attr *attr) __NONNULL1(1);
+/*
+ * mln_websocket_broadcast_frame_new():
+ * Encode an unmasked server frame once for many receivers. flags takes
+ * M_WS_FLAG_NEW and M_WS_FLAG_END as the generators do. The frame is
+ * never compressed, so it suits connections with or without deflate.
+ * mln_websocket_broadcast():
+ * Queue the frame on the send queues of n connections, each of them only
+ * gets a refcounted slice of it. Returns the number of connections queued,
+ * conns[ret] is the one that ran out of memory if ret < n.
+ * The caller drops its own reference with mln_websocket_broadcast_frame_free
+ * once the fan-out is done, the data is freed when the last slice is released.
+ * The refcount is not atomic, all the connections must be served by the
+ * thread that owns the frame.
+ */
+extern mln_buf_t *mln_websocket_broadcast_frame_new(mln_alloc_t *pool, \
+                                                    mln_u8_t opcode, \
+                                                    void *data, \
+                                                    mln_size_t len, \
+                                                    mln_u32_t flags) __NONNULL1(1);
+extern mln_size_t
+mln_websocket_broadcast(mln_buf_t *frame, mln_tcp_conn_t **conns, mln_size_t n);
+#define mln_websocket_broadcast_frame_free(frame) mln_buf_pool_release(frame)
 
 #endif
@@ -7,6 +7,11 @@
 #include "mln_defs.h"
 #include "mln_log.h"
 
+#if defined(__GNUC__) && !defined(__wasm__)
+#define M_ALLOC_CALLER __builtin_return_address(0)
+#else
+#define M_ALLOC_CALLER NULL
+#endif
 
 MLN_CHAIN_FUNC_DECLARE(mln_blk, \
                        mln_alloc_blk_t, \
@@ -17,6 +22,9 @@ MLN_CHAIN_FUNC_DECLARE(mln_chunk, \
 MLN_CHAIN_FUNC_DECLARE(mln_alloc_shm, \
                        mln_alloc_shm_t, \
                        static inline void,);
+MLN_CHAIN_FUNC_DECLARE(mln_alloc_tcache_local, \
+                       mln_alloc_tcache_local_t, \
+                       static inline void,);
 static inline void
 mln_alloc_mgr_table_init(mln_alloc_mgr_t *tbl);
 static inline mln_alloc_mgr_t *
@@ -27,6 +35,11 @@ static inline int mln_alloc_shm_allowed(mln_alloc_shm_t *as, mln_off_t *Boff, ml
 static inline void *mln_alloc_shm_set_bitmap(mln_alloc_shm_t *as, mln_off_t Boff, mln_off_t boff, mln_size_t size);
 static inline mln_alloc_shm_t *mln_alloc_shm_new_block(mln_alloc_t *pool, mln_off_t *Boff, mln_off_t *boff, mln_size_t size);
 static inline void mln_alloc_free_shm(void *ptr);
+static inline void *mln_alloc_arena_m(mln_alloc_t *pool, mln_size_t size);
+static inline void *mln_alloc_arena_re(mln_alloc_t *pool, void *ptr, mln_size_t size);
+static inline void mln_alloc_arena_slab_free(mln_alloc_t *pool, mln_alloc_slab_t *slab);
+static inline void mln_alloc_stats_alloc(mln_alloc_t *pool, void *ptr, void *site);
+static inline void mln_alloc_stats_free(mln_alloc_t *pool, void *ptr);
 
 static inline mln_alloc_shm_t *mln_alloc_shm_new(mln_alloc_t *pool, mln_size_t size, int is_large)
 {
@@ -132,6 +145,10 @@ mln_alloc_t *mln_alloc_shm_init(struct mln_alloc_shm_attr_s *attr)
     pool->locker = attr->locker;
     pool->lock = attr->lock;
     pool->unlock = attr->unlock;
+    pool->slab_head = NULL;
+    pool->slab_pos = pool->slab_end = NULL;
+    pool->slab_size = 0;
+    pool->stats = NULL;
     return pool;
 }
 
@@ -160,6 +177,18 @@ mln_alloc_t *mln_alloc_init(mln_alloc_t *parent)
     pool->locker = NULL;
     pool->lock = NULL;
     pool->unlock = NULL;
+    pool->slab_head = NULL;
+    pool->slab_pos = pool->slab_end = NULL;
+    pool->slab_size = 0;
+    pool->stats = NULL;
+    return pool;
+}
+
+mln_alloc_t *mln_alloc_arena_init(mln_alloc_t *parent, mln_size_t slab_size)
+{
+    mln_alloc_t *pool = mln_alloc_init(parent);
+    if (pool == NULL) return NULL;
+    pool->slab_size = slab_size? slab_size: M_ALLOC_ARENA_SLAB_SIZE;
     return pool;
 }
 
@@ -201,6 +230,12 @@ void mln_alloc_destroy(mln_alloc_t *pool)
         mln_alloc_mgr_t *am, *amend;
         amend = pool->mgr_tbl + M_ALLOC_MGR_LEN;
         mln_alloc_chunk_t *ch;
+        mln_alloc_slab_t *slab;
+        while ((slab = pool->slab_head) != NULL) {
+            pool->slab_head = slab->next;
+            if (parent != NULL) mln_alloc_free(slab);
+            else free(slab);
+        }
         for (am = pool->mgr_tbl; am < amend; ++am) {
             while ((ch = am->chunk_head) != NULL) {
                 mln_chunk_chain_del(&(am->chunk_head), &(am->chunk_tail), ch);
@@ -213,6 +248,7 @@ void mln_alloc_destroy(mln_alloc_t *pool)
             if (parent != NULL) mln_alloc_free(ch);
             else free(ch);
         }
+        if (pool->stats != NULL) free(pool->stats);
         if (parent != NULL) mln_alloc_free(pool);
         else free(pool);
     } else {
@@ -228,7 +264,7 @@ void mln_alloc_destroy(mln_alloc_t *pool)
         (void)parent->unlock(parent->locker);
 }
 
-void *mln_alloc_m(mln_alloc_t *pool, mln_size_t size)
+static inline void *mln_alloc_m_inner(mln_alloc_t *pool, mln_size_t size)
 {
     mln_alloc_blk_t *blk;
     mln_alloc_mgr_t *am;
@@ -239,6 +275,9 @@ void *mln_alloc_m(mln_alloc_t *pool, mln_size_t size)
     if (pool->mem != NULL) {
         return mln_alloc_shm_m(pool, size);
     }
+    if (mln_alloc_is_arena(pool)) {
+        return mln_alloc_arena_m(pool, size);
+    }
 
     am = mln_alloc_get_mgr_by_size(pool->mgr_tbl, size);
 
@@ -348,10 +387,18 @@ mln_alloc_get_mgr_by_size(mln_alloc_mgr_t *tbl, mln_size_t size)
     return &am[off+2];
 }
 
+void *mln_alloc_m(mln_alloc_t *pool, mln_size_t size)
+{
+    void *ptr = mln_alloc_m_inner(pool, size);
+    if (ptr != NULL && pool->stats != NULL) mln_alloc_stats_alloc(pool, ptr, M_ALLOC_CALLER);
+    return ptr;
+}
+
 void *mln_alloc_c(mln_alloc_t *pool, mln_size_t size)
 {
-    mln_u8ptr_t ptr = mln_alloc_m(pool, size);
+    mln_u8ptr_t ptr = mln_alloc_m_inner(pool, size);
     if (ptr == NULL) return NULL;
+    if (pool->stats != NULL) mln_alloc_stats_alloc(pool, ptr, M_ALLOC_CALLER);
     memset(ptr, 0, size);
     return ptr;
 }
@@ -362,14 +409,21 @@ void *mln_alloc_re(mln_alloc_t *pool, void *ptr, mln_size_t size)
         mln_alloc_free(ptr);
         return NULL;
     }
+    if (mln_alloc_is_arena(pool)) {
+        mln_u8ptr_t new_ptr = mln_alloc_arena_re(pool, ptr, size);
+        if (new_ptr != NULL && new_ptr != ptr && pool->stats != NULL)
+            mln_alloc_stats_alloc(pool, new_ptr, M_ALLOC_CALLER);
+        return new_ptr;
+    }
 
     mln_alloc_blk_t *old_blk = (mln_alloc_blk_t *)((mln_u8ptr_t)ptr - sizeof(mln_alloc_blk_t));
     if (old_blk->pool == pool && old_blk->blk_size >= size) {
         return ptr;
     }
 
-    mln_u8ptr_t new_ptr = mln_alloc_m(pool, size);
+    mln_u8ptr_t new_ptr = mln_alloc_m_inner(pool, size);
     if (new_ptr == NULL) return NULL;
+    if (pool->stats != NULL) mln_alloc_stats_alloc(pool, new_ptr, M_ALLOC_CALLER);
     memcpy(new_ptr, ptr, old_blk->blk_size);
     mln_alloc_free(ptr);
     
@@ -387,6 +441,16 @@ void mln_alloc_free(void *ptr)
     mln_alloc_mgr_t *am;
     mln_alloc_blk_t *blk;
 
+    /*
+     * The pool pointer is always the last field before the data,
+     * no matter it is an arena header or a block header.
+     */
+    pool = *(mln_alloc_t **)((mln_u8ptr_t)ptr - sizeof(mln_alloc_t *));
+    if (mln_alloc_is_arena(pool)) {
+        if (pool->stats != NULL) mln_alloc_stats_free(pool, ptr);
+        return;
+    }
+
     blk = (mln_alloc_blk_t *)((mln_u8ptr_t)ptr - sizeof(mln_alloc_blk_t));
 
     if (!blk->in_used) {
@@ -394,10 +458,10 @@ void mln_alloc_free(void *ptr)
         abort();
     }
 
-    pool = blk->pool;
     if (pool->mem) {
         return mln_alloc_free_shm(ptr);
     }
+    if (pool->stats != NULL) mln_alloc_stats_free(pool, ptr);
 
     if (blk->is_large) {
         mln_chunk_chain_del(&(pool->large_used_head), &(pool->large_used_tail), blk->chunk);
@@ -602,6 +666,517 @@ static inline void mln_alloc_free_shm(void *ptr)
     }
 }
 
+/*
+ * arena
+ */
+static inline mln_alloc_slab_t *mln_alloc_arena_slab_new(mln_alloc_t *pool, mln_size_t size)
+{
+    mln_alloc_slab_t *slab;
+
+    if (pool->parent != NULL) {
+        if (mln_alloc_is_shm(pool->parent)) {
+            if (pool->parent->lock(pool->parent->locker) != 0)
+                return NULL;
+        }
+        slab = (mln_alloc_slab_t *)mln_alloc_m(pool->parent, sizeof(mln_alloc_slab_t) + size);
+        if (mln_alloc_is_shm(pool->parent)) {
+            (void)pool->parent->unlock(pool->parent->locker);
+        }
+    } else {
+        slab = (mln_alloc_slab_t *)malloc(sizeof(mln_alloc_slab_t) + size);
+    }
+    if (slab == NULL) return NULL;
+    slab->next = NULL;
+    slab->size = size;
+    return slab;
+}
+
+static inline void mln_alloc_arena_slab_free(mln_alloc_t *pool, mln_alloc_slab_t *slab)
+{
+    if (pool->parent != NULL) {
+        if (mln_alloc_is_shm(pool->parent)) {
+            if (pool->parent->lock(pool->parent->locker) != 0)
+                return;
+        }
+        mln_alloc_free(slab);
+        if (mln_alloc_is_shm(pool->parent)) {
+            (void)pool->parent->unlock(pool->parent->locker);
+        }
+    } else {
+        free(slab);
+    }
+}
+
+static inline void *mln_alloc_arena_m(mln_alloc_t *pool, mln_size_t size)
+{
+    mln_alloc_slab_t *slab;
+    mln_alloc_arena_hdr_t *hdr;
+    mln_size_t n = (sizeof(mln_alloc_arena_hdr_t) + size + M_ALLOC_ARENA_ALIGN - 1) & ~((mln_size_t)M_ALLOC_ARENA_ALIGN - 1);
+
+    if ((mln_size_t)(pool->slab_end - pool->slab_pos) < n) {
+        if (n > (pool->slab_size >> 2)) {
+            /*
+             * Large memory owns a slab, the current slab is kept for the following small ones.
+             */
+            if ((slab = mln_alloc_arena_slab_new(pool, n)) == NULL) return NULL;
+            if (pool->slab_head == NULL) {
+                pool->slab_head = slab;
+            } else {
+                slab->next = pool->slab_head->next;
+                pool->slab_head->next = slab;
+            }
+            hdr = (mln_alloc_arena_hdr_t *)(slab + 1);
+            hdr->size = n - sizeof(mln_alloc_arena_hdr_t);
+            hdr->pool = pool;
+            return hdr + 1;
+        }
+        if ((slab = mln_alloc_arena_slab_new(pool, pool->slab_size)) == NULL) return NULL;
+        slab->next = pool->slab_head;
+        pool->slab_head = slab;
+        pool->slab_pos = (mln_u8ptr_t)(slab + 1);
+        pool->slab_end = pool->slab_pos + slab->size;
+    }
+
+    hdr = (mln_alloc_arena_hdr_t *)(pool->slab_pos);
+    pool->slab_pos += n;
+    hdr->size = n - sizeof(mln_alloc_arena_hdr_t);
+    hdr->pool = pool;
+    return hdr + 1;
+}
+
+static inline void *mln_alloc_arena_re(mln_alloc_t *pool, void *ptr, mln_size_t size)
+{
+    mln_u8ptr_t new_ptr;
+    mln_alloc_arena_hdr_t *hdr;
+    mln_size_t n;
+
+    if (ptr == NULL) return mln_alloc_arena_m(pool, size);
+
+    hdr = (mln_alloc_arena_hdr_t *)ptr - 1;
+    if (hdr->size >= size) return ptr;
+
+    /*
+     * The last memory in the current slab can grow in place.
+     */
+    n = (size - hdr->size + M_ALLOC_ARENA_ALIGN - 1) & ~((mln_size_t)M_ALLOC_ARENA_ALIGN - 1);
+    if ((mln_u8ptr_t)ptr + hdr->size == pool->slab_pos && \
+        (mln_size_t)(pool->slab_end - pool->slab_pos) >= n)
+    {
+        pool->slab_pos += n;
+        hdr->size += n;
+        return ptr;
+    }
+
+    if ((new_ptr = (mln_u8ptr_t)mln_alloc_arena_m(pool, size)) == NULL) return NULL;
+    memcpy(new_ptr, ptr, hdr->size);
+    return new_ptr;
+}
+
+void mln_alloc_arena_reset(mln_alloc_t *pool)
+{
+    mln_alloc_slab_t *slab, *keep = NULL;
+
+    if (pool == NULL || !mln_alloc_is_arena(pool)) return;
+
+    /*
+     * Keep one regular slab to serve the next round without asking parent again.
+     */
+    while ((slab = pool->slab_head) != NULL) {
+        pool->slab_head = slab->next;
+        if (keep == NULL && slab->size == pool->slab_size) {
+            keep = slab;
+            continue;
+        }
+        mln_alloc_arena_slab_free(pool, slab);
+    }
+    if (keep != NULL) {
+        keep->next = NULL;
+        pool->slab_head = keep;
+        pool->slab_pos = (mln_u8ptr_t)(keep + 1);
+        pool->slab_end = pool->slab_pos + keep->size;
+    } else {
+        pool->slab_pos = pool->slab_end = NULL;
+    }
+    if (pool->stats != NULL) pool->stats->in_use = 0;
+}
+
+/*
+ * statistics
+ */
+static inline mln_alloc_stats_cnt_t *
+mln_alloc_stats_cnt_get(mln_alloc_t *pool, void *ptr, mln_size_t *size)
+{
+    mln_alloc_mgr_t *am;
+    mln_alloc_blk_t *blk;
+
+    if (mln_alloc_is_arena(pool)) {
+        *size = ((mln_alloc_arena_hdr_t *)ptr - 1)->size;
+        am = mln_alloc_get_mgr_by_size(pool->mgr_tbl, *size);
+    } else {
+        blk = (mln_alloc_blk_t *)((mln_u8ptr_t)ptr - sizeof(mln_alloc_blk_t));
+        *size = blk->blk_size;
+        am = blk->is_large? NULL: blk->chunk->mgr;
+    }
+    return am == NULL? &(pool->stats->large): &(pool->stats->cls[am - pool->mgr_tbl]);
+}
+
+static inline void mln_alloc_stats_alloc(mln_alloc_t *pool, void *ptr, void *site)
+{
+    mln_size_t size, i, n;
+    mln_alloc_stats_t *st = pool->stats;
+    mln_alloc_stats_site_t *ss;
+
+    ++(mln_alloc_stats_cnt_get(pool, ptr, &size)->nalloc);
+    if ((st->in_use += size) > st->peak) st->peak = st->in_use;
+
+    if (!st->sample || ++(st->tick) < st->sample) return;
+    st->tick = 0;
+
+    /*
+     * Sampled sites are kept in a small open addressing table,
+     * new sites are dropped once the table is full.
+     */
+    i = ((mln_uptr_t)site >> 4) % M_ALLOC_STATS_SITE_NUM;
+    for (n = 0; n < M_ALLOC_STATS_SITE_NUM; ++n) {
+        ss = &(st->sites[i]);
+        if (ss->site == site || ss->site == NULL) {
+            ss->site = site;
+            ++(ss->count);
+            ss->bytes += size;
+            return;
+        }
+        if (++i >= M_ALLOC_STATS_SITE_NUM) i = 0;
+    }
+}
+
+static inline void mln_alloc_stats_free(mln_alloc_t *pool, void *ptr)
+{
+    mln_size_t size;
+    mln_alloc_stats_t *st = pool->stats;
+
+    ++(mln_alloc_stats_cnt_get(pool, ptr, &size)->nfree);
+    /*
+     * Memory of arena pool is only given back on reset.
+     */
+    if (mln_alloc_is_arena(pool)) return;
+    st->in_use = st->in_use > size? st->in_use - size: 0;
+}
+
+int mln_alloc_stats_enable(mln_alloc_t *pool, mln_u32_t sample)
+{
+    mln_alloc_snapshot_t snap;
+
+    if (pool == NULL || mln_alloc_is_shm(pool)) return -1;
+
+    if (pool->stats == NULL) {
+        if ((pool->stats = (mln_alloc_stats_t *)malloc(sizeof(mln_alloc_stats_t))) == NULL)
+            return -1;
+    }
+    mln_alloc_stats_snapshot(pool, &snap);
+    memset(pool->stats, 0, sizeof(mln_alloc_stats_t));
+    pool->stats->sample = sample;
+    pool->stats->in_use = pool->stats->peak = snap.in_use;
+    return 0;
+}
+
+void mln_alloc_stats_disable(mln_alloc_t *pool)
+{
+    if (pool == NULL || pool->stats == NULL) return;
+    free(pool->stats);
+    pool->stats = NULL;
+}
+
+void mln_alloc_stats_snapshot(mln_alloc_t *pool, mln_alloc_snapshot_t *snap)
+{
+    int i;
+    mln_size_t stride;
+    mln_alloc_mgr_t *am;
+    mln_alloc_blk_t *blk;
+    mln_alloc_chunk_t *ch;
+    mln_alloc_slab_t *slab;
+    mln_alloc_shm_t *as;
+    mln_alloc_class_info_t *ci;
+
+    memset(snap, 0, sizeof(mln_alloc_snapshot_t));
+
+    if (mln_alloc_is_shm(pool)) {
+        for (as = pool->shm_head; as != NULL; as = as->next) {
+            ++(snap->shm_num);
+            snap->reserved += as->size;
+            if (as->large) {
+                snap->in_use += as->size;
+                continue;
+            }
+            snap->shm_bits_total += as->base;
+            snap->shm_bits_used += as->base - as->nfree;
+            snap->in_use += (as->base - as->nfree) * M_ALLOC_SHM_BIT_SIZE;
+        }
+        return;
+    }
+
+    for (slab = pool->slab_head; slab != NULL; slab = slab->next) {
+        ++(snap->slab_num);
+        snap->reserved += sizeof(mln_alloc_slab_t) + slab->size;
+        snap->in_use += slab->size;
+    }
+    snap->in_use -= (mln_size_t)(pool->slab_end - pool->slab_pos);
+
+    for (i = 0; i < M_ALLOC_MGR_LEN; ++i) {
+        am = &(pool->mgr_tbl[i]);
+        ci = &(snap->classes[i]);
+        ci->blk_size = am->blk_size;
+        for (blk = am->used_head; blk != NULL; blk = blk->next) ++(ci->nused);
+        for (blk = am->free_head; blk != NULL; blk = blk->next) ++(ci->nidle);
+        for (ch = am->chunk_head; ch != NULL; ch = ch->next) ++(ci->nchunk);
+        stride = ((sizeof(mln_alloc_blk_t) + am->blk_size + 3) >> 2) << 2;
+        snap->reserved += ci->nchunk * (((sizeof(mln_alloc_chunk_t) + M_ALLOC_BLK_NUM * stride + 3) >> 2) << 2);
+        snap->in_use += ci->nused * am->blk_size;
+    }
+
+    for (ch = pool->large_used_head; ch != NULL; ch = ch->next) {
+        ++(snap->large_num);
+        snap->large_bytes += ch->blks[0]->blk_size;
+        snap->reserved += sizeof(mln_alloc_chunk_t) + sizeof(mln_alloc_blk_t) + ch->blks[0]->blk_size;
+    }
+    snap->in_use += snap->large_bytes;
+
+    if (pool->stats != NULL) {
+        snap->peak = pool->stats->peak;
+        snap->large_nalloc = pool->stats->large.nalloc;
+        snap->large_nfree = pool->stats->large.nfree;
+        for (i = 0; i < M_ALLOC_MGR_LEN; ++i) {
+            snap->classes[i].nalloc = pool->stats->cls[i].nalloc;
+            snap->classes[i].nfree = pool->stats->cls[i].nfree;
+        }
+        memcpy(snap->sites, pool->stats->sites, sizeof(snap->sites));
+    }
+}
+
+void mln_alloc_stats_dump(mln_alloc_t *pool)
+{
+    int i;
+    mln_alloc_snapshot_t snap;
+    mln_alloc_class_info_t *ci;
+
+    printf("Alloc Dump:\n");
+    if (pool == NULL) return;
+
+    mln_alloc_stats_snapshot(pool, &snap);
+    printf("\tin use:%lu reserved:%lu peak:%lu\n", \
+           (unsigned long)snap.in_use, (unsigned long)snap.reserved, (unsigned long)snap.peak);
+    if (mln_alloc_is_shm(pool)) {
+        printf("\tshm blocks:%lu bitmap used:%lu/%lu\n", \
+               (unsigned long)snap.shm_num, (unsigned long)snap.shm_bits_used, (unsigned long)snap.shm_bits_total);
+        return;
+    }
+    if (mln_alloc_is_arena(pool)) {
+        printf("\tslabs:%lu\n", (unsigned long)snap.slab_num);
+    }
+    for (i = 0; i < M_ALLOC_MGR_LEN; ++i) {
+        ci = &(snap.classes[i]);
+        if (!ci->nalloc && !ci->nchunk) continue;
+        printf("\tclass:%d size:%lu alloc:%lu free:%lu used:%lu idle:%lu chunks:%lu\n", \
+               i, (unsigned long)ci->blk_size, (unsigned long)ci->nalloc, (unsigned long)ci->nfree, \
+               (unsigned long)ci->nused, (unsigned long)ci->nidle, (unsigned long)ci->nchunk);
+    }
+    printf("\tlarge alloc:%lu free:%lu used:%lu bytes:%lu\n", \
+           (unsigned long)snap.large_nalloc, (unsigned long)snap.large_nfree, \
+           (unsigned long)snap.large_num, (unsigned long)snap.large_bytes);
+    for (i = 0; i < M_ALLOC_STATS_SITE_NUM; ++i) {
+        if (snap.sites[i].site == NULL) continue;
+        printf("\tsite:%p samples:%lu bytes:%lu\n", \
+               snap.sites[i].site, (unsigned long)snap.sites[i].count, (unsigned long)snap.sites[i].bytes);
+    }
+}
+
+/*
+ * thread cache
+ */
+static inline void mln_alloc_tcache_local_flush(mln_alloc_tcache_local_t *local)
+{
+    /*
+     * @ tc->lock must be locked by caller.
+     */
+    mln_alloc_mag_t *mag, *end = local->mags + M_ALLOC_MGR_LEN;
+
+    for (mag = local->mags; mag < end; ++mag) {
+        while (mag->nr > 0) {
+            mln_alloc_free(mag->blks[--(mag->nr)]);
+        }
+    }
+}
+
+static void mln_alloc_tcache_local_free(void *arg)
+{
+    mln_alloc_tcache_local_t *local = (mln_alloc_tcache_local_t *)arg;
+    mln_alloc_tcache_t *tc = local->tc;
+
+    pthread_mutex_lock(&(tc->lock));
+    mln_alloc_tcache_local_flush(local);
+    mln_alloc_tcache_local_chain_del(&(tc->local_head), &(tc->local_tail), local);
+    pthread_mutex_unlock(&(tc->lock));
+    free(local);
+}
+
+static inline mln_alloc_tcache_local_t *mln_alloc_tcache_local_get(mln_alloc_tcache_t *tc)
+{
+    mln_alloc_tcache_local_t *local;
+
+    if ((local = (mln_alloc_tcache_local_t *)pthread_getspecific(tc->key)) != NULL)
+        return local;
+
+    if ((local = (mln_alloc_tcache_local_t *)calloc(1, sizeof(mln_alloc_tcache_local_t))) == NULL)
+        return NULL;
+    local->tc = tc;
+    if (pthread_setspecific(tc->key, local) != 0) {
+        free(local);
+        return NULL;
+    }
+    pthread_mutex_lock(&(tc->lock));
+    mln_alloc_tcache_local_chain_add(&(tc->local_head), &(tc->local_tail), local);
+    pthread_mutex_unlock(&(tc->lock));
+    return local;
+}
+
+mln_alloc_tcache_t *mln_alloc_tcache_init(mln_alloc_t *pool)
+{
+    mln_alloc_tcache_t *tc;
+
+    if (pool == NULL || mln_alloc_is_shm(pool) || mln_alloc_is_arena(pool)) return NULL;
+
+    if ((tc = (mln_alloc_tcache_t *)malloc(sizeof(mln_alloc_tcache_t))) == NULL)
+        return NULL;
+    tc->pool = pool;
+    tc->local_head = tc->local_tail = NULL;
+    if (pthread_mutex_init(&(tc->lock), NULL) != 0) {
+        free(tc);
+        return NULL;
+    }
+    if (pthread_key_create(&(tc->key), mln_alloc_tcache_local_free) != 0) {
+        pthread_mutex_destroy(&(tc->lock));
+        free(tc);
+        return NULL;
+    }
+    return tc;
+}
+
+void mln_alloc_tcache_destroy(mln_alloc_tcache_t *tc)
+{
+    mln_alloc_tcache_local_t *local;
+
+    if (tc == NULL) return;
+
+    /*
+     * After pthread_key_delete, no destructor will be called on thread exit,
+     * so all magazines which are still alive are released here.
+     */
+    pthread_key_delete(tc->key);
+    pthread_mutex_lock(&(tc->lock));
+    while ((local = tc->local_head) != NULL) {
+        mln_alloc_tcache_local_flush(local);
+        mln_alloc_tcache_local_chain_del(&(tc->local_head), &(tc->local_tail), local);
+        free(local);
+    }
+    pthread_mutex_unlock(&(tc->lock));
+    pthread_mutex_destroy(&(tc->lock));
+    free(tc);
+}
+
+void *mln_alloc_tcache_m(mln_alloc_tcache_t *tc, mln_size_t size)
+{
+    void *ptr;
+    mln_alloc_mgr_t *am;
+    mln_alloc_mag_t *mag;
+    mln_alloc_tcache_local_t *local;
+
+    am = mln_alloc_get_mgr_by_size(tc->pool->mgr_tbl, size);
+    if (am == NULL || am->blk_size > M_ALLOC_TCACHE_MAX_SIZE || \
+        (local = mln_alloc_tcache_local_get(tc)) == NULL)
+    {
+        pthread_mutex_lock(&(tc->lock));
+        ptr = mln_alloc_m(tc->pool, size);
+        pthread_mutex_unlock(&(tc->lock));
+        return ptr;
+    }
+
+    mag = &(local->mags[am - tc->pool->mgr_tbl]);
+    if (mag->nr == 0) {
+        pthread_mutex_lock(&(tc->lock));
+        while (mag->nr < M_ALLOC_TCACHE_BATCH) {
+            if ((ptr = mln_alloc_m(tc->pool, am->blk_size)) == NULL) break;
+            mag->blks[(mag->nr)++] = ptr;
+        }
+        pthread_mutex_unlock(&(tc->lock));
+        if (mag->nr == 0) return NULL;
+    }
+    return mag->blks[--(mag->nr)];
+}
+
+void *mln_alloc_tcache_c(mln_alloc_tcache_t *tc, mln_size_t size)
+{
+    mln_u8ptr_t ptr = mln_alloc_tcache_m(tc, size);
+    if (ptr == NULL) return NULL;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void *mln_alloc_tcache_re(mln_alloc_tcache_t *tc, void *ptr, mln_size_t size)
+{
+    if (size == 0) {
+        mln_alloc_tcache_free(tc, ptr);
+        return NULL;
+    }
+    if (ptr == NULL) return mln_alloc_tcache_m(tc, size);
+
+    mln_alloc_blk_t *old_blk = (mln_alloc_blk_t *)((mln_u8ptr_t)ptr - sizeof(mln_alloc_blk_t));
+    if (old_blk->blk_size >= size) {
+        return ptr;
+    }
+
+    mln_u8ptr_t new_ptr = mln_alloc_tcache_m(tc, size);
+    if (new_ptr == NULL) return NULL;
+    memcpy(new_ptr, ptr, old_blk->blk_size);
+    mln_alloc_tcache_free(tc, ptr);
+
+    return new_ptr;
+}
+
+void mln_alloc_tcache_free(mln_alloc_tcache_t *tc, void *ptr)
+{
+    mln_alloc_blk_t *blk;
+    mln_alloc_mag_t *mag;
+    mln_alloc_mgr_t *am;
+    mln_alloc_tcache_local_t *local;
+    mln_u32_t i;
+
+    if (ptr == NULL) return;
+
+    blk = (mln_alloc_blk_t *)((mln_u8ptr_t)ptr - sizeof(mln_alloc_blk_t));
+    if (blk->is_large || (am = blk->chunk->mgr)->blk_size > M_ALLOC_TCACHE_MAX_SIZE || \
+        (local = mln_alloc_tcache_local_get(tc)) == NULL)
+    {
+        pthread_mutex_lock(&(tc->lock));
+        mln_alloc_free(ptr);
+        pthread_mutex_unlock(&(tc->lock));
+        return;
+    }
+
+    mag = &(local->mags[am - tc->pool->mgr_tbl]);
+    if (mag->nr >= M_ALLOC_TCACHE_MAG_SIZE) {
+        /*
+         * Give the coldest blocks (at the bottom of magazine) back to pool.
+         */
+        pthread_mutex_lock(&(tc->lock));
+        for (i = 0; i < M_ALLOC_TCACHE_BATCH; ++i) {
+            mln_alloc_free(mag->blks[i]);
+        }
+        pthread_mutex_unlock(&(tc->lock));
+        mag->nr -= M_ALLOC_TCACHE_BATCH;
+        memmove(mag->blks, mag->blks + M_ALLOC_TCACHE_BATCH, mag->nr * sizeof(void *));
+    }
+    mag->blks[(mag->nr)++] = ptr;
+}
+
 /*
  * chain
  */
@@ -621,3 +1196,8 @@ MLN_CHAIN_FUNC_DEFINE(mln_alloc_shm, \
                       prev, \
                       next);
 
+MLN_CHAIN_FUNC_DEFINE(mln_alloc_tcache_local, \
+                      mln_alloc_tcache_local_t, \
+                      static inline void, \
+                      prev, \
+                      next);
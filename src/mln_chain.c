@@ -8,11 +8,14 @@
 mln_buf_t *mln_buf_new(mln_alloc_t *pool)
 {
     mln_buf_t *b = mln_alloc_m(pool, sizeof(mln_buf_t));
+    if (b == NULL) return NULL;
     b->left_pos = b->pos = b->last = NULL;
     b->start = b->end = NULL;
     b->shadow = NULL;
     b->file_left_pos = b->file_pos = b->file_last = 0;
     b->file = NULL;
+    b->origin = NULL;
+    b->refs = 0;
     b->temporary = b->in_memory = b->in_file = 0;
 #if !defined(WIN32)
     b->mmap = 0;
@@ -24,6 +27,7 @@ mln_buf_t *mln_buf_new(mln_alloc_t *pool)
 mln_chain_t *mln_chain_new(mln_alloc_t *pool)
 {
     mln_chain_t *c = mln_alloc_m(pool, sizeof(mln_chain_t));
+    if (c == NULL) return NULL;
     c->buf = NULL;
     c->next = NULL;
     return c;
@@ -33,6 +37,19 @@ void mln_buf_pool_release(mln_buf_t *b)
 {
     if (b == NULL) return;
 
+    if (b->origin != NULL) {
+        mln_buf_t *origin = b->origin;
+        mln_alloc_free(b);
+        mln_buf_pool_release(origin);
+        return;
+    }
+
+    if (b->refs) {
+        /*the data is still referred by some slices, the last one will release it*/
+        --(b->refs);
+        return;
+    }
+
     if (b->shadow != NULL || b->temporary) {
         mln_alloc_free(b);
         return;
@@ -90,3 +107,154 @@ void mln_chain_pool_release_all(mln_chain_t *c)
     }
 }
 
+/*
+ * slice, split and splice
+ */
+mln_buf_t *mln_buf_slice(mln_alloc_t *pool, mln_buf_t *b, mln_size_t off, mln_size_t len)
+{
+    mln_buf_t *s, *origin;
+    mln_size_t size;
+
+    if (b == NULL) return NULL;
+    size = mln_buf_left_size(b);
+    if (off > size || len > size - off) return NULL;
+
+    if ((s = mln_buf_new(pool)) == NULL) return NULL;
+
+    if (b->in_file) {
+        s->file = b->file;
+        s->file_left_pos = s->file_pos = b->file_left_pos + off;
+        s->file_last = s->file_pos + len;
+        s->in_file = 1;
+    } else {
+        s->left_pos = s->pos = b->left_pos + off;
+        s->last = s->pos + len;
+        s->in_memory = b->in_memory;
+    }
+    s->last_buf = 1;
+
+    /*
+     * The buf at the end of the shadow list is the one that really frees the data.
+     */
+    origin = b->origin != NULL? b->origin: b;
+    while (origin->shadow != NULL) origin = origin->shadow;
+    s->origin = origin;
+    ++(origin->refs);
+
+    return s;
+}
+
+mln_chain_t *mln_chain_slice(mln_alloc_t *pool, mln_chain_t *c, mln_size_t off, mln_size_t len)
+{
+    mln_chain_t *head = NULL, *tail = NULL, *n;
+    mln_size_t size, l;
+    mln_buf_t *b;
+
+    for (; c != NULL && len; c = c->next) {
+        size = mln_buf_left_size(c->buf);
+        if (off >= size) {
+            off -= size;
+            continue;
+        }
+        l = size - off > len? len: size - off;
+        if ((n = mln_chain_new(pool)) == NULL) goto err;
+        if ((b = mln_buf_slice(pool, c->buf, off, l)) == NULL) {
+            mln_chain_pool_release(n);
+            goto err;
+        }
+        n->buf = b;
+        mln_chain_add(&head, &tail, n);
+        off = 0;
+        len -= l;
+    }
+    if (len) goto err;/*out of range*/
+
+    return head;
+
+err:
+    mln_chain_pool_release_all(head);
+    return NULL;
+}
+
+/*
+ * Keep the first 'size' bytes in c and put the rest into 'rest'. If the boundary is
+ * in the middle of a buf, the buf is replaced by two slices of it.
+ * Return 0 on success, -1 if no memory.
+ */
+int mln_chain_split(mln_alloc_t *pool, mln_chain_t *c, mln_size_t size, mln_chain_t **rest)
+{
+    mln_size_t l;
+    mln_buf_t *b1, *b2;
+    mln_chain_t *n;
+
+    for (; c != NULL; c = c->next) {
+        l = mln_buf_left_size(c->buf);
+        if (size < l) break;
+        size -= l;
+        if (!size) {
+            *rest = c->next;
+            c->next = NULL;
+            return 0;
+        }
+    }
+    if (c == NULL) {
+        *rest = NULL;
+        return 0;
+    }
+    if (!size) {/*only if the first buf is split at 0*/
+        if ((n = mln_chain_new(pool)) == NULL) return -1;
+        n->buf = c->buf;
+        n->next = c->next;
+        c->buf = NULL;
+        c->next = NULL;
+        *rest = n;
+        return 0;
+    }
+
+    if ((n = mln_chain_new(pool)) == NULL) return -1;
+    if ((b1 = mln_buf_slice(pool, c->buf, 0, size)) == NULL) {
+        mln_chain_pool_release(n);
+        return -1;
+    }
+    if ((b2 = mln_buf_slice(pool, c->buf, size, l - size)) == NULL) {
+        mln_buf_pool_release(b1);
+        mln_chain_pool_release(n);
+        return -1;
+    }
+    b1->last_in_chain = 0;
+    b2->last_in_chain = c->buf->last_in_chain;
+    mln_buf_pool_release(c->buf);
+    c->buf = b1;
+    n->buf = b2;
+    n->next = c->next;
+    c->next = NULL;
+    *rest = n;
+    return 0;
+}
+
+mln_chain_t *mln_chain_concat(mln_chain_t *c1, mln_chain_t *c2)
+{
+    mln_chain_t *c;
+
+    if (c1 == NULL) return c2;
+    for (c = c1; c->next != NULL; c = c->next)
+        ;
+    c->next = c2;
+    return c1;
+}
+
+/*
+ * Insert chain 'in' into *c at byte offset 'off'. Return 0 on success, -1 if no memory.
+ */
+int mln_chain_splice(mln_alloc_t *pool, mln_chain_t **c, mln_size_t off, mln_chain_t *in)
+{
+    mln_chain_t *rest;
+
+    if (!off || *c == NULL) {
+        *c = mln_chain_concat(in, *c);
+        return 0;
+    }
+    if (mln_chain_split(pool, *c, off, &rest) < 0) return -1;
+    mln_chain_concat(*c, mln_chain_concat(in, rest));
+    return 0;
+}
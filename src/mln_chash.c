@@ -0,0 +1,274 @@
+
+/*
+ * Copyright (C) Niklaus F.Schen.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "mln_chash.h"
+
+/*
+ * The map is split into nr_shards open addressing tables, each one behind
+ * its own reader-writer lock. The shard of a key is picked by the user's
+ * hash callback, which is called with the first shard's table. Open addressing
+ * tables never change h->len, so this needs no lock. The multiplier spreads
+ * the hash into bits that the tables themselves do not use for probing.
+ */
+#define mln_chash_index(m,key) \
+    ((mln_u32_t)((((m)->shards[0].tbl->hash((m)->shards[0].tbl, (key))) * 0x9e3779b97f4a7c15ULL) >> 40) & (m)->mask)
+
+mln_chash_t *mln_chash_new(struct mln_chash_attr *attr)
+{
+    mln_chash_t *m;
+    mln_chash_shard_t *s;
+    struct mln_hash_attr hattr;
+    mln_u32_t n = 1, i;
+
+    if (attr->hash == NULL || attr->cmp == NULL) return NULL;
+    while (n < (attr->nr_shards? attr->nr_shards: M_CHASH_DFL_SHARDS) && n < M_CHASH_MAX_SHARDS)
+        n <<= 1;
+
+    if ((m = (mln_chash_t *)malloc(sizeof(mln_chash_t))) == NULL) return NULL;
+    if ((m->mem = malloc(n * sizeof(mln_chash_shard_t) + 64)) == NULL) {
+        free(m);
+        return NULL;
+    }
+    m->shards = (mln_chash_shard_t *)(((mln_uptr_t)(m->mem) + 63) & ~((mln_uptr_t)63));
+    m->nr_shards = n;
+    m->mask = n - 1;
+
+    hattr.pool = NULL;
+    hattr.pool_alloc = NULL;
+    hattr.pool_free = NULL;
+    hattr.hash = attr->hash;
+    hattr.cmp = attr->cmp;
+    hattr.free_key = attr->free_key;
+    hattr.free_val = attr->free_val;
+    hattr.len_base = (attr->len_base + n - 1) / n;
+    hattr.expandable = 1;
+    hattr.calc_prime = 0;
+    hattr.incremental = 0;
+    for (i = 0; i < n; ++i) {
+        s = &(m->shards[i]);
+        if ((s->tbl = mln_hash_open_new(&hattr)) == NULL) goto err;
+        if (pthread_rwlock_init(&(s->lock), NULL) != 0) {
+            mln_hash_free(s->tbl, M_HASH_F_NONE);
+            goto err;
+        }
+    }
+    return m;
+
+err:
+    while (i-- > 0) {
+        s = &(m->shards[i]);
+        pthread_rwlock_destroy(&(s->lock));
+        mln_hash_free(s->tbl, M_HASH_F_NONE);
+    }
+    free(m->mem);
+    free(m);
+    return NULL;
+}
+
+void mln_chash_free(mln_chash_t *m, mln_hash_flag_t flg)
+{
+    mln_chash_shard_t *s, *end = m->shards + m->nr_shards;
+
+    for (s = m->shards; s < end; ++s) {
+        pthread_rwlock_destroy(&(s->lock));
+        mln_hash_free(s->tbl, flg);
+    }
+    free(m->mem);
+    free(m);
+}
+
+/*
+ * The returned value may be removed and freed by another thread at any time
+ * after the shard is unlocked. Use mln_chash_search_apply() unless values
+ * live longer than the map entries.
+ */
+void *mln_chash_search(mln_chash_t *m, void *key)
+{
+    void *val;
+    mln_chash_shard_t *s = &(m->shards[mln_chash_index(m, key)]);
+
+    pthread_rwlock_rdlock(&(s->lock));
+    val = mln_hash_search(s->tbl, key);
+    pthread_rwlock_unlock(&(s->lock));
+    return val;
+}
+
+/*
+ * Call handler on the value of key while the shard is read-locked.
+ * Return 1 if key was found, otherwise 0.
+ */
+int mln_chash_search_apply(mln_chash_t *m, void *key, hash_iterate_handler handler, void *udata)
+{
+    void *val;
+    mln_chash_shard_t *s = &(m->shards[mln_chash_index(m, key)]);
+
+    pthread_rwlock_rdlock(&(s->lock));
+    if ((val = mln_hash_search(s->tbl, key)) != NULL) {
+        (void)handler(key, val, udata);
+    }
+    pthread_rwlock_unlock(&(s->lock));
+    return val != NULL;
+}
+
+int mln_chash_insert(mln_chash_t *m, void *key, void *val)
+{
+    int rc;
+    mln_chash_shard_t *s = &(m->shards[mln_chash_index(m, key)]);
+
+    pthread_rwlock_wrlock(&(s->lock));
+    rc = mln_hash_insert(s->tbl, key, val);
+    pthread_rwlock_unlock(&(s->lock));
+    return rc;
+}
+
+int mln_chash_replace(mln_chash_t *m, void *key, void *val)
+{
+    int rc;
+    mln_chash_shard_t *s = &(m->shards[mln_chash_index(m, *((void **)key))]);
+
+    pthread_rwlock_wrlock(&(s->lock));
+    rc = mln_hash_replace(s->tbl, key, val);
+    pthread_rwlock_unlock(&(s->lock));
+    return rc;
+}
+
+void mln_chash_remove(mln_chash_t *m, void *key, mln_hash_flag_t flg)
+{
+    mln_chash_shard_t *s = &(m->shards[mln_chash_index(m, key)]);
+
+    pthread_rwlock_wrlock(&(s->lock));
+    mln_hash_remove(s->tbl, key, flg);
+    pthread_rwlock_unlock(&(s->lock));
+}
+
+/*
+ * Shards are visited one by one under their read lock,
+ * so the handler must not modify the map.
+ */
+int mln_chash_iterate(mln_chash_t *m, hash_iterate_handler handler, void *udata)
+{
+    int rc = 0;
+    mln_chash_shard_t *s, *end = m->shards + m->nr_shards;
+
+    for (s = m->shards; rc == 0 && s < end; ++s) {
+        pthread_rwlock_rdlock(&(s->lock));
+        rc = mln_hash_iterate(s->tbl, handler, udata);
+        pthread_rwlock_unlock(&(s->lock));
+    }
+    return rc;
+}
+
+mln_u64_t mln_chash_count(mln_chash_t *m)
+{
+    mln_u64_t n = 0;
+    mln_chash_shard_t *s, *end = m->shards + m->nr_shards;
+
+    for (s = m->shards; s < end; ++s) {
+        pthread_rwlock_rdlock(&(s->lock));
+        n += s->tbl->nr_nodes;
+        pthread_rwlock_unlock(&(s->lock));
+    }
+    return n;
+}
+
+/*
+ * bulk operations
+ *
+ * Keys are handled in batches of M_CHASH_BULK_BATCH. Each batch is
+ * counting-sorted by shard, so every shard is locked once per batch
+ * instead of once per key. bounds[i] to bounds[i+1] is the range of
+ * order[] that belongs to shard i.
+ */
+static inline void
+mln_chash_bulk_sort(mln_chash_t *m, void **keys, mln_size_t n, mln_u16_t *order, mln_u16_t *bounds)
+{
+    mln_u8_t ids[M_CHASH_BULK_BATCH];
+    mln_u16_t pos[M_CHASH_MAX_SHARDS];
+    mln_size_t i;
+
+    memset(bounds, 0, (m->nr_shards + 1) * sizeof(mln_u16_t));
+    for (i = 0; i < n; ++i) {
+        ids[i] = (mln_u8_t)mln_chash_index(m, keys[i]);
+        ++bounds[ids[i] + 1];
+    }
+    for (i = 0; i < m->nr_shards; ++i) {
+        bounds[i + 1] += bounds[i];
+        pos[i] = bounds[i];
+    }
+    for (i = 0; i < n; ++i) {
+        order[pos[ids[i]]++] = (mln_u16_t)i;
+    }
+}
+
+void mln_chash_search_bulk(mln_chash_t *m, void **keys, void **vals, mln_size_t n)
+{
+    mln_u16_t order[M_CHASH_BULK_BATCH], bounds[M_CHASH_MAX_SHARDS + 1];
+    mln_size_t batch, i, j;
+    mln_chash_shard_t *s;
+
+    for (; n > 0; keys += batch, vals += batch, n -= batch) {
+        batch = n > M_CHASH_BULK_BATCH? M_CHASH_BULK_BATCH: n;
+        mln_chash_bulk_sort(m, keys, batch, order, bounds);
+        for (i = 0; i < m->nr_shards; ++i) {
+            if (bounds[i] == bounds[i + 1]) continue;
+            s = &(m->shards[i]);
+            pthread_rwlock_rdlock(&(s->lock));
+            for (j = bounds[i]; j < bounds[i + 1]; ++j) {
+                vals[order[j]] = mln_hash_search(s->tbl, keys[order[j]]);
+            }
+            pthread_rwlock_unlock(&(s->lock));
+        }
+    }
+}
+
+/*
+ * Return the number of entries inserted,
+ * it is less than n only if memory allocation failed.
+ */
+mln_size_t mln_chash_insert_bulk(mln_chash_t *m, void **keys, void **vals, mln_size_t n)
+{
+    mln_u16_t order[M_CHASH_BULK_BATCH], bounds[M_CHASH_MAX_SHARDS + 1];
+    mln_size_t batch, i, j, cnt = 0;
+    mln_chash_shard_t *s;
+
+    for (; n > 0; keys += batch, vals += batch, n -= batch) {
+        batch = n > M_CHASH_BULK_BATCH? M_CHASH_BULK_BATCH: n;
+        mln_chash_bulk_sort(m, keys, batch, order, bounds);
+        for (i = 0; i < m->nr_shards; ++i) {
+            if (bounds[i] == bounds[i + 1]) continue;
+            s = &(m->shards[i]);
+            pthread_rwlock_wrlock(&(s->lock));
+            for (j = bounds[i]; j < bounds[i + 1]; ++j) {
+                if (mln_hash_insert(s->tbl, keys[order[j]], vals[order[j]]) == 0) ++cnt;
+            }
+            pthread_rwlock_unlock(&(s->lock));
+        }
+    }
+    return cnt;
+}
+
+void mln_chash_remove_bulk(mln_chash_t *m, void **keys, mln_size_t n, mln_hash_flag_t flg)
+{
+    mln_u16_t order[M_CHASH_BULK_BATCH], bounds[M_CHASH_MAX_SHARDS + 1];
+    mln_size_t batch, i, j;
+    mln_chash_shard_t *s;
+
+    for (; n > 0; keys += batch, n -= batch) {
+        batch = n > M_CHASH_BULK_BATCH? M_CHASH_BULK_BATCH: n;
+        mln_chash_bulk_sort(m, keys, batch, order, bounds);
+        for (i = 0; i < m->nr_shards; ++i) {
+            if (bounds[i] == bounds[i + 1]) continue;
+            s = &(m->shards[i]);
+            pthread_rwlock_wrlock(&(s->lock));
+            for (j = bounds[i]; j < bounds[i + 1]; ++j) {
+                mln_hash_remove(s->tbl, keys[order[j]], flg);
+            }
+            pthread_rwlock_unlock(&(s->lock));
+        }
+    }
+}
+
@@ -283,18 +283,15 @@ static mln_conf_lex_struct_t *mln_conf_token(mln_lex_t *lex)
         }
         if (clst->type == CONF_TK_DEC || clst->type == CONF_TK_REAL) {
             if (!sub_mark) break;
-            mln_u64_t len = clst->text->len + 2;
-            mln_u8ptr_t s = (mln_u8ptr_t)mln_alloc_m(lex->pool, len);
+            mln_string_t minus = mln_string("-");
+            mln_string_t *s = mln_string_pool_strcat(lex->pool, &minus, clst->text);
             if (s == NULL) {
                 mln_lex_error_set(lex, MLN_LEX_ENMEM);
                 mln_conf_lex_free(clst);
                 return NULL;
             }
-            s[0] = '-';
-            memcpy(s+1, clst->text->data, clst->text->len);
-            s[len-1] = 0;
-            mln_alloc_free(clst->text->data);
-            clst->text->data = s;
+            mln_string_free(clst->text);
+            clst->text = s;
             break;
         } else {
             if (!sub_mark) break;
@@ -26,14 +26,16 @@ static inline int mln_fd_is_nonblock(int fd);
 static inline mln_chain_t *
 mln_tcp_conn_pop_inline(mln_tcp_conn_t *tc, int type);
 static inline int
-mln_tcp_conn_recv_chain(mln_tcp_conn_t *tc, mln_u32_t flag);
+mln_tcp_conn_recv_chain(mln_tcp_conn_t *tc, mln_u32_t flag, mln_u32_t size);
 static inline int
 mln_tcp_conn_recv_chain_file(int sockfd, \
                              mln_alloc_t *pool, \
                              mln_buf_t *b, \
-                             mln_buf_t *last);
+                             mln_buf_t *last, \
+                             mln_u32_t size);
 static inline int
-mln_tcp_conn_recv_chain_mem(int sockfd, mln_alloc_t *pool, mln_buf_t *b);
+mln_tcp_conn_recv_chain_mem(int sockfd, mln_alloc_t *pool, mln_buf_t *b, mln_u32_t size);
+static inline void mln_tcp_conn_recv_size_update(mln_tcp_conn_t *tc, mln_u32_t size, int n);
 static inline ssize_t
 mln_tcp_conn_send_chain_memory(mln_tcp_conn_t *tc);
 static inline ssize_t
@@ -61,12 +63,23 @@ static inline int mln_fd_is_nonblock(int fd)
 
 int mln_tcp_conn_init(mln_tcp_conn_t *tc, int sockfd)
 {
-    tc->pool = mln_alloc_init(NULL);
-    if (tc->pool == NULL) return -1;
+    mln_alloc_t *pool = mln_alloc_init(NULL);
+    if (pool == NULL) return -1;
+    return mln_tcp_conn_pool_init(tc, sockfd, pool);
+}
+
+int mln_tcp_conn_pool_init(mln_tcp_conn_t *tc, int sockfd, mln_alloc_t *pool)
+{
+    /*
+     * pool is taken over by tc, it will be destroyed in mln_tcp_conn_destroy.
+     */
+    tc->pool = pool;
     tc->rcv_head = tc->rcv_tail = NULL;
     tc->snd_head = tc->snd_tail = NULL;
     tc->sent_head = tc->sent_tail = NULL;
     tc->sockfd = sockfd;
+    tc->rcv_size = M_C_RECV_MIN_SIZE;
+    tc->rcv_shrink = 0;
     return 0;
 }
 
@@ -176,6 +189,16 @@ mln_chain_t *mln_tcp_conn_remove(mln_tcp_conn_t *tc, int type)
     return rc;
 }
 
+/*
+ * Move the whole queue 'src_type' of src to the end of the queue 'dst_type' of dst
+ * without copying. The moved buffers are still allocated from the pool of src.
+ */
+void mln_tcp_conn_move(mln_tcp_conn_t *dst, int dst_type, mln_tcp_conn_t *src, int src_type)
+{
+    mln_chain_t *tail = mln_tcp_conn_get_tail(src, src_type);
+    mln_tcp_conn_append_chain(dst, mln_tcp_conn_remove(src, src_type), tail, dst_type);
+}
+
 mln_chain_t *mln_tcp_conn_pop(mln_tcp_conn_t *tc, int type)
 {
     mln_chain_t **head, **tail;
@@ -725,21 +748,34 @@ mln_tcp_conn_pop_inline(mln_tcp_conn_t *tc, int type)
 
 int mln_tcp_conn_recv(mln_tcp_conn_t *tc, mln_u32_t flag)
 {
-    if (flag != M_C_TYPE_MEMORY && flag != M_C_TYPE_FILE) {
+    if ((flag & (M_C_TYPE_MEMORY|M_C_TYPE_FILE)) == 0 || \
+        (flag & (M_C_TYPE_MEMORY|M_C_TYPE_FILE)) == (M_C_TYPE_MEMORY|M_C_TYPE_FILE) || \
+        (flag & ~(M_C_TYPE_MEMORY|M_C_TYPE_FILE|M_C_TYPE_FOLLOW|M_C_TYPE_ADAPTIVE)))
+    {
         mln_log(error, "Flag error.\n");
         abort();
     }
 
     int n;
+    mln_u32_t size;
 
     if (mln_fd_is_nonblock(tc->sockfd)) {
 goon_non:
-        while ((n = mln_tcp_conn_recv_chain(tc, flag)) > 0) {
-            /*do nothing*/
+        while (1) {
+            size = (flag & M_C_TYPE_ADAPTIVE)? tc->rcv_size: M_C_RECV_MIN_SIZE;
+            if ((n = mln_tcp_conn_recv_chain(tc, flag, size)) <= 0)
+                break;
+            /*
+             * a short read means the socket is drained, so the recv which
+             * would only return EAGAIN is saved.
+             */
+            if ((flag & M_C_TYPE_ADAPTIVE) && n < size)
+                return M_C_NOTYET;
         }
     } else {
 goon_blk:
-        if ((n = mln_tcp_conn_recv_chain(tc, flag)) > 0) {
+        size = (flag & M_C_TYPE_ADAPTIVE)? tc->rcv_size: M_C_RECV_MIN_SIZE;
+        if ((n = mln_tcp_conn_recv_chain(tc, flag, size)) > 0) {
             return M_C_NOTYET;
         }
     }
@@ -761,7 +797,7 @@ goon_blk:
 }
 
 static inline int
-mln_tcp_conn_recv_chain(mln_tcp_conn_t *tc, mln_u32_t flag)
+mln_tcp_conn_recv_chain(mln_tcp_conn_t *tc, mln_u32_t flag, mln_u32_t size)
 {
     mln_buf_t *last = NULL;
     int n = -1;
@@ -784,9 +820,9 @@ mln_tcp_conn_recv_chain(mln_tcp_conn_t *tc, mln_u32_t flag)
                 last = NULL;
             }
         }
-        n = mln_tcp_conn_recv_chain_file(tc->sockfd, pool, b, last);
+        n = mln_tcp_conn_recv_chain_file(tc->sockfd, pool, b, last, size);
     } else if (flag & M_C_TYPE_MEMORY) {
-        n = mln_tcp_conn_recv_chain_mem(tc->sockfd, pool, b);
+        n = mln_tcp_conn_recv_chain_mem(tc->sockfd, pool, b, size);
     } else {
         mln_log(error, "Flag error.\n");
         abort();
@@ -796,30 +832,57 @@ mln_tcp_conn_recv_chain(mln_tcp_conn_t *tc, mln_u32_t flag)
         mln_chain_pool_release(c);
     } else {
         mln_tcp_conn_append(tc, c, M_C_RECV);
+        if (flag & M_C_TYPE_ADAPTIVE)
+            mln_tcp_conn_recv_size_update(tc, size, n);
     }
 
     return n;
 }
 
+static inline void mln_tcp_conn_recv_size_update(mln_tcp_conn_t *tc, mln_u32_t size, int n)
+{
+    if ((mln_u32_t)n >= size) {
+        if (size < M_C_RECV_MAX_SIZE) tc->rcv_size = size << 1;
+        tc->rcv_shrink = 0;
+    } else if ((mln_u32_t)n <= (size >> 1) && size > M_C_RECV_MIN_SIZE) {
+        if (++(tc->rcv_shrink) >= 2) {
+            tc->rcv_size = size >> 1;
+            tc->rcv_shrink = 0;
+        }
+    } else {
+        tc->rcv_shrink = 0;
+    }
+}
+
 static inline int
 mln_tcp_conn_recv_chain_file(int sockfd, \
                              mln_alloc_t *pool, \
                              mln_buf_t *b, \
-                             mln_buf_t *last)
+                             mln_buf_t *last, \
+                             mln_u32_t size)
 {
     int n;
-    mln_u8_t buf[1024];
+    mln_u8_t stack_buf[M_C_RECV_MIN_SIZE];
+    mln_u8ptr_t buf = stack_buf;
+
+    if (size > sizeof(stack_buf)) {
+        if ((buf = (mln_u8ptr_t)mln_alloc_m(pool, size)) == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
 
 #if defined(WIN32)
-    n = recv(sockfd, (char *)buf, sizeof(buf), 0);
+    n = recv(sockfd, (char *)buf, size, 0);
 #else
-    n = recv(sockfd, buf, sizeof(buf), 0);
+    n = recv(sockfd, buf, size, 0);
 #endif
-    if (n <= 0) return n;
+    if (n <= 0) goto out;
 
     if (last == NULL) {
         if ((b->file = mln_file_open_tmp(pool)) == NULL) {
-            return -1;
+            n = -1;
+            goto out;
         }
         b->file_left_pos = b->file_pos = 0;
     } else {
@@ -832,28 +895,30 @@ mln_tcp_conn_recv_chain_file(int sockfd, \
     b->last_buf = 1;
 
     if (write(mln_file_fd(b->file), buf, n) < 0) {
-        return -1;
+        n = -1;
     }
 
+out:
+    if (buf != stack_buf) mln_alloc_free(buf);
     return n;
 }
 
 static inline int
-mln_tcp_conn_recv_chain_mem(int sockfd, mln_alloc_t *pool, mln_buf_t *b)
+mln_tcp_conn_recv_chain_mem(int sockfd, mln_alloc_t *pool, mln_buf_t *b, mln_u32_t size)
 {
     mln_u8ptr_t buf;
     int n;
 
-    buf = (mln_u8ptr_t)mln_alloc_m(pool, 1024);
+    buf = (mln_u8ptr_t)mln_alloc_m(pool, size);
     if (buf == NULL) {
         errno = ENOMEM;
         return -1;
     }
 
 #if defined(WIN32)
-    n = recv(sockfd, (char *)buf, 1024, 0);
+    n = recv(sockfd, (char *)buf, size, 0);
 #else
-    n = recv(sockfd, buf, 1024, 0);
+    n = recv(sockfd, buf, size, 0);
 #endif
     if (n <= 0) {
         mln_alloc_free(buf);
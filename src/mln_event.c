@@ -16,6 +16,36 @@
 #if !defined(WIN32)
 #include <sys/socket.h>
 #endif
+#if defined(MLN_EPOLL) && defined(MLN_IOURING)
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define M_EV_URING_ENTRIES 1024
+
+struct mln_event_uring_s {
+    int                      fd;
+    unsigned                 to_submit;
+    unsigned                *sq_head;
+    unsigned                *sq_tail;
+    unsigned                *sq_mask;
+    unsigned                *sq_entries;
+    unsigned                *sq_array;
+    unsigned                *cq_head;
+    unsigned                *cq_tail;
+    unsigned                *cq_mask;
+    struct io_uring_sqe     *sqes;
+    struct io_uring_cqe     *cqes;
+    void                    *sq_ptr;
+    void                    *cq_ptr;
+    size_t                   sq_len;
+    size_t                   cq_len;
+    size_t                   sqes_len;
+    struct __kernel_timespec ts;
+};
+#endif
 
 /*declarations*/
 MLN_CHAIN_FUNC_DECLARE(ev_fd_wait, \
@@ -24,6 +54,17 @@ MLN_CHAIN_FUNC_DECLARE(ev_fd_wait, \
 MLN_CHAIN_FUNC_DECLARE(ev_fd_active, \
                        mln_event_desc_t, \
                        static inline void,);
+MLN_CHAIN_FUNC_DECLARE(ev_tw, \
+                       mln_event_desc_t, \
+                       static inline void,);
+static mln_event_t *mln_event_new_internal(int wheel);
+static mln_event_wheel_t *mln_event_tw_new(void);
+static void mln_event_tw_free(mln_event_wheel_t *tw, int free_desc);
+static inline void mln_event_tw_insert(mln_event_wheel_t *tw, mln_event_desc_t *ed);
+static inline void mln_event_tw_delete(mln_event_wheel_t *tw, mln_event_desc_t *ed);
+static inline mln_event_desc_t *mln_event_tw_expired(mln_event_wheel_t *tw, mln_u64_t now);
+static inline mln_u64_t mln_event_tw_next(mln_event_wheel_t *tw);
+static inline void mln_event_fd_timeout_del(mln_event_t *ev, mln_event_desc_t *ed);
 static inline void
 mln_event_desc_free(void *data);
 static int
@@ -66,15 +107,37 @@ mln_event_fd_append_set(mln_event_t *event, \
                         int other_mark);
 static int
 mln_event_fd_timeout_set(mln_event_t *ev, mln_event_desc_t *ed, int timeout_ms);
+static inline void mln_event_lock(mln_event_t *ev, pthread_mutex_t *lock);
+static inline void mln_event_unlock(mln_event_t *ev, pthread_mutex_t *lock);
+static inline int mln_event_trylock(mln_event_t *ev, pthread_mutex_t *lock);
+static inline int mln_event_wait_timeout_get(mln_event_t *event);
+#if defined(MLN_EPOLL) && defined(MLN_IOURING)
+static mln_event_uring_t *mln_event_uring_new(void);
+static void mln_event_uring_free(mln_event_uring_t *ur);
+static inline void mln_event_uring_update(mln_event_t *event, mln_event_desc_t *ed);
+static inline void mln_event_uring_cancel(mln_event_t *event, mln_event_desc_t *ed);
+static inline int mln_event_uring_process(mln_event_t *event, int timeout);
+#endif
 
 /*varliables*/
 mln_event_desc_t fheap_min = {
     M_EV_TM, 0,
     {{NULL, NULL, 0}},
-    NULL, NULL, NULL, NULL
+    NULL, NULL, NULL, NULL,
+    NULL, NULL, M_EV_WHEEL_NONE
 };
 
 mln_event_t *mln_event_new(void)
+{
+    return mln_event_new_internal(0);
+}
+
+mln_event_t *mln_event_wheel_new(void)
+{
+    return mln_event_new_internal(1);
+}
+
+static mln_event_t *mln_event_new_internal(int wheel)
 {
     int rc;
     mln_event_t *ev;
@@ -100,6 +163,22 @@ mln_event_t *mln_event_new(void)
     ev->ev_fd_wait_tail = NULL;
     ev->ev_fd_active_head = NULL;
     ev->ev_fd_active_tail = NULL;
+    ev->ev_fd_timeout_heap = NULL;
+    ev->ev_timer_heap = NULL;
+    ev->ev_fd_timeout_wheel = NULL;
+    ev->ev_timer_wheel = NULL;
+
+    if (wheel) {
+        if ((ev->ev_fd_timeout_wheel = mln_event_tw_new()) == NULL) {
+            mln_log(error, "No memory.\n");
+            goto err2;
+        }
+        if ((ev->ev_timer_wheel = mln_event_tw_new()) == NULL) {
+            mln_log(error, "No memory.\n");
+            goto err3;
+        }
+        goto timers_ok;
+    }
 
     struct mln_fheap_attr fattr;
     fattr.pool = NULL;
@@ -129,7 +208,9 @@ mln_event_t *mln_event_new(void)
         mln_log(error, "No memory.\n");
         goto err3;
     }
+timers_ok:
     ev->is_break = 0;
+    ev->nolock = 0;
 #if defined(MLN_EPOLL)
     ev->epollfd = epoll_create(M_EV_EPOLL_SIZE);
     if (ev->epollfd < 0) {
@@ -142,6 +223,9 @@ mln_event_t *mln_event_new(void)
         mln_log(error, "epoll_create error. %s\n", strerror(errno));
         goto err4;
     }
+#if defined(MLN_IOURING)
+    ev->uring = mln_event_uring_new();
+#endif
 #elif defined(MLN_KQUEUE)
     ev->kqfd = kqueue();
     if (ev->kqfd < 0) {
@@ -172,8 +256,13 @@ mln_event_t *mln_event_new(void)
         pthread_mutex_destroy(&ev->cb_lock);
 #if defined(MLN_EPOLL)
         close(ev->epollfd);
+        close(ev->unusedfd);
+#if defined(MLN_IOURING)
+        mln_event_uring_free(ev->uring);
+#endif
 #elif defined(MLN_KQUEUE)
         close(ev->kqfd);
+        close(ev->unusedfd);
 #endif
         goto err4;
     }
@@ -182,8 +271,10 @@ mln_event_t *mln_event_new(void)
 
 err4:
     mln_fheap_free(ev->ev_timer_heap);
+    mln_event_tw_free(ev->ev_timer_wheel, 1);
 err3:
     mln_fheap_free(ev->ev_fd_timeout_heap);
+    mln_event_tw_free(ev->ev_fd_timeout_wheel, 0);
 err2:
     mln_rbtree_free(ev->ev_fd_tree);
 err1:
@@ -196,6 +287,7 @@ void mln_event_free(mln_event_t *ev)
     if (ev == NULL) return;
     mln_event_desc_t *ed;
     mln_fheap_free(ev->ev_fd_timeout_heap);
+    mln_event_tw_free(ev->ev_fd_timeout_wheel, 0);
     mln_rbtree_free(ev->ev_fd_tree);
     while ((ed = ev->ev_fd_wait_head) != NULL) {
         ev_fd_wait_chain_del(&(ev->ev_fd_wait_head), \
@@ -204,9 +296,13 @@ void mln_event_free(mln_event_t *ev)
         mln_event_desc_free(ed);
     }
     mln_fheap_free(ev->ev_timer_heap);
+    mln_event_tw_free(ev->ev_timer_wheel, 1);
 #if defined(MLN_EPOLL)
     close(ev->epollfd);
     close(ev->unusedfd);
+#if defined(MLN_IOURING)
+    mln_event_uring_free(ev->uring);
+#endif
 #elif defined(MLN_KQUEUE)
     close(ev->kqfd);
     close(ev->unusedfd);
@@ -252,24 +348,40 @@ mln_event_timer_t *mln_event_timer_set(mln_event_t *event, \
     ed->next = NULL;
     ed->act_prev = NULL;
     ed->act_next = NULL;
+    ed->tw_prev = NULL;
+    ed->tw_next = NULL;
+    ed->tw_index = M_EV_WHEEL_NONE;
+    ed->data.tm.node = NULL;
+    if (event->ev_timer_wheel != NULL) {
+        mln_event_lock(event, &event->timer_lock);
+        mln_event_tw_insert(event->ev_timer_wheel, ed);
+        mln_event_unlock(event, &event->timer_lock);
+        return ed;
+    }
     mln_fheap_node_t *fn = mln_fheap_node_new(event->ev_timer_heap, ed);
     if (fn == NULL) {
         mln_log(error, "No memory.\n");
         free(ed);
         return NULL;
     }
-    pthread_mutex_lock(&event->timer_lock);
+    ed->data.tm.node = fn;
+    mln_event_lock(event, &event->timer_lock);
     mln_fheap_insert(event->ev_timer_heap, fn);
-    pthread_mutex_unlock(&event->timer_lock);
-    return fn;
+    mln_event_unlock(event, &event->timer_lock);
+    return ed;
 }
 
 void mln_event_timer_cancel(mln_event_t *event, mln_event_timer_t *timer)
 {
-    pthread_mutex_lock(&event->timer_lock);
-    mln_fheap_delete(event->ev_timer_heap, timer);
-    mln_fheap_node_free(event->ev_timer_heap, timer);
-    pthread_mutex_unlock(&event->timer_lock);
+    mln_event_lock(event, &event->timer_lock);
+    if (event->ev_timer_wheel != NULL) {
+        mln_event_tw_delete(event->ev_timer_wheel, timer);
+        mln_event_desc_free(timer);
+    } else {
+        mln_fheap_delete(event->ev_timer_heap, timer->data.tm.node);
+        mln_fheap_node_free(event->ev_timer_heap, timer->data.tm.node);
+    }
+    mln_event_unlock(event, &event->timer_lock);
 }
 
 static inline void mln_event_timer_process(mln_event_t *event)
@@ -282,24 +394,39 @@ static inline void mln_event_timer_process(mln_event_t *event)
     mln_fheap_node_t *fn;
 
 lp:
-    if (pthread_mutex_trylock(&event->timer_lock))
+    if (mln_event_trylock(event, &event->timer_lock))
         return;
 
+    if (event->ev_timer_wheel != NULL) {
+        ed = mln_event_tw_expired(event->ev_timer_wheel, now / 1000);
+        mln_event_unlock(event, &event->timer_lock);
+        if (ed == NULL) return;
+
+        if (ed->data.tm.handler != NULL)
+            ed->data.tm.handler(event, ed->data.tm.data);
+
+        mln_event_desc_free(ed);
+
+        if (!event->is_break)
+            goto lp;
+        return;
+    }
+
     fn = mln_fheap_minimum(event->ev_timer_heap);
     if (fn == NULL) {
-        pthread_mutex_unlock(&event->timer_lock);
+        mln_event_unlock(event, &event->timer_lock);
         return;
     }
 
     ed = (mln_event_desc_t *)mln_fheap_node_key(fn);
     if (ed->data.tm.end_tm > now) {
-        pthread_mutex_unlock(&event->timer_lock);
+        mln_event_unlock(event, &event->timer_lock);
         return;
     }
 
     fn = mln_fheap_extract_min(event->ev_timer_heap);
 
-    pthread_mutex_unlock(&event->timer_lock);
+    mln_event_unlock(event, &event->timer_lock);
 
     if (ed->data.tm.handler != NULL)
         ed->data.tm.handler(event, ed->data.tm.data);
@@ -318,7 +445,7 @@ void mln_event_fd_timeout_handler_set(mln_event_t *event, \
                                       void *data, \
                                       ev_fd_handler timeout_handler)
 {
-    pthread_mutex_lock(&event->fd_lock);
+    mln_event_lock(event, &event->fd_lock);
     mln_event_desc_t tmp;
     memset(&tmp, 0, sizeof(tmp));
     tmp.type = M_EV_FD;
@@ -331,7 +458,7 @@ void mln_event_fd_timeout_handler_set(mln_event_t *event, \
     mln_event_desc_t *ed = (mln_event_desc_t *)mln_rbtree_node_data(rn);
     ed->data.fd.timeout_data = data;
     ed->data.fd.timeout_handler = timeout_handler;
-    pthread_mutex_unlock(&event->fd_lock);
+    mln_event_unlock(event, &event->fd_lock);
 }
 
 int mln_event_fd_set(mln_event_t *event, \
@@ -349,10 +476,10 @@ int mln_event_fd_set(mln_event_t *event, \
         mln_log(error, "fd or flag error.\n");
         abort();
     }
-    pthread_mutex_lock(&event->fd_lock);
+    mln_event_lock(event, &event->fd_lock);
     if (flag == M_EV_CLR) {
         mln_event_fd_clr_set(event, fd);
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
         return 0;
     }
     mln_event_desc_t tmp;
@@ -378,7 +505,7 @@ int mln_event_fd_set(mln_event_t *event, \
                                         fd_handler, \
                                         1) < 0)
             {
-                pthread_mutex_unlock(&event->fd_lock);
+                mln_event_unlock(event, &event->fd_lock);
                 return -1;
             }
         } else {
@@ -396,11 +523,11 @@ int mln_event_fd_set(mln_event_t *event, \
                                         fd_handler, \
                                         ((mln_event_desc_t *)(rn->data))->data.fd.is_clear?0:1) < 0)
             {
-                pthread_mutex_unlock(&event->fd_lock);
+                mln_event_unlock(event, &event->fd_lock);
                 return -1;
             }
         }
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
         return 0;
     }
     if (flag & M_EV_NONBLOCK) {
@@ -409,10 +536,10 @@ int mln_event_fd_set(mln_event_t *event, \
         mln_event_fd_block_set(fd);
     }
     if (mln_event_fd_normal_set(event, NULL, fd, flag, timeout_ms, data, fd_handler, 0) < 0) {
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
         return -1;
     }
-    pthread_mutex_unlock(&event->fd_lock);
+    mln_event_unlock(event, &event->fd_lock);
     return 0;
 }
 
@@ -440,6 +567,9 @@ mln_event_fd_normal_set(mln_event_t *event, \
         ed->prev = NULL;
         ed->act_next = NULL;
         ed->act_prev = NULL;
+        ed->tw_prev = NULL;
+        ed->tw_next = NULL;
+        ed->tw_index = M_EV_WHEEL_NONE;
         mln_rbtree_node_t *rn;
         rn = mln_rbtree_node_new(event->ev_fd_tree, ed);
         if (rn == NULL) {
@@ -458,8 +588,14 @@ mln_event_fd_normal_set(mln_event_t *event, \
     } else {
         if (ed->data.fd.is_clear) {
             mln_u32_t in_process = ed->data.fd.in_process;
+            mln_u32_t in_ring = ed->data.fd.in_ring;
+            mln_u32_t ring_cancel = ed->data.fd.ring_cancel;
+            mln_u32_t ring_mask = ed->data.fd.ring_mask;
             memset(&(ed->data.fd), 0, sizeof(mln_event_fd_t));
             ed->data.fd.in_process = in_process;
+            ed->data.fd.in_ring = in_ring;
+            ed->data.fd.ring_cancel = ring_cancel;
+            ed->data.fd.ring_mask = ring_mask;
             ed->data.fd.fd = fd;
             ed->flag = 0;
         } else {
@@ -546,6 +682,12 @@ mln_event_fd_append_set(mln_event_t *event, \
         if (oneshot) ed->data.fd.err_oneshot = 1;
         mask |= 0x4;
     }
+#if defined(MLN_IOURING)
+    if (event->uring != NULL) {
+        mln_event_uring_update(event, ed);
+        return 0;
+    }
+#endif
     struct epoll_event ev;
     memset(&ev, 0, sizeof(ev));
     switch (mask) {
@@ -654,19 +796,19 @@ mln_event_fd_timeout_set(mln_event_t *ev, mln_event_desc_t *ed, int timeout_ms)
     if (timeout_ms == M_EV_UNMODIFIED) return 0;
     mln_event_fd_t *ef = &(ed->data.fd);
     if (timeout_ms == M_EV_UNLIMITED) {
-        if (ef->timeout_node != NULL) {
-            mln_fheap_delete(ev->ev_fd_timeout_heap, ef->timeout_node);
-            mln_fheap_node_free(ev->ev_fd_timeout_heap, ef->timeout_node);
-            ef->timeout_node = NULL;
-            ef->end_us = 0;
-        }
+        mln_event_fd_timeout_del(ev, ed);
         return 0;
     }
     mln_fheap_node_t *fn;
     struct timeval tv;
     memset(&tv, 0, sizeof(tv));
     gettimeofday(&tv, NULL);
-    if (ef->timeout_node == NULL) {
+    if (ev->ev_fd_timeout_wheel != NULL) {
+        if (ed->tw_index != M_EV_WHEEL_NONE)
+            mln_event_tw_delete(ev->ev_fd_timeout_wheel, ed);
+        ef->end_us = tv.tv_sec*1000000+tv.tv_usec+timeout_ms*1000;
+        mln_event_tw_insert(ev->ev_fd_timeout_wheel, ed);
+    } else if (ef->timeout_node == NULL) {
         ef->end_us = tv.tv_sec*1000000+tv.tv_usec+timeout_ms*1000;
         fn = mln_fheap_node_new(ev->ev_fd_timeout_heap, ed);
         if (fn == NULL) {
@@ -684,6 +826,20 @@ mln_event_fd_timeout_set(mln_event_t *ev, mln_event_desc_t *ed, int timeout_ms)
     return 0;
 }
 
+static inline void mln_event_fd_timeout_del(mln_event_t *ev, mln_event_desc_t *ed)
+{
+    mln_event_fd_t *ef = &(ed->data.fd);
+    if (ev->ev_fd_timeout_wheel != NULL) {
+        if (ed->tw_index != M_EV_WHEEL_NONE)
+            mln_event_tw_delete(ev->ev_fd_timeout_wheel, ed);
+    } else if (ef->timeout_node != NULL) {
+        mln_fheap_delete(ev->ev_fd_timeout_heap, ef->timeout_node);
+        mln_fheap_node_free(ev->ev_fd_timeout_heap, ef->timeout_node);
+        ef->timeout_node = NULL;
+    }
+    ef->end_us = 0;
+}
+
 static inline void
 mln_event_fd_clr_set(mln_event_t *event, int fd)
 {
@@ -697,17 +853,20 @@ mln_event_fd_clr_set(mln_event_t *event, int fd)
         return;
     }
     ed = (mln_event_desc_t *)mln_rbtree_node_data(rn);
-    if (ed->data.fd.timeout_node != NULL) {
-        mln_fheap_delete(event->ev_fd_timeout_heap, ed->data.fd.timeout_node);
-        mln_fheap_node_free(event->ev_fd_timeout_heap, ed->data.fd.timeout_node);
-        ed->data.fd.timeout_node = NULL;
-        ed->data.fd.end_us = 0;
-    }
+    mln_event_fd_timeout_del(event, ed);
 #if defined(MLN_EPOLL)
+#if defined(MLN_IOURING)
+    if (event->uring != NULL) {
+        mln_event_uring_cancel(event, ed);
+    } else {
+#endif
     struct epoll_event ev;
     memset(&ev, 0, sizeof(ev));
     ev.data.ptr = ed;
     epoll_ctl(event->epollfd, EPOLL_CTL_DEL, fd, &ev);
+#if defined(MLN_IOURING)
+    }
+#endif
 #elif defined(MLN_KQUEUE)
     struct kevent ev;
     EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, ed);
@@ -721,7 +880,11 @@ mln_event_fd_clr_set(mln_event_t *event, int fd)
     if (ed->flag & M_EV_ERROR)
         FD_CLR(fd, &(event->err_set));
 #endif
-    if (ed->data.fd.in_process) {
+    /*
+     * in_ring: io_uring still holds ed as user_data, so ed is freed
+     * after the completion of the poll request is reaped.
+     */
+    if (ed->data.fd.in_process || ed->data.fd.in_ring) {
         ed->data.fd.is_clear = 1;
         return;
     }
@@ -747,10 +910,10 @@ void mln_event_callback_set(mln_event_t *ev, \
                             dispatch_callback dc, \
                             void *dc_data)
 {
-    pthread_mutex_lock(&ev->cb_lock);
+    mln_event_lock(ev, &ev->cb_lock);
     ev->callback = dc;
     ev->callback_data = dc_data;
-    pthread_mutex_unlock(&ev->cb_lock);
+    mln_event_unlock(ev, &ev->cb_lock);
 }
 
 /*
@@ -796,6 +959,353 @@ mln_event_fd_block_set(int fd)
 #endif
 }
 
+/*
+ * locks, all of them are skipped in nolock mode
+ */
+static inline void mln_event_lock(mln_event_t *ev, pthread_mutex_t *lock)
+{
+    if (!ev->nolock) pthread_mutex_lock(lock);
+}
+
+static inline void mln_event_unlock(mln_event_t *ev, pthread_mutex_t *lock)
+{
+    if (!ev->nolock) pthread_mutex_unlock(lock);
+}
+
+static inline int mln_event_trylock(mln_event_t *ev, pthread_mutex_t *lock)
+{
+    if (ev->nolock) return 0;
+    return pthread_mutex_trylock(lock);
+}
+
+/*
+ * Calculate how many milliseconds the poller can sleep, -1 means infinite.
+ * The result is the distance to the nearest timer or fd timeout. In locked mode
+ * (or if dispatch callback is set) it never exceeds M_EV_TIMEOUT_MS, because
+ * other threads may add events without waking up the poller.
+ * fd_lock must be held by the caller.
+ */
+static inline int mln_event_wait_timeout_get(mln_event_t *event)
+{
+    mln_u64_t now, end = 0, tmp;
+    mln_fheap_node_t *fn;
+    struct timeval tv;
+    int capped = !event->nolock || event->callback != NULL;
+
+    if (event->ev_fd_active_head != NULL) return 0;
+
+    if (mln_event_trylock(event, &event->timer_lock))
+        return M_EV_TIMEOUT_MS;
+    if (event->ev_timer_wheel != NULL) {
+        end = mln_event_tw_next(event->ev_timer_wheel) * 1000;
+    } else {
+        fn = mln_fheap_minimum(event->ev_timer_heap);
+        if (fn != NULL)
+            end = ((mln_event_desc_t *)mln_fheap_node_key(fn))->data.tm.end_tm;
+    }
+    mln_event_unlock(event, &event->timer_lock);
+
+    if (event->ev_fd_timeout_wheel != NULL) {
+        tmp = mln_event_tw_next(event->ev_fd_timeout_wheel) * 1000;
+        if (tmp && (!end || tmp < end)) end = tmp;
+    } else {
+        fn = mln_fheap_minimum(event->ev_fd_timeout_heap);
+        if (fn != NULL) {
+            tmp = ((mln_event_desc_t *)mln_fheap_node_key(fn))->data.fd.end_us;
+            if (!end || tmp < end) end = tmp;
+        }
+    }
+
+    if (!end) return capped? M_EV_TIMEOUT_MS: -1;
+
+    gettimeofday(&tv, NULL);
+    now = tv.tv_sec * 1000000 + tv.tv_usec;
+    if (end <= now) return 0;
+    tmp = (end - now + 999) / 1000;
+    if (capped && tmp > M_EV_TIMEOUT_MS) return M_EV_TIMEOUT_MS;
+    return tmp > 0x7fffffff? 0x7fffffff: (int)tmp;
+}
+
+#if defined(MLN_EPOLL) && defined(MLN_IOURING)
+/*
+ * io_uring
+ *
+ * Readiness is watched by one-shot IORING_OP_POLL_ADD requests whose user_data
+ * is the event descriptor. After a completion is reaped, the poll request is
+ * submitted again if the descriptor is still interested in some events, so the
+ * behavior is the same as level-triggered epoll. All modifications are queued in
+ * the submission ring and sent to kernel in one io_uring_enter together with
+ * the wait. All functions here must be called with fd_lock held.
+ */
+static mln_event_uring_t *mln_event_uring_new(void)
+{
+    mln_event_uring_t *ur;
+    struct io_uring_params p;
+
+    if ((ur = (mln_event_uring_t *)calloc(1, sizeof(mln_event_uring_t))) == NULL)
+        return NULL;
+    memset(&p, 0, sizeof(p));
+    ur->fd = syscall(__NR_io_uring_setup, M_EV_URING_ENTRIES, &p);
+    if (ur->fd < 0) {
+        mln_log(debug, "io_uring_setup error. %s, fall back to epoll.\n", strerror(errno));
+        free(ur);
+        return NULL;
+    }
+
+    ur->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ur->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ur->cq_len > ur->sq_len) ur->sq_len = ur->cq_len;
+        ur->cq_len = ur->sq_len;
+    }
+    ur->sq_ptr = mmap(NULL, ur->sq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+    if (ur->sq_ptr == MAP_FAILED) goto err1;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ur->cq_ptr = ur->sq_ptr;
+    } else {
+        ur->cq_ptr = mmap(NULL, ur->cq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING);
+        if (ur->cq_ptr == MAP_FAILED) goto err2;
+    }
+    ur->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ur->sqes = (struct io_uring_sqe *)mmap(NULL, ur->sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+    if (ur->sqes == MAP_FAILED) goto err3;
+
+    ur->sq_head = (unsigned *)((char *)ur->sq_ptr + p.sq_off.head);
+    ur->sq_tail = (unsigned *)((char *)ur->sq_ptr + p.sq_off.tail);
+    ur->sq_mask = (unsigned *)((char *)ur->sq_ptr + p.sq_off.ring_mask);
+    ur->sq_entries = (unsigned *)((char *)ur->sq_ptr + p.sq_off.ring_entries);
+    ur->sq_array = (unsigned *)((char *)ur->sq_ptr + p.sq_off.array);
+    ur->cq_head = (unsigned *)((char *)ur->cq_ptr + p.cq_off.head);
+    ur->cq_tail = (unsigned *)((char *)ur->cq_ptr + p.cq_off.tail);
+    ur->cq_mask = (unsigned *)((char *)ur->cq_ptr + p.cq_off.ring_mask);
+    ur->cqes = (struct io_uring_cqe *)((char *)ur->cq_ptr + p.cq_off.cqes);
+    return ur;
+
+err3:
+    if (ur->cq_ptr != ur->sq_ptr) munmap(ur->cq_ptr, ur->cq_len);
+err2:
+    munmap(ur->sq_ptr, ur->sq_len);
+err1:
+    mln_log(debug, "io_uring mmap error. %s, fall back to epoll.\n", strerror(errno));
+    close(ur->fd);
+    free(ur);
+    return NULL;
+}
+
+static void mln_event_uring_free(mln_event_uring_t *ur)
+{
+    if (ur == NULL) return;
+    munmap(ur->sqes, ur->sqes_len);
+    if (ur->cq_ptr != ur->sq_ptr) munmap(ur->cq_ptr, ur->cq_len);
+    munmap(ur->sq_ptr, ur->sq_len);
+    close(ur->fd);
+    free(ur);
+}
+
+static inline int mln_event_uring_enter(mln_event_uring_t *ur, unsigned wait_nr)
+{
+    int n;
+    unsigned to_submit = ur->to_submit;
+
+    n = syscall(__NR_io_uring_enter, ur->fd, to_submit, wait_nr, wait_nr? IORING_ENTER_GETEVENTS: 0, NULL, 0);
+    if (n > 0) ur->to_submit -= (unsigned)n;
+    return n;
+}
+
+static inline struct io_uring_sqe *mln_event_uring_sqe_get(mln_event_uring_t *ur)
+{
+    unsigned tail = *ur->sq_tail, index;
+    struct io_uring_sqe *sqe;
+
+    while (tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE) >= *ur->sq_entries) {
+        if (mln_event_uring_enter(ur, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            mln_log(error, "io_uring_enter error. %s\n", strerror(errno));
+            abort();
+        }
+    }
+    index = tail & *ur->sq_mask;
+    sqe = &ur->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ur->sq_array[index] = index;
+    return sqe;
+}
+
+static inline void mln_event_uring_sqe_put(mln_event_uring_t *ur)
+{
+    __atomic_store_n(ur->sq_tail, *ur->sq_tail + 1, __ATOMIC_RELEASE);
+    ++(ur->to_submit);
+}
+
+static inline void mln_event_uring_arm(mln_event_t *event, mln_event_desc_t *ed)
+{
+    struct io_uring_sqe *sqe;
+    mln_u32_t events = 0, mask = 0;
+
+    if (ed->flag & M_EV_RECV) {
+        events |= POLLIN;
+        mask |= 0x1;
+    }
+    if (ed->flag & M_EV_SEND) {
+        events |= POLLOUT;
+        mask |= 0x2;
+    }
+    if (ed->flag & M_EV_ERROR) {
+        events |= POLLERR;
+        mask |= 0x4;
+    }
+    if (!mask) return;
+
+    sqe = mln_event_uring_sqe_get(event->uring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = ed->data.fd.fd;
+    sqe->poll32_events = events;
+    sqe->user_data = (__u64)(uintptr_t)ed;
+    mln_event_uring_sqe_put(event->uring);
+    ed->data.fd.in_ring = 1;
+    ed->data.fd.ring_mask = mask;
+}
+
+static inline void mln_event_uring_cancel(mln_event_t *event, mln_event_desc_t *ed)
+{
+    struct io_uring_sqe *sqe;
+
+    if (!ed->data.fd.in_ring || ed->data.fd.ring_cancel) return;
+
+    sqe = mln_event_uring_sqe_get(event->uring);
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = (__u64)(uintptr_t)ed;
+    sqe->user_data = 0;
+    mln_event_uring_sqe_put(event->uring);
+    ed->data.fd.ring_cancel = 1;
+}
+
+/*
+ * Called when the interested events of ed are modified. If the poll request in ring
+ * has different events, it is removed and a new one will be submitted after its
+ * completion is reaped.
+ */
+static inline void mln_event_uring_update(mln_event_t *event, mln_event_desc_t *ed)
+{
+    mln_u32_t mask = 0;
+
+    if (ed->flag & M_EV_RECV) mask |= 0x1;
+    if (ed->flag & M_EV_SEND) mask |= 0x2;
+    if (ed->flag & M_EV_ERROR) mask |= 0x4;
+
+    if (!ed->data.fd.in_ring) {
+        mln_event_uring_arm(event, ed);
+    } else if (ed->data.fd.ring_mask != mask) {
+        mln_event_uring_cancel(event, ed);
+    }
+}
+
+static inline void mln_event_uring_ready(mln_event_t *event, mln_event_desc_t *ed, int revents)
+{
+    mln_event_fd_t *ef = &(ed->data.fd);
+    int busy = ef->in_active || ef->in_process;
+
+    /*
+     * If ed is being processed, the events are just left in ed->flag,
+     * so they will be polled again.
+     */
+    if ((revents & (POLLIN|POLLHUP|POLLERR)) && (ed->flag & M_EV_RECV)) {
+        if (!busy) {
+            if (ef->rd_oneshot) {
+                ef->rd_oneshot = 0;
+                ed->flag &= (~M_EV_RECV);
+            }
+            ef->active_flag |= M_EV_RECV;
+        }
+    }
+    if ((revents & (POLLOUT|POLLHUP|POLLERR)) && (ed->flag & M_EV_SEND)) {
+        if (!busy) {
+            if (ef->wr_oneshot) {
+                ef->wr_oneshot = 0;
+                ed->flag &= (~M_EV_SEND);
+            }
+            ef->active_flag |= M_EV_SEND;
+        }
+    }
+    if ((revents & POLLERR) && (ed->flag & M_EV_ERROR)) {
+        if (!busy) {
+            if (ef->err_oneshot) {
+                ef->err_oneshot = 0;
+                ed->flag &= (~M_EV_ERROR);
+            }
+            ef->active_flag |= M_EV_ERROR;
+        }
+    }
+
+    if (busy || !ef->active_flag) return;
+
+    ev_fd_active_chain_add(&(event->ev_fd_active_head), \
+                           &(event->ev_fd_active_tail), \
+                           ed);
+    ef->in_active = 1;
+}
+
+/*
+ * Submit all queued requests, wait for completions at most timeout milliseconds
+ * (-1 means infinite), then reap completions. Return the number of ready descriptors.
+ */
+static inline int mln_event_uring_process(mln_event_t *event, int timeout)
+{
+    mln_event_uring_t *ur = event->uring;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    mln_event_desc_t *ed;
+    unsigned head, tail;
+    int n = 0, res;
+
+    if (timeout > 0) {
+        ur->ts.tv_sec = timeout / 1000;
+        ur->ts.tv_nsec = (timeout % 1000) * 1000000;
+        sqe = mln_event_uring_sqe_get(ur);
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (__u64)(uintptr_t)&(ur->ts);
+        sqe->len = 1;
+        sqe->off = 1;/*completed by any other completion*/
+        sqe->user_data = 0;
+        mln_event_uring_sqe_put(ur);
+    }
+
+    if (mln_event_uring_enter(ur, timeout? 1: 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME) {
+            mln_log(error, "io_uring_enter error. %s\n", strerror(errno));
+            abort();
+        }
+    }
+
+    head = *ur->cq_head;
+    while (1) {
+        tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) break;
+        for (; head != tail; ++head) {
+            cqe = &ur->cqes[head & *ur->cq_mask];
+            if (!cqe->user_data) continue;
+            ed = (mln_event_desc_t *)(uintptr_t)cqe->user_data;
+            res = cqe->res;
+            ed->data.fd.in_ring = 0;
+            ed->data.fd.ring_cancel = 0;
+            ed->data.fd.ring_mask = 0;
+            if (ed->data.fd.is_clear) {
+                if (!ed->data.fd.in_process) mln_event_fd_clr_set(event, ed->data.fd.fd);
+                continue;
+            }
+            if (res > 0) {
+                mln_event_uring_ready(event, ed, res);
+                ++n;
+            }
+            mln_event_uring_arm(event, ed);
+        }
+        __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+#endif
+
 /*
  * dispatch
  */
@@ -807,19 +1317,19 @@ mln_event_fd_block_set(int fd)
 void mln_event_dispatch(mln_event_t *event)
 {
     __uint32_t mod_event;
-    int nfds, n, oneshot, other_oneshot;
+    int nfds, n, oneshot, other_oneshot, timeout;
     mln_event_desc_t *ed;
     struct epoll_event events[M_EV_EPOLL_SIZE], *ev, mod_ev;
 
     while (1) {
-        if (!pthread_mutex_trylock(&event->cb_lock)) {
+        if (!mln_event_trylock(event, &event->cb_lock)) {
             dispatch_callback cb = event->callback;
             void *data = event->callback_data;
             if (cb != NULL) {
-                pthread_mutex_unlock(&event->cb_lock);
+                mln_event_unlock(event, &event->cb_lock);
                 cb(event, data);
             } else {
-                pthread_mutex_unlock(&event->cb_lock);
+                mln_event_unlock(event, &event->cb_lock);
             }
         }
         BREAK_OUT();
@@ -832,21 +1342,32 @@ void mln_event_dispatch(mln_event_t *event)
         mln_event_timer_process(event);
         BREAK_OUT();
 
-        if (pthread_mutex_trylock(&event->fd_lock)) {
+        if (mln_event_trylock(event, &event->fd_lock)) {
             epoll_wait(event->unusedfd, events, M_EV_EPOLL_SIZE, M_EV_NOLOCK_TIMEOUT_MS);
         } else {
-            nfds = epoll_wait(event->epollfd, events, M_EV_EPOLL_SIZE, M_EV_TIMEOUT_MS);
+            timeout = mln_event_wait_timeout_get(event);
+#if defined(MLN_IOURING)
+            if (event->uring != NULL) {
+                nfds = mln_event_uring_process(event, timeout);
+                mln_event_unlock(event, &event->fd_lock);
+                if (!nfds && !event->nolock && timeout == M_EV_TIMEOUT_MS)
+                    epoll_wait(event->unusedfd, events, M_EV_EPOLL_SIZE, M_EV_NOLOCK_TIMEOUT_MS);
+                continue;
+            }
+#endif
+            nfds = epoll_wait(event->epollfd, events, M_EV_EPOLL_SIZE, timeout);
             if (nfds < 0) {
                 if (errno == EINTR) {
-                    pthread_mutex_unlock(&event->fd_lock);
+                    mln_event_unlock(event, &event->fd_lock);
                     continue;
                 } else {
                     mln_log(error, "epoll_wait error. %s\n", strerror(errno));
                     abort();
                 }
             } else if (nfds == 0) {
-                pthread_mutex_unlock(&event->fd_lock);
-                epoll_wait(event->unusedfd, events, M_EV_EPOLL_SIZE, M_EV_NOLOCK_TIMEOUT_MS);
+                mln_event_unlock(event, &event->fd_lock);
+                if (!event->nolock && timeout == M_EV_TIMEOUT_MS)
+                    epoll_wait(event->unusedfd, events, M_EV_EPOLL_SIZE, M_EV_NOLOCK_TIMEOUT_MS);
                 continue;
             }
             for (n = 0; n < nfds; ++n) {
@@ -950,27 +1471,27 @@ void mln_event_dispatch(mln_event_t *event)
                     }
                 }
             }
-            pthread_mutex_unlock(&event->fd_lock);
+            mln_event_unlock(event, &event->fd_lock);
         }
     }
 }
 #elif defined(MLN_KQUEUE)
 void mln_event_dispatch(mln_event_t *event)
 {
-    int nfds, n;
+    int nfds, n, timeout;
     mln_event_desc_t *ed;
     struct kevent events[M_EV_EPOLL_SIZE], *ev, mod;
     struct timespec ts;
 
     while (1) {
-        if (!pthread_mutex_trylock(&event->cb_lock)) {
+        if (!mln_event_trylock(event, &event->cb_lock)) {
             dispatch_callback cb = event->callback;
             void *data = event->callback_data;
             if (cb != NULL) {
-                pthread_mutex_unlock(&event->cb_lock);
+                mln_event_unlock(event, &event->cb_lock);
                 cb(event, data);
             } else {
-                pthread_mutex_unlock(&event->cb_lock);
+                mln_event_unlock(event, &event->cb_lock);
             }
         }
         BREAK_OUT();
@@ -983,27 +1504,30 @@ void mln_event_dispatch(mln_event_t *event)
         mln_event_timer_process(event);
         BREAK_OUT();
 
-        if (pthread_mutex_trylock(&event->fd_lock)) {
+        if (mln_event_trylock(event, &event->fd_lock)) {
             ts.tv_sec = 0;
             ts.tv_nsec = M_EV_NOLOCK_TIMEOUT_NS;
             kevent(event->unusedfd, NULL, 0, events, M_EV_EPOLL_SIZE, &ts);
         } else {
-            ts.tv_sec = 0;
-            ts.tv_nsec = M_EV_TIMEOUT_NS;
-            nfds = kevent(event->kqfd, NULL, 0, events, M_EV_EPOLL_SIZE, &ts);
+            timeout = mln_event_wait_timeout_get(event);
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000;
+            nfds = kevent(event->kqfd, NULL, 0, events, M_EV_EPOLL_SIZE, timeout < 0? NULL: &ts);
             if (nfds < 0) {
                 if (errno == EINTR) {
-                    pthread_mutex_unlock(&event->fd_lock);
+                    mln_event_unlock(event, &event->fd_lock);
                     continue;
                 } else {
                     mln_log(error, "kevent error. %s\n", strerror(errno));
                     abort();
                 }
             } else if (nfds == 0) {
-                pthread_mutex_unlock(&event->fd_lock);
-                ts.tv_sec = 0;
-                ts.tv_nsec = M_EV_NOLOCK_TIMEOUT_NS;
-                kevent(event->unusedfd, NULL, 0, events, M_EV_EPOLL_SIZE, &ts);
+                mln_event_unlock(event, &event->fd_lock);
+                if (!event->nolock && timeout == M_EV_TIMEOUT_MS) {
+                    ts.tv_sec = 0;
+                    ts.tv_nsec = M_EV_NOLOCK_TIMEOUT_NS;
+                    kevent(event->unusedfd, NULL, 0, events, M_EV_EPOLL_SIZE, &ts);
+                }
                 continue;
             }
             for (n = 0; n < nfds; ++n) {
@@ -1090,14 +1614,14 @@ void mln_event_dispatch(mln_event_t *event)
                                        ed);
                 ed->data.fd.in_active = 1;
             }
-            pthread_mutex_unlock(&event->fd_lock);
+            mln_event_unlock(event, &event->fd_lock);
         }
     }
 }
 #else
 void mln_event_dispatch(mln_event_t *event)
 {
-    int nfds, fd;
+    int nfds, fd, timeout;
     mln_event_desc_t *ed;
     fd_set *rd_set = &(event->rd_set);
     fd_set *wr_set = &(event->wr_set);
@@ -1106,14 +1630,14 @@ void mln_event_dispatch(mln_event_t *event)
     mln_u32_t move;
 
     while (1) {
-        if (!pthread_mutex_trylock(&event->cb_lock)) {
+        if (!mln_event_trylock(event, &event->cb_lock)) {
             dispatch_callback cb = event->callback;
             void *data = event->callback_data;
             if (cb != NULL) {
-                pthread_mutex_unlock(&event->cb_lock);
+                mln_event_unlock(event, &event->cb_lock);
                 cb(event, data);
             } else {
-                pthread_mutex_unlock(&event->cb_lock);
+                mln_event_unlock(event, &event->cb_lock);
             }
         }
         BREAK_OUT();
@@ -1130,7 +1654,7 @@ void mln_event_dispatch(mln_event_t *event)
         FD_ZERO(wr_set);
         FD_ZERO(err_set);
 
-        if (pthread_mutex_trylock(&event->fd_lock)) {
+        if (mln_event_trylock(event, &event->fd_lock)) {
             tm.tv_sec = 0;
             tm.tv_usec = M_EV_NOLOCK_TIMEOUT_US;
             select(event->select_fd, rd_set, wr_set, err_set, &tm);
@@ -1146,14 +1670,15 @@ void mln_event_dispatch(mln_event_t *event)
                 if (fd >= event->select_fd)
                     event->select_fd = fd + 1;
             }
-            tm.tv_sec = 0;
-            tm.tv_usec = M_EV_TIMEOUT_US;
-            nfds = select(event->select_fd, rd_set, wr_set, err_set, &tm);
+            timeout = mln_event_wait_timeout_get(event);
+            tm.tv_sec = timeout / 1000;
+            tm.tv_usec = (timeout % 1000) * 1000;
+            nfds = select(event->select_fd, rd_set, wr_set, err_set, timeout < 0? NULL: &tm);
             if (nfds < 0) {
 #if !defined(WIN32)
                 if (errno == EINTR || errno == ENOMEM) {
 #endif
-                    pthread_mutex_unlock(&event->fd_lock);
+                    mln_event_unlock(event, &event->fd_lock);
                     continue;
 #if !defined(WIN32)
                 } else {
@@ -1162,10 +1687,12 @@ void mln_event_dispatch(mln_event_t *event)
                 }
 #endif
             } else if (nfds == 0) {
-                pthread_mutex_unlock(&event->fd_lock);
-                tm.tv_sec = 0;
-                tm.tv_usec = M_EV_NOLOCK_TIMEOUT_US;
-                select(event->select_fd, rd_set, wr_set, err_set, &tm);
+                mln_event_unlock(event, &event->fd_lock);
+                if (!event->nolock && timeout == M_EV_TIMEOUT_MS) {
+                    tm.tv_sec = 0;
+                    tm.tv_usec = M_EV_NOLOCK_TIMEOUT_US;
+                    select(event->select_fd, rd_set, wr_set, err_set, &tm);
+                }
                 continue;
             }
             ed = event->ev_fd_wait_head;
@@ -1209,7 +1736,7 @@ void mln_event_dispatch(mln_event_t *event)
                     ed->data.fd.in_active = 1;
                 }
             }
-            pthread_mutex_unlock(&event->fd_lock);
+            mln_event_unlock(event, &event->fd_lock);
         }
     }
 }
@@ -1225,7 +1752,7 @@ mln_event_active_fd_process(mln_event_t *event)
     int fd;
 
 lp:
-    if (pthread_mutex_trylock(&event->fd_lock))
+    if (mln_event_trylock(event, &event->fd_lock))
         return;
 
     ed = event->ev_fd_active_head;
@@ -1234,12 +1761,7 @@ lp:
                                &(event->ev_fd_active_tail), \
                                ed);
         ef = &(ed->data.fd);
-        if (ef->timeout_node != NULL) {
-            mln_fheap_delete(event->ev_fd_timeout_heap, ef->timeout_node);
-            mln_fheap_node_free(event->ev_fd_timeout_heap, ef->timeout_node);
-            ef->timeout_node = NULL;
-            ef->end_us = 0;
-        }
+        mln_event_fd_timeout_del(event, ed);
 
         ef->in_active = 0;
         ef->in_process = 1;
@@ -1250,9 +1772,9 @@ lp:
                 h = ef->rcv_handler;
                 data = ef->rcv_data;
                 fd = ef->fd;
-                pthread_mutex_unlock(&event->fd_lock);
+                mln_event_unlock(event, &event->fd_lock);
                 h(event, fd, data);
-                pthread_mutex_lock(&event->fd_lock);
+                mln_event_lock(event, &event->fd_lock);
             }
             ef->active_flag &= (~M_EV_RECV);
         }
@@ -1262,9 +1784,9 @@ lp:
                 h = ef->snd_handler;
                 data = ef->snd_data;
                 fd = ef->fd;
-                pthread_mutex_unlock(&event->fd_lock);
+                mln_event_unlock(event, &event->fd_lock);
                 h(event, fd, data);
-                pthread_mutex_lock(&event->fd_lock);
+                mln_event_lock(event, &event->fd_lock);
             }
             ef->active_flag &= (~M_EV_SEND);
         }
@@ -1274,9 +1796,9 @@ lp:
                 h = ef->err_handler;
                 data = ef->err_data;
                 fd = ef->fd;
-                pthread_mutex_unlock(&event->fd_lock);
+                mln_event_unlock(event, &event->fd_lock);
                 h(event, fd, data);
-                pthread_mutex_lock(&event->fd_lock);
+                mln_event_lock(event, &event->fd_lock);
             }
             ef->active_flag &= (~M_EV_ERROR);
         }
@@ -1284,12 +1806,12 @@ lp:
 
         if (ef->is_clear) mln_event_fd_clr_set(event, ef->fd);
 
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
 
         if (event->is_break) return;
         goto lp;
     } else {
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
     }
 }
 
@@ -1307,12 +1829,30 @@ static inline void mln_event_fd_timeout_process(mln_event_t *event)
     int fd;
 
 lp:
-    if (pthread_mutex_trylock(&event->fd_lock))
+    if (mln_event_trylock(event, &event->fd_lock))
         return;
 
+    if (event->ev_fd_timeout_wheel != NULL) {
+        ed = mln_event_tw_expired(event->ev_fd_timeout_wheel, now / 1000);
+        if (ed == NULL) {
+            mln_event_unlock(event, &event->fd_lock);
+            return;
+        }
+        ef = &(ed->data.fd);
+        if (ef->in_active) {
+            ev_fd_active_chain_del(&(event->ev_fd_active_head), \
+                                   &(event->ev_fd_active_tail), \
+                                   ed);
+            ef->in_active = 0;
+        }
+        ef->in_process = 1;
+        ef->end_us = 0;
+        goto expired;
+    }
+
     fn = mln_fheap_minimum(event->ev_fd_timeout_heap);
     if (fn == NULL) {
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
         return;
     }
     ed = (mln_event_desc_t *)mln_fheap_node_key(fn);
@@ -1324,7 +1864,7 @@ lp:
         ef->in_active = 0;
     }
     if (ef->end_us > now) {
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
         return;
     }
     ef->in_process = 1;
@@ -1332,25 +1872,160 @@ lp:
     mln_fheap_node_free(event->ev_fd_timeout_heap, fn);
     ed->data.fd.timeout_node = NULL;
 
+expired:
     if (ed->data.fd.timeout_handler != NULL) {
         h = ed->data.fd.timeout_handler;
         fd = ed->data.fd.fd;
         data = ed->data.fd.timeout_data;
-        pthread_mutex_unlock(&event->fd_lock);
+        mln_event_unlock(event, &event->fd_lock);
         h(event, fd, data);
-        pthread_mutex_lock(&event->fd_lock);
+        mln_event_lock(event, &event->fd_lock);
     }
 
     ef->in_process = 0;
 
     if (ef->is_clear) mln_event_fd_clr_set(event, ef->fd);
 
-    pthread_mutex_unlock(&event->fd_lock);
+    mln_event_unlock(event, &event->fd_lock);
 
     if (event->is_break) return;
     goto lp;
 }
 
+/*
+ * timing wheel
+ *
+ * Each level has M_EV_WHEEL_SLOTS buckets, a bucket of level n covers
+ * 2^(n*M_EV_WHEEL_BITS) ticks. Descriptors are linked into buckets by
+ * tw_prev/tw_next, so arm and cancel are O(1). When the lower level wraps,
+ * the corresponding bucket of the upper level is cascaded down. Expired
+ * descriptors are moved into the pending bucket and handed out one by one.
+ */
+static mln_event_wheel_t *mln_event_tw_new(void)
+{
+    struct timeval tv;
+    mln_event_wheel_t *tw;
+
+    if ((tw = (mln_event_wheel_t *)calloc(1, sizeof(mln_event_wheel_t))) == NULL)
+        return NULL;
+    gettimeofday(&tv, NULL);
+    tw->tick = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    return tw;
+}
+
+static void mln_event_tw_free(mln_event_wheel_t *tw, int free_desc)
+{
+    mln_u32_t i;
+    mln_event_desc_t *ed;
+
+    if (tw == NULL) return;
+
+    for (i = 0; i <= M_EV_WHEEL_PENDING; ++i) {
+        while ((ed = tw->heads[i]) != NULL) {
+            ev_tw_chain_del(&(tw->heads[i]), &(tw->tails[i]), ed);
+            ed->tw_index = M_EV_WHEEL_NONE;
+            if (free_desc) mln_event_desc_free(ed);
+        }
+    }
+    free(tw);
+}
+
+static inline void mln_event_tw_insert(mln_event_wheel_t *tw, mln_event_desc_t *ed)
+{
+    mln_u32_t lv, index;
+    mln_u64_t expire, diff;
+
+    expire = ed->type == M_EV_TM? ed->data.tm.end_tm: ed->data.fd.end_us;
+    expire = (expire + 999) / 1000;
+    if (expire < tw->tick) expire = tw->tick;
+    diff = expire - tw->tick;
+
+    for (lv = 0; lv < M_EV_WHEEL_LEVELS - 1; ++lv) {
+        if (diff < ((mln_u64_t)1 << ((lv + 1) * M_EV_WHEEL_BITS)))
+            break;
+    }
+    if (diff >= ((mln_u64_t)1 << (M_EV_WHEEL_LEVELS * M_EV_WHEEL_BITS)))
+        expire = tw->tick + ((mln_u64_t)1 << (M_EV_WHEEL_LEVELS * M_EV_WHEEL_BITS)) - 1;
+
+    index = lv * M_EV_WHEEL_SLOTS + ((expire >> (lv * M_EV_WHEEL_BITS)) & M_EV_WHEEL_MASK);
+    ev_tw_chain_add(&(tw->heads[index]), &(tw->tails[index]), ed);
+    ed->tw_index = index;
+    ++(tw->nr);
+}
+
+static inline void mln_event_tw_delete(mln_event_wheel_t *tw, mln_event_desc_t *ed)
+{
+    mln_u32_t index = ed->tw_index;
+
+    ev_tw_chain_del(&(tw->heads[index]), &(tw->tails[index]), ed);
+    ed->tw_index = M_EV_WHEEL_NONE;
+    --(tw->nr);
+}
+
+static inline mln_u32_t mln_event_tw_cascade(mln_event_wheel_t *tw, mln_u32_t lv)
+{
+    mln_event_desc_t *ed;
+    mln_u32_t slot = (tw->tick >> (lv * M_EV_WHEEL_BITS)) & M_EV_WHEEL_MASK;
+    mln_u32_t index = lv * M_EV_WHEEL_SLOTS + slot;
+
+    while ((ed = tw->heads[index]) != NULL) {
+        mln_event_tw_delete(tw, ed);
+        mln_event_tw_insert(tw, ed);
+    }
+    return slot;
+}
+
+/*
+ * now is in milliseconds. Return an expired descriptor which is already
+ * removed from the wheel, or NULL if there is none.
+ */
+static inline mln_event_desc_t *mln_event_tw_expired(mln_event_wheel_t *tw, mln_u64_t now)
+{
+    mln_u32_t lv, slot;
+    mln_event_desc_t *ed;
+
+    while (tw->heads[M_EV_WHEEL_PENDING] == NULL) {
+        if (tw->tick > now) return NULL;
+        if (!tw->nr) {
+            tw->tick = now + 1;
+            return NULL;
+        }
+        slot = tw->tick & M_EV_WHEEL_MASK;
+        for (lv = 1; !slot && lv < M_EV_WHEEL_LEVELS; ++lv)
+            slot = mln_event_tw_cascade(tw, lv);
+
+        slot = tw->tick & M_EV_WHEEL_MASK;
+        while ((ed = tw->heads[slot]) != NULL) {
+            ev_tw_chain_del(&(tw->heads[slot]), &(tw->tails[slot]), ed);
+            ev_tw_chain_add(&(tw->heads[M_EV_WHEEL_PENDING]), &(tw->tails[M_EV_WHEEL_PENDING]), ed);
+            ed->tw_index = M_EV_WHEEL_PENDING;
+        }
+        ++(tw->tick);
+    }
+
+    ed = tw->heads[M_EV_WHEEL_PENDING];
+    mln_event_tw_delete(tw, ed);
+    return ed;
+}
+
+/*
+ * Return the earliest tick at which something may expire or be cascaded,
+ * 0 if the wheel is empty.
+ */
+static inline mln_u64_t mln_event_tw_next(mln_event_wheel_t *tw)
+{
+    mln_u64_t t;
+
+    if (!tw->nr) return 0;
+    if (tw->heads[M_EV_WHEEL_PENDING] != NULL) return 1;
+
+    for (t = tw->tick; ; ++t) {
+        if (!(t & M_EV_WHEEL_MASK) || tw->heads[t & M_EV_WHEEL_MASK] != NULL)
+            return t;
+    }
+    return 0;
+}
+
 /*
  * rbtree functions
  */
@@ -1412,3 +2087,8 @@ MLN_CHAIN_FUNC_DEFINE(ev_fd_active, \
                       static inline void, \
                       act_prev, \
                       act_next);
+MLN_CHAIN_FUNC_DEFINE(ev_tw, \
+                      mln_event_desc_t, \
+                      static inline void, \
+                      tw_prev, \
+                      tw_next);
@@ -8,6 +8,11 @@
 #include "mln_hash.h"
 #include <stdio.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define M_HASH_MIGRATE_NUM 16
 
 MLN_CHAIN_FUNC_DECLARE(mln_hash_entry, \
                        mln_hash_entry_t, \
@@ -17,11 +22,31 @@ mln_hash_entry_new(mln_hash_t *h, void *key, void *val) __NONNULL3(1,2,3);
 static inline void
 mln_hash_entry_free(mln_hash_t *h, mln_hash_entry_t *he, mln_hash_flag_t flg) __NONNULL1(1);
 static inline void
+mln_hash_kv_free(mln_hash_t *h, void *key, void *val, mln_hash_flag_t flg) __NONNULL1(1);
+static inline void
 mln_hash_reduce(mln_hash_t *h) __NONNULL1(1);
 static inline void
 mln_hash_expand(mln_hash_t *h) __NONNULL1(1);
 static inline void
 mln_move_hash_entry(mln_hash_t *h, mln_hash_mgr_t *old_tbl, mln_u32_t old_len) __NONNULL2(1,2);
+static inline void mln_hash_migrate(mln_hash_t *h, mln_u64_t n) __NONNULL1(1);
+static inline void mln_hash_old_free(mln_hash_t *h, mln_hash_flag_t flg) __NONNULL1(1);
+static inline mln_hash_entry_t *
+mln_hash_entry_search(mln_hash_t *h, void *key, mln_hash_mgr_t **pmgr) __NONNULL2(1,2);
+static void mln_hash_open_free(mln_hash_t *h, mln_hash_flag_t flg) __NONNULL1(1);
+static int mln_hash_open_insert(mln_hash_t *h, void *key, void *val) __NONNULL2(1,2);
+static int mln_hash_open_replace(mln_hash_t *h, void *key, void *val) __NONNULL3(1,2,3);
+static mln_hash_slot_t *
+mln_hash_open_search_slot(mln_hash_t *h, void *key, int *in_old) __NONNULL2(1,2);
+static void *mln_hash_open_search(mln_hash_t *h, void *key) __NONNULL2(1,2);
+static void *
+mln_hash_open_search_iterator(mln_hash_t *h, void *key, int **ctx) __NONNULL3(1,2,3);
+static void *
+mln_hash_open_change_value(mln_hash_t *h, void *key, void *new_value) __NONNULL2(1,2);
+static void mln_hash_open_remove(mln_hash_t *h, void *key, mln_hash_flag_t flg) __NONNULL2(1,2);
+static int
+mln_hash_open_iterate(mln_hash_t *h, hash_iterate_handler handler, void *udata) __NONNULL1(1);
+static void mln_hash_open_reset(mln_hash_t *h, mln_hash_flag_t flg) __NONNULL1(1);
 
 mln_hash_t *
 mln_hash_new(struct mln_hash_attr *attr)
@@ -57,6 +82,13 @@ mln_hash_new(struct mln_hash_attr *attr)
     h->threshold = attr->calc_prime? mln_prime_calc(h->len << 1): h->len << 1;
     h->expandable = attr->expandable;
     h->calc_prime = attr->calc_prime;
+    h->incremental = attr->incremental;
+    h->open_addr = 0;
+    h->old_tbl = NULL;
+    h->old_len = h->migrated = 0;
+    h->slots = h->old_slots = NULL;
+    h->ctrl = h->old_ctrl = NULL;
+    h->cap = h->old_cap = h->nr_deleted = 0;
     if (h->len == 0 || \
         h->hash == NULL || \
         h->cmp == NULL)
@@ -78,6 +110,11 @@ mln_hash_free(mln_hash_t *h, mln_hash_flag_t flg)
 {
     mln_hash_entry_t *he, *fr;
     mln_hash_mgr_t *mgr, *mgr_end = h->tbl + h->len;
+    if (h->open_addr) {
+        mln_hash_open_free(h, flg);
+        return;
+    }
+    mln_hash_old_free(h, flg);
     for (mgr = h->tbl; mgr < mgr_end; ++mgr) {
         he = mgr->head;
         while (he != NULL) {
@@ -94,14 +131,10 @@ mln_hash_free(mln_hash_t *h, mln_hash_flag_t flg)
 
 int mln_hash_replace(mln_hash_t *h, void *key, void *val)
 {
+    if (h->open_addr) return mln_hash_open_replace(h, key, val);
     void **k = (void **)key;
     void **v = (void **)val;
-    mln_u32_t index = h->hash(h, *k);
-    mln_hash_mgr_t *mgr = &(h->tbl[index]);
-    mln_hash_entry_t *he;
-    for (he = mgr->head; he != NULL; he = he->next) {
-        if (h->cmp(h, *k, he->key)) break;
-    }
+    mln_hash_entry_t *he = mln_hash_entry_search(h, *k, NULL);
     if (he != NULL) {
         void *save_key = he->key;
         void *save_val = he->val;
@@ -112,26 +145,19 @@ int mln_hash_replace(mln_hash_t *h, void *key, void *val)
         return 0;
     }
 
-    if (h->expandable && h->nr_nodes > h->threshold) {
-        mln_hash_expand(h);
-    }
-    if (h->expandable && h->nr_nodes <= (h->threshold >> 3)) {
-        mln_hash_reduce(h);
-    }
-    he = mln_hash_entry_new(h, *k, *v);
-    if (he == NULL) return -1;
-    mln_hash_entry_chain_add(&(mgr->head), &(mgr->tail), he);
-    ++(h->nr_nodes);
+    if (mln_hash_insert(h, *k, *v) < 0) return -1;
     *k = *v = NULL;
     return 0;
 }
 
 int mln_hash_insert(mln_hash_t *h, void *key, void *val)
 {
-    if (h->expandable && h->nr_nodes > h->threshold) {
+    if (h->open_addr) return mln_hash_open_insert(h, key, val);
+    if (h->old_tbl != NULL) {
+        mln_hash_migrate(h, M_HASH_MIGRATE_NUM);
+    } else if (h->expandable && h->nr_nodes > h->threshold) {
         mln_hash_expand(h);
-    }
-    if (h->expandable && h->nr_nodes <= (h->threshold >> 3)) {
+    } else if (h->expandable && h->nr_nodes <= (h->threshold >> 3)) {
         mln_hash_reduce(h);
     }
     mln_u32_t index = h->hash(h, key);
@@ -161,6 +187,12 @@ static inline void mln_hash_reduce(mln_hash_t *h)
         return;
     }
     h->threshold = h->calc_prime? mln_prime_calc(h->threshold >> 1): h->threshold >> 1;
+    if (h->incremental) {
+        h->old_tbl = old_tbl;
+        h->old_len = len;
+        h->migrated = 0;
+        return;
+    }
     mln_move_hash_entry(h, old_tbl, len);
     if (h->pool != NULL) h->pool_free(old_tbl);
     else free(old_tbl);
@@ -169,8 +201,9 @@ static inline void mln_hash_reduce(mln_hash_t *h)
 static inline void mln_hash_expand(mln_hash_t *h)
 {
     mln_hash_mgr_t *old_tbl = h->tbl;
-    mln_u32_t len = h->len;
+    mln_u32_t len = h->len, threshold;
     h->len = h->calc_prime? mln_prime_calc(len + (len >> 1)): (len + (len >> 1));
+    if (h->len <= len) h->len = len + 1;
     if (h->pool != NULL) {
         h->tbl = (mln_hash_mgr_t *)h->pool_alloc(h->pool, h->len*sizeof(mln_hash_mgr_t));
         memset(h->tbl, 0, h->len*sizeof(mln_hash_mgr_t));
@@ -182,8 +215,16 @@ static inline void mln_hash_expand(mln_hash_t *h)
         h->len = len;
         return;
     }
+    threshold = h->threshold;
     h->threshold = h->calc_prime? mln_prime_calc(h->threshold + (h->threshold >> 1)): \
                                   (h->threshold + (h->threshold >> 1));
+    if (h->threshold <= threshold) h->threshold = h->len << 1;
+    if (h->incremental) {
+        h->old_tbl = old_tbl;
+        h->old_len = len;
+        h->migrated = 0;
+        return;
+    }
     mln_move_hash_entry(h, old_tbl, len);
     if (h->pool != NULL) h->pool_free(old_tbl);
     else free(old_tbl);
@@ -207,14 +248,84 @@ mln_move_hash_entry(mln_hash_t *h, mln_hash_mgr_t *old_tbl, mln_u32_t old_len)
     }
 }
 
-void *mln_hash_change_value(mln_hash_t *h, void *key, void *new_value)
+/*
+ * Incremental resize: move up to n buckets of the old table into the
+ * current one, and release the old table once all buckets are moved.
+ */
+static inline void mln_hash_migrate(mln_hash_t *h, mln_u64_t n)
 {
-    mln_u32_t index = h->hash(h, key);
+    mln_u64_t end;
+
+    if (h->old_tbl == NULL) return;
+    end = h->migrated + n;
+    if (end > h->old_len) end = h->old_len;
+    mln_move_hash_entry(h, h->old_tbl + h->migrated, end - h->migrated);
+    h->migrated = end;
+
+    if (h->migrated >= h->old_len) {
+        if (h->pool != NULL) h->pool_free(h->old_tbl);
+        else free(h->old_tbl);
+        h->old_tbl = NULL;
+        h->old_len = h->migrated = 0;
+    }
+}
+
+static inline void mln_hash_old_free(mln_hash_t *h, mln_hash_flag_t flg)
+{
+    mln_hash_entry_t *he;
+    mln_hash_mgr_t *mgr, *end;
+
+    if (h->old_tbl == NULL) return;
+    end = h->old_tbl + h->old_len;
+    for (mgr = h->old_tbl + h->migrated; mgr < end; ++mgr) {
+        while ((he = mgr->head) != NULL) {
+            mln_hash_entry_chain_del(&(mgr->head), &(mgr->tail), he);
+            mln_hash_entry_free(h, he, flg);
+        }
+    }
+    if (h->pool != NULL) h->pool_free(h->old_tbl);
+    else free(h->old_tbl);
+    h->old_tbl = NULL;
+    h->old_len = h->migrated = 0;
+}
+
+/*
+ * Look the key up in the current buckets and, during an incremental resize,
+ * in the old bucket it would belong to if that one has not been moved yet.
+ * The hash callback works on h->len, so it is evaluated with the old length.
+ */
+static inline mln_hash_entry_t *
+mln_hash_entry_search(mln_hash_t *h, void *key, mln_hash_mgr_t **pmgr)
+{
+    mln_u64_t index = h->hash(h, key), len;
     mln_hash_mgr_t *mgr = &(h->tbl[index]);
     mln_hash_entry_t *he;
+
     for (he = mgr->head; he != NULL; he = he->next) {
-        if (h->cmp(h, key, he->key)) break;
+        if (h->cmp(h, key, he->key)) goto found;
     }
+    if (h->old_tbl == NULL) return NULL;
+
+    len = h->len;
+    h->len = h->old_len;
+    index = h->hash(h, key);
+    h->len = len;
+    if (index < h->migrated) return NULL;
+    mgr = &(h->old_tbl[index]);
+    for (he = mgr->head; he != NULL; he = he->next) {
+        if (h->cmp(h, key, he->key)) goto found;
+    }
+    return NULL;
+
+found:
+    if (pmgr != NULL) *pmgr = mgr;
+    return he;
+}
+
+void *mln_hash_change_value(mln_hash_t *h, void *key, void *new_value)
+{
+    if (h->open_addr) return mln_hash_open_change_value(h, key, new_value);
+    mln_hash_entry_t *he = mln_hash_entry_search(h, key, NULL);
     if (he == NULL) return NULL;
     mln_u8ptr_t retval = (mln_u8ptr_t)(he->val);
     he->val = new_value;
@@ -223,18 +334,19 @@ void *mln_hash_change_value(mln_hash_t *h, void *key, void *new_value)
 
 void *mln_hash_search(mln_hash_t *h, void *key)
 {
-    mln_u32_t index = h->hash(h, key);
-    mln_hash_mgr_t *mgr = &(h->tbl[index]);
-    mln_hash_entry_t *he;
-    for (he = mgr->head; he != NULL; he = he->next) {
-        if (h->cmp(h, key, he->key)) break;
-    }
+    if (h->open_addr) return mln_hash_open_search(h, key);
+    mln_hash_entry_t *he = mln_hash_entry_search(h, key, NULL);
     if (he == NULL) return NULL;
     return he->val;
 }
 
 void *mln_hash_search_iterator(mln_hash_t *h, void *key, int **ctx)
 {
+    if (h->open_addr) return mln_hash_open_search_iterator(h, key, ctx);
+    /*
+     * ctx points into a bucket list, finish a pending resize to keep it valid.
+     */
+    if (h->old_tbl != NULL) mln_hash_migrate(h, h->old_len);
     if (*ctx != NULL) {
         mln_hash_entry_t *he = *((mln_hash_entry_t **)ctx);
         for (; he != NULL; he = he->next) {
@@ -260,16 +372,17 @@ void *mln_hash_search_iterator(mln_hash_t *h, void *key, int **ctx)
 
 void mln_hash_remove(mln_hash_t *h, void *key, mln_hash_flag_t flg)
 {
-    mln_u32_t index = h->hash(h, key);
-    mln_hash_mgr_t *mgr = &(h->tbl[index]);
-    mln_hash_entry_t *he;
-    for (he = mgr->head; he != NULL; he = he->next) {
-        if (h->cmp(h, key, he->key)) break;
+    if (h->open_addr) {
+        mln_hash_open_remove(h, key, flg);
+        return;
     }
+    mln_hash_mgr_t *mgr;
+    mln_hash_entry_t *he = mln_hash_entry_search(h, key, &mgr);
     if (he == NULL) return;
     mln_hash_entry_chain_del(&(mgr->head), &(mgr->tail), he);
     --(h->nr_nodes);
     mln_hash_entry_free(h, he, flg);
+    mln_hash_migrate(h, M_HASH_MIGRATE_NUM);
 }
 
 static inline mln_hash_entry_t *
@@ -292,29 +405,36 @@ static inline void
 mln_hash_entry_free(mln_hash_t *h, mln_hash_entry_t *he, mln_hash_flag_t flg)
 {
     if (he == NULL) return;
+    mln_hash_kv_free(h, he->key, he->val, flg);
+    if (h->pool != NULL) h->pool_free(he);
+    else free(he);
+}
+
+static inline void
+mln_hash_kv_free(mln_hash_t *h, void *key, void *val, mln_hash_flag_t flg)
+{
     switch (flg) {
         case M_HASH_F_VAL:
             if (h->free_val != NULL)
-                h->free_val(he->val);
+                h->free_val(val);
             break;
         case M_HASH_F_KEY:
             if (h->free_key != NULL)
-                h->free_key(he->key);
+                h->free_key(key);
             break;
         case M_HASH_F_KV:
             if (h->free_val != NULL)
-                h->free_val(he->val);
+                h->free_val(val);
             if (h->free_key != NULL)
-                h->free_key(he->key);
+                h->free_key(key);
             break;
         default: break;
     }
-    if (h->pool != NULL) h->pool_free(he);
-    else free(he);
 }
 
 int mln_hash_iterate(mln_hash_t *h, hash_iterate_handler handler, void *udata)
 {
+    if (h->open_addr) return mln_hash_open_iterate(h, handler, udata);
     mln_hash_mgr_t *mgr, *end;
     mgr = h->tbl;
     end = h->tbl + h->len;
@@ -325,22 +445,31 @@ int mln_hash_iterate(mln_hash_t *h, hash_iterate_handler handler, void *udata)
                 return -1;
         }
     }
+    if (h->old_tbl == NULL) return 0;
+    mgr = h->old_tbl + h->migrated;
+    end = h->old_tbl + h->old_len;
+    for (; mgr < end; ++mgr) {
+        for (he = mgr->head; he != NULL; he = he->next) {
+            if (handler != NULL && handler(he->key, he->val, udata) < 0)
+                return -1;
+        }
+    }
     return 0;
 }
 
 int mln_hash_key_exist(mln_hash_t *h, void *key)
 {
-    mln_u32_t index = h->hash(h, key);
-    mln_hash_mgr_t *mgr = &(h->tbl[index]);
-    mln_hash_entry_t *he;
-    for (he = mgr->head; he != NULL; he = he->next) {
-        if (h->cmp(h, key, he->key)) return 1;
-    }
-    return 0;
+    if (h->open_addr) return mln_hash_open_search_slot(h, key, NULL) != NULL;
+    return mln_hash_entry_search(h, key, NULL) != NULL;
 }
 
 void mln_hash_reset(mln_hash_t *h, mln_hash_flag_t flg)
 {
+    if (h->open_addr) {
+        mln_hash_open_reset(h, flg);
+        return;
+    }
+    mln_hash_old_free(h, flg);
     mln_hash_mgr_t *mgr, *end;
     mgr = h->tbl;
     end = h->tbl + h->len;
@@ -355,6 +484,444 @@ void mln_hash_reset(mln_hash_t *h, mln_hash_flag_t flg)
     h->nr_nodes = 0;
 }
 
+/*
+ * open addressing
+ *
+ * Slots are kept in one flat array next to a control byte array.
+ * A control byte is either EMPTY, DELETED (tombstone) or the low
+ * 7 bits of the slot's hash, so a lookup compares a whole group of
+ * 16 control bytes at once and only touches the slots whose tag matches.
+ * Groups are probed triangularly, which visits every group once
+ * because the number of groups is a power of 2.
+ *
+ * Growing does not move all slots at once: the old table is kept and
+ * each insert or remove migrates M_HASH_OPEN_MIGRATE_NUM of its slots,
+ * lookups fall back to the old table until migration is done.
+ */
+#define M_HASH_OPEN_GROUP       16
+#define M_HASH_OPEN_MIGRATE_NUM 64
+#define M_HASH_OPEN_EMPTY       ((mln_u8_t)0x80)
+#define M_HASH_OPEN_DELETED     ((mln_u8_t)0xfe)
+#define mln_hash_open_is_full(c) (!((c) & 0x80))
+#define mln_hash_open_tag(hv)    ((mln_u8_t)((hv) & 0x7f))
+#define mln_hash_open_max_load(cap) ((cap) - ((cap) >> 3))
+
+#if defined(__GNUC__)
+#define mln_hash_open_ctz(m) __builtin_ctz(m)
+#else
+static inline int mln_hash_open_ctz(mln_u32_t m)
+{
+    int n = 0;
+    for (; !(m & 1); m >>= 1) ++n;
+    return n;
+}
+#endif
+
+/*
+ * bitmask of the bytes of a group equal to c.
+ */
+static inline mln_u32_t mln_hash_open_match(mln_u8ptr_t ctrl, mln_u8_t c)
+{
+#if defined(__SSE2__)
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (mln_u32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+#else
+    mln_u32_t i, m = 0;
+    for (i = 0; i < M_HASH_OPEN_GROUP; ++i) {
+        if (ctrl[i] == c) m |= (1U << i);
+    }
+    return m;
+#endif
+}
+
+/*
+ * bitmask of the bytes of a group that are EMPTY or DELETED.
+ */
+static inline mln_u32_t mln_hash_open_match_free(mln_u8ptr_t ctrl)
+{
+#if defined(__SSE2__)
+    return (mln_u32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    mln_u32_t i, m = 0;
+    for (i = 0; i < M_HASH_OPEN_GROUP; ++i) {
+        if (ctrl[i] & 0x80) m |= (1U << i);
+    }
+    return m;
+#endif
+}
+
+/*
+ * user callbacks are often weak (e.g. sum of bytes),
+ * mix them so that both the tag and the group index are usable.
+ */
+static inline mln_u64_t mln_hash_open_hash(mln_hash_t *h, void *key)
+{
+    mln_u64_t x = h->hash(h, key);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline int
+mln_hash_open_table_new(mln_hash_t *h, mln_u64_t cap, mln_hash_slot_t **slots, mln_u8ptr_t *ctrl)
+{
+    mln_u8ptr_t p;
+    mln_size_t size = cap * sizeof(mln_hash_slot_t) + cap;
+
+    if (h->pool != NULL) p = (mln_u8ptr_t)h->pool_alloc(h->pool, size);
+    else p = (mln_u8ptr_t)malloc(size);
+    if (p == NULL) return -1;
+
+    *slots = (mln_hash_slot_t *)p;
+    *ctrl = p + cap * sizeof(mln_hash_slot_t);
+    memset(*ctrl, M_HASH_OPEN_EMPTY, cap);
+    return 0;
+}
+
+static inline void mln_hash_open_table_free(mln_hash_t *h, mln_hash_slot_t *slots)
+{
+    if (slots == NULL) return;
+    if (h->pool != NULL) h->pool_free(slots);
+    else free(slots);
+}
+
+/*
+ * Return the index of the first slot matching key, or -1.
+ * If after is not negative, the probe resumes behind slot 'after'
+ * which must have been returned by a former call with the same key.
+ */
+static inline mln_s64_t
+mln_hash_open_find(mln_hash_t *h, mln_hash_slot_t *slots, mln_u8ptr_t ctrl, mln_u64_t cap, void *key, mln_u64_t hv, mln_s64_t after)
+{
+    mln_u64_t gmask = cap / M_HASH_OPEN_GROUP - 1, g = (hv >> 7) & gmask, i, base;
+    mln_u8_t tag = mln_hash_open_tag(hv);
+    mln_hash_slot_t *s;
+    mln_u32_t m;
+
+    for (i = 1; i <= gmask + 1; ++i) {
+        base = g * M_HASH_OPEN_GROUP;
+        m = mln_hash_open_match(ctrl + base, tag);
+        if (after >= 0) {
+            if ((mln_u64_t)after < base || (mln_u64_t)after >= base + M_HASH_OPEN_GROUP) {
+                m = 0;
+            } else {
+                m &= ~((2U << ((mln_u64_t)after - base)) - 1);
+                after = -1;
+            }
+        }
+        for (; m; m &= m - 1) {
+            s = slots + base + mln_hash_open_ctz(m);
+            if (s->hash == hv && h->cmp(h, key, s->key)) return s - slots;
+        }
+        if (mln_hash_open_match(ctrl + base, M_HASH_OPEN_EMPTY)) break;
+        g = (g + i) & gmask;
+    }
+    return -1;
+}
+
+/*
+ * Return the index of the first EMPTY or DELETED slot on hv's probe sequence, or -1.
+ */
+static inline mln_s64_t mln_hash_open_find_free(mln_u8ptr_t ctrl, mln_u64_t cap, mln_u64_t hv)
+{
+    mln_u64_t gmask = cap / M_HASH_OPEN_GROUP - 1, g = (hv >> 7) & gmask, i, base;
+    mln_u32_t m;
+
+    for (i = 1; i <= gmask + 1; ++i) {
+        base = g * M_HASH_OPEN_GROUP;
+        if ((m = mln_hash_open_match_free(ctrl + base)) != 0)
+            return base + mln_hash_open_ctz(m);
+        g = (g + i) & gmask;
+    }
+    return -1;
+}
+
+static inline int mln_hash_open_put(mln_hash_t *h, void *key, void *val, mln_u64_t hv)
+{
+    mln_hash_slot_t *s;
+    mln_s64_t i = mln_hash_open_find_free(h->ctrl, h->cap, hv);
+    if (i < 0) return -1;
+
+    if (h->ctrl[i] == M_HASH_OPEN_DELETED) --(h->nr_deleted);
+    h->ctrl[i] = mln_hash_open_tag(hv);
+    s = &(h->slots[i]);
+    s->key = key;
+    s->val = val;
+    s->hash = hv;
+    return 0;
+}
+
+/*
+ * Free the slot. If its group still has an EMPTY byte, no probe sequence
+ * ever went through this group, so the slot can become EMPTY again.
+ */
+static inline void mln_hash_open_erase(mln_u8ptr_t ctrl, mln_u64_t i, mln_u64_t *nr_deleted)
+{
+    mln_u8ptr_t group = ctrl + (i & ~((mln_u64_t)M_HASH_OPEN_GROUP - 1));
+    if (mln_hash_open_match(group, M_HASH_OPEN_EMPTY)) {
+        ctrl[i] = M_HASH_OPEN_EMPTY;
+    } else {
+        ctrl[i] = M_HASH_OPEN_DELETED;
+        if (nr_deleted != NULL) ++(*nr_deleted);
+    }
+}
+
+static inline void mln_hash_open_migrate(mln_hash_t *h, mln_u64_t n)
+{
+    mln_hash_slot_t *s;
+    mln_u64_t end = h->migrated + n;
+
+    if (h->old_slots == NULL) return;
+    if (end > h->old_cap) end = h->old_cap;
+
+    for (; h->migrated < end; ++(h->migrated)) {
+        if (!mln_hash_open_is_full(h->old_ctrl[h->migrated])) continue;
+        s = &(h->old_slots[h->migrated]);
+        /*
+         * never fails, the new table is at least as large as the live set.
+         * The old slot becomes a tombstone to keep the old probe sequences intact.
+         */
+        (void)mln_hash_open_put(h, s->key, s->val, s->hash);
+        h->old_ctrl[h->migrated] = M_HASH_OPEN_DELETED;
+    }
+
+    if (h->migrated >= h->old_cap) {
+        mln_hash_open_table_free(h, h->old_slots);
+        h->old_slots = NULL;
+        h->old_ctrl = NULL;
+        h->old_cap = h->migrated = 0;
+    }
+}
+
+/*
+ * Start a resize. Doubles the table, or rebuilds it at the same size
+ * if most of the used slots are tombstones.
+ */
+static inline int mln_hash_open_resize(mln_hash_t *h)
+{
+    mln_hash_slot_t *slots;
+    mln_u8ptr_t ctrl;
+    mln_u64_t cap = h->cap;
+
+    if (h->old_slots != NULL) {
+        mln_hash_open_migrate(h, h->old_cap);
+        if (h->nr_nodes + h->nr_deleted < h->threshold) return 0;
+    }
+    if (h->nr_nodes + 1 > (h->threshold >> 1)) cap <<= 1;
+    if (mln_hash_open_table_new(h, cap, &slots, &ctrl) < 0) return -1;
+
+    h->old_slots = h->slots;
+    h->old_ctrl = h->ctrl;
+    h->old_cap = h->cap;
+    h->migrated = 0;
+    h->slots = slots;
+    h->ctrl = ctrl;
+    h->cap = cap;
+    h->nr_deleted = 0;
+    h->threshold = mln_hash_open_max_load(cap);
+    return 0;
+}
+
+mln_hash_t *
+mln_hash_open_new(struct mln_hash_attr *attr)
+{
+    mln_hash_t *h;
+    mln_u64_t cap = M_HASH_OPEN_GROUP;
+
+    if (attr->hash == NULL || attr->cmp == NULL) return NULL;
+
+    if (attr->pool != NULL) {
+        h = (mln_hash_t *)attr->pool_alloc(attr->pool, sizeof(mln_hash_t));
+    } else {
+        h = (mln_hash_t *)malloc(sizeof(mln_hash_t));
+    }
+    if (h == NULL) return NULL;
+
+    h->pool = attr->pool;
+    h->pool_alloc = attr->pool_alloc;
+    h->pool_free = attr->pool_free;
+    h->hash = attr->hash;
+    h->cmp = attr->cmp;
+    h->free_key = attr->free_key;
+    h->free_val = attr->free_val;
+    h->tbl = NULL;
+    h->len = M_HASH_OPEN_RANGE;
+    h->nr_nodes = 0;
+    h->expandable = 1;
+    h->calc_prime = 0;
+    h->incremental = 0;
+    h->open_addr = 1;
+    h->old_tbl = NULL;
+    h->old_len = 0;
+    while (mln_hash_open_max_load(cap) < attr->len_base) cap <<= 1;
+    if (mln_hash_open_table_new(h, cap, &(h->slots), &(h->ctrl)) < 0) {
+        if (h->pool != NULL) h->pool_free(h);
+        else free(h);
+        return NULL;
+    }
+    h->cap = cap;
+    h->threshold = mln_hash_open_max_load(cap);
+    h->nr_deleted = 0;
+    h->old_slots = NULL;
+    h->old_ctrl = NULL;
+    h->old_cap = h->migrated = 0;
+    return h;
+}
+
+static void mln_hash_open_free(mln_hash_t *h, mln_hash_flag_t flg)
+{
+    mln_hash_open_reset(h, flg);
+    mln_hash_open_table_free(h, h->slots);
+    if (h->pool != NULL) h->pool_free(h);
+    else free(h);
+}
+
+static int mln_hash_open_insert(mln_hash_t *h, void *key, void *val)
+{
+    mln_u64_t hv = mln_hash_open_hash(h, key);
+
+    mln_hash_open_migrate(h, M_HASH_OPEN_MIGRATE_NUM);
+    if (h->nr_nodes + h->nr_deleted >= h->threshold) {
+        /*
+         * a failed resize is not fatal while there is still a free slot.
+         */
+        (void)mln_hash_open_resize(h);
+    }
+    if (mln_hash_open_put(h, key, val, hv) < 0) return -1;
+    ++(h->nr_nodes);
+    return 0;
+}
+
+static mln_hash_slot_t *mln_hash_open_search_slot(mln_hash_t *h, void *key, int *in_old)
+{
+    mln_u64_t hv = mln_hash_open_hash(h, key);
+    mln_s64_t i;
+
+    if ((i = mln_hash_open_find(h, h->slots, h->ctrl, h->cap, key, hv, -1)) >= 0) {
+        if (in_old != NULL) *in_old = 0;
+        return &(h->slots[i]);
+    }
+    if (h->old_slots != NULL && \
+        (i = mln_hash_open_find(h, h->old_slots, h->old_ctrl, h->old_cap, key, hv, -1)) >= 0)
+    {
+        if (in_old != NULL) *in_old = 1;
+        return &(h->old_slots[i]);
+    }
+    return NULL;
+}
+
+static int mln_hash_open_replace(mln_hash_t *h, void *key, void *val)
+{
+    void **k = (void **)key;
+    void **v = (void **)val;
+    mln_hash_slot_t *s = mln_hash_open_search_slot(h, *k, NULL);
+
+    if (s != NULL) {
+        void *save_key = s->key;
+        void *save_val = s->val;
+        s->key = *k;
+        s->val = *v;
+        *k = save_key;
+        *v = save_val;
+        return 0;
+    }
+    if (mln_hash_open_insert(h, *k, *v) < 0) return -1;
+    *k = *v = NULL;
+    return 0;
+}
+
+static void *mln_hash_open_search(mln_hash_t *h, void *key)
+{
+    mln_hash_slot_t *s = mln_hash_open_search_slot(h, key, NULL);
+    return s == NULL? NULL: s->val;
+}
+
+/*
+ * ctx holds the index of the last returned slot plus 1.
+ * A pending resize is completed first, so that the index stays valid.
+ */
+static void *mln_hash_open_search_iterator(mln_hash_t *h, void *key, int **ctx)
+{
+    mln_s64_t i = (mln_s64_t)((mln_uptr_t)(*ctx)) - 1;
+
+    if (h->old_slots != NULL) mln_hash_open_migrate(h, h->old_cap);
+
+    i = mln_hash_open_find(h, h->slots, h->ctrl, h->cap, key, mln_hash_open_hash(h, key), i);
+    if (i < 0) {
+        *ctx = NULL;
+        return NULL;
+    }
+    *ctx = (int *)((mln_uptr_t)(i + 1));
+    return h->slots[i].val;
+}
+
+static void *mln_hash_open_change_value(mln_hash_t *h, void *key, void *new_value)
+{
+    void *retval;
+    mln_hash_slot_t *s = mln_hash_open_search_slot(h, key, NULL);
+
+    if (s == NULL) return NULL;
+    retval = s->val;
+    s->val = new_value;
+    return retval;
+}
+
+static void mln_hash_open_remove(mln_hash_t *h, void *key, mln_hash_flag_t flg)
+{
+    int in_old;
+    mln_hash_slot_t *s = mln_hash_open_search_slot(h, key, &in_old);
+
+    if (s == NULL) return;
+    mln_hash_kv_free(h, s->key, s->val, flg);
+    if (in_old) mln_hash_open_erase(h->old_ctrl, s - h->old_slots, NULL);
+    else mln_hash_open_erase(h->ctrl, s - h->slots, &(h->nr_deleted));
+    --(h->nr_nodes);
+    mln_hash_open_migrate(h, M_HASH_OPEN_MIGRATE_NUM);
+}
+
+static int mln_hash_open_iterate(mln_hash_t *h, hash_iterate_handler handler, void *udata)
+{
+    mln_u64_t i;
+
+    if (handler == NULL) return 0;
+    for (i = 0; i < h->cap; ++i) {
+        if (!mln_hash_open_is_full(h->ctrl[i])) continue;
+        if (handler(h->slots[i].key, h->slots[i].val, udata) < 0) return -1;
+    }
+    if (h->old_slots == NULL) return 0;
+    for (i = h->migrated; i < h->old_cap; ++i) {
+        if (!mln_hash_open_is_full(h->old_ctrl[i])) continue;
+        if (handler(h->old_slots[i].key, h->old_slots[i].val, udata) < 0) return -1;
+    }
+    return 0;
+}
+
+static void mln_hash_open_reset(mln_hash_t *h, mln_hash_flag_t flg)
+{
+    mln_u64_t i;
+
+    if (flg != M_HASH_F_NONE) {
+        for (i = 0; i < h->cap; ++i) {
+            if (mln_hash_open_is_full(h->ctrl[i]))
+                mln_hash_kv_free(h, h->slots[i].key, h->slots[i].val, flg);
+        }
+        for (i = h->migrated; i < h->old_cap; ++i) {
+            if (mln_hash_open_is_full(h->old_ctrl[i]))
+                mln_hash_kv_free(h, h->old_slots[i].key, h->old_slots[i].val, flg);
+        }
+    }
+    mln_hash_open_table_free(h, h->old_slots);
+    h->old_slots = NULL;
+    h->old_ctrl = NULL;
+    h->old_cap = h->migrated = 0;
+    memset(h->ctrl, M_HASH_OPEN_EMPTY, h->cap);
+    h->nr_nodes = 0;
+    h->nr_deleted = 0;
+}
+
 MLN_CHAIN_FUNC_DEFINE(mln_hash_entry, \
                       mln_hash_entry_t, \
                       static inline void, \
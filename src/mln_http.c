@@ -6,8 +6,13 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
 #include "mln_types.h"
 #include "mln_http.h"
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__wasm__)
+#include <immintrin.h>
+#define MLN_HTTP_SIMD
+#endif
 
 
 struct mln_http_chain_s {
@@ -16,12 +21,15 @@ struct mln_http_chain_s {
     mln_chain_t *tail;
     mln_u8ptr_t  pos;
     mln_size_t   left_size;
+    mln_u32_t    skip;/*M_HTTP_TEMPLATE_* fields not to be written*/
 };
 
-static inline int mln_http_line_length(mln_http_t *http, mln_chain_t *in, mln_size_t *len);
-static inline int mln_http_process_line(mln_http_t *http, mln_chain_t **in, mln_size_t len);
-static inline int mln_http_parse_headline(mln_http_t *http, mln_u8ptr_t buf, mln_size_t len);
-static inline int mln_http_parse_field(mln_http_t *http, mln_u8ptr_t buf, mln_size_t len);
+static inline int
+mln_http_line_length(mln_http_t *http, mln_chain_t *in, mln_chain_t **lc, mln_u8ptr_t *lf, mln_size_t *len);
+static inline int
+mln_http_process_line(mln_http_t *http, mln_chain_t **in, mln_chain_t *lc, mln_u8ptr_t lf, mln_size_t len);
+static inline int mln_http_parse_headline(mln_http_t *http, mln_buf_t *b, mln_u8ptr_t buf, mln_size_t len);
+static inline int mln_http_parse_field(mln_http_t *http, mln_buf_t *b, mln_u8ptr_t buf, mln_size_t len);
 static void mln_http_hash_free(void *data);
 static mln_u64_t mln_http_hash_calc(mln_hash_t *h, void *key);
 static int mln_http_hash_cmp(mln_hash_t *h, void *key1, void *key2);
@@ -41,6 +49,8 @@ static inline int
 mln_http_generate_write(struct mln_http_chain_s *hc, void *buf, mln_size_t size);
 static inline int
 mln_http_generate_set_last_in_chain(struct mln_http_chain_s *hc);
+static inline int
+mln_http_generate_head(struct mln_http_chain_s *hc);
 
 mln_string_t http_version[] = {
     mln_string("HTTP/1.0"),
@@ -118,19 +128,106 @@ mln_http_map_t mln_http_status[] = {
 };
 
 
+#if defined(MLN_HTTP_SIMD)
+static mln_u8ptr_t mln_http_scan_lf_sse2(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+    mln_u32_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        mask = (mln_u32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), lf));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    for (; p < end && *p != (mln_u8_t)'\n'; ++p)
+        ;
+    return p;
+}
+
+__attribute__((target("avx2")))
+static mln_u8ptr_t mln_http_scan_lf_avx2(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+    mln_u32_t mask;
+
+    for (; end - p >= 32; p += 32) {
+        mask = (mln_u32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), lf));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return mln_http_scan_lf_sse2(p, end);
+}
+
+/*
+ * Field names are short, one 16-byte block usually covers the name and the colon.
+ */
+static inline mln_u8ptr_t mln_http_scan_name(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    const __m128i colon = _mm_set1_epi8(':'), sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    __m128i v;
+    mln_u32_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        mask = (mln_u32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, colon), \
+                                            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab))));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    for (; p < end; ++p) {
+        if (*p == (mln_u8_t)' ' || *p == (mln_u8_t)'\t' || *p == (mln_u8_t)':')
+            break;
+    }
+    return p;
+}
+#else
+static mln_u8ptr_t mln_http_scan_lf_scalar(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    mln_u8ptr_t lf = (mln_u8ptr_t)memchr(p, '\n', end - p);
+    return lf == NULL? end: lf;
+}
+
+static inline mln_u8ptr_t mln_http_scan_name(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    for (; p < end; ++p) {
+        if (*p == (mln_u8_t)' ' || *p == (mln_u8_t)'\t' || *p == (mln_u8_t)':')
+            break;
+    }
+    return p;
+}
+#endif
+
+static mln_u8ptr_t mln_http_scan_lf_init(mln_u8ptr_t p, mln_u8ptr_t end);
+static mln_u8ptr_t (*mln_http_scan_lf)(mln_u8ptr_t, mln_u8ptr_t) = mln_http_scan_lf_init;
+
+static mln_u8ptr_t mln_http_scan_lf_init(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+#if defined(MLN_HTTP_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        mln_http_scan_lf = mln_http_scan_lf_avx2;
+    } else {
+        mln_http_scan_lf = mln_http_scan_lf_sse2;
+    }
+#else
+    mln_http_scan_lf = mln_http_scan_lf_scalar;
+#endif
+    return mln_http_scan_lf(p, end);
+}
+
+
 int mln_http_parse(mln_http_t *http, mln_chain_t **in)
 {
     if (http == NULL) return M_HTTP_RET_ERROR;
 
-    int ret = M_HTTP_RET_DONE, rc;
+    int ret = M_HTTP_RET_DONE;
     mln_size_t len = 0;
+    mln_chain_t *lc = NULL;
+    mln_u8ptr_t lf = NULL;
     mln_http_handler handler = mln_http_get_handler(http);
 
     while (!mln_http_get_Done(http) && \
-           (ret = mln_http_line_length(http, *in, &len)) == M_HTTP_RET_DONE)
+           (ret = mln_http_line_length(http, *in, &lc, &lf, &len)) == M_HTTP_RET_DONE)
     {
-        if ((rc = mln_http_process_line(http, in, len) == M_HTTP_RET_ERROR))
-            return rc;
+        if (mln_http_process_line(http, in, lc, lf, len) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
     }
     if (ret == M_HTTP_RET_OK || ret == M_HTTP_RET_ERROR) return ret;
 
@@ -141,99 +238,173 @@ int mln_http_parse(mln_http_t *http, mln_chain_t **in)
     return ret;
 }
 
-static inline int mln_http_line_length(mln_http_t *http, mln_chain_t *in, mln_size_t *len)
+/*
+ * The bytes of a pending line which have been scanned in the previous calls
+ * are skipped, so a header arriving in many small pieces is scanned only once.
+ */
+static inline int
+mln_http_line_length(mln_http_t *http, mln_chain_t *in, mln_chain_t **lc, mln_u8ptr_t *lf, mln_size_t *len)
 {
     mln_buf_t *b;
     mln_u8ptr_t p, end;
-    mln_size_t length = 0;
+    mln_size_t size, skip = http->scanned, length = 0;
 
-    while (in != NULL) {
+    for (; in != NULL; in = in->next) {
         b = in->buf;
-        if (b == NULL || b->in_file || mln_buf_left_size(b) <= 0) {
-            in = in->next;
+        if (b == NULL || b->in_file || (size = mln_buf_left_size(b)) <= 0)
             continue;
-        }
-        for (p = b->left_pos, end = b->last; p < end; ++p) {
-            if (*p == (mln_u8_t)'\n') break;
-            ++length;
-        }
-        if (p >= end) {
-            in = in->next;
+        if (skip >= size) {
+            skip -= size;
+            length += size;
             continue;
         }
-        break;
+        end = b->last;
+        p = mln_http_scan_lf(b->left_pos + skip, end);
+        skip = 0;
+        if (p < end) {
+            length += p - b->left_pos;
+            break;
+        }
+        length += size;
+    }
+    if (in == NULL) {
+        http->scanned = length;
+        return M_HTTP_RET_OK;
     }
-    if (in == NULL) return M_HTTP_RET_OK;
 
+    http->scanned = 0;
+    *lc = in;
+    *lf = p;
     *len = length;
     return M_HTTP_RET_DONE;
 }
 
-static inline int mln_http_process_line(mln_http_t *http, mln_chain_t **in, mln_size_t len)
+/*
+ * A line lying in one buf is parsed in place, only a line spanning bufs is copied.
+ */
+static inline int
+mln_http_process_line(mln_http_t *http, mln_chain_t **in, mln_chain_t *lc, mln_u8ptr_t lf, mln_size_t len)
 {
     int ret;
     mln_buf_t *b;
     mln_chain_t *c;
-    mln_u8ptr_t buf, p, last;
+    mln_u8ptr_t buf, p;
+    mln_size_t n;
     mln_alloc_t *pool = mln_http_get_pool(http);
     mln_u32_t type = mln_http_get_type(http);
 
-    buf = (mln_u8ptr_t)mln_alloc_m(pool, len+1);
-    if (buf == NULL) {
-        mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
-        return M_HTTP_RET_ERROR;
-    }
-    buf[len] = 0;
-    p = buf;
-
-    while ((c = *in) != NULL) {
+    while ((c = *in) != lc) {
         b = c->buf;
         if (b == NULL || b->in_file || mln_buf_left_size(b) <= 0) {
-            *in = (*in)->next;
+            *in = c->next;
             mln_chain_pool_release(c);
             continue;
         }
-        while (mln_buf_left_size(b) > 0) {
-            if (*(b->left_pos) == '\n') break;
-            *p++ = *(b->left_pos++);
+        break;
+    }
+
+    if (c == lc) {
+        b = c->buf;
+        buf = b->left_pos;
+        b->left_pos = lf + 1;
+    } else {
+        b = NULL;
+        buf = (mln_u8ptr_t)mln_alloc_m(pool, len+1);
+        if (buf == NULL) {
+            mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
+            return M_HTTP_RET_ERROR;
         }
-        if (mln_buf_left_size(b) > 0) {
-            ++(b->left_pos);
-            break;
+        buf[len] = 0;
+        p = buf;
+        while ((c = *in) != NULL) {
+            if (c->buf == NULL || c->buf->in_file || mln_buf_left_size(c->buf) <= 0) {
+                *in = c->next;
+                mln_chain_pool_release(c);
+                continue;
+            }
+            if (c == lc) {
+                memcpy(p, c->buf->left_pos, lf - c->buf->left_pos);
+                c->buf->left_pos = lf + 1;
+                break;
+            }
+            n = mln_buf_left_size(c->buf);
+            memcpy(p, c->buf->left_pos, n);
+            p += n;
+            c->buf->left_pos += n;
         }
     }
 
-    for (last = buf + len - 1; last > buf; --last, --len) {
-        if (*last != 0) break;
-    }
-    if (len == 0 || (len == 1 && buf[0] == '\r')) {
-        mln_alloc_free(buf);
+    if (len && buf[len-1] == '\r') --len;
+    if (len == 0) {
+        if (b == NULL) mln_alloc_free(buf);
         mln_http_set_Done(http, 1);
         return M_HTTP_RET_OK;
     }
 
-    if (buf[len-1] == '\r') {
-        buf[len-1] = 0;
-        --len;
-    }
-
     if (type == M_HTTP_UNKNOWN) {
-        ret = mln_http_parse_headline(http, buf, len);
+        ret = mln_http_parse_headline(http, b, buf, len);
     } else {
-        ret = mln_http_parse_field(http, buf, len);
+        ret = mln_http_parse_field(http, b, buf, len);
     }
 
-    mln_alloc_free(buf);
+    if (b == NULL) mln_alloc_free(buf);
 
     return ret;
 }
 
-static inline int mln_http_parse_headline(mln_http_t *http, mln_u8ptr_t buf, mln_size_t len)
+/*
+ * Keep the buf which owns the data until the http is reset or destroyed.
+ * Return 1 if the data is not owned by any buf and should be copied.
+ */
+static inline int mln_http_pin(mln_http_t *http, mln_buf_t *b)
+{
+    mln_buf_t *origin, *s;
+    mln_chain_t *c;
+    mln_alloc_t *pool = mln_http_get_pool(http);
+
+    origin = b->origin != NULL? b->origin: b;
+    while (origin->shadow != NULL) origin = origin->shadow;
+    if (http->pinned != NULL && http->pinned->buf->origin == origin) return 0;
+    if (!origin->in_memory || origin->temporary) return 1;
+
+    if ((c = mln_chain_new(pool)) == NULL) return -1;
+    if ((s = mln_buf_slice(pool, b, 0, 0)) == NULL) {
+        mln_chain_pool_release(c);
+        return -1;
+    }
+    c->buf = s;
+    c->next = http->pinned;
+    http->pinned = c;
+    return 0;
+}
+
+static inline mln_string_t *mln_http_string_new(mln_http_t *http, mln_buf_t *b, mln_u8ptr_t data, mln_size_t len)
+{
+    int rc;
+    mln_string_t tmp, *s;
+    mln_alloc_t *pool = mln_http_get_pool(http);
+
+    if (b == NULL || (rc = mln_http_pin(http, b)) > 0) {
+        mln_string_nset(&tmp, data, len);
+        return mln_string_pool_dup(pool, &tmp);
+    }
+    if (rc < 0) return NULL;
+
+    if ((s = (mln_string_t *)mln_alloc_m(pool, sizeof(mln_string_t))) == NULL)
+        return NULL;
+    s->data = data;
+    s->len = len;
+    s->data_ref = 1;
+    s->pool = 1;
+    s->ref = 1;
+    return s;
+}
+
+static inline int mln_http_parse_headline(mln_http_t *http, mln_buf_t *b, mln_u8ptr_t buf, mln_size_t len)
 {
     mln_u8ptr_t p, end = buf + len, ques;
     mln_string_t tmp, *s, *scan, *send;
     mln_u32_t type, status = 0;
-    mln_alloc_t *pool = mln_http_get_pool(http);
 
     /*first part*/
     for (; buf < end; ++buf) {
@@ -293,8 +464,7 @@ static inline int mln_http_parse_headline(mln_http_t *http, mln_u8ptr_t buf, mln
                 break;
         }
         if (ques == NULL || ques+1 >= p) {
-            mln_string_nset(&tmp, buf, (ques == NULL)? p-buf: ques-buf);
-            s = mln_string_pool_dup(pool, &tmp);
+            s = mln_http_string_new(http, b, buf, (ques == NULL)? p-buf: ques-buf);
             if (s == NULL) {
                 mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
                 return M_HTTP_RET_ERROR;
@@ -302,15 +472,14 @@ static inline int mln_http_parse_headline(mln_http_t *http, mln_u8ptr_t buf, mln
             mln_http_set_uri(http, s);
             mln_http_set_args(http, NULL);
         } else {
-            mln_string_nset(&tmp, buf, ques-buf);
-            s = mln_string_pool_dup(pool, &tmp);
+            s = mln_http_string_new(http, b, buf, ques-buf);
             if (s == NULL) {
                 mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
                 return M_HTTP_RET_ERROR;
             }
             mln_http_set_uri(http, s);
-            mln_string_nset(&tmp, ++ques, p - ques);
-            s = mln_string_pool_dup(pool, &tmp);
+            ++ques;
+            s = mln_http_string_new(http, b, ques, p - ques);
             if (s == NULL) {
                 mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
                 return M_HTTP_RET_ERROR;
@@ -359,8 +528,7 @@ static inline int mln_http_parse_headline(mln_http_t *http, mln_u8ptr_t buf, mln
         mln_http_set_version(http, scan - http_version);
         return M_HTTP_RET_OK;
     }
-    mln_string_nset(&tmp, buf, end-buf);
-    s = mln_string_pool_dup(pool, &tmp);
+    s = mln_http_string_new(http, b, buf, end-buf);
     if (s == NULL) {
         mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
         return M_HTTP_RET_ERROR;
@@ -369,11 +537,10 @@ static inline int mln_http_parse_headline(mln_http_t *http, mln_u8ptr_t buf, mln
     return M_HTTP_RET_OK;
 }
 
-static inline int mln_http_parse_field(mln_http_t *http, mln_u8ptr_t buf, mln_size_t len)
+static inline int mln_http_parse_field(mln_http_t *http, mln_buf_t *b, mln_u8ptr_t buf, mln_size_t len)
 {
     mln_u8ptr_t p, end = buf + len;
-    mln_string_t tmp, *s, *v;
-    mln_alloc_t *pool = mln_http_get_pool(http);
+    mln_string_t *s, *v;
     mln_u32_t type = mln_http_get_type(http);
     mln_hash_t *header_fields = mln_http_get_header(http);
 
@@ -386,10 +553,7 @@ static inline int mln_http_parse_field(mln_http_t *http, mln_u8ptr_t buf, mln_si
         mln_http_set_Done(http, 1);
         return M_HTTP_RET_OK;
     }
-    for (p = buf; p < end; ++p) {
-        if (*p == (mln_u8_t)' ' || *p == (mln_u8_t)'\t' || *p == (mln_u8_t)':')
-            break;
-    }
+    p = mln_http_scan_name(buf, end);
     if (p - buf <= 0) {
         if (type == M_HTTP_REQUEST) {
             mln_http_set_error(http, M_HTTP_BAD_REQUEST);
@@ -398,8 +562,7 @@ static inline int mln_http_parse_field(mln_http_t *http, mln_u8ptr_t buf, mln_si
         }
         return M_HTTP_RET_ERROR;
     }
-    mln_string_nset(&tmp, buf, p-buf);
-    s = mln_string_pool_dup(pool, &tmp);
+    s = mln_http_string_new(http, b, buf, p-buf);
     if (s == NULL) {
         mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
         return M_HTTP_RET_ERROR;
@@ -443,8 +606,7 @@ static inline int mln_http_parse_field(mln_http_t *http, mln_u8ptr_t buf, mln_si
         }
         return M_HTTP_RET_OK;
     }
-    mln_string_nset(&tmp, buf, end-buf);
-    v = mln_string_pool_dup(pool, &tmp);
+    v = mln_http_string_new(http, b, buf, end-buf);
     if (v == NULL) {
         mln_string_free(s);
         mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
@@ -466,7 +628,6 @@ int mln_http_generate(mln_http_t *http, mln_chain_t **out_head, mln_chain_t **ou
         return M_HTTP_RET_ERROR;
 
     mln_u32_t type = mln_http_get_type(http);
-    mln_hash_t *header_fields = mln_http_get_header(http);
     mln_http_handler handler = mln_http_get_handler(http);
     struct mln_http_chain_s hc;
     int ret;
@@ -485,6 +646,7 @@ int mln_http_generate(mln_http_t *http, mln_chain_t **out_head, mln_chain_t **ou
     }
     hc.pos = NULL;
     hc.left_size = 0;
+    hc.skip = 0;
 
     if (!mln_http_get_Done(http)) {
         if (handler != NULL) {
@@ -500,35 +662,8 @@ int mln_http_generate(mln_http_t *http, mln_chain_t **out_head, mln_chain_t **ou
         mln_http_set_Done(http, 1);
     }
 
-    if (type == M_HTTP_RESPONSE) {
-        if (mln_http_generate_version(&hc) == M_HTTP_RET_ERROR)
-            goto err;
-        if (mln_http_generate_write(&hc, " ", 1) == M_HTTP_RET_ERROR)
-            goto err;
-        if (mln_http_generate_status(&hc) == M_HTTP_RET_ERROR)
-            goto err;
-    } else {
-        if (mln_http_generate_method(&hc) == M_HTTP_RET_ERROR)
-            goto err;
-        if (mln_http_generate_write(&hc, " ", 1) == M_HTTP_RET_ERROR)
-            goto err;
-        if (mln_http_generate_uri(&hc) == M_HTTP_RET_ERROR)
-            goto err;
-        if (mln_http_generate_write(&hc, " ", 1) == M_HTTP_RET_ERROR)
-            goto err;
-        if (mln_http_generate_version(&hc) == M_HTTP_RET_ERROR)
-            goto err;
-    }
-    if (mln_http_generate_write(&hc, "\r\n", 2) == M_HTTP_RET_ERROR)
+    if (mln_http_generate_head(&hc) == M_HTTP_RET_ERROR)
         goto err;
-
-    if (header_fields != NULL) {
-        if (mln_hash_iterate(header_fields, \
-                              mln_http_generate_fields_hash_iterate_handler, \
-                              &hc) < 0)
-            goto err;
-    }
-
     if (mln_http_generate_write(&hc, "\r\n", 2) == M_HTTP_RET_ERROR)
         goto err;
 
@@ -558,6 +693,49 @@ err:
     return M_HTTP_RET_ERROR;
 }
 
+/*
+ * The start line and the header fields, without the empty line.
+ */
+static inline int
+mln_http_generate_head(struct mln_http_chain_s *hc)
+{
+    mln_http_t *http = hc->http;
+    mln_hash_t *header_fields = mln_http_get_header(http);
+
+    if (mln_http_get_type(http) == M_HTTP_RESPONSE) {
+        if (mln_http_generate_version(hc) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+        if (mln_http_generate_write(hc, " ", 1) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+        if (mln_http_generate_status(hc) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+    } else {
+        if (mln_http_generate_method(hc) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+        if (mln_http_generate_write(hc, " ", 1) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+        if (mln_http_generate_uri(hc) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+        if (mln_http_generate_write(hc, " ", 1) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+        if (mln_http_generate_version(hc) == M_HTTP_RET_ERROR)
+            return M_HTTP_RET_ERROR;
+    }
+    if (mln_http_generate_write(hc, "\r\n", 2) == M_HTTP_RET_ERROR)
+        return M_HTTP_RET_ERROR;
+
+    if (header_fields != NULL) {
+        if (mln_hash_iterate(header_fields, \
+                              mln_http_generate_fields_hash_iterate_handler, \
+                              hc) < 0)
+        {
+            return M_HTTP_RET_ERROR;
+        }
+    }
+
+    return M_HTTP_RET_OK;
+}
+
 static inline int
 mln_http_generate_set_last_in_chain(struct mln_http_chain_s *hc)
 {
@@ -583,7 +761,7 @@ mln_http_generate_set_last_in_chain(struct mln_http_chain_s *hc)
     b->in_memory = 1;
     b->last_in_chain = 1;
     if (hc->head == NULL) {
-        hc->head = hc->tail;
+        hc->head = hc->tail = c;
     } else {
         hc->tail->next = c;
         hc->tail = c;
@@ -750,6 +928,12 @@ mln_http_generate_fields_hash_iterate_handler(void *key, void *val, void *data)
     mln_string_t *k = (mln_string_t *)key;
     mln_string_t *v = (mln_string_t *)val;
     struct mln_http_chain_s *hc = (struct mln_http_chain_s *)data;
+    mln_string_t cl = mln_string("Content-Length"), date = mln_string("Date");
+
+    if ((hc->skip & M_HTTP_TEMPLATE_CONTENT_LENGTH) && !mln_string_strcasecmp(k, &cl))
+        return 0;
+    if ((hc->skip & M_HTTP_TEMPLATE_DATE) && !mln_string_strcasecmp(k, &date))
+        return 0;
 
     if (mln_http_generate_write(hc, k->data, k->len) == M_HTTP_RET_ERROR)
         return -1;
@@ -766,6 +950,178 @@ mln_http_generate_fields_hash_iterate_handler(void *key, void *val, void *data)
 }
 
 
+/*
+ * response templates
+ */
+static const char *mln_http_week_days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *mln_http_months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+mln_http_template_t *mln_http_template_new(mln_alloc_t *pool, mln_http_t *http, mln_u32_t flags)
+{
+    mln_http_template_t *tpl;
+    struct mln_http_chain_s hc;
+    mln_chain_t *c;
+    mln_buf_t *b;
+    mln_u8ptr_t buf, p;
+    mln_size_t size = 0;
+
+    if (mln_http_get_type(http) == M_HTTP_UNKNOWN) {
+        mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
+        return NULL;
+    }
+
+    hc.http = http;
+    hc.head = hc.tail = NULL;
+    hc.pos = NULL;
+    hc.left_size = 0;
+    hc.skip = flags;
+    if (mln_http_generate_head(&hc) == M_HTTP_RET_ERROR) {
+        mln_chain_pool_release_all(hc.head);
+        return NULL;
+    }
+    for (c = hc.head; c != NULL; c = c->next)
+        size += mln_buf_size(c->buf);
+
+    if ((tpl = (mln_http_template_t *)mln_alloc_m(pool, sizeof(mln_http_template_t))) == NULL)
+        goto nomem;
+    if ((b = tpl->head = mln_buf_new(pool)) == NULL) {
+        mln_alloc_free(tpl);
+        goto nomem;
+    }
+    if ((buf = (mln_u8ptr_t)mln_alloc_m(pool, size? size: 1)) == NULL) {
+        mln_alloc_free(b);
+        mln_alloc_free(tpl);
+        goto nomem;
+    }
+    for (p = buf, c = hc.head; c != NULL; c = c->next) {
+        memcpy(p, c->buf->pos, mln_buf_size(c->buf));
+        p += mln_buf_size(c->buf);
+    }
+    mln_chain_pool_release_all(hc.head);
+
+    b->left_pos = b->pos = b->start = buf;
+    b->last = b->end = buf + size;
+    b->in_memory = 1;
+    b->last_buf = 1;
+    tpl->date_sec = 0;
+    tpl->date_len = 0;
+    tpl->flags = flags;
+    return tpl;
+
+nomem:
+    mln_chain_pool_release_all(hc.head);
+    mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
+    return NULL;
+}
+
+void mln_http_template_free(mln_http_template_t *tpl)
+{
+    if (tpl == NULL) return;
+
+    /*the data is freed after the last response referring to it is released*/
+    mln_buf_pool_release(tpl->head);
+    mln_alloc_free(tpl);
+}
+
+/*
+ * The Date value only changes once per second, so it is formatted at most once per second.
+ */
+static inline void mln_http_template_date_update(mln_http_template_t *tpl)
+{
+    struct tm tm;
+    time_t now = time(NULL);
+
+    if (tpl->date_len && now == tpl->date_sec) return;
+
+    gmtime_r(&now, &tm);
+    tpl->date_len = snprintf((char *)tpl->date, sizeof(tpl->date), \
+                             "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\n", \
+                             mln_http_week_days[tm.tm_wday], tm.tm_mday, mln_http_months[tm.tm_mon], \
+                             tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    tpl->date_sec = now;
+}
+
+int mln_http_template_generate(mln_http_template_t *tpl, mln_http_t *http, mln_chain_t **out_head, mln_chain_t **out_tail)
+{
+    mln_alloc_t *pool = mln_http_get_pool(http);
+    mln_chain_t *hc, *vc, *c;
+    mln_u8ptr_t buf, p;
+    mln_u8_t digits[24];
+    mln_u64_t size = 0;
+    int n = 0;
+
+    if ((hc = mln_chain_new(pool)) == NULL) goto nomem;
+    if ((hc->buf = mln_buf_slice(pool, tpl->head, 0, mln_buf_left_size(tpl->head))) == NULL) {
+        mln_chain_pool_release(hc);
+        goto nomem;
+    }
+    if ((vc = mln_chain_new(pool)) == NULL) {
+        mln_chain_pool_release(hc);
+        goto nomem;
+    }
+    hc->next = vc;
+    if ((vc->buf = mln_buf_new(pool)) == NULL) {
+        mln_chain_pool_release_all(hc);
+        goto nomem;
+    }
+    if ((buf = (mln_u8ptr_t)mln_alloc_m(pool, M_HTTP_TEMPLATE_VAR_SIZE)) == NULL) {
+        mln_chain_pool_release_all(hc);
+        goto nomem;
+    }
+    vc->buf->left_pos = vc->buf->pos = vc->buf->start = buf;
+    vc->buf->in_memory = 1;
+    vc->buf->last_buf = 1;
+    p = buf;
+
+    if (tpl->flags & M_HTTP_TEMPLATE_CONTENT_LENGTH) {
+        for (c = http->body_head; c != NULL; c = c->next)
+            size += mln_buf_size(c->buf);
+        do {
+            digits[n++] = '0' + size % 10;
+            size /= 10;
+        } while (size);
+        memcpy(p, "Content-Length: ", 16);
+        p += 16;
+        while (n > 0) *p++ = digits[--n];
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    if (tpl->flags & M_HTTP_TEMPLATE_DATE) {
+        mln_http_template_date_update(tpl);
+        memcpy(p, tpl->date, tpl->date_len);
+        p += tpl->date_len;
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    vc->buf->last = vc->buf->end = p;
+
+    if (http->body_head == NULL) {
+        vc->buf->last_in_chain = 1;
+        vc->next = NULL;
+        c = vc;
+    } else {
+        vc->next = http->body_head;
+        c = http->body_tail;
+        http->body_head = http->body_tail = NULL;
+    }
+    if (*out_head == NULL) {
+        *out_head = hc;
+    } else {
+        (*out_tail)->next = hc;
+    }
+    *out_tail = c;
+
+    mln_http_set_error(http, M_HTTP_OK);
+    return M_HTTP_RET_DONE;
+
+nomem:
+    mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
+    return M_HTTP_RET_ERROR;
+}
+
+
 int mln_http_set_field(mln_http_t *http, mln_string_t *key, mln_string_t *val)
 {
     if (http == NULL || key == NULL) {
@@ -851,6 +1207,343 @@ void mln_http_drop_field(mln_http_t *http, mln_string_t *key)
     }
 }
 
+/*
+ * body receiving, chunked codec and keep-alive
+ */
+#define M_HTTP_BODY_UNKNOWN   0
+#define M_HTTP_BODY_LENGTH    1
+#define M_HTTP_BODY_CHUNKED   2
+#define M_HTTP_BODY_CLOSE     3
+
+#define M_HTTP_CHUNK_SIZE     0
+#define M_HTTP_CHUNK_EXT      1
+#define M_HTTP_CHUNK_SIZE_LF  2
+#define M_HTTP_CHUNK_DATA     3
+#define M_HTTP_CHUNK_DATA_CR  4
+#define M_HTTP_CHUNK_DATA_LF  5
+#define M_HTTP_CHUNK_TRAILER  6
+#define M_HTTP_CHUNK_FIELD    7
+#define M_HTTP_CHUNK_END_LF   8
+#define M_HTTP_CHUNK_DONE     9
+
+/*
+ * Move n bytes at the front of c into the chain head and tail as a slice.
+ */
+static inline int
+mln_http_body_append(mln_alloc_t *pool, mln_chain_t *c, mln_size_t n, mln_chain_t **head, mln_chain_t **tail)
+{
+    mln_chain_t *nc;
+
+    if ((nc = mln_chain_new(pool)) == NULL) return -1;
+    if ((nc->buf = mln_buf_slice(pool, c->buf, 0, n)) == NULL) {
+        mln_chain_pool_release(nc);
+        return -1;
+    }
+    c->buf->left_pos += n;
+    mln_chain_add(head, tail, nc);
+    return 0;
+}
+
+int mln_http_chunk_decode(mln_http_chunk_t *ck, mln_alloc_t *pool, mln_chain_t **in, mln_chain_t **head, mln_chain_t **tail)
+{
+    mln_chain_t *c;
+    mln_buf_t *b;
+    mln_u8ptr_t p, end;
+    mln_size_t n;
+    mln_u8_t ch;
+    int d;
+
+    while ((c = *in) != NULL) {
+        b = c->buf;
+        if (b == NULL || b->in_file || mln_buf_left_size(b) <= 0) {
+            *in = c->next;
+            mln_chain_pool_release(c);
+            continue;
+        }
+        if (ck->state == M_HTTP_CHUNK_DONE) return M_HTTP_RET_DONE;
+
+        if (ck->state == M_HTTP_CHUNK_DATA) {
+            n = mln_buf_left_size(b);
+            if (n > ck->size) n = ck->size;
+            if (mln_http_body_append(pool, c, n, head, tail) < 0) return M_HTTP_RET_ERROR;
+            if ((ck->size -= n) == 0) ck->state = M_HTTP_CHUNK_DATA_CR;
+            continue;
+        }
+
+        for (p = b->left_pos, end = b->last; p < end; ++p) {
+            ch = *p;
+            switch (ck->state) {
+                case M_HTTP_CHUNK_SIZE:
+                    if (ch >= '0' && ch <= '9') d = ch - '0';
+                    else if (ch >= 'a' && ch <= 'f') d = ch - 'a' + 10;
+                    else if (ch >= 'A' && ch <= 'F') d = ch - 'A' + 10;
+                    else d = -1;
+                    if (d >= 0) {
+                        if (ck->size >> 60) return M_HTTP_RET_ERROR;
+                        ck->size = (ck->size << 4) | d;
+                        ++(ck->digits);
+                        break;
+                    }
+                    if (!ck->digits) return M_HTTP_RET_ERROR;
+                    if (ch == ';' || ch == ' ' || ch == '\t') {
+                        ck->state = M_HTTP_CHUNK_EXT;
+                    } else if (ch == '\r') {
+                        ck->state = M_HTTP_CHUNK_SIZE_LF;
+                    } else if (ch == '\n') {
+                        goto size_done;
+                    } else {
+                        return M_HTTP_RET_ERROR;
+                    }
+                    break;
+                case M_HTTP_CHUNK_EXT:
+                    if (ch == '\n') goto size_done;
+                    break;
+                case M_HTTP_CHUNK_SIZE_LF:
+                    if (ch != '\n') return M_HTTP_RET_ERROR;
+size_done:
+                    ck->digits = 0;
+                    ck->state = ck->size? M_HTTP_CHUNK_DATA: M_HTTP_CHUNK_TRAILER;
+                    break;
+                case M_HTTP_CHUNK_DATA_CR:
+                    if (ch == '\r') ck->state = M_HTTP_CHUNK_DATA_LF;
+                    else if (ch == '\n') ck->state = M_HTTP_CHUNK_SIZE;
+                    else return M_HTTP_RET_ERROR;
+                    break;
+                case M_HTTP_CHUNK_DATA_LF:
+                    if (ch != '\n') return M_HTTP_RET_ERROR;
+                    ck->state = M_HTTP_CHUNK_SIZE;
+                    break;
+                case M_HTTP_CHUNK_TRAILER:
+                    if (ch == '\r') ck->state = M_HTTP_CHUNK_END_LF;
+                    else if (ch == '\n') ck->state = M_HTTP_CHUNK_DONE;
+                    else ck->state = M_HTTP_CHUNK_FIELD;
+                    break;
+                case M_HTTP_CHUNK_FIELD:
+                    if (ch == '\n') ck->state = M_HTTP_CHUNK_TRAILER;
+                    break;
+                default: /*M_HTTP_CHUNK_END_LF*/
+                    if (ch != '\n') return M_HTTP_RET_ERROR;
+                    ck->state = M_HTTP_CHUNK_DONE;
+                    break;
+            }
+            if (ck->state == M_HTTP_CHUNK_DATA || ck->state == M_HTTP_CHUNK_DONE) {
+                ++p;
+                break;
+            }
+        }
+        b->left_pos = p;
+        if (ck->state == M_HTTP_CHUNK_DONE) return M_HTTP_RET_DONE;
+    }
+
+    return ck->state == M_HTTP_CHUNK_DONE? M_HTTP_RET_DONE: M_HTTP_RET_OK;
+}
+
+static inline mln_chain_t *mln_http_chain_const_new(mln_alloc_t *pool, const char *data, mln_size_t len)
+{
+    mln_chain_t *c;
+    mln_buf_t *b;
+    mln_u8ptr_t buf;
+
+    if ((c = mln_chain_new(pool)) == NULL) return NULL;
+    if ((b = c->buf = mln_buf_new(pool)) == NULL) {
+        mln_chain_pool_release(c);
+        return NULL;
+    }
+    if ((buf = (mln_u8ptr_t)mln_alloc_m(pool, len)) == NULL) {
+        mln_chain_pool_release(c);
+        return NULL;
+    }
+    memcpy(buf, data, len);
+    b->left_pos = b->pos = b->start = buf;
+    b->last = b->end = buf + len;
+    b->in_memory = 1;
+    b->last_buf = 1;
+    return c;
+}
+
+int mln_http_chunk_encode(mln_alloc_t *pool, mln_chain_t **head, mln_chain_t **tail, int last)
+{
+    mln_chain_t *c, *size_line = NULL, *end;
+    mln_u64_t size = 0;
+    char line[32];
+    int n;
+
+    for (c = *head; c != NULL; c = c->next)
+        size += mln_buf_size(c->buf);
+
+    if (size) {
+        n = snprintf(line, sizeof(line), "%llx\r\n", (unsigned long long)size);
+        if ((size_line = mln_http_chain_const_new(pool, line, n)) == NULL)
+            return M_HTTP_RET_ERROR;
+        if (last) end = mln_http_chain_const_new(pool, "\r\n0\r\n\r\n", 7);
+        else end = mln_http_chain_const_new(pool, "\r\n", 2);
+    } else if (last) {
+        end = mln_http_chain_const_new(pool, "0\r\n\r\n", 5);
+    } else {
+        return M_HTTP_RET_OK;
+    }
+    if (end == NULL) {
+        if (size_line != NULL) mln_chain_pool_release(size_line);
+        return M_HTTP_RET_ERROR;
+    }
+
+    if (*head != NULL && (*tail)->buf != NULL) (*tail)->buf->last_in_chain = 0;
+    if (size) {
+        size_line->next = *head;
+        *head = size_line;
+        (*tail)->next = end;
+    } else if (*head == NULL) {
+        *head = end;
+    } else {
+        (*tail)->next = end;
+    }
+    *tail = end;
+    end->buf->last_in_chain = last? 1: 0;
+
+    return M_HTTP_RET_OK;
+}
+
+/*
+ * Return 1 if token is one of the comma separated elements of val.
+ * If only_last is set, token must be the last element.
+ */
+static int mln_http_has_token(mln_string_t *val, char *token, int only_last)
+{
+    mln_u8ptr_t p = val->data, end = val->data + val->len, t;
+    mln_string_t tmp, tk;
+    int found = 0;
+
+    mln_string_set(&tk, token);
+    while (p < end) {
+        for (; p < end && (*p == ' ' || *p == '\t' || *p == ','); ++p)
+            ;
+        for (t = p; t < end && *t != ','; ++t)
+            ;
+        mln_string_nset(&tmp, p, t - p);
+        for (; tmp.len && (tmp.data[tmp.len-1] == ' ' || tmp.data[tmp.len-1] == '\t'); --tmp.len)
+            ;
+        if (tmp.len) found = !mln_string_strcasecmp(&tmp, &tk);
+        if (found && !only_last) return 1;
+        p = t;
+    }
+    return found;
+}
+
+static inline int mln_http_body_prepare(mln_http_t *http)
+{
+    mln_string_t te_key = mln_string("Transfer-Encoding");
+    mln_string_t cl_key = mln_string("Content-Length");
+    mln_string_t *val;
+    mln_u8ptr_t p, end;
+    mln_u64_t len = 0;
+    mln_u32_t status;
+
+    if ((val = mln_http_get_field(http, &te_key)) != NULL) {
+        if (!mln_http_has_token(val, "chunked", 1)) {
+            if (mln_http_get_type(http) == M_HTTP_REQUEST) {
+                mln_http_set_error(http, M_HTTP_NOT_IMPLEMENTED);
+                return M_HTTP_RET_ERROR;
+            }
+            http->body_type = M_HTTP_BODY_CLOSE;
+            return M_HTTP_RET_OK;
+        }
+        mln_http_chunk_init(&(http->chunk));
+        http->body_type = M_HTTP_BODY_CHUNKED;
+        return M_HTTP_RET_OK;
+    }
+
+    if ((val = mln_http_get_field(http, &cl_key)) != NULL) {
+        for (p = val->data, end = p + val->len; p < end; ++p) {
+            if (!isdigit(*p) || len > ((mln_u64_t)-1 - 9) / 10) {
+                if (mln_http_get_type(http) == M_HTTP_REQUEST) {
+                    mln_http_set_error(http, M_HTTP_BAD_REQUEST);
+                } else {
+                    mln_http_set_error(http, M_HTTP_UNPARSEABLE_RESPONSE_HEADERS);
+                }
+                return M_HTTP_RET_ERROR;
+            }
+            len = len * 10 + (*p - '0');
+        }
+        http->body_left = len;
+        http->body_type = M_HTTP_BODY_LENGTH;
+        return M_HTTP_RET_OK;
+    }
+
+    status = mln_http_get_status(http);
+    if (mln_http_get_type(http) == M_HTTP_RESPONSE && status >= 200 && \
+        status != M_HTTP_NO_CONTENT && status != M_HTTP_NOT_MODIFIED)
+    {
+        http->body_type = M_HTTP_BODY_CLOSE;
+    } else {
+        http->body_left = 0;
+        http->body_type = M_HTTP_BODY_LENGTH;
+    }
+    return M_HTTP_RET_OK;
+}
+
+int mln_http_body_receive(mln_http_t *http, mln_chain_t **in, mln_chain_t **nil)
+{
+    mln_chain_t *c;
+    mln_buf_t *b;
+    mln_size_t n;
+    int ret;
+    mln_alloc_t *pool = mln_http_get_pool(http);
+
+    if (nil != NULL) return M_HTTP_RET_DONE;
+
+    if (http->body_type == M_HTTP_BODY_UNKNOWN && mln_http_body_prepare(http) == M_HTTP_RET_ERROR)
+        return M_HTTP_RET_ERROR;
+
+    if (http->body_type == M_HTTP_BODY_CHUNKED) {
+        ret = mln_http_chunk_decode(&(http->chunk), pool, in, &(http->body_head), &(http->body_tail));
+        if (ret == M_HTTP_RET_ERROR) {
+            if (mln_http_get_type(http) == M_HTTP_REQUEST) {
+                mln_http_set_error(http, M_HTTP_BAD_REQUEST);
+            } else {
+                mln_http_set_error(http, M_HTTP_UNPARSEABLE_RESPONSE_HEADERS);
+            }
+            return M_HTTP_RET_ERROR;
+        }
+        if (ret == M_HTTP_RET_DONE) http->body_type = M_HTTP_BODY_UNKNOWN;
+        return ret;
+    }
+
+    while ((c = *in) != NULL && (http->body_type == M_HTTP_BODY_CLOSE || http->body_left)) {
+        b = c->buf;
+        if (b == NULL || b->in_file || mln_buf_left_size(b) <= 0) {
+            *in = c->next;
+            mln_chain_pool_release(c);
+            continue;
+        }
+        n = mln_buf_left_size(b);
+        if (http->body_type == M_HTTP_BODY_LENGTH && n > http->body_left) n = http->body_left;
+        if (mln_http_body_append(pool, c, n, &(http->body_head), &(http->body_tail)) < 0) {
+            mln_http_set_error(http, M_HTTP_INTERNAL_SERVER_ERROR);
+            return M_HTTP_RET_ERROR;
+        }
+        if (http->body_type == M_HTTP_BODY_LENGTH) http->body_left -= n;
+    }
+    if (http->body_type == M_HTTP_BODY_CLOSE || http->body_left) return M_HTTP_RET_OK;
+
+    http->body_type = M_HTTP_BODY_UNKNOWN;
+    return M_HTTP_RET_DONE;
+}
+
+int mln_http_keepalive(mln_http_t *http)
+{
+    if (http == NULL) return 0;
+
+    mln_string_t key = mln_string("Connection");
+    mln_string_t *val = mln_http_get_field(http, &key);
+
+    if (val != NULL) {
+        if (mln_http_has_token(val, "close", 0)) return 0;
+        if (mln_http_has_token(val, "keep-alive", 0)) return 1;
+    }
+    if (http->body_type == M_HTTP_BODY_CLOSE) return 0;
+    return mln_http_get_version(http) == M_HTTP_VERSION_1_1;
+}
+
 static inline int mln_http_atou(mln_string_t *s, mln_u32_t *status)
 {
     mln_u32_t st = 0;
@@ -892,6 +1585,7 @@ mln_http_t *mln_http_init(mln_tcp_conn_t *connection, void *data, mln_http_handl
     hattr.len_base = M_HTTP_HASH_LEN;
     hattr.expandable = 0;
     hattr.calc_prime = 0;
+    hattr.incremental = 0;
     http->header_fields = mln_hash_new(&hattr);
     if (http->header_fields == NULL) {
         mln_alloc_free(http);
@@ -903,6 +1597,11 @@ mln_http_t *mln_http_init(mln_tcp_conn_t *connection, void *data, mln_http_handl
     http->uri = NULL;
     http->args = NULL;
     http->response_msg = NULL;
+    http->pinned = NULL;
+    http->scanned = 0;
+    mln_http_chunk_init(&(http->chunk));
+    http->body_left = 0;
+    http->body_type = M_HTTP_BODY_UNKNOWN;
     http->error = M_HTTP_OK;
     http->status = M_HTTP_OK;
     http->method = 0;
@@ -932,6 +1631,9 @@ void mln_http_destroy(mln_http_t *http)
     if (http->response_msg != NULL) {
         mln_string_free(http->response_msg);
     }
+    if (http->pinned != NULL) {
+        mln_chain_pool_release_all(http->pinned);
+    }
 
     mln_alloc_free(http);
 }
@@ -959,6 +1661,14 @@ void mln_http_reset(mln_http_t *http)
         mln_string_free(http->response_msg);
         http->response_msg = NULL;
     }
+    if (http->pinned != NULL) {
+        mln_chain_pool_release_all(http->pinned);
+        http->pinned = NULL;
+    }
+    http->scanned = 0;
+    mln_http_chunk_init(&(http->chunk));
+    http->body_left = 0;
+    http->body_type = M_HTTP_BODY_UNKNOWN;
     http->error = M_HTTP_OK;
     http->status = M_HTTP_OK;
     http->method = 0;
@@ -1025,9 +1735,13 @@ void mln_http_dump(mln_http_t *http)
 
 static int mln_http_dump_iterate_handler(void *key, void *val, void *data)
 {
-    printf("\t\tkey:[%s] value:[%s]\n", \
-           (char *)(((mln_string_t *)key)->data), \
-           val == NULL?"NULL":(char *)(((mln_string_t *)val)->data));
+    mln_string_t *k = (mln_string_t *)key, *v = (mln_string_t *)val;
+
+    if (v == NULL) {
+        printf("\t\tkey:[%.*s] value:[NULL]\n", (int)k->len, (char *)k->data);
+    } else {
+        printf("\t\tkey:[%.*s] value:[%.*s]\n", (int)k->len, (char *)k->data, (int)v->len, (char *)v->data);
+    }
 
     return 0;
 }
@@ -7,8 +7,12 @@
 #include <ctype.h>
 #include <stdio.h>
 #include "mln_json.h"
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__wasm__)
+#include <immintrin.h>
+#define MLN_JSON_SIMD
+#endif
 
-static inline mln_json_obj_t *mln_json_obj_new(void);
+static inline mln_json_obj_t *mln_json_obj_new(mln_alloc_t *pool);
 static void mln_json_encode_utf8(unsigned int u, mln_u8ptr_t *b, int *count);
 static inline int mln_json_get_char(mln_u8ptr_t *s, int *len, unsigned int *hex);
 static mln_u64_t mln_json_hash_calc(mln_hash_t *h, void *key);
@@ -25,7 +29,7 @@ mln_json_parse_array(mln_json_t *val, char *jstr, int len, mln_uauto_t index);
 static int
 mln_json_parse_string(mln_json_t *j, char *jstr, int len, mln_uauto_t index);
 static mln_u8ptr_t
-mln_json_parse_string_fetch(mln_u8ptr_t jstr, int *len);
+mln_json_parse_string_fetch(mln_alloc_t *pool, mln_u8ptr_t jstr, int *len);
 static int
 mln_json_parse_digit(mln_json_t *j, char *jstr, int len, mln_uauto_t index);
 static inline int
@@ -37,27 +41,174 @@ mln_json_parse_false(mln_json_t *j, char *jstr, int len, mln_uauto_t index);
 static int
 mln_json_parse_null(mln_json_t *j, char *jstr, int len, mln_uauto_t index);
 
+static void mln_json_dump_vec(mln_json_vec_t *v, int space);
 static int mln_json_dump_hash_iterate_handler(void *key, void *val, void *data);
 static int mln_json_dump_rbtree_iterate_handler(mln_rbtree_node_t *node, void *udata);
-static inline mln_size_t mln_json_get_length(mln_json_t *j);
-static int
-mln_json_get_length_hash_iterate_handler(void *key, void *val, void *data);
-static int
-mln_json_get_length_rbtree_iterate_handler(mln_rbtree_node_t *node, void *data);
-static inline mln_size_t
-mln_json_write_content(mln_json_t *j, mln_s8ptr_t buf);
+typedef struct mln_json_writer_s mln_json_writer_t;
+static int mln_json_write_content(mln_json_t *j, mln_json_writer_t *w);
+static int mln_json_write_content_vec(mln_json_vec_t *v, mln_json_writer_t *w);
 static int
 mln_json_write_content_hash_iterate_handler(void *key, void *val, void *data);
 static int
 mln_json_write_content_rbtree_iterate_handler(mln_rbtree_node_t *node, void *data);
+static mln_json_t *mln_json_compact_search(mln_json_vec_t *v, mln_string_t *key);
+
+/*
+ * scan
+ *
+ * Kernels finding the first non-blank byte and the first byte that is
+ * a quote, a backslash or a control character. On x86-64 the SSE2 or
+ * AVX2 version is chosen at the first call.
+ */
+#define mln_json_is_blank(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#define mln_json_is_special(c) ((c) == '\"' || (c) == '\\' || (c) < 0x20)
+
+static mln_u8ptr_t mln_json_scan_blank_scalar(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    for (; p < end && mln_json_is_blank(*p); ++p)
+        ;
+    return p;
+}
+
+static mln_u8ptr_t mln_json_scan_special_scalar(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    for (; p < end && !mln_json_is_special(*p); ++p)
+        ;
+    return p;
+}
+
+#if defined(MLN_JSON_SIMD)
+static mln_u8ptr_t mln_json_scan_blank_sse2(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+    __m128i v, m;
+    mln_u32_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)), \
+                         _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        mask = ~(mln_u32_t)_mm_movemask_epi8(m) & 0xffff;
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return mln_json_scan_blank_scalar(p, end);
+}
+
+static mln_u8ptr_t mln_json_scan_special_sse2(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    const __m128i quote = _mm_set1_epi8('\"'), bs = _mm_set1_epi8('\\'), ctl = _mm_set1_epi8(0x1f);
+    __m128i v, m;
+    mln_u32_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bs)), \
+                         _mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v));
+        mask = (mln_u32_t)_mm_movemask_epi8(m);
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return mln_json_scan_special_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static mln_u8ptr_t mln_json_scan_blank_avx2(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n');
+    __m256i v, m;
+    mln_u32_t mask;
+
+    for (; end - p >= 32; p += 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)), \
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        mask = ~(mln_u32_t)_mm256_movemask_epi8(m);
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return mln_json_scan_blank_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static mln_u8ptr_t mln_json_scan_special_avx2(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    const __m256i quote = _mm256_set1_epi8('\"'), bs = _mm256_set1_epi8('\\'), ctl = _mm256_set1_epi8(0x1f);
+    __m256i v, m;
+    mln_u32_t mask;
+
+    for (; end - p >= 32; p += 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bs)), \
+                            _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl), v));
+        mask = (mln_u32_t)_mm256_movemask_epi8(m);
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return mln_json_scan_special_sse2(p, end);
+}
+#endif
+
+static mln_u8ptr_t mln_json_scan_blank_init(mln_u8ptr_t p, mln_u8ptr_t end);
+static mln_u8ptr_t mln_json_scan_special_init(mln_u8ptr_t p, mln_u8ptr_t end);
+static mln_u8ptr_t (*mln_json_scan_blank_handler)(mln_u8ptr_t, mln_u8ptr_t) = mln_json_scan_blank_init;
+static mln_u8ptr_t (*mln_json_scan_special_handler)(mln_u8ptr_t, mln_u8ptr_t) = mln_json_scan_special_init;
+
+static void mln_json_scan_select(void)
+{
+#if defined(MLN_JSON_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        mln_json_scan_special_handler = mln_json_scan_special_avx2;
+        mln_json_scan_blank_handler = mln_json_scan_blank_avx2;
+    } else {
+        mln_json_scan_special_handler = mln_json_scan_special_sse2;
+        mln_json_scan_blank_handler = mln_json_scan_blank_sse2;
+    }
+#else
+    mln_json_scan_special_handler = mln_json_scan_special_scalar;
+    mln_json_scan_blank_handler = mln_json_scan_blank_scalar;
+#endif
+}
+
+static mln_u8ptr_t mln_json_scan_blank_init(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    mln_json_scan_select();
+    return mln_json_scan_blank_handler(p, end);
+}
+
+static mln_u8ptr_t mln_json_scan_special_init(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    mln_json_scan_select();
+    return mln_json_scan_special_handler(p, end);
+}
+
+/*
+ * Most blank runs are a byte or two, so the first bytes are checked inline.
+ */
+static inline mln_u8ptr_t mln_json_scan_blank(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    if (p >= end || !mln_json_is_blank(*p)) return p;
+    if (++p >= end || !mln_json_is_blank(*p)) return p;
+    return mln_json_scan_blank_handler(p + 1, end);
+}
+
+static inline mln_u8ptr_t mln_json_scan_special(mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    if (end - p < 16) return mln_json_scan_special_scalar(p, end);
+    return mln_json_scan_special_handler(p, end);
+}
 
 mln_json_t *mln_json_parse(mln_string_t *jstr)
+{
+    return mln_json_pool_parse(NULL, jstr);
+}
+
+mln_json_t *mln_json_pool_parse(mln_alloc_t *pool, mln_string_t *jstr)
 {
     if (jstr == NULL) {
         return NULL;
     }
 
-    mln_json_t *j = mln_json_new();
+    mln_json_t *j = mln_json_pool_new(pool);
     if (j == NULL) {
         return NULL;
     }
@@ -79,11 +230,28 @@ mln_json_t *mln_json_new(void)
     return (mln_json_t *)calloc(1, sizeof(mln_json_t));
 }
 
+mln_json_t *mln_json_pool_new(mln_alloc_t *pool)
+{
+    mln_json_t *j;
+
+    if (pool == NULL) return mln_json_new();
+
+    if ((j = (mln_json_t *)mln_alloc_c(pool, sizeof(mln_json_t))) == NULL)
+        return NULL;
+    j->pool = pool;
+    return j;
+}
+
 void mln_json_free(void *json)
 {
     mln_json_t *j = (mln_json_t *)json;
     if (j == NULL) return;
 
+    if (j->compact) {
+        if (j->arena) mln_alloc_destroy(j->pool);
+        return;
+    }
+
     switch (j->type) {
         case M_JSON_OBJECT:
             if (j->data.m_j_obj != NULL) {
@@ -109,7 +277,8 @@ void mln_json_free(void *json)
             break;
     }
 
-    free(j);
+    if (j->pool != NULL) mln_alloc_free(j);
+    else free(j);
 }
 
 static inline int
@@ -162,9 +331,9 @@ mln_json_parse_obj(mln_json_t *val, char *jstr, int len, mln_uauto_t index)
 
     val->index = index;
     val->type = M_JSON_OBJECT;
-    hattr.pool = NULL;
-    hattr.pool_alloc = NULL;
-    hattr.pool_free = NULL;
+    hattr.pool = val->pool;
+    hattr.pool_alloc = (hash_pool_alloc_handler)mln_alloc_m;
+    hattr.pool_free = (hash_pool_free_handler)mln_alloc_free;
     hattr.hash = mln_json_hash_calc;
     hattr.cmp = mln_json_hash_cmp;
     hattr.free_key = NULL;
@@ -172,18 +341,19 @@ mln_json_parse_obj(mln_json_t *val, char *jstr, int len, mln_uauto_t index)
     hattr.len_base = M_JSON_HASH_LEN;
     hattr.expandable = 1;
     hattr.calc_prime = 0;
+    hattr.incremental = 0;
     val->data.m_j_obj = mln_hash_new(&hattr);
     if (val->data.m_j_obj == NULL) {
         return -1;
     }
 
 again:
-    obj = mln_json_obj_new();
+    obj = mln_json_obj_new(val->pool);
     if (obj == NULL) {
         return -1;
     }
 
-    obj->key = mln_json_new();
+    obj->key = mln_json_pool_new(val->pool);
     if (obj->key == NULL) {
         mln_json_obj_free(obj);
         return -1;
@@ -225,7 +395,7 @@ again:
             return -1;
         }
 
-        obj->val = mln_json_new();
+        obj->val = mln_json_pool_new(val->pool);
         if (obj->val == NULL) {
             return -1;
         }
@@ -268,9 +438,9 @@ mln_json_parse_array(mln_json_t *val, char *jstr, int len, mln_uauto_t index)
     mln_rbtree_node_t *rn;
     struct mln_rbtree_attr rbattr;
 
-    rbattr.pool = NULL;
-    rbattr.pool_alloc = NULL;
-    rbattr.pool_free = NULL;
+    rbattr.pool = val->pool;
+    rbattr.pool_alloc = (rbtree_pool_alloc_handler)mln_alloc_m;
+    rbattr.pool_free = (rbtree_pool_free_handler)mln_alloc_free;
     rbattr.cmp = mln_json_rbtree_cmp;
     rbattr.data_free = mln_json_free;
     val->index = index;
@@ -287,7 +457,7 @@ mln_json_parse_array(mln_json_t *val, char *jstr, int len, mln_uauto_t index)
     }
 
 again:
-    j = mln_json_new();
+    j = mln_json_pool_new(val->pool);
     if (j == NULL) {
         return -1;
     }
@@ -336,8 +506,8 @@ again:
 static int
 mln_json_parse_string(mln_json_t *j, char *jstr, int len, mln_uauto_t index)
 {
-    mln_u8_t *p, flag = 0;
-    int plen, count = 0;
+    mln_u8ptr_t p, end;
+    int plen, count;
     mln_string_t *str;
     mln_u8ptr_t buf;
 
@@ -347,28 +517,33 @@ mln_json_parse_string(mln_json_t *j, char *jstr, int len, mln_uauto_t index)
         return -1;
     }
 
-    for (p = (mln_u8ptr_t)jstr, plen = len; plen > 0; ++p, ++count, --plen) {
-        if (!flag && *p == (mln_u8_t)'\\') {
-            flag = 1;
-        } else {
-            if (*p == (mln_u8_t)'\"' && (p == (mln_u8ptr_t)jstr || !flag))
-                break;
-            if (flag) flag = 0;
+    for (p = (mln_u8ptr_t)jstr, end = p + len; ; ++p) {
+        p = mln_json_scan_special(p, end);
+        if (p >= end) {
+            return -1;
         }
+        if (*p == (mln_u8_t)'\"') break;
+        if (*p == (mln_u8_t)'\\') ++p;
     }
-    if (plen <= 0) {
-        return -1;
-    }
+    count = p - (mln_u8ptr_t)jstr;
+    plen = end - p;
 
-    buf = mln_json_parse_string_fetch((mln_u8ptr_t)jstr, &count);
+    buf = mln_json_parse_string_fetch(j->pool, (mln_u8ptr_t)jstr, &count);
     if (buf == NULL) {
         return -1;
     }
 
-    str = mln_string_const_ndup((char *)buf, count);
-    free(buf);
-    if (str == NULL) {
-        return -1;
+    if (j->pool != NULL) {
+        if ((str = mln_string_buf_pool_new(j->pool, buf, count)) == NULL) {
+            mln_alloc_free(buf);
+            return -1;
+        }
+    } else {
+        str = mln_string_const_ndup((char *)buf, count);
+        free(buf);
+        if (str == NULL) {
+            return -1;
+        }
     }
 
     j->index = index;
@@ -378,19 +553,35 @@ mln_json_parse_string(mln_json_t *j, char *jstr, int len, mln_uauto_t index)
     return --plen; /* jump off " */
 }
 
-static mln_u8ptr_t mln_json_parse_string_fetch(mln_u8ptr_t jstr, int *len)
+static mln_u8ptr_t mln_json_parse_string_fetch(mln_alloc_t *pool, mln_u8ptr_t jstr, int *len)
 {
     int l = *len, c, count = 0;
     unsigned int hex = 0;
     mln_u8ptr_t p = jstr, buf, q;
-    if ((buf = (mln_u8ptr_t)malloc(l)) == NULL) {
+    if (pool != NULL) {
+        buf = (mln_u8ptr_t)mln_alloc_m(pool, l + 1);
+    } else {
+        buf = (mln_u8ptr_t)malloc(l);
+    }
+    if (buf == NULL) {
         return NULL;
     }
     q = buf;
     while (l > 0) {
+        if (*p != (mln_u8_t)'\\') {
+            mln_u8ptr_t e = (mln_u8ptr_t)memchr(p, '\\', l);
+            c = e == NULL? l: e - p;
+            memcpy(q, p, c);
+            q += c;
+            p += c;
+            l -= c;
+            count += c;
+            continue;
+        }
         c = mln_json_get_char(&p, &l, &hex);
         if (c < 0) {
-            free(buf);
+            if (pool != NULL) mln_alloc_free(buf);
+            else free(buf);
             return NULL;
         } else if (c == 0) {
             mln_json_encode_utf8(hex, &q, &count);
@@ -399,6 +590,7 @@ static mln_u8ptr_t mln_json_parse_string_fetch(mln_u8ptr_t jstr, int *len)
             ++count;
         }
     }
+    if (pool != NULL) buf[count] = 0;
     *len = count;
     return buf;
 }
@@ -530,69 +722,122 @@ mln_json_parse_digit(mln_json_t *j, char *jstr, int len, mln_uauto_t index)
     return left;
 }
 
+static const double mln_json_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/*
+ * Check and convert 8 digits at a time in a 64-bit word.
+ */
+static inline int mln_json_is_8digits(mln_u64_t v)
+{
+    return !(((v & 0xF0F0F0F0F0F0F0F0ULL) | \
+              (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ^ \
+             0x3333333333333333ULL);
+}
+
+static inline mln_u64_t mln_json_parse_8digits(mln_u64_t v)
+{
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    return (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) + \
+            (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+}
+#endif
+
+/*
+ * At most 19 significant digits are kept in *m, *exp10 is the decimal exponent.
+ */
+static inline mln_u8ptr_t
+mln_json_digits(mln_u8ptr_t p, mln_u8ptr_t end, mln_u64_t *m, int *nd, int *exp10, int frac)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    mln_u64_t v;
+    while (end - p >= 8 && *nd + 8 <= 19) {
+        memcpy(&v, p, 8);
+        if (!mln_json_is_8digits(v)) break;
+        *m = *m * 100000000ULL + mln_json_parse_8digits(v);
+        *nd += 8;
+        if (frac) *exp10 -= 8;
+        p += 8;
+    }
+#endif
+    for (; p < end && isdigit(*p); ++p) {
+        if (*nd < 19) {
+            if (*m || *p != '0') {
+                *m = *m * 10 + (*p - '0');
+                ++(*nd);
+            }
+            if (frac) --(*exp10);
+        } else if (!frac) {
+            ++(*exp10);
+        }
+    }
+    return p;
+}
+
+static inline double mln_json_digit_value(mln_u64_t m, int exp10)
+{
+    double val = (double)m;
+
+    if (m == 0) return 0;
+
+    /*
+     * Exact if m and 10^|exp10| are both exactly representable.
+     */
+    if (m <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+        return exp10 < 0? val / mln_json_pow10[-exp10]: val * mln_json_pow10[exp10];
+    }
+
+    for (; exp10 > 22; exp10 -= 22) val *= 1e22;
+    for (; exp10 < -22; exp10 += 22) val /= 1e22;
+    return exp10 < 0? val / mln_json_pow10[-exp10]: val * mln_json_pow10[exp10];
+}
+
 static inline int
 mln_json_digit_process(double *val, char *s, int len)
 {
-    double f = 0;
-    int i, j, dir = 1;
+    mln_u8ptr_t p = (mln_u8ptr_t)s, end = p + len;
+    mln_u64_t m = 0;
+    int nd = 0, exp10 = 0, e = 0, dir = 1;
 
-    if (!isdigit(*s)) return -1;
+    if (!isdigit(*p)) return -1;
 
-    if (s[0] == '0') {
-        ++s; --len;
-        if (len <= 0) return 0;
-        if (isdigit(*s)) return -1;
+    if (*p == '0') {
+        if (++p >= end) goto out;
+        if (isdigit(*p)) return -1;
     } else {
-        for (; len > 0; --len, ++s) {
-            if (!isdigit(*s)) break;
-            (*val) *= 10;
-            (*val) += (*s - '0');
-        }
-        if (len <= 0) return 0;
+        p = mln_json_digits(p, end, &m, &nd, &exp10, 0);
+        if (p >= end) goto out;
     }
 
-    if (*s == '.') {
-        ++s; --len;
-        if (len <= 0) return -1;
-        for (i = 1; len > 0; --len, ++s, ++i) {
-            if (!isdigit(*s)) break;
-            f = *s - '0';
-            for (j = 0; j < i; ++j) {
-                f /= 10;
-            }
-            *val += f;
-        }
-        if (len <= 0) return 0;
+    if (*p == '.') {
+        if (++p >= end) return -1;
+        p = mln_json_digits(p, end, &m, &nd, &exp10, 1);
+        if (p >= end) goto out;
     }
 
-    if (*s == 'e' || *s == 'E') {
-        ++s; --len;
-        if (len <= 0) return -1;
+    if (*p == 'e' || *p == 'E') {
+        if (++p >= end) return -1;
 
-        if (*s == '+') {
-            ++s; --len;
-            if (len <= 0) return 0;
-        } else if (*s == '-') {
+        if (*p == '+') {
+            if (++p >= end) goto out;
+        } else if (*p == '-') {
             dir = 0;
-            ++s; --len;
-            if (len <= 0) return 0;
-        }
-
-        for (i = 0; len > 0; --len, ++s) {
-            if (!isdigit(*s)) break;
-            i *= 10;
-            i += (*s - '0');
+            if (++p >= end) goto out;
         }
-        if (i == 0) return len;
 
-        for (f = 1, j = 0; j < i; ++j) {
-            if (dir) f *= 10;
-            else f /= 10;
+        for (; p < end && isdigit(*p); ++p) {
+            if (e < 10000) e = e * 10 + (*p - '0');
         }
-        (*val) *= f;
+        exp10 += dir? e: -e;
     }
 
-    return len;
+out:
+    *val = mln_json_digit_value(m, exp10);
+    return end - p;
 }
 
 static int
@@ -649,153 +894,229 @@ mln_json_parse_null(mln_json_t *j, char *jstr, int len, mln_uauto_t index)
     return len - 4;
 }
 
-mln_string_t *mln_json_generate(mln_json_t *j)
+/*
+ * generate
+ *
+ * Generation is a single walk over the tree, the text is written into
+ * a growing buffer or into the bufs of a chain.
+ */
+struct mln_json_writer_s {
+    mln_u8ptr_t                  start;
+    mln_u8ptr_t                  pos;
+    mln_u8ptr_t                  end;
+    mln_alloc_t                 *pool;/*chain mode if not NULL*/
+    mln_chain_t                 *head;
+    mln_chain_t                 *tail;
+    int                          first;
+};
+
+static int mln_json_writer_more(mln_json_writer_t *w, mln_size_t n)
 {
-    mln_u32_t size = mln_json_get_length(j), n;
-    mln_s8ptr_t buf;
-    mln_string_t *s;
+    mln_size_t size, used;
+    mln_u8ptr_t ptr;
+    mln_chain_t *c;
+    mln_buf_t *b;
+
+    if (w->pool == NULL) {
+        used = w->pos - w->start;
+        size = (w->end - w->start) << 1;
+        if (size < used + n) size = used + n;
+        if ((ptr = (mln_u8ptr_t)realloc(w->start, size)) == NULL) return -1;
+        w->start = ptr;
+        w->pos = ptr + used;
+        w->end = ptr + size;
+        return 0;
+    }
 
-    buf = (mln_s8ptr_t)malloc(size);
-    if (buf == NULL) return NULL;
+    if (w->tail != NULL) w->tail->buf->last = w->pos;
 
-    n = mln_json_write_content(j, buf);
-    buf[n] = 0;
+    size = n > M_JSON_GENERATE_ALLOC_SIZE? n: M_JSON_GENERATE_ALLOC_SIZE;
+    if ((c = mln_chain_new(w->pool)) == NULL) return -1;
+    if ((b = mln_buf_new(w->pool)) == NULL) {
+        mln_chain_pool_release(c);
+        return -1;
+    }
+    c->buf = b;
+    if ((ptr = (mln_u8ptr_t)mln_alloc_m(w->pool, size)) == NULL) {
+        mln_chain_pool_release(c);
+        return -1;
+    }
+    b->left_pos = b->pos = b->start = b->last = ptr;
+    b->end = ptr + size;
+    b->in_memory = 1;
+    if (w->head == NULL) {
+        w->head = w->tail = c;
+    } else {
+        w->tail->buf->last_buf = 0;
+        w->tail->next = c;
+        w->tail = c;
+    }
+    b->last_buf = 1;
 
-    s = mln_string_const_ndup(buf, n);
-    free(buf);
-    if (s == NULL) return NULL;
+    w->start = w->pos = ptr;
+    w->end = ptr + size;
+    return 0;
+}
 
-    return s;
+#define mln_json_writer_reserve(w,n) \
+    ((mln_size_t)((w)->end - (w)->pos) >= (n) || mln_json_writer_more((w), (n)) == 0)
+
+static inline int mln_json_writer_write(mln_json_writer_t *w, mln_u8ptr_t data, mln_size_t n)
+{
+    mln_size_t room = w->end - w->pos;
+
+    while (n > room) {
+        memcpy(w->pos, data, room);
+        w->pos += room;
+        data += room;
+        n -= room;
+        if (mln_json_writer_more(w, w->pool == NULL? n: 1) < 0) return -1;
+        room = w->end - w->pos;
+    }
+    memcpy(w->pos, data, n);
+    w->pos += n;
+    return 0;
 }
 
-struct mln_json_tmp_s {
-    mln_size_t  *length;
-    mln_s8ptr_t *buf;
-};
+static inline int mln_json_writer_putc(mln_json_writer_t *w, mln_u8_t c)
+{
+    if (!mln_json_writer_reserve(w, 1)) return -1;
+    *(w->pos)++ = c;
+    return 0;
+}
 
-static inline mln_size_t
-mln_json_write_content(mln_json_t *j, mln_s8ptr_t buf)
+static inline int mln_json_write_string(mln_json_writer_t *w, mln_string_t *s)
 {
-    if (j == NULL) return 0;
+    mln_u8ptr_t p, q, end;
+    static const char hex[] = "0123456789abcdef";
+
+    if (mln_json_writer_putc(w, '\"') < 0) return -1;
+
+    if (s != NULL) {
+        for (p = s->data, end = p + s->len; p < end; p = q + 1) {
+            q = mln_json_scan_special(p, end);
+            if (mln_json_writer_write(w, p, q - p) < 0) return -1;
+            if (q >= end) break;
+
+            if (!mln_json_writer_reserve(w, 6)) return -1;
+            *(w->pos)++ = '\\';
+            switch (*q) {
+                case '\"':
+                case '\\':
+                    *(w->pos)++ = *q;
+                    break;
+                case '\b':
+                    *(w->pos)++ = 'b';
+                    break;
+                case '\f':
+                    *(w->pos)++ = 'f';
+                    break;
+                case '\n':
+                    *(w->pos)++ = 'n';
+                    break;
+                case '\r':
+                    *(w->pos)++ = 'r';
+                    break;
+                case '\t':
+                    *(w->pos)++ = 't';
+                    break;
+                default:
+                    *(w->pos)++ = 'u';
+                    *(w->pos)++ = '0';
+                    *(w->pos)++ = '0';
+                    *(w->pos)++ = hex[*q >> 4];
+                    *(w->pos)++ = hex[*q & 0xf];
+                    break;
+            }
+        }
+    }
 
-    int n;
-    mln_size_t length = 0, save;
-    mln_string_t *s;
-    struct mln_json_tmp_s tmp;
-    mln_u8ptr_t p, end;
+    return mln_json_writer_putc(w, '\"');
+}
+
+static inline int mln_json_write_number(mln_json_writer_t *w, double num)
+{
+    mln_s64_t i = (mln_s64_t)num;
+    mln_u64_t u;
+    mln_u8_t tmp[24], *p = tmp + sizeof(tmp);
+
+    if (!mln_json_writer_reserve(w, 512)) return -1;
+
+    if (i != num) {
+        w->pos += snprintf((char *)(w->pos), 512, "%f", num);
+        return 0;
+    }
+
+    u = i < 0? -(mln_u64_t)i: (mln_u64_t)i;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (i < 0) *--p = '-';
+    memcpy(w->pos, p, tmp + sizeof(tmp) - p);
+    w->pos += tmp + sizeof(tmp) - p;
+    return 0;
+}
+
+static int mln_json_write_content(mln_json_t *j, mln_json_writer_t *w)
+{
+    if (j == NULL) return 0;
 
     switch (j->type) {
         case M_JSON_OBJECT:
-            *buf++ = '{'; ++length;
-            tmp.length = &length;
-            tmp.buf = &buf;
-            save = length;
-            if (j->data.m_j_obj != NULL)
-                mln_hash_iterate(j->data.m_j_obj, \
-                                  mln_json_write_content_hash_iterate_handler, \
-                                  &tmp);
-            if (save < length) {
-                --buf; --length;
-                *buf = 0;
+            if (mln_json_writer_putc(w, '{') < 0) return -1;
+            w->first = 1;
+            if (j->compact) {
+                if (mln_json_write_content_vec(j->data.m_j_vec, w) < 0) return -1;
+            } else if (j->data.m_j_obj != NULL) {
+                if (mln_hash_iterate(j->data.m_j_obj, \
+                                      mln_json_write_content_hash_iterate_handler, \
+                                      w) < 0)
+                    return -1;
             }
-            *buf++ = '}'; ++length;
-            break;
+            return mln_json_writer_putc(w, '}');
         case M_JSON_ARRAY:
-            *buf++ = '['; ++length;
-            tmp.length = &length;
-            tmp.buf = &buf;
-            save = length;
-            if (j->data.m_j_array != NULL)
-                mln_rbtree_iterate(j->data.m_j_array, \
-                                    mln_json_write_content_rbtree_iterate_handler, \
-                                    &tmp);
-            if (save < length) {
-                --buf; --length;
-                *buf = 0;
+            if (mln_json_writer_putc(w, '[') < 0) return -1;
+            w->first = 1;
+            if (j->compact) {
+                if (mln_json_write_content_vec(j->data.m_j_vec, w) < 0) return -1;
+            } else if (j->data.m_j_array != NULL) {
+                if (mln_rbtree_iterate(j->data.m_j_array, \
+                                        mln_json_write_content_rbtree_iterate_handler, \
+                                        w) < 0)
+                    return -1;
             }
-            *buf++ = ']'; ++length;
-            break;
+            return mln_json_writer_putc(w, ']');
         case M_JSON_STRING:
-            *buf++ = '\"'; ++length;
-            if ((s = j->data.m_j_string) != NULL) {
-                p = j->data.m_j_string->data;
-                end = p + j->data.m_j_string->len;
-                for (; p < end; ) {
-                    if (*p == '\"' || *p == '\\') {
-                        *buf++ = '\\';
-                        ++length;
-                    }
-                    *buf++ = *p++;
-                    ++length;
-                }
-            }
-            *buf++ = '\"'; ++length;
-            break;
+            return mln_json_write_string(w, j->data.m_j_string);
         case M_JSON_NUM:
-        {
-            mln_s64_t i = (mln_s64_t)(j->data.m_j_number);
-            if (i == j->data.m_j_number)
-#if defined(WIN32)
-                n = snprintf(buf, 512, "%I64d", i);
-#elif defined(i386) || defined(__arm__) || defined(__wasm__)
-                n = snprintf(buf, 512, "%lld", i);
-#else
-                n = snprintf(buf, 512, "%ld", i);
-#endif
-            else
-                n = snprintf(buf, 512, "%f", j->data.m_j_number);
-            buf += n;
-            length += n;
-            break;
-        }
+            return mln_json_write_number(w, j->data.m_j_number);
         case M_JSON_TRUE:
-            memcpy(buf, "true", 4);
-            buf += 4;
-            length += 4;
-            break;
+            return mln_json_writer_write(w, (mln_u8ptr_t)"true", 4);
         case M_JSON_FALSE:
-            memcpy(buf, "false", 5);
-            buf += 5;
-            length += 5;
-            break;
+            return mln_json_writer_write(w, (mln_u8ptr_t)"false", 5);
         case M_JSON_NULL:
-            memcpy(buf, "null", 4);
-            buf += 4;
-            length += 4;
-            break;
+            return mln_json_writer_write(w, (mln_u8ptr_t)"null", 4);
         default:
             break;
     }
 
-    return length;
+    return 0;
 }
 
 static int
 mln_json_write_content_hash_iterate_handler(void *key, void *val, void *data)
 {
     mln_json_obj_t *obj = (mln_json_obj_t *)val;
-    struct mln_json_tmp_s *tmp = (struct mln_json_tmp_s *)data;
-    mln_s8ptr_t *buf = tmp->buf;
-    mln_size_t *length = tmp->length;
-    mln_size_t n;
+    mln_json_writer_t *w = (mln_json_writer_t *)data;
 
     if (obj == NULL) return 0;
 
-    if (obj->key != NULL) {
-        n = mln_json_write_content(obj->key, *buf);
-        (*buf) += n;
-        (*length) += n;
-    }
-    *(*buf)++ = ':';
-    ++(*length);
-    if (obj->val != NULL) {
-        n = mln_json_write_content(obj->val, *buf);
-        (*buf) += n;
-        (*length) += n;
-    }
-
-    *(*buf)++ = ',';
-    (*length) += 1;
+    if (!w->first && mln_json_writer_putc(w, ',') < 0) return -1;
+    if (obj->key != NULL && mln_json_write_content(obj->key, w) < 0) return -1;
+    if (mln_json_writer_putc(w, ':') < 0) return -1;
+    if (obj->val != NULL && mln_json_write_content(obj->val, w) < 0) return -1;
+    w->first = 0;
 
     return 0;
 }
@@ -804,114 +1125,84 @@ static int
 mln_json_write_content_rbtree_iterate_handler(mln_rbtree_node_t *node, void *data)
 {
     mln_json_t *j = (mln_json_t *)mln_rbtree_node_data(node);
-    struct mln_json_tmp_s *tmp = (struct mln_json_tmp_s *)data;
-    mln_size_t *length = tmp->length, n;
-    mln_s8ptr_t *buf = tmp->buf;
+    mln_json_writer_t *w = (mln_json_writer_t *)data;
 
     if (j == NULL) return 0;
 
-    n = mln_json_write_content(j, *buf);
-    (*buf) += n;
-    (*length) += n;
-
-    *(*buf)++ = ',';
-    (*length) += 1;
+    if (!w->first && mln_json_writer_putc(w, ',') < 0) return -1;
+    if (mln_json_write_content(j, w) < 0) return -1;
+    w->first = 0;
 
     return 0;
 }
 
-static inline mln_size_t mln_json_get_length(mln_json_t *j)
+static int mln_json_write_content_vec(mln_json_vec_t *v, mln_json_writer_t *w)
 {
-    if (j == NULL) return 0;
+    mln_u32_t i;
 
-    char num_str[512] = {0};
-    mln_size_t length = 1;
-    mln_u8ptr_t p, end;
-
-    switch (j->type) {
-        case M_JSON_OBJECT:
-            length += 2;
-            if (j->data.m_j_obj != NULL)
-                mln_hash_iterate(j->data.m_j_obj, mln_json_get_length_hash_iterate_handler, &length);
-            break;
-        case M_JSON_ARRAY:
-            length += 2;
-            if (j->data.m_j_array != NULL)
-                mln_rbtree_iterate(j->data.m_j_array, \
-                                    mln_json_get_length_rbtree_iterate_handler, \
-                                    &length);
-            break;
-        case M_JSON_STRING:
-            length += 2;
-            if (j->data.m_j_string != NULL) {
-                p = j->data.m_j_string->data;
-                end = p + j->data.m_j_string->len;
-                for (; p < end; ++p) {
-                    if (*p == '\"' || *p == '\\')
-                        ++length;
-                }
-                length += j->data.m_j_string->len;
-            }
-            break;
-        case M_JSON_NUM:
-            length += snprintf(num_str, sizeof(num_str), "%f", j->data.m_j_number);
-            break;
-        case M_JSON_TRUE:
-            length += 4;
-            break;
-        case M_JSON_FALSE:
-            length += 5;
-            break;
-        case M_JSON_NULL:
-            length += 4;
-            break;
-        default:
-            break;
+    for (i = 0; i < v->nelts; ++i) {
+        if (i && mln_json_writer_putc(w, ',') < 0) return -1;
+        if (v->keys != NULL) {
+            if (mln_json_write_string(w, &(v->keys[i])) < 0) return -1;
+            if (mln_json_writer_putc(w, ':') < 0) return -1;
+        }
+        if (mln_json_write_content(&(v->vals[i]), w) < 0) return -1;
     }
 
-    return length;
+    return 0;
 }
 
-static int
-mln_json_get_length_hash_iterate_handler(void *key, void *val, void *data)
+mln_string_t *mln_json_generate(mln_json_t *j)
 {
-    mln_json_obj_t *obj = (mln_json_obj_t *)val;
-    mln_size_t *length = (mln_size_t *)data;
+    mln_json_writer_t w;
+    mln_string_t *s;
 
-    if (obj == NULL) return 0;
+    memset(&w, 0, sizeof(w));
+    if (mln_json_writer_more(&w, M_JSON_GENERATE_ALLOC_SIZE) < 0) return NULL;
 
-    if (obj->key != NULL) {
-        (*length) += mln_json_get_length(obj->key);
-    }
-    if (obj->val != NULL) {
-        (*length) += mln_json_get_length(obj->val);
+    if (mln_json_write_content(j, &w) < 0 || mln_json_writer_putc(&w, 0) < 0) {
+        free(w.start);
+        return NULL;
     }
 
-    (*length) += 2;
+    if ((s = mln_string_buf_new(w.start, w.pos - w.start - 1)) == NULL) {
+        free(w.start);
+        return NULL;
+    }
 
-    return 0;
+    return s;
 }
 
-static int
-mln_json_get_length_rbtree_iterate_handler(mln_rbtree_node_t *node, void *data)
+mln_chain_t *mln_json_generate_chain(mln_alloc_t *pool, mln_json_t *j)
 {
-    mln_json_t *j = (mln_json_t *)mln_rbtree_node_data(node);
-    mln_size_t *length = (mln_size_t *)data;
+    mln_json_writer_t w;
 
-    if (j == NULL) return 0;
+    memset(&w, 0, sizeof(w));
+    w.pool = pool;
+    if (mln_json_writer_more(&w, M_JSON_GENERATE_ALLOC_SIZE) < 0) return NULL;
 
-    (*length) += mln_json_get_length(j);
-    (*length) += 1;
+    if (mln_json_write_content(j, &w) < 0) {
+        mln_chain_pool_release_all(w.head);
+        return NULL;
+    }
+    w.tail->buf->last = w.pos;
 
-    return 0;
+    return w.head;
 }
 
 /*
  * tools
  */
-static inline mln_json_obj_t *mln_json_obj_new(void)
+static inline mln_json_obj_t *mln_json_obj_new(mln_alloc_t *pool)
 {
-    return (mln_json_obj_t *)calloc(1, sizeof(mln_json_obj_t));
+    mln_json_obj_t *obj;
+
+    if (pool == NULL) return (mln_json_obj_t *)calloc(1, sizeof(mln_json_obj_t));
+
+    if ((obj = (mln_json_obj_t *)mln_alloc_c(pool, sizeof(mln_json_obj_t))) == NULL)
+        return NULL;
+    obj->pool = pool;
+    return obj;
 }
 
 static mln_u64_t mln_json_hash_calc(mln_hash_t *h, void *key)
@@ -946,7 +1237,8 @@ static void mln_json_obj_free(void *data)
         mln_json_free(obj->val);
     }
 
-    free(obj);
+    if (obj->pool != NULL) mln_alloc_free(obj);
+    else free(obj);
 }
 
 static int mln_json_rbtree_cmp(const void *data1, const void *data2)
@@ -965,10 +1257,10 @@ static int mln_json_rbtree_cmp(const void *data1, const void *data2)
 
 static inline void mln_json_jumpoff_blank(char **jstr, int *len)
 {
-    for (; \
-         *len > 0 && (*jstr[0] == ' ' || *jstr[0] == '\t' || *jstr[0] == '\r' || *jstr[0] == '\n'); \
-         ++(*jstr), --(*len))
-        ;
+    mln_u8ptr_t p = mln_json_scan_blank((mln_u8ptr_t)*jstr, (mln_u8ptr_t)*jstr + *len);
+
+    *len -= p - (mln_u8ptr_t)*jstr;
+    *jstr = (char *)p;
 }
 
 /*
@@ -989,12 +1281,16 @@ void mln_json_dump(mln_json_t *j, int n_space, char *prefix)
     switch (j->type) {
         case M_JSON_OBJECT:
             printf("type:object\n");
-            if (j->data.m_j_obj != NULL)
+            if (j->compact)
+                mln_json_dump_vec(j->data.m_j_vec, space);
+            else if (j->data.m_j_obj != NULL)
                 mln_hash_iterate(j->data.m_j_obj, mln_json_dump_hash_iterate_handler, &space);
             break;
         case M_JSON_ARRAY:
             printf("type:array\n");
-            if (j->data.m_j_array != NULL)
+            if (j->compact)
+                mln_json_dump_vec(j->data.m_j_vec, space);
+            else if (j->data.m_j_array != NULL)
                 mln_rbtree_iterate(j->data.m_j_array, \
                                     mln_json_dump_rbtree_iterate_handler, \
                                     &space);
@@ -1021,6 +1317,24 @@ void mln_json_dump(mln_json_t *j, int n_space, char *prefix)
     }
 }
 
+static void mln_json_dump_vec(mln_json_vec_t *v, int space)
+{
+    mln_json_t key;
+    mln_u32_t i;
+
+    memset(&key, 0, sizeof(key));
+    key.type = M_JSON_STRING;
+    for (i = 0; i < v->nelts; ++i) {
+        if (v->keys != NULL) {
+            key.data.m_j_string = &(v->keys[i]);
+            mln_json_dump(&key, space, "Object key:");
+            mln_json_dump(&(v->vals[i]), space, "Object value:");
+        } else {
+            mln_json_dump(&(v->vals[i]), space, "Array member:");
+        }
+    }
+}
+
 static int mln_json_dump_hash_iterate_handler(void *key, void *val, void *data)
 {
     int *space = (int *)data;
@@ -1053,12 +1367,14 @@ mln_json_t *mln_json_search_value(mln_json_t *j, mln_string_t *key)
 
     if (!M_JSON_IS_OBJECT(j)) return NULL;
 
+    if (j->compact) return mln_json_compact_search(j->data.m_j_vec, key);
+
     mln_hash_t *h = j->data.m_j_obj;
     if (h == NULL) return NULL;
 
     mln_json_obj_t *obj = (mln_json_obj_t *)mln_hash_search(h, key);
 
-    return obj->val;
+    return obj == NULL? NULL: obj->val;
 }
 
 mln_json_t *mln_json_search_element(mln_json_t *j, mln_uauto_t index)
@@ -1067,6 +1383,11 @@ mln_json_t *mln_json_search_element(mln_json_t *j, mln_uauto_t index)
 
     if (!M_JSON_IS_ARRAY(j)) return NULL;
 
+    if (j->compact) {
+        if (index < 1 || index > j->data.m_j_vec->nelts) return NULL;
+        return &(j->data.m_j_vec->vals[index - 1]);
+    }
+
     mln_rbtree_t *t = j->data.m_j_array;
     if (t == NULL) return NULL;
 
@@ -1085,6 +1406,8 @@ mln_uauto_t mln_json_get_array_length(mln_json_t *j)
 
     if (!M_JSON_IS_ARRAY(j)) return 0;
 
+    if (j->compact) return j->data.m_j_vec->nelts;
+
     mln_rbtree_t *t = j->data.m_j_array;
     if (t == NULL) return 0;
 
@@ -1097,7 +1420,7 @@ mln_uauto_t mln_json_get_array_length(mln_json_t *j)
 int mln_json_update_obj(mln_json_t *j, mln_json_t *key, mln_json_t *val)
 {
     if (j == NULL || key == NULL) return -1;
-    if (!M_JSON_IS_STRING(key)) return -1;
+    if (!M_JSON_IS_STRING(key) || j->compact) return -1;
 
     int is_new = 0;
     mln_json_obj_t *obj;
@@ -1106,9 +1429,9 @@ int mln_json_update_obj(mln_json_t *j, mln_json_t *key, mln_json_t *val)
         is_new = 1;
         M_JSON_SET_TYPE_OBJECT(j);
         struct mln_hash_attr hattr;
-        hattr.pool = NULL;
-        hattr.pool_alloc = NULL;
-        hattr.pool_free = NULL;
+        hattr.pool = j->pool;
+        hattr.pool_alloc = (hash_pool_alloc_handler)mln_alloc_m;
+        hattr.pool_free = (hash_pool_free_handler)mln_alloc_free;
         hattr.hash = mln_json_hash_calc;
         hattr.cmp = mln_json_hash_cmp;
         hattr.free_key = NULL;
@@ -1116,6 +1439,7 @@ int mln_json_update_obj(mln_json_t *j, mln_json_t *key, mln_json_t *val)
         hattr.len_base = M_JSON_HASH_LEN;
         hattr.expandable = 1;
         hattr.calc_prime = 0;
+        hattr.incremental = 0;
         j->data.m_j_obj = mln_hash_new(&hattr);
         if (j->data.m_j_obj == NULL) {
             return -1;
@@ -1126,7 +1450,7 @@ int mln_json_update_obj(mln_json_t *j, mln_json_t *key, mln_json_t *val)
 
     obj = mln_hash_search(j->data.m_j_obj, key->data.m_j_string);
     if (obj == NULL) {
-        obj = mln_json_obj_new();
+        obj = mln_json_obj_new(j->pool);
         if (obj == NULL) {
             if (is_new) {
                 M_JSON_SET_TYPE_NONE(j);
@@ -1157,15 +1481,16 @@ int mln_json_update_obj(mln_json_t *j, mln_json_t *key, mln_json_t *val)
 int mln_json_add_element(mln_json_t *j, mln_json_t *value)
 {
     if (j == NULL || value == NULL) return -1;
+    if (j->compact) return -1;
 
     int is_new = 0;
     mln_rbtree_node_t *rn;
     if (M_JSON_IS_NONE(j) || (M_JSON_IS_ARRAY(j) && j->data.m_j_array == NULL)) {
         is_new = 1;
         struct mln_rbtree_attr rbattr;
-        rbattr.pool = NULL;
-        rbattr.pool_alloc = NULL;
-        rbattr.pool_free = NULL;
+        rbattr.pool = j->pool;
+        rbattr.pool_alloc = (rbtree_pool_alloc_handler)mln_alloc_m;
+        rbattr.pool_free = (rbtree_pool_free_handler)mln_alloc_free;
         rbattr.cmp = mln_json_rbtree_cmp;
         rbattr.data_free = mln_json_free;
         j->data.m_j_array = mln_rbtree_new(&rbattr);
@@ -1193,7 +1518,7 @@ int mln_json_add_element(mln_json_t *j, mln_json_t *value)
 int mln_json_update_element(mln_json_t *j, mln_json_t *value, mln_uauto_t index)
 {
     if (j == NULL || value == NULL) return -1;
-    if (!M_JSON_IS_ARRAY(j)) return -1;
+    if (!M_JSON_IS_ARRAY(j) || j->compact) return -1;
     if (M_JSON_GET_DATA_ARRAY(j) == NULL) return -1;
 
     mln_json_t tmp, *elem;
@@ -1222,7 +1547,7 @@ int mln_json_update_element(mln_json_t *j, mln_json_t *value, mln_uauto_t index)
  */
 void mln_json_reset(mln_json_t *j)
 {
-    if (j == NULL) return;
+    if (j == NULL || j->compact) return;
 
     switch (j->type) {
         case M_JSON_OBJECT:
@@ -1244,13 +1569,15 @@ void mln_json_reset(mln_json_t *j)
             break;
     }
 
+    mln_alloc_t *pool = j->pool;
     memset(j, 0, sizeof(mln_json_t));
+    j->pool = pool;
 }
 
 mln_json_t *mln_json_remove_object(mln_json_t *j, mln_string_t *key)
 {
     if (j == NULL || key == NULL) return NULL;
-    if (!M_JSON_IS_OBJECT(j)) return NULL;
+    if (!M_JSON_IS_OBJECT(j) || j->compact) return NULL;
 
     mln_json_t *val;
     mln_json_obj_t *obj;
@@ -1270,7 +1597,7 @@ mln_json_t *mln_json_remove_object(mln_json_t *j, mln_string_t *key)
 mln_json_t *mln_json_remove_element(mln_json_t *j, mln_uauto_t index)
 {
     if (j == NULL) return NULL;
-    if (!M_JSON_IS_ARRAY(j)) return NULL;
+    if (!M_JSON_IS_ARRAY(j) || j->compact) return NULL;
 
     mln_json_t *val, tmp;
     mln_rbtree_node_t *rn;
@@ -1289,3 +1616,602 @@ mln_json_t *mln_json_remove_element(mln_json_t *j, mln_uauto_t index)
     return val;
 }
 
+
+/*
+ * stream
+ */
+enum {
+    M_JSON_STREAM_ST_ROOT = 0,
+    M_JSON_STREAM_ST_VALUE,
+    M_JSON_STREAM_ST_ARRAY_FIRST,
+    M_JSON_STREAM_ST_OBJ_FIRST,
+    M_JSON_STREAM_ST_KEY,
+    M_JSON_STREAM_ST_COLON,
+    M_JSON_STREAM_ST_NEXT,
+    M_JSON_STREAM_ST_STRING,
+    M_JSON_STREAM_ST_NUMBER,
+    M_JSON_STREAM_ST_LITERAL,
+    M_JSON_STREAM_ST_DONE
+};
+
+#define mln_json_stream_is_digit(c) \
+    (((c) >= '0' && (c) <= '9') || (c) == '.' || (c) == '-' || (c) == '+' || (c) == 'e' || (c) == 'E')
+
+static inline void
+mln_json_stream_init(mln_json_stream_t *s, mln_alloc_t *pool, mln_json_stream_handler handler, void *data)
+{
+    memset(s, 0, sizeof(mln_json_stream_t));
+    s->pool = pool;
+    s->handler = handler;
+    s->data = data;
+    s->state = M_JSON_STREAM_ST_ROOT;
+}
+
+mln_json_stream_t *
+mln_json_stream_new(mln_alloc_t *pool, mln_json_stream_handler handler, void *data)
+{
+    mln_json_stream_t *s;
+
+    if (pool != NULL) s = (mln_json_stream_t *)mln_alloc_m(pool, sizeof(mln_json_stream_t));
+    else s = (mln_json_stream_t *)malloc(sizeof(mln_json_stream_t));
+    if (s == NULL) return NULL;
+
+    mln_json_stream_init(s, pool, handler, data);
+    return s;
+}
+
+void mln_json_stream_free(mln_json_stream_t *s)
+{
+    if (s == NULL) return;
+
+    if (s->pool != NULL) {
+        if (s->stack != NULL) mln_alloc_free(s->stack);
+        if (s->buf != NULL) mln_alloc_free(s->buf);
+        mln_alloc_free(s);
+    } else {
+        if (s->stack != NULL) free(s->stack);
+        if (s->buf != NULL) free(s->buf);
+        free(s);
+    }
+}
+
+void mln_json_stream_reset(mln_json_stream_t *s)
+{
+    s->depth = 0;
+    s->buf_len = 0;
+    s->lit = NULL;
+    s->lit_pos = 0;
+    s->state = M_JSON_STREAM_ST_ROOT;
+    s->is_key = s->escape = s->has_esc = 0;
+}
+
+static inline void *mln_json_stream_realloc(mln_json_stream_t *s, void *ptr, mln_size_t size)
+{
+    if (s->pool == NULL) return realloc(ptr, size);
+    if (ptr == NULL) return mln_alloc_m(s->pool, size);
+    return mln_alloc_re(s->pool, ptr, size);
+}
+
+static inline int mln_json_stream_push(mln_json_stream_t *s, mln_u8_t type)
+{
+    if (s->depth >= s->stack_size) {
+        mln_size_t n = s->stack_size? s->stack_size << 1: 32;
+        mln_u8ptr_t ptr = (mln_u8ptr_t)mln_json_stream_realloc(s, s->stack, n);
+        if (ptr == NULL) return -1;
+        s->stack = ptr;
+        s->stack_size = n;
+    }
+    s->stack[s->depth++] = type;
+    return 0;
+}
+
+static inline int mln_json_stream_append(mln_json_stream_t *s, mln_u8ptr_t data, mln_size_t len)
+{
+    if (s->buf_len + len > s->buf_size) {
+        mln_size_t n = s->buf_size? s->buf_size: 256;
+        mln_u8ptr_t ptr;
+        while (n < s->buf_len + len) n <<= 1;
+        if ((ptr = (mln_u8ptr_t)mln_json_stream_realloc(s, s->buf, n)) == NULL) return -1;
+        s->buf = ptr;
+        s->buf_size = n;
+    }
+    memcpy(s->buf + s->buf_len, data, len);
+    s->buf_len += len;
+    return 0;
+}
+
+/*
+ * escapes are decoded in place, the output is never longer than the input.
+ */
+static inline int mln_json_stream_unescape(mln_json_stream_t *s)
+{
+    mln_u8ptr_t p = s->buf, q = s->buf;
+    int l = s->buf_len, c, count = 0;
+    unsigned int hex = 0;
+
+    while (l > 0) {
+        c = mln_json_get_char(&p, &l, &hex);
+        if (c < 0) {
+            return -1;
+        } else if (c == 0) {
+            mln_json_encode_utf8(hex, &q, &count);
+        } else {
+            *q++ = (mln_u8_t)c;
+            ++count;
+        }
+    }
+    s->buf_len = count;
+    return 0;
+}
+
+static inline int mln_json_stream_value_begin(mln_json_stream_t *s, mln_u8_t c)
+{
+    switch (c) {
+        case '{':
+            if (mln_json_stream_push(s, M_JSON_OBJECT) < 0) return -1;
+            s->state = M_JSON_STREAM_ST_OBJ_FIRST;
+            s->val.type = M_JSON_OBJECT;
+            return M_JSON_STREAM_OBJ_BEGIN;
+        case '[':
+            if (mln_json_stream_push(s, M_JSON_ARRAY) < 0) return -1;
+            s->state = M_JSON_STREAM_ST_ARRAY_FIRST;
+            s->val.type = M_JSON_ARRAY;
+            return M_JSON_STREAM_ARRAY_BEGIN;
+        case '\"':
+            s->state = M_JSON_STREAM_ST_STRING;
+            s->is_key = s->escape = s->has_esc = 0;
+            s->buf_len = 0;
+            return 0;
+        case 't':
+        case 'T':
+            s->lit = "true";
+            s->val.type = M_JSON_TRUE;
+            s->val.data.m_j_true = 1;
+            goto lit;
+        case 'f':
+        case 'F':
+            s->lit = "false";
+            s->val.type = M_JSON_FALSE;
+            s->val.data.m_j_false = 1;
+            goto lit;
+        case 'n':
+        case 'N':
+            s->lit = "null";
+            s->val.type = M_JSON_NULL;
+            s->val.data.m_j_null = NULL;
+lit:
+            s->lit_pos = 1;
+            s->state = M_JSON_STREAM_ST_LITERAL;
+            return 0;
+        default:
+            if (isdigit(c) || c == '-') {
+                s->state = M_JSON_STREAM_ST_NUMBER;
+                s->buf_len = 0;
+                return 0;
+            }
+            break;
+    }
+    return -1;
+}
+
+static inline void mln_json_stream_value_end(mln_json_stream_t *s)
+{
+    s->state = s->depth? M_JSON_STREAM_ST_NEXT: M_JSON_STREAM_ST_DONE;
+}
+
+#define mln_json_stream_emit(s,ev,p) \
+    if ((s)->handler != NULL && (s)->handler((s), (ev), &((s)->val), (s)->data)) {\
+        *pos = (p);\
+        return M_JSON_STREAM_STOP;\
+    }
+
+static int mln_json_stream_parse(mln_json_stream_t *s, mln_u8ptr_t *pos, mln_u8ptr_t end)
+{
+    mln_u8ptr_t p = *pos, q;
+    int ev, n;
+
+    while (p < end) {
+        switch (s->state) {
+            case M_JSON_STREAM_ST_ROOT:
+                if (mln_json_is_blank(*p)) {
+                    p = mln_json_scan_blank(p, end);
+                    break;
+                }
+                if (*p != '{' && *p != '[') return M_JSON_STREAM_ERROR;
+                /* fall through */
+            case M_JSON_STREAM_ST_VALUE:
+value:
+                if (mln_json_is_blank(*p)) {
+                    p = mln_json_scan_blank(p, end);
+                    break;
+                }
+                if ((ev = mln_json_stream_value_begin(s, *p)) < 0) return M_JSON_STREAM_ERROR;
+                if (s->state == M_JSON_STREAM_ST_NUMBER) break; /*the first digit is part of the token*/
+                ++p;
+                if (s->state == M_JSON_STREAM_ST_OBJ_FIRST || s->state == M_JSON_STREAM_ST_ARRAY_FIRST) {
+                    mln_json_stream_emit(s, ev, p);
+                }
+                break;
+            case M_JSON_STREAM_ST_ARRAY_FIRST:
+                if (mln_json_is_blank(*p)) {
+                    p = mln_json_scan_blank(p, end);
+                    break;
+                }
+                if (*p != ']') goto value;
+                goto close;
+            case M_JSON_STREAM_ST_OBJ_FIRST:
+                if (mln_json_is_blank(*p)) {
+                    p = mln_json_scan_blank(p, end);
+                    break;
+                }
+                if (*p == '}') goto close;
+                /* fall through */
+            case M_JSON_STREAM_ST_KEY:
+                if (mln_json_is_blank(*p)) {
+                    p = mln_json_scan_blank(p, end);
+                    break;
+                }
+                if (*p != '\"') return M_JSON_STREAM_ERROR;
+                ++p;
+                s->state = M_JSON_STREAM_ST_STRING;
+                s->is_key = 1;
+                s->escape = s->has_esc = 0;
+                s->buf_len = 0;
+                break;
+            case M_JSON_STREAM_ST_COLON:
+                if (mln_json_is_blank(*p)) {
+                    p = mln_json_scan_blank(p, end);
+                    break;
+                }
+                if (*p != ':') return M_JSON_STREAM_ERROR;
+                ++p;
+                s->state = M_JSON_STREAM_ST_VALUE;
+                break;
+            case M_JSON_STREAM_ST_NEXT:
+                if (mln_json_is_blank(*p)) {
+                    p = mln_json_scan_blank(p, end);
+                    break;
+                }
+                if (*p == ',') {
+                    ++p;
+                    s->state = s->stack[s->depth - 1] == M_JSON_OBJECT? M_JSON_STREAM_ST_KEY: M_JSON_STREAM_ST_VALUE;
+                    break;
+                }
+close:
+                if ((*p == '}' && s->stack[s->depth - 1] == M_JSON_OBJECT) || \
+                    (*p == ']' && s->stack[s->depth - 1] == M_JSON_ARRAY))
+                {
+                    s->val.type = s->stack[--(s->depth)];
+                    ++p;
+                    mln_json_stream_value_end(s);
+                    mln_json_stream_emit(s, s->val.type == M_JSON_OBJECT? M_JSON_STREAM_OBJ_END: M_JSON_STREAM_ARRAY_END, p);
+                    if (s->state == M_JSON_STREAM_ST_DONE) {
+                        *pos = p;
+                        return M_JSON_STREAM_DONE;
+                    }
+                    break;
+                }
+                return M_JSON_STREAM_ERROR;
+            case M_JSON_STREAM_ST_STRING:
+                q = p;
+                if (s->escape) {
+                    s->escape = 0;
+                    ++p;
+                }
+                for (; (p = mln_json_scan_special(p, end)) < end; ++p) {
+                    if (*p == '\"') break;
+                    if (*p == '\\') {
+                        s->has_esc = 1;
+                        if (++p >= end) {
+                            s->escape = 1;
+                            break;
+                        }
+                    }
+                }
+                if (p >= end || s->buf_len || s->has_esc) {
+                    if (mln_json_stream_append(s, q, p - q) < 0) return M_JSON_STREAM_ERROR;
+                    if (p >= end) break;
+                    if (s->has_esc && mln_json_stream_unescape(s) < 0) return M_JSON_STREAM_ERROR;
+                    q = s->buf;
+                    mln_string_nset(&(s->str), q, s->buf_len);
+                } else {
+                    mln_string_nset(&(s->str), q, p - q);
+                }
+                ++p;
+                s->val.type = M_JSON_STRING;
+                s->val.data.m_j_string = &(s->str);
+                if (s->is_key) {
+                    s->state = M_JSON_STREAM_ST_COLON;
+                    mln_json_stream_emit(s, M_JSON_STREAM_KEY, p);
+                } else {
+                    mln_json_stream_value_end(s);
+                    mln_json_stream_emit(s, M_JSON_STREAM_VALUE, p);
+                }
+                break;
+            case M_JSON_STREAM_ST_NUMBER:
+                for (q = p; p < end && mln_json_stream_is_digit(*p); ++p)
+                    ;
+                if (p >= end || s->buf_len) {
+                    if (mln_json_stream_append(s, q, p - q) < 0) return M_JSON_STREAM_ERROR;
+                    if (p >= end) break;
+                    q = s->buf;
+                    n = s->buf_len;
+                } else {
+                    n = p - q;
+                }
+                if (mln_json_parse_digit(&(s->val), (char *)q, n, 0) != 0) return M_JSON_STREAM_ERROR;
+                mln_json_stream_value_end(s);
+                mln_json_stream_emit(s, M_JSON_STREAM_VALUE, p);
+                break;
+            case M_JSON_STREAM_ST_LITERAL:
+                for (; p < end && s->lit[s->lit_pos]; ++p, ++(s->lit_pos)) {
+                    if (tolower(*p) != s->lit[s->lit_pos]) return M_JSON_STREAM_ERROR;
+                }
+                if (s->lit[s->lit_pos]) break;
+                mln_json_stream_value_end(s);
+                mln_json_stream_emit(s, M_JSON_STREAM_VALUE, p);
+                break;
+            default: /* M_JSON_STREAM_ST_DONE */
+                *pos = p;
+                return M_JSON_STREAM_DONE;
+        }
+    }
+
+    *pos = p;
+    return s->state == M_JSON_STREAM_ST_DONE? M_JSON_STREAM_DONE: M_JSON_STREAM_AGAIN;
+}
+
+int mln_json_stream_feed(mln_json_stream_t *s, mln_u8ptr_t data, mln_size_t *len)
+{
+    int rc;
+    mln_u8ptr_t p = data;
+
+    rc = mln_json_stream_parse(s, &p, data + *len);
+    *len = p - data;
+    return rc;
+}
+
+int mln_json_stream_feed_chain(mln_json_stream_t *s, mln_chain_t *c)
+{
+    int rc = M_JSON_STREAM_AGAIN;
+    mln_buf_t *b;
+
+    for (; c != NULL; c = c->next) {
+        if ((b = c->buf) == NULL) continue;
+        if (!b->in_memory) return M_JSON_STREAM_ERROR;
+        if (b->left_pos >= b->last) continue;
+
+        rc = mln_json_stream_parse(s, &(b->left_pos), b->last);
+        if (rc != M_JSON_STREAM_AGAIN) break;
+    }
+
+    return rc;
+}
+
+/*
+ * compact
+ */
+#define M_JSON_COMPACT_ENTRY_NUM 64
+
+typedef struct {
+    mln_string_t                 key;
+    mln_json_t                   val;
+} mln_json_compact_entry_t;
+
+/*
+ * Members of all open containers are kept in entries until the container
+ * is closed, then they are moved into one exactly sized vector.
+ */
+typedef struct {
+    mln_alloc_t                 *arena;
+    mln_json_compact_entry_t    *entries;
+    mln_size_t                   nentries;
+    mln_size_t                   size;
+    mln_size_t                   cur;/*position of the innermost open container plus 1*/
+    mln_string_t                 key;
+    mln_json_compact_entry_t     small[M_JSON_COMPACT_ENTRY_NUM];
+} mln_json_compact_t;
+
+static inline mln_u32_t mln_json_compact_hash(mln_u8ptr_t data, mln_u64_t len)
+{
+    mln_u32_t h = 2166136261U;
+    mln_u8ptr_t end = data + len;
+
+    for (; data < end; ++data) {
+        h ^= *data;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static inline mln_u8ptr_t mln_json_compact_strcpy(mln_alloc_t *arena, mln_string_t *str, mln_u8ptr_t buf)
+{
+    if (buf == NULL && (buf = (mln_u8ptr_t)mln_alloc_m(arena, str->len + 1)) == NULL)
+        return NULL;
+    memcpy(buf, str->data, str->len);
+    buf[str->len] = 0;
+    return buf;
+}
+
+static inline mln_json_compact_entry_t *mln_json_compact_entry_new(mln_json_compact_t *c)
+{
+    mln_json_compact_entry_t *e;
+
+    if (c->nentries >= c->size) {
+        if (c->entries == c->small) {
+            e = (mln_json_compact_entry_t *)malloc((c->size << 1) * sizeof(mln_json_compact_entry_t));
+            if (e != NULL) memcpy(e, c->small, sizeof(c->small));
+        } else {
+            e = (mln_json_compact_entry_t *)realloc(c->entries, (c->size << 1) * sizeof(mln_json_compact_entry_t));
+        }
+        if (e == NULL) return NULL;
+        c->entries = e;
+        c->size <<= 1;
+    }
+
+    e = &(c->entries[c->nentries++]);
+    e->key = c->key;
+    memset(&(e->val), 0, sizeof(mln_json_t));
+    e->val.compact = 1;
+    e->val.pool = c->arena;
+    return e;
+}
+
+static int mln_json_compact_close(mln_json_compact_t *c)
+{
+    mln_json_compact_entry_t *con = &(c->entries[c->cur - 1]), *e;
+    mln_size_t n = c->nentries - c->cur, size, i;
+    mln_u32_t mask = 0, h;
+    mln_json_vec_t *v;
+
+    size = sizeof(mln_json_vec_t) + n * sizeof(mln_json_t);
+    if (con->val.type == M_JSON_OBJECT) {
+        size += n * sizeof(mln_string_t);
+        if (n > M_JSON_COMPACT_HASH_MIN) {
+            for (mask = 1; mask < (n << 1); mask <<= 1)
+                ;
+            size += mask * sizeof(mln_u32_t);
+            --mask;
+        }
+    }
+    if ((v = (mln_json_vec_t *)mln_alloc_m(c->arena, size)) == NULL) return -1;
+
+    v->vals = (mln_json_t *)(v + 1);
+    v->keys = NULL;
+    v->index = NULL;
+    v->mask = mask;
+    v->nelts = n;
+    e = &(c->entries[c->cur]);
+    if (con->val.type == M_JSON_OBJECT) {
+        v->keys = (mln_string_t *)(v->vals + n);
+        for (i = 0; i < n; ++i, ++e) {
+            v->vals[i] = e->val;
+            v->keys[i] = e->key;
+        }
+        if (mask) {
+            v->index = (mln_u32_t *)(v->keys + n);
+            memset(v->index, 0, (mask + 1) * sizeof(mln_u32_t));
+            for (i = 0; i < n; ++i) {
+                h = mln_json_compact_hash(v->keys[i].data, v->keys[i].len) & mask;
+                while (v->index[h]) h = (h + 1) & mask;
+                v->index[h] = i + 1;
+            }
+        }
+    } else {
+        for (i = 0; i < n; ++i, ++e) {
+            v->vals[i] = e->val;
+            v->vals[i].index = i + 1;
+        }
+    }
+
+    c->nentries = c->cur;
+    c->cur = con->val.index;
+    con->val.index = 0;
+    con->val.data.m_j_vec = v;
+    return 0;
+}
+
+static int
+mln_json_compact_handler(mln_json_stream_t *s, enum json_stream_event ev, mln_json_t *val, void *data)
+{
+    mln_json_compact_t *c = (mln_json_compact_t *)data;
+    mln_json_compact_entry_t *e;
+    mln_string_t *str;
+
+    switch (ev) {
+        case M_JSON_STREAM_KEY:
+            str = val->data.m_j_string;
+            if ((c->key.data = mln_json_compact_strcpy(c->arena, str, NULL)) == NULL) return -1;
+            c->key.len = str->len;
+            return 0;
+        case M_JSON_STREAM_OBJ_END:
+        case M_JSON_STREAM_ARRAY_END:
+            return mln_json_compact_close(c);
+        default:
+            break;
+    }
+
+    if ((e = mln_json_compact_entry_new(c)) == NULL) return -1;
+    e->val.type = val->type;
+    switch (val->type) {
+        case M_JSON_OBJECT:
+        case M_JSON_ARRAY:
+            e->val.index = c->cur;
+            c->cur = c->nentries;
+            break;
+        case M_JSON_STRING:
+            str = val->data.m_j_string;
+            if ((e->val.data.m_j_string = (mln_string_t *)mln_alloc_m(c->arena, sizeof(mln_string_t) + str->len + 1)) == NULL)
+                return -1;
+            mln_string_nset(e->val.data.m_j_string, \
+                            mln_json_compact_strcpy(c->arena, str, (mln_u8ptr_t)(e->val.data.m_j_string + 1)), \
+                            str->len);
+            break;
+        default:
+            e->val.data = val->data;
+            break;
+    }
+    return 0;
+}
+
+mln_json_t *mln_json_compact_parse(mln_alloc_t *pool, mln_string_t *jstr)
+{
+    mln_json_stream_t s;
+    mln_json_compact_t c;
+    mln_json_t *j = NULL;
+    mln_size_t len, slab_size;
+
+    if (jstr == NULL) return NULL;
+
+    /*
+     * Small documents use a small arena, the result is usually about twice the input.
+     */
+    slab_size = (jstr->len << 1) + 256;
+    if (slab_size > M_ALLOC_ARENA_SLAB_SIZE) slab_size = M_ALLOC_ARENA_SLAB_SIZE;
+    if ((c.arena = mln_alloc_arena_init(pool, slab_size)) == NULL) return NULL;
+    c.entries = c.small;
+    c.nentries = c.cur = 0;
+    c.size = M_JSON_COMPACT_ENTRY_NUM;
+    mln_string_nset(&(c.key), NULL, 0);
+
+    mln_json_stream_init(&s, c.arena, mln_json_compact_handler, &c);
+    len = jstr->len;
+    if (mln_json_stream_feed(&s, jstr->data, &len) != M_JSON_STREAM_DONE) goto out;
+    /*trailing blanks only*/
+    for (; len < jstr->len; ++len) {
+        if (!mln_json_is_blank(jstr->data[len])) goto out;
+    }
+
+    if ((j = (mln_json_t *)mln_alloc_m(c.arena, sizeof(mln_json_t))) == NULL) goto out;
+    *j = c.entries[0].val;
+    j->arena = 1;
+
+out:
+    if (c.entries != c.small) free(c.entries);
+    if (j == NULL) mln_alloc_destroy(c.arena);
+    return j;
+}
+
+static mln_json_t *mln_json_compact_search(mln_json_vec_t *v, mln_string_t *key)
+{
+    mln_u32_t h, i;
+    mln_string_t *k;
+
+    if (v->keys == NULL) return NULL;
+
+    if (v->index != NULL) {
+        h = mln_json_compact_hash(key->data, key->len) & v->mask;
+        for (; (i = v->index[h]) != 0; h = (h + 1) & v->mask) {
+            k = &(v->keys[i - 1]);
+            if (k->len == key->len && !memcmp(k->data, key->data, key->len))
+                return &(v->vals[i - 1]);
+        }
+        return NULL;
+    }
+
+    for (i = 0, k = v->keys; i < v->nelts; ++i, ++k) {
+        if (k->len == key->len && !memcmp(k->data, key->data, key->len))
+            return &(v->vals[i]);
+    }
+    return NULL;
+}
@@ -912,3 +912,1514 @@ void mln_reg_match_result_free(mln_reg_match_t *results)
     mln_reg_match_chain_del(NULL, NULL, NULL);
 }
 
+
+/*
+ * Compiled regular expression
+ */
+#define M_REG_OP_CHAR    0
+#define M_REG_OP_CLASS   1
+#define M_REG_OP_ANY     2
+#define M_REG_OP_SPLIT   3 /*x is preferred to y*/
+#define M_REG_OP_JMP     4 /*y of a jump back to a loop is 1 if the loop body can match the empty string*/
+#define M_REG_OP_SAVE    5
+#define M_REG_OP_BOL     6
+#define M_REG_OP_EOL     7
+#define M_REG_OP_MATCH   8
+
+#define M_REG_NODE_CHAR  0
+#define M_REG_NODE_CLASS 1
+#define M_REG_NODE_ANY   2
+#define M_REG_NODE_BOL   3
+#define M_REG_NODE_EOL   4
+#define M_REG_NODE_CAT   5
+#define M_REG_NODE_ALT   6
+#define M_REG_NODE_GROUP 7
+#define M_REG_NODE_REP   8
+
+#define M_REG_NIL        ((mln_u32_t)-1)
+
+/*
+ * Nesting depth of the loops whose body can match the empty string that the
+ * Pike VM tracks, deeper ones are simulated without the empty iteration check.
+ */
+#define M_REG_EMPTY_LOOP_DEPTH 16
+#define M_REG_LOOP_HEAD        0x80000000U
+
+#define M_REG_DFA_MATCH     0x1
+#define M_REG_DFA_MATCH_END 0x2 /*matched if the text ends here*/
+#define M_REG_DFA_DEAD      0x4
+
+typedef struct {
+    mln_u32_t        type;
+    mln_u32_t        val;/*char, class index or group index*/
+    mln_s32_t        child;
+    mln_s32_t        last;
+    mln_s32_t        next;
+    mln_s32_t        min;
+    mln_s32_t        max;/*-1 means no limit*/
+    mln_u32_t        greedy;
+} mln_reg_node_t;
+
+typedef struct {
+    mln_u8ptr_t      p;
+    mln_u8ptr_t      end;
+    mln_reg_node_t  *nodes;
+    mln_u32_t        nnodes;
+    mln_u32_t        cap;
+    mln_u32_t        depth;
+    mln_reg_t       *reg;
+} mln_reg_parser_t;
+
+typedef struct {
+    mln_u32_t       *dense;
+    mln_u32_t       *sparse;
+    mln_u32_t        n;
+    mln_u32_t       *seen;/*Pike VM only, the states visited while the list is built*/
+    mln_u32_t        nseen;
+    mln_u32_t        gen;
+} mln_reg_sparse_t;
+
+typedef struct {
+    mln_u32_t        pc;
+    mln_s32_t        slot;/*-1 means visiting pc, otherwise the slot to be restored*/
+    mln_u32_t        level;/*the loops around pc from this level inwards began an iteration at this position*/
+    mln_s64_t        old;
+} mln_reg_frame_t;
+
+typedef struct {
+    mln_reg_sparse_t    set[2];
+    mln_reg_frame_t *stack;
+    mln_u32_t       *kept;
+    mln_s64_t       *caps;
+    mln_u32_t        caps_cap;/*slots per thread caps can hold*/
+    mln_u32_t        nslots;
+    mln_u32_t       *loop;/*number of loops around each instruction, M_REG_LOOP_HEAD marks a loop*/
+    mln_u32_t       *state;/*first state of each instruction in seen*/
+} mln_reg_scratch_t;
+
+static mln_s32_t mln_reg_parse_alt(mln_reg_parser_t *ps);
+
+static mln_s32_t mln_reg_node_new(mln_reg_parser_t *ps, mln_u32_t type)
+{
+    mln_reg_node_t *n;
+
+    if (ps->nnodes >= ps->cap) {
+        mln_u32_t cap = ps->cap? ps->cap << 1: 32;
+        if ((n = (mln_reg_node_t *)realloc(ps->nodes, cap * sizeof(mln_reg_node_t))) == NULL)
+            return -1;
+        ps->nodes = n;
+        ps->cap = cap;
+    }
+    n = &ps->nodes[ps->nnodes];
+    n->type = type;
+    n->val = 0;
+    n->child = n->last = n->next = -1;
+    n->min = n->max = 0;
+    n->greedy = 1;
+    return ps->nnodes++;
+}
+
+static inline void mln_reg_node_append(mln_reg_parser_t *ps, mln_s32_t parent, mln_s32_t child)
+{
+    mln_reg_node_t *p = &ps->nodes[parent];
+
+    if (p->last < 0) p->child = child;
+    else ps->nodes[p->last].next = child;
+    p->last = child;
+}
+
+static mln_s32_t mln_reg_class_new(mln_reg_t *reg)
+{
+    mln_u8_t (*c)[32];
+
+    if ((c = realloc(reg->classes, (reg->nclasses + 1) * sizeof(*c))) == NULL) return -1;
+    reg->classes = c;
+    memset(c[reg->nclasses], 0, sizeof(*c));
+    return reg->nclasses++;
+}
+
+static inline void mln_reg_class_range(mln_u8_t *bits, mln_u32_t lo, mln_u32_t hi)
+{
+    for (; lo <= hi; ++lo) bits[lo >> 3] |= (1 << (lo & 7));
+}
+
+/*
+ * \d, \D and \a fill the class and return -1, other escapes return their character.
+ */
+static int mln_reg_parse_escape(mln_reg_parser_t *ps, mln_u8_t *bits)
+{
+    mln_u8_t c;
+
+    if (ps->p >= ps->end) return '\\';
+    c = *(ps->p)++;
+    switch (c) {
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'd':
+            mln_reg_class_range(bits, '0', '9');
+            return -1;
+        case 'D':
+            mln_reg_class_range(bits, 0, '0' - 1);
+            mln_reg_class_range(bits, '9' + 1, 255);
+            return -1;
+        case 'a':
+            mln_reg_class_range(bits, 'a', 'z');
+            mln_reg_class_range(bits, 'A', 'Z');
+            return -1;
+        default:
+            break;
+    }
+    return c;
+}
+
+static mln_s32_t mln_reg_parse_class(mln_reg_parser_t *ps)
+{
+    mln_s32_t n, idx;
+    mln_u8_t *bits;
+    int lo, hi, neg = 0, first = 1, i;
+
+    if ((idx = mln_reg_class_new(ps->reg)) < 0) return -1;
+    bits = ps->reg->classes[idx];
+    if (ps->p < ps->end && *(ps->p) == '^') {
+        neg = 1;
+        ++(ps->p);
+    }
+
+    while (1) {
+        if (ps->p >= ps->end) return -1;
+        if (*(ps->p) == ']' && !first) {
+            ++(ps->p);
+            break;
+        }
+        first = 0;
+
+        lo = *(ps->p)++;
+        if (lo == '\\' && (lo = mln_reg_parse_escape(ps, bits)) < 0) continue;
+
+        if (ps->p + 1 < ps->end && ps->p[0] == '-' && ps->p[1] != ']') {
+            ++(ps->p);
+            hi = *(ps->p)++;
+            if (hi == '\\' && (hi = mln_reg_parse_escape(ps, bits)) < 0) return -1;
+            if (lo > hi) return -1;
+            mln_reg_class_range(bits, lo, hi);
+        } else {
+            mln_reg_class_range(bits, lo, lo);
+        }
+    }
+    if (neg) {
+        for (i = 0; i < 32; ++i) bits[i] = ~bits[i];
+    }
+
+    if ((n = mln_reg_node_new(ps, M_REG_NODE_CLASS)) < 0) return -1;
+    ps->nodes[n].val = idx;
+    return n;
+}
+
+static mln_s32_t mln_reg_parse_atom(mln_reg_parser_t *ps)
+{
+    mln_s32_t n, sub, idx;
+    mln_u8_t bits[32];
+    int c = *(ps->p)++;
+
+    switch (c) {
+        case '(':
+            if ((n = mln_reg_node_new(ps, M_REG_NODE_GROUP)) < 0) return -1;
+            ps->nodes[n].val = ++(ps->reg->ngroups);
+            if ((sub = mln_reg_parse_alt(ps)) < 0) return -1;
+            if (ps->p >= ps->end || *(ps->p) != ')') return -1;
+            ++(ps->p);
+            mln_reg_node_append(ps, n, sub);
+            return n;
+        case '[':
+            return mln_reg_parse_class(ps);
+        case '.':
+            return mln_reg_node_new(ps, M_REG_NODE_ANY);
+        case '^':
+            return mln_reg_node_new(ps, M_REG_NODE_BOL);
+        case '$':
+            return mln_reg_node_new(ps, M_REG_NODE_EOL);
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            return -1;/*nothing to repeat*/
+        case '\\':
+            memset(bits, 0, sizeof(bits));
+            if ((c = mln_reg_parse_escape(ps, bits)) < 0) {
+                if ((idx = mln_reg_class_new(ps->reg)) < 0) return -1;
+                memcpy(ps->reg->classes[idx], bits, sizeof(bits));
+                if ((n = mln_reg_node_new(ps, M_REG_NODE_CLASS)) < 0) return -1;
+                ps->nodes[n].val = idx;
+                return n;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if ((n = mln_reg_node_new(ps, M_REG_NODE_CHAR)) < 0) return -1;
+    ps->nodes[n].val = c;
+    return n;
+}
+
+static inline int mln_reg_parse_number(mln_reg_parser_t *ps)
+{
+    int val = 0, found = 0;
+
+    while (ps->p < ps->end && isdigit(*(ps->p))) {
+        val = val * 10 + (*(ps->p)++ - '0');
+        if (val > M_REG_MAX_REPEAT) return -2;
+        found = 1;
+    }
+    return found? val: -1;
+}
+
+static mln_s32_t mln_reg_parse_rep(mln_reg_parser_t *ps)
+{
+    mln_s32_t n, r;
+    int min, max, nested = 0;
+
+    if ((n = mln_reg_parse_atom(ps)) < 0) return -1;
+
+    while (ps->p < ps->end) {
+        switch (*(ps->p)) {
+            case '*':
+                min = 0, max = -1;
+                break;
+            case '+':
+                min = 1, max = -1;
+                break;
+            case '?':
+                min = 0, max = 1;
+                break;
+            case '{':
+                ++(ps->p);
+                if ((min = mln_reg_parse_number(ps)) < 0) return -1;
+                max = min;
+                if (ps->p < ps->end && *(ps->p) == ',') {
+                    ++(ps->p);
+                    if ((max = mln_reg_parse_number(ps)) == -2) return -1;
+                    if (max >= 0 && min > max) return -1;
+                }
+                if (ps->p >= ps->end || *(ps->p) != '}') return -1;
+                break;
+            default:
+                goto out;
+        }
+        ++(ps->p);
+
+        if (ps->depth + ++nested > M_REG_MAX_DEPTH) return -1;
+        if ((r = mln_reg_node_new(ps, M_REG_NODE_REP)) < 0) return -1;
+        ps->nodes[r].min = min;
+        ps->nodes[r].max = max;
+        if (ps->p < ps->end && *(ps->p) == '?') {
+            ps->nodes[r].greedy = 0;
+            ++(ps->p);
+        }
+        mln_reg_node_append(ps, r, n);
+        n = r;
+    }
+
+out:
+    return n;
+}
+
+static mln_s32_t mln_reg_parse_alt(mln_reg_parser_t *ps)
+{
+    mln_s32_t alt = -1, cat, n;
+
+    if (++(ps->depth) > M_REG_MAX_DEPTH) return -1;
+
+    while (1) {
+        if ((cat = mln_reg_node_new(ps, M_REG_NODE_CAT)) < 0) return -1;
+        while (ps->p < ps->end && *(ps->p) != '|' && *(ps->p) != ')') {
+            if ((n = mln_reg_parse_rep(ps)) < 0) return -1;
+            mln_reg_node_append(ps, cat, n);
+        }
+        if (alt >= 0) {
+            mln_reg_node_append(ps, alt, cat);
+        }
+        if (ps->p >= ps->end || *(ps->p) != '|') break;
+        ++(ps->p);
+        if (alt < 0) {
+            if ((alt = mln_reg_node_new(ps, M_REG_NODE_ALT)) < 0) return -1;
+            mln_reg_node_append(ps, alt, cat);
+        }
+    }
+
+    --(ps->depth);
+    return alt < 0? cat: alt;
+}
+
+static mln_u32_t
+mln_reg_inst_add(mln_reg_t *reg, mln_u32_t *cap, mln_u32_t op, mln_u32_t c, mln_u32_t x, mln_u32_t y)
+{
+    mln_reg_inst_t *in;
+
+    if (reg->ninst >= *cap) {
+        mln_u32_t n = *cap? *cap << 1: 64;
+        if (reg->ninst >= M_REG_MAX_INST) return M_REG_NIL;
+        if (n > M_REG_MAX_INST) n = M_REG_MAX_INST;
+        if ((in = (mln_reg_inst_t *)realloc(reg->insts, n * sizeof(mln_reg_inst_t))) == NULL)
+            return M_REG_NIL;
+        reg->insts = in;
+        *cap = n;
+    }
+    in = &reg->insts[reg->ninst];
+    in->op = op;
+    in->c = c;
+    in->x = x;
+    in->y = y;
+    return reg->ninst++;
+}
+
+/*
+ * Return 1 if the node can match the empty string, 0 if not and -1 on error.
+ */
+static int mln_reg_emit(mln_reg_t *reg, mln_u32_t *cap, mln_reg_node_t *nodes, mln_s32_t n)
+{
+    mln_reg_node_t *node = &nodes[n];
+    mln_u32_t pc, list = M_REG_NIL, next;
+    mln_s32_t i, child;
+    int rc, empty;
+
+    switch (node->type) {
+        case M_REG_NODE_CHAR:
+            return mln_reg_inst_add(reg, cap, M_REG_OP_CHAR, node->val, 0, 0) == M_REG_NIL? -1: 0;
+        case M_REG_NODE_CLASS:
+            return mln_reg_inst_add(reg, cap, M_REG_OP_CLASS, 0, node->val, 0) == M_REG_NIL? -1: 0;
+        case M_REG_NODE_ANY:
+            return mln_reg_inst_add(reg, cap, M_REG_OP_ANY, 0, 0, 0) == M_REG_NIL? -1: 0;
+        case M_REG_NODE_BOL:
+            return mln_reg_inst_add(reg, cap, M_REG_OP_BOL, 0, 0, 0) == M_REG_NIL? -1: 1;
+        case M_REG_NODE_EOL:
+            return mln_reg_inst_add(reg, cap, M_REG_OP_EOL, 0, 0, 0) == M_REG_NIL? -1: 1;
+        case M_REG_NODE_CAT:
+            for (empty = 1, child = node->child; child >= 0; child = nodes[child].next) {
+                if ((rc = mln_reg_emit(reg, cap, nodes, child)) < 0) return -1;
+                empty &= rc;
+            }
+            return empty;
+        case M_REG_NODE_GROUP:
+            if (mln_reg_inst_add(reg, cap, M_REG_OP_SAVE, 0, node->val << 1, 0) == M_REG_NIL) return -1;
+            if ((empty = mln_reg_emit(reg, cap, nodes, node->child)) < 0) return -1;
+            return mln_reg_inst_add(reg, cap, M_REG_OP_SAVE, 0, (node->val << 1) + 1, 0) == M_REG_NIL? -1: empty;
+        case M_REG_NODE_ALT:
+            /*
+             * The jumps to the end are chained through their x until the end is known.
+             */
+            for (empty = 0, child = node->child; nodes[child].next >= 0; child = nodes[child].next) {
+                if ((pc = mln_reg_inst_add(reg, cap, M_REG_OP_SPLIT, 0, 0, 0)) == M_REG_NIL) return -1;
+                reg->insts[pc].x = pc + 1;
+                if ((rc = mln_reg_emit(reg, cap, nodes, child)) < 0) return -1;
+                empty |= rc;
+                if ((list = mln_reg_inst_add(reg, cap, M_REG_OP_JMP, 0, list, 0)) == M_REG_NIL) return -1;
+                reg->insts[pc].y = reg->ninst;
+            }
+            if ((rc = mln_reg_emit(reg, cap, nodes, child)) < 0) return -1;
+            for (; list != M_REG_NIL; list = next) {
+                next = reg->insts[list].x;
+                reg->insts[list].x = reg->ninst;
+            }
+            return empty | rc;
+        default: /*M_REG_NODE_REP*/
+            break;
+    }
+
+    for (empty = 1, i = 0; i < node->min; ++i) {
+        if ((empty = mln_reg_emit(reg, cap, nodes, node->child)) < 0) return -1;
+    }
+    if (node->max < 0) {
+        if ((pc = mln_reg_inst_add(reg, cap, M_REG_OP_SPLIT, 0, 0, 0)) == M_REG_NIL) return -1;
+        if ((rc = mln_reg_emit(reg, cap, nodes, node->child)) < 0) return -1;
+        if (mln_reg_inst_add(reg, cap, M_REG_OP_JMP, 0, pc, rc) == M_REG_NIL) return -1;
+        reg->insts[pc].x = node->greedy? pc + 1: reg->ninst;
+        reg->insts[pc].y = node->greedy? reg->ninst: pc + 1;
+        return empty;
+    }
+    /*
+     * x{0,3} is x(x(x)?)?)?, every optional copy skips to the end once it fails.
+     * The splits are chained through their y until the end is known.
+     */
+    for (; i < node->max; ++i) {
+        if ((list = mln_reg_inst_add(reg, cap, M_REG_OP_SPLIT, 0, 0, list)) == M_REG_NIL) return -1;
+        if (mln_reg_emit(reg, cap, nodes, node->child) < 0) return -1;
+    }
+    for (; list != M_REG_NIL; list = next) {
+        next = reg->insts[list].y;
+        reg->insts[list].x = node->greedy? list + 1: reg->ninst;
+        reg->insts[list].y = node->greedy? reg->ninst: list + 1;
+    }
+    return empty;
+}
+
+static inline int mln_reg_inst_test(mln_reg_t *reg, mln_reg_inst_t *in, mln_u8_t c)
+{
+    switch (in->op) {
+        case M_REG_OP_CHAR:
+            return in->c == c;
+        case M_REG_OP_CLASS:
+            return reg->classes[in->x][c >> 3] & (1 << (c & 7));
+        case M_REG_OP_ANY:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Bytes never told apart by the program share one DFA transition.
+ */
+static void mln_reg_byte_classes(mln_reg_t *reg)
+{
+    mln_u8_t edge[257];
+    mln_reg_inst_t *in, *end = reg->insts + reg->ninst;
+    mln_u8_t *bits;
+    mln_u32_t b, k = 0;
+
+    memset(edge, 0, sizeof(edge));
+    for (in = reg->insts; in < end; ++in) {
+        if (in->op == M_REG_OP_CHAR) {
+            edge[in->c] = edge[in->c + 1] = 1;
+        } else if (in->op == M_REG_OP_CLASS) {
+            bits = reg->classes[in->x];
+            for (b = 1; b < 256; ++b) {
+                if (!(bits[b >> 3] & (1 << (b & 7))) != !(bits[(b - 1) >> 3] & (1 << ((b - 1) & 7))))
+                    edge[b] = 1;
+            }
+        }
+    }
+    reg->byte_class[0] = 0;
+    for (b = 1; b < 256; ++b) {
+        if (edge[b]) ++k;
+        reg->byte_class[b] = k;
+    }
+    reg->nbyte_classes = k + 1;
+}
+
+/*
+ * The literal every match starts with. memchr looks for its least common byte,
+ * lowercase letters, digits and URL punctuation are assumed to be common.
+ */
+static void mln_reg_prefix(mln_reg_t *reg)
+{
+    mln_reg_inst_t *in;
+    mln_u32_t pc = 0, i, rank, best = 3;
+
+    reg->prefix_len = 0;
+    while (pc < reg->ninst && reg->prefix_len < M_REG_PREFIX_MAX) {
+        in = &reg->insts[pc];
+        if (in->op == M_REG_OP_SAVE || in->op == M_REG_OP_BOL) {
+            ++pc;
+        } else if (in->op == M_REG_OP_JMP) {
+            pc = in->x;
+        } else if (in->op == M_REG_OP_CHAR) {
+            reg->prefix[reg->prefix_len++] = in->c;
+            ++pc;
+        } else {
+            break;
+        }
+    }
+
+    reg->prefix_rare = 0;
+    for (i = 0; i < reg->prefix_len; ++i) {
+        mln_u8_t c = reg->prefix[i];
+        if (islower(c) || c == ' ') rank = 2;
+        else if (isdigit(c) || c == '/' || c == '.' || c == '-' || c == '_') rank = 1;
+        else rank = 0;
+        if (rank < best) {
+            best = rank;
+            reg->prefix_rare = i;
+        }
+    }
+}
+
+static inline mln_u8ptr_t mln_reg_prefix_find(mln_reg_t *reg, mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    mln_u32_t r = reg->prefix_rare, len = reg->prefix_len;
+    mln_u8ptr_t q;
+
+    if ((mln_size_t)(end - p) < len) return NULL;
+    for (q = p + r; q < end; ++q) {
+        if ((q = (mln_u8ptr_t)memchr(q, reg->prefix[r], end - q)) == NULL) return NULL;
+        if ((mln_size_t)(end - (q - r)) < len) return NULL;
+        if (!memcmp(q - r, reg->prefix, len)) return q - r;
+    }
+    return NULL;
+}
+
+static inline void mln_reg_sparse_clear(mln_reg_sparse_t *set)
+{
+    set->n = 0;
+}
+
+static inline int mln_reg_sparse_add(mln_reg_sparse_t *set, mln_u32_t pc)
+{
+    mln_u32_t i = set->sparse[pc];
+
+    if (i < set->n && set->dense[i] == pc) return 0;
+    set->sparse[pc] = set->n;
+    set->dense[(set->n)++] = pc;
+    return 1;
+}
+
+/*
+ * Follow the empty transitions from pc. The instructions that consume a byte,
+ * match or wait for the end of the text are kept.
+ */
+static mln_u32_t
+mln_reg_closure(mln_reg_t *reg, mln_reg_sparse_t *set, mln_u32_t *kept, mln_u32_t nkept, mln_u32_t pc, int at_begin)
+{
+    mln_reg_frame_t *stack = ((mln_reg_scratch_t *)(reg->scratch))->stack;
+    mln_reg_inst_t *in;
+    mln_u32_t n = 0;
+
+    stack[n++].pc = pc;
+    while (n) {
+        pc = stack[--n].pc;
+        if (!mln_reg_sparse_add(set, pc)) continue;
+        in = &reg->insts[pc];
+        switch (in->op) {
+            case M_REG_OP_JMP:
+                stack[n++].pc = in->x;
+                break;
+            case M_REG_OP_SPLIT:
+                stack[n++].pc = in->y;
+                stack[n++].pc = in->x;
+                break;
+            case M_REG_OP_SAVE:
+                stack[n++].pc = pc + 1;
+                break;
+            case M_REG_OP_BOL:
+                if (at_begin) stack[n++].pc = pc + 1;
+                break;
+            default:
+                kept[nkept++] = pc;
+                break;
+        }
+    }
+    return nkept;
+}
+
+/*
+ * Whether MATCH can be reached from pc once the text has ended.
+ * If ids is not NULL, every pattern reached is marked in it.
+ */
+static int mln_reg_matched_at_end(mln_reg_t *reg, mln_u32_t pc, mln_u64_t *ids)
+{
+    mln_reg_scratch_t *sc = (mln_reg_scratch_t *)(reg->scratch);
+    mln_reg_sparse_t *set = &sc->set[1];
+    mln_reg_frame_t *stack = sc->stack;
+    mln_reg_inst_t *in;
+    mln_u32_t n = 0;
+    int matched = 0;
+
+    mln_reg_sparse_clear(set);
+    stack[n++].pc = pc;
+    while (n) {
+        pc = stack[--n].pc;
+        if (!mln_reg_sparse_add(set, pc)) continue;
+        in = &reg->insts[pc];
+        switch (in->op) {
+            case M_REG_OP_MATCH:
+                if (ids == NULL) return 1;
+                ids[in->x >> 6] |= (mln_u64_t)1 << (in->x & 63);
+                matched = 1;
+                break;
+            case M_REG_OP_JMP:
+                stack[n++].pc = in->x;
+                break;
+            case M_REG_OP_SPLIT:
+                stack[n++].pc = in->y;
+                stack[n++].pc = in->x;
+                break;
+            case M_REG_OP_SAVE:
+            case M_REG_OP_EOL:
+                stack[n++].pc = pc + 1;
+                break;
+            default:
+                break;
+        }
+    }
+    return matched;
+}
+
+static void mln_reg_dfa_destroy(mln_reg_dfa_t *dfa)
+{
+    free(dfa->states);
+    free(dfa->trans);
+    free(dfa->slots);
+    free(dfa->pcs);
+    free(dfa->start_pcs);
+    free(dfa->in_start);
+}
+
+static int mln_reg_dfa_init(mln_reg_t *reg, mln_reg_dfa_t *dfa)
+{
+    mln_reg_scratch_t *sc = (mln_reg_scratch_t *)(reg->scratch);
+    mln_u32_t i, nslots;
+
+    if (!dfa->max_states) dfa->max_states = M_REG_DFA_MAX_STATES;
+    nslots = dfa->max_states << 1;
+    dfa->cap = 16;
+    dfa->states = (mln_reg_dfa_state_t *)malloc(dfa->cap * sizeof(mln_reg_dfa_state_t));
+    dfa->trans = (mln_s32_t *)malloc(dfa->cap * (reg->nbyte_classes + 1) * sizeof(mln_s32_t));
+    dfa->slots = (mln_s32_t *)malloc(nslots * sizeof(mln_s32_t));
+    dfa->pcs_cap = 64;
+    dfa->pcs = (mln_u32_t *)malloc(dfa->pcs_cap * sizeof(mln_u32_t));
+    if (dfa->unanchored) {
+        mln_reg_sparse_clear(&sc->set[0]);
+        dfa->nstart_pcs = mln_reg_closure(reg, &sc->set[0], sc->kept, 0, 0, 0);
+        dfa->start_pcs = (mln_u32_t *)malloc((dfa->nstart_pcs + 1) * sizeof(mln_u32_t));
+        dfa->in_start = (mln_u8_t *)calloc(reg->ninst, sizeof(mln_u8_t));
+    }
+    if (dfa->states == NULL || dfa->trans == NULL || dfa->slots == NULL || dfa->pcs == NULL || \
+        (dfa->unanchored && (dfa->start_pcs == NULL || dfa->in_start == NULL)))
+    {
+        mln_reg_dfa_destroy(dfa);
+        dfa->states = NULL;
+        dfa->trans = dfa->slots = NULL;
+        dfa->pcs = dfa->start_pcs = NULL;
+        dfa->in_start = NULL;
+        return -1;
+    }
+    for (i = 0; i < nslots; ++i) dfa->slots[i] = -1;
+    for (i = 0; i < dfa->nstart_pcs; ++i) {
+        dfa->start_pcs[i] = sc->kept[i];
+        dfa->in_start[sc->kept[i]] = 1;
+    }
+    dfa->nstates = dfa->npcs = 0;
+    dfa->start[0] = dfa->start[1] = -1;
+    return 0;
+}
+
+static inline void mln_reg_sort(mln_u32_t *a, mln_u32_t n)
+{
+    mln_u32_t i, j, v;
+
+    for (i = 1; i < n; ++i) {
+        v = a[i];
+        for (j = i; j > 0 && a[j - 1] > v; --j) a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+static inline void
+mln_reg_dfa_flags(mln_reg_t *reg, mln_u32_t *pcs, mln_u32_t npcs, mln_s32_t *flags, mln_u32_t *nids)
+{
+    mln_u32_t i;
+
+    for (i = 0; i < npcs; ++i) {
+        if (reg->insts[pcs[i]].op == M_REG_OP_MATCH) {
+            *flags |= M_REG_DFA_MATCH | M_REG_DFA_MATCH_END;
+            ++(*nids);
+        } else if (reg->insts[pcs[i]].op == M_REG_OP_EOL && \
+                   !(*flags & M_REG_DFA_MATCH_END) && \
+                   mln_reg_matched_at_end(reg, pcs[i], NULL))
+        {
+            *flags |= M_REG_DFA_MATCH_END;
+        }
+    }
+}
+
+/*
+ * Look the state up by its instruction set, add it if it is new.
+ * The cache is flushed once it is full, so memory is bounded
+ * and each byte still costs at most one state construction.
+ */
+static mln_s32_t
+mln_reg_dfa_state(mln_reg_t *reg, mln_reg_dfa_t *dfa, mln_u32_t *pcs, mln_u32_t npcs, int *flushed)
+{
+    mln_u32_t i, j, nids = 0, h = 2166136261u, mask = (dfa->max_states << 1) - 1;
+    mln_reg_dfa_state_t *st;
+    mln_s32_t idx, flags = 0, *row;
+
+    if (dfa->unanchored) {
+        for (i = j = 0; i < npcs; ++i) {
+            if (!dfa->in_start[pcs[i]]) pcs[j++] = pcs[i];
+        }
+        npcs = j;
+    }
+    mln_reg_sort(pcs, npcs);
+    for (i = 0; i < npcs; ++i) h = (h ^ pcs[i]) * 16777619u;
+
+    for (i = h & mask; (idx = dfa->slots[i]) >= 0; i = (i + 1) & mask) {
+        st = &dfa->states[idx];
+        if (st->hash == h && st->npcs == npcs && !memcmp(dfa->pcs + st->off, pcs, npcs * sizeof(mln_u32_t)))
+            return idx;
+    }
+
+    mln_reg_dfa_flags(reg, pcs, npcs, &flags, &nids);
+    mln_reg_dfa_flags(reg, dfa->start_pcs, dfa->nstart_pcs, &flags, &nids);
+    if (!npcs && !dfa->nstart_pcs) flags = M_REG_DFA_DEAD;
+
+    if (dfa->nstates >= dfa->max_states) {
+        for (i = 0; i <= mask; ++i) dfa->slots[i] = -1;
+        dfa->nstates = dfa->npcs = 0;
+        dfa->start[0] = dfa->start[1] = -1;
+        *flushed = 1;
+        for (i = h & mask; dfa->slots[i] >= 0; i = (i + 1) & mask)
+            ;
+    }
+    if (dfa->nstates >= dfa->cap) {
+        mln_u32_t cap = dfa->cap << 1;
+        mln_reg_dfa_state_t *states;
+        mln_s32_t *trans;
+        if ((states = realloc(dfa->states, cap * sizeof(mln_reg_dfa_state_t))) == NULL) return -1;
+        dfa->states = states;
+        if ((trans = realloc(dfa->trans, cap * (reg->nbyte_classes + 1) * sizeof(mln_s32_t))) == NULL) return -1;
+        dfa->trans = trans;
+        dfa->cap = cap;
+    }
+    if (dfa->npcs + npcs + nids > dfa->pcs_cap) {
+        mln_u32_t cap = dfa->pcs_cap;
+        mln_u32_t *p;
+        while (cap < dfa->npcs + npcs + nids) cap <<= 1;
+        if ((p = realloc(dfa->pcs, cap * sizeof(mln_u32_t))) == NULL) return -1;
+        dfa->pcs = p;
+        dfa->pcs_cap = cap;
+    }
+
+    idx = dfa->nstates++;
+    dfa->slots[i] = idx;
+    st = &dfa->states[idx];
+    st->off = dfa->npcs;
+    st->npcs = npcs;
+    st->nids = nids;
+    st->hash = h;
+    memcpy(dfa->pcs + dfa->npcs, pcs, npcs * sizeof(mln_u32_t));
+    dfa->npcs += npcs;
+    for (i = 0; i < npcs; ++i) {
+        if (reg->insts[pcs[i]].op == M_REG_OP_MATCH) dfa->pcs[dfa->npcs++] = reg->insts[pcs[i]].x;
+    }
+    for (i = 0; i < dfa->nstart_pcs; ++i) {
+        if (reg->insts[dfa->start_pcs[i]].op == M_REG_OP_MATCH)
+            dfa->pcs[dfa->npcs++] = reg->insts[dfa->start_pcs[i]].x;
+    }
+
+    row = dfa->trans + idx * (reg->nbyte_classes + 1);
+    for (i = 0; i < reg->nbyte_classes; ++i) row[i] = -1;
+    row[i] = flags;
+    return idx;
+}
+
+static mln_s32_t mln_reg_dfa_start(mln_reg_t *reg, mln_reg_dfa_t *dfa, int at_begin)
+{
+    mln_reg_scratch_t *sc = (mln_reg_scratch_t *)(reg->scratch);
+    mln_u32_t nkept;
+    int flushed = 0;
+
+    if (dfa->start[at_begin] >= 0) return dfa->start[at_begin];
+    mln_reg_sparse_clear(&sc->set[0]);
+    nkept = mln_reg_closure(reg, &sc->set[0], sc->kept, 0, 0, at_begin);
+    return dfa->start[at_begin] = mln_reg_dfa_state(reg, dfa, sc->kept, nkept, &flushed);
+}
+
+static mln_s32_t mln_reg_dfa_step(mln_reg_t *reg, mln_reg_dfa_t *dfa, mln_s32_t s, mln_u8_t c)
+{
+    mln_reg_scratch_t *sc = (mln_reg_scratch_t *)(reg->scratch);
+    mln_reg_dfa_state_t *st = &dfa->states[s];
+    mln_u32_t i, pc, nkept = 0;
+    mln_s32_t t;
+    int flushed = 0;
+
+    mln_reg_sparse_clear(&sc->set[0]);
+    for (i = 0; i < st->npcs + dfa->nstart_pcs; ++i) {
+        pc = i < st->npcs? dfa->pcs[st->off + i]: dfa->start_pcs[i - st->npcs];
+        if (mln_reg_inst_test(reg, &reg->insts[pc], c))
+            nkept = mln_reg_closure(reg, &sc->set[0], sc->kept, nkept, pc + 1, 0);
+    }
+
+    if ((t = mln_reg_dfa_state(reg, dfa, sc->kept, nkept, &flushed)) < 0) return -1;
+    if (!flushed) dfa->trans[s * (reg->nbyte_classes + 1) + reg->byte_class[c]] = t * (reg->nbyte_classes + 1);
+    return t;
+}
+
+/*
+ * search: stop at the first match, otherwise the whole text has to match.
+ * The transitions hold row offsets rather than state indexes,
+ * which keeps a multiplication off the critical path of the loop.
+ */
+static int mln_reg_dfa_run(mln_reg_t *reg, mln_reg_dfa_t *dfa, mln_u8ptr_t p, mln_u8ptr_t end, int search)
+{
+    mln_u32_t nbc = reg->nbyte_classes, stride = nbc + 1;
+    mln_u8ptr_t bc = reg->byte_class;
+    mln_s32_t s, t, f, *trans;
+
+    if (dfa->states == NULL && mln_reg_dfa_init(reg, dfa) < 0) return -1;
+    if ((s = mln_reg_dfa_start(reg, dfa, 1)) < 0) return -1;
+    if (dfa->unanchored && mln_reg_dfa_start(reg, dfa, 0) < 0) return -1;
+    s *= stride;
+    trans = dfa->trans;
+
+    for (; p < end; ++p) {
+        if ((f = trans[s + nbc]) != 0) {
+            if (search && (f & M_REG_DFA_MATCH)) return 1;
+            if (f & M_REG_DFA_DEAD) return 0;
+        }
+        if (s == dfa->start[0] * (mln_s32_t)stride && dfa->unanchored && reg->prefix_len) {
+            if ((p = mln_reg_prefix_find(reg, p, end)) == NULL) return 0;
+        }
+        if ((t = trans[s + bc[*p]]) < 0) {
+            if ((t = mln_reg_dfa_step(reg, dfa, s / stride, *p)) < 0) return -1;
+            if (dfa->start[0] < 0 && dfa->unanchored && mln_reg_dfa_start(reg, dfa, 0) < 0) return -1;
+            t *= stride;
+            trans = dfa->trans;
+        }
+        s = t;
+    }
+    return (trans[s + nbc] & M_REG_DFA_MATCH_END)? 1: 0;
+}
+
+static inline void mln_reg_pike_clear(mln_reg_sparse_t *list)
+{
+    list->n = 0;
+    if (++(list->gen) == 0) {
+        memset(list->seen, 0, list->nseen * sizeof(mln_u32_t));
+        list->gen = 1;
+    }
+}
+
+/*
+ * Pike VM: the threads in a list are ordered by priority,
+ * so the match is the one a backtracking matcher would find first.
+ *
+ * Like backtracking matchers, a loop is left once an iteration matches the
+ * empty string. Whether it did depends on the loops whose iteration began at
+ * this position, which are the ones from some level inwards, so a state is
+ * an instruction and that level and each state is visited once.
+ */
+static void mln_reg_pike_add(mln_reg_t *reg, \
+                             mln_reg_sparse_t *list, \
+                             mln_s64_t *lcaps, \
+                             mln_u32_t pc, \
+                             mln_s64_t *caps, \
+                             mln_s64_t pos, \
+                             int at_begin, \
+                             int at_end)
+{
+    mln_reg_scratch_t *sc = (mln_reg_scratch_t *)(reg->scratch);
+    mln_reg_frame_t *stack = sc->stack;
+    mln_u32_t n = 0, nslots = sc->nslots, level, *loop = sc->loop;
+    mln_reg_inst_t *in;
+
+    stack[n].pc = pc;
+    stack[n].level = M_REG_EMPTY_LOOP_DEPTH;
+    stack[n++].slot = -1;
+    while (n) {
+        --n;
+        if (stack[n].slot >= 0) {
+            caps[stack[n].slot] = stack[n].old;
+            continue;
+        }
+        pc = stack[n].pc;
+        if ((level = loop[pc] & ~M_REG_LOOP_HEAD) > stack[n].level) level = stack[n].level;
+        if (list->seen[sc->state[pc] + level] == list->gen) continue;
+        list->seen[sc->state[pc] + level] = list->gen;
+        in = &reg->insts[pc];
+        switch (in->op) {
+            case M_REG_OP_JMP:
+                stack[n].pc = in->x;
+                if ((loop[in->x] & M_REG_LOOP_HEAD) && level <= (loop[in->x] & ~M_REG_LOOP_HEAD)) {
+                    /*the iteration began here and matched nothing, leave the loop*/
+                    in = &reg->insts[in->x];
+                    stack[n].pc = in->x == stack[n].pc + 1? in->y: in->x;
+                }
+                stack[n].level = level;
+                stack[n++].slot = -1;
+                break;
+            case M_REG_OP_SPLIT:
+                stack[n].pc = in->y;
+                stack[n].level = level;
+                stack[n++].slot = -1;
+                stack[n].pc = in->x;
+                stack[n].level = level;
+                stack[n++].slot = -1;
+                break;
+            case M_REG_OP_SAVE:
+                if (in->x < nslots) {
+                    stack[n].slot = in->x;
+                    stack[n++].old = caps[in->x];
+                    caps[in->x] = pos;
+                }
+                stack[n].pc = pc + 1;
+                stack[n].level = level;
+                stack[n++].slot = -1;
+                break;
+            case M_REG_OP_BOL:
+                if (at_begin) {
+                    stack[n].pc = pc + 1;
+                    stack[n].level = level;
+                    stack[n++].slot = -1;
+                }
+                break;
+            case M_REG_OP_EOL:
+                if (at_end) {
+                    stack[n].pc = pc + 1;
+                    stack[n].level = level;
+                    stack[n++].slot = -1;
+                }
+                break;
+            default:
+                if (!mln_reg_sparse_add(list, pc)) break;
+                memcpy(lcaps + (list->n - 1) * nslots, caps, nslots * sizeof(mln_s64_t));
+                break;
+        }
+    }
+}
+
+static int mln_reg_pike(mln_reg_t *reg, mln_u8ptr_t text, mln_s64_t len, mln_string_t *caps, mln_u32_t ncaps)
+{
+    mln_reg_scratch_t *sc = (mln_reg_scratch_t *)(reg->scratch);
+    mln_u32_t i, nslots = (ncaps < reg->ngroups + 1? ncaps: reg->ngroups + 1) << 1;
+    mln_reg_sparse_t *clist = &sc->set[0], *nlist = &sc->set[1], *tmp_list;
+    mln_s64_t *ccaps, *ncaps_, *tmp, *best, *tc, pos;
+    mln_reg_inst_t *in;
+    int matched = 0;
+    mln_u8ptr_t q;
+
+    if (sc->caps_cap < nslots) {
+        if ((tmp = (mln_s64_t *)realloc(sc->caps, ((reg->ninst << 1) + 2) * nslots * sizeof(mln_s64_t))) == NULL)
+            return -1;
+        sc->caps = tmp;
+        sc->caps_cap = nslots;
+    }
+    sc->nslots = nslots;
+    ccaps = sc->caps;
+    ncaps_ = ccaps + reg->ninst * nslots;
+    tmp = ncaps_ + reg->ninst * nslots;
+    best = tmp + nslots;
+
+    mln_reg_pike_clear(clist);
+    for (pos = 0; ; ++pos) {
+        if (!matched && (!pos || !reg->anchored)) {
+            if (!clist->n && reg->prefix_len && !reg->anchored) {
+                if ((q = mln_reg_prefix_find(reg, text + pos, text + len)) == NULL) break;
+                pos = q - text;
+            }
+            for (i = 0; i < nslots; ++i) tmp[i] = -1;
+            mln_reg_pike_add(reg, clist, ccaps, 0, tmp, pos, !pos, pos == len);
+        }
+        if (!clist->n) {
+            if (matched || reg->anchored || pos >= len) break;
+            mln_reg_pike_clear(clist);
+            continue;
+        }
+
+        mln_reg_pike_clear(nlist);
+        for (i = 0; i < clist->n; ++i) {
+            in = &reg->insts[clist->dense[i]];
+            tc = ccaps + i * nslots;
+            if (in->op == M_REG_OP_MATCH) {
+                matched = 1;
+                memcpy(best, tc, nslots * sizeof(mln_s64_t));
+                break;/*threads of lower priority are cut off*/
+            }
+            if (pos < len && mln_reg_inst_test(reg, in, text[pos])) {
+                memcpy(tmp, tc, nslots * sizeof(mln_s64_t));
+                mln_reg_pike_add(reg, nlist, ncaps_, clist->dense[i] + 1, tmp, pos + 1, 0, pos + 1 == len);
+            }
+        }
+
+        tmp_list = clist, clist = nlist, nlist = tmp_list;
+        tc = ccaps, ccaps = ncaps_, ncaps_ = tc;
+        if (pos >= len) break;
+    }
+
+    if (!matched) return 0;
+    for (i = 0; i < ncaps; ++i) {
+        if ((i << 1) < nslots && best[i << 1] >= 0 && best[(i << 1) + 1] >= 0) {
+            mln_string_nset(&caps[i], text + best[i << 1], best[(i << 1) + 1] - best[i << 1]);
+        } else {
+            mln_string_nset(&caps[i], NULL, 0);
+        }
+    }
+    return 1;
+}
+
+/*
+ * Number the Pike VM states: an instruction inside n loops whose body can
+ * match the empty string has n + 1 of them. Return the number of states.
+ */
+static mln_u32_t mln_reg_loops(mln_reg_t *reg, mln_u32_t *loop, mln_u32_t *state)
+{
+    mln_u32_t pc, n = 0, total = 0, ends[M_REG_EMPTY_LOOP_DEPTH];
+    mln_reg_inst_t *in;
+
+    /*
+     * Find the loops whose body can match the empty string,
+     * loop holds the end of the loop at its head for the time being.
+     */
+    memset(loop, 0, reg->ninst * sizeof(mln_u32_t));
+    for (pc = 0, in = reg->insts; pc < reg->ninst; ++pc, ++in) {
+        if (in->op == M_REG_OP_JMP && in->x < pc && in->y) loop[in->x] = pc;
+    }
+    for (pc = 0; pc < reg->ninst; ++pc) {
+        while (n && ends[n - 1] < pc) --n;
+        if (loop[pc] && n < M_REG_EMPTY_LOOP_DEPTH) {
+            ends[n] = loop[pc];
+            loop[pc] = n++ | M_REG_LOOP_HEAD;
+        } else {
+            loop[pc] = n;
+        }
+        state[pc] = total;
+        total += (loop[pc] & ~M_REG_LOOP_HEAD) + 1;
+    }
+    return total;
+}
+
+/*
+ * Allocate the work memory of the program and analyse it.
+ */
+static int mln_reg_prepare(mln_reg_t *reg)
+{
+    mln_reg_scratch_t *sc;
+    mln_u32_t nkept, nstates, i;
+
+    if ((sc = (mln_reg_scratch_t *)calloc(1, sizeof(mln_reg_scratch_t))) == NULL) return -1;
+    reg->scratch = sc;
+    sc->loop = (mln_u32_t *)malloc(reg->ninst * sizeof(mln_u32_t));
+    sc->state = (mln_u32_t *)malloc(reg->ninst * sizeof(mln_u32_t));
+    if (sc->loop == NULL || sc->state == NULL) return -1;
+    nstates = mln_reg_loops(reg, sc->loop, sc->state);
+    for (i = 0; i < 2; ++i) {
+        sc->set[i].dense = (mln_u32_t *)malloc(reg->ninst * sizeof(mln_u32_t));
+        sc->set[i].sparse = (mln_u32_t *)calloc(reg->ninst, sizeof(mln_u32_t));
+        sc->set[i].seen = (mln_u32_t *)calloc(nstates, sizeof(mln_u32_t));
+        sc->set[i].nseen = nstates;
+    }
+    sc->stack = (mln_reg_frame_t *)malloc(((nstates << 1) + 1) * sizeof(mln_reg_frame_t));
+    sc->kept = (mln_u32_t *)malloc(reg->ninst * sizeof(mln_u32_t));
+    if (sc->set[0].dense == NULL || sc->set[0].sparse == NULL || sc->set[0].seen == NULL || \
+        sc->set[1].dense == NULL || sc->set[1].sparse == NULL || sc->set[1].seen == NULL || \
+        sc->stack == NULL || sc->kept == NULL)
+    {
+        return -1;
+    }
+
+    mln_reg_byte_classes(reg);
+    mln_reg_prefix(reg);
+    /*anchored if nothing can start in the middle of the text*/
+    mln_reg_sparse_clear(&sc->set[0]);
+    nkept = mln_reg_closure(reg, &sc->set[0], sc->kept, 0, 0, 0);
+    reg->anchored = nkept? 0: 1;
+    return 0;
+}
+
+mln_reg_t *mln_reg_compile(mln_string_t *exp)
+{
+    mln_reg_t *reg;
+    mln_reg_parser_t ps;
+    mln_s32_t root;
+    mln_u32_t cap = 0;
+
+    if ((reg = (mln_reg_t *)calloc(1, sizeof(mln_reg_t))) == NULL) return NULL;
+    reg->search.unanchored = 1;
+
+    ps.p = exp->data;
+    ps.end = exp->data + exp->len;
+    ps.nodes = NULL;
+    ps.nnodes = ps.cap = ps.depth = 0;
+    ps.reg = reg;
+    root = mln_reg_parse_alt(&ps);
+    if (root < 0 || ps.p != ps.end || \
+        mln_reg_inst_add(reg, &cap, M_REG_OP_SAVE, 0, 0, 0) == M_REG_NIL || \
+        mln_reg_emit(reg, &cap, ps.nodes, root) < 0 || \
+        mln_reg_inst_add(reg, &cap, M_REG_OP_SAVE, 0, 1, 0) == M_REG_NIL || \
+        mln_reg_inst_add(reg, &cap, M_REG_OP_MATCH, 0, 0, 0) == M_REG_NIL)
+    {
+        free(ps.nodes);
+        mln_reg_free(reg);
+        return NULL;
+    }
+    free(ps.nodes);
+
+    if (mln_reg_prepare(reg) < 0) {
+        mln_reg_free(reg);
+        return NULL;
+    }
+    return reg;
+}
+
+void mln_reg_free(mln_reg_t *reg)
+{
+    mln_reg_scratch_t *sc;
+
+    if (reg == NULL) return;
+
+    if ((sc = (mln_reg_scratch_t *)(reg->scratch)) != NULL) {
+        free(sc->set[0].dense);
+        free(sc->set[0].sparse);
+        free(sc->set[1].dense);
+        free(sc->set[1].sparse);
+        free(sc->set[0].seen);
+        free(sc->set[1].seen);
+        free(sc->loop);
+        free(sc->state);
+        free(sc->stack);
+        free(sc->kept);
+        free(sc->caps);
+        free(sc);
+    }
+    mln_reg_dfa_destroy(&reg->search);
+    mln_reg_dfa_destroy(&reg->equal);
+    free(reg->insts);
+    free(reg->classes);
+    free(reg);
+}
+
+int mln_reg_exec(mln_reg_t *reg, mln_string_t *text, mln_string_t *caps, mln_u32_t ncaps)
+{
+    int ret;
+
+    ret = mln_reg_dfa_run(reg, reg->anchored? &reg->equal: &reg->search, text->data, text->data + text->len, 1);
+    if (ret <= 0 || caps == NULL || !ncaps) return ret;
+    return mln_reg_pike(reg, text->data, text->len, caps, ncaps);
+}
+
+int mln_reg_exec_equal(mln_reg_t *reg, mln_string_t *text)
+{
+    if (reg->prefix_len && \
+        (text->len < reg->prefix_len || memcmp(text->data, reg->prefix, reg->prefix_len)))
+    {
+        return 0;
+    }
+    return mln_reg_dfa_run(reg, &reg->equal, text->data, text->data + text->len, 0);
+}
+
+
+/*
+ * Pattern set
+ */
+mln_reg_set_t *mln_reg_set_new(void)
+{
+    return (mln_reg_set_t *)calloc(1, sizeof(mln_reg_set_t));
+}
+
+static void mln_reg_set_reset(mln_reg_set_t *set)
+{
+    free(set->ac.trans);
+    free(set->ac.out);
+    free(set->ac.dict);
+    free(set->ac.out_id);
+    free(set->ac.out_next);
+    memset(&set->ac, 0, sizeof(mln_reg_ac_t));
+    mln_reg_free(set->prog);
+    set->prog = NULL;
+    free(set->matched);
+    set->matched = NULL;
+    set->compiled = 0;
+}
+
+void mln_reg_set_free(mln_reg_set_t *set)
+{
+    mln_u32_t i;
+
+    if (set == NULL) return;
+
+    mln_reg_set_reset(set);
+    for (i = 0; i < set->n; ++i) {
+        if (set->patterns[i].literal != NULL) mln_string_free(set->patterns[i].literal);
+        mln_reg_free(set->patterns[i].reg);
+    }
+    free(set->patterns);
+    free(set);
+}
+
+int mln_reg_set_add(mln_reg_set_t *set, mln_string_t *exp, mln_u32_t flags)
+{
+    mln_reg_pattern_t *pat;
+
+    if (set->n >= set->cap) {
+        mln_u32_t cap = set->cap? set->cap << 1: 16;
+        if ((pat = (mln_reg_pattern_t *)realloc(set->patterns, cap * sizeof(mln_reg_pattern_t))) == NULL)
+            return -1;
+        set->patterns = pat;
+        set->cap = cap;
+    }
+    pat = &set->patterns[set->n];
+    pat->literal = NULL;
+    pat->reg = NULL;
+    if (flags & M_REG_SET_LITERAL) {
+        if ((pat->literal = mln_string_dup(exp)) == NULL) return -1;
+    } else {
+        if ((pat->reg = mln_reg_compile(exp)) == NULL) return -1;
+    }
+    set->compiled = 0;
+    return (set->n)++;
+}
+
+/*
+ * Aho-Corasick automaton of the literals. The failure links are folded into
+ * the transitions, so each byte costs one table lookup.
+ */
+static int mln_reg_set_ac_build(mln_reg_set_t *set)
+{
+    mln_reg_ac_t *ac = &set->ac;
+    mln_u32_t i, j, c, u, v, nbc, stride, max = 1, nout = 0, head = 0, tail = 0;
+    mln_u32_t *fail, *queue;
+    mln_u8_t used[256];
+    mln_string_t *lit;
+    mln_s32_t *row;
+
+    memset(used, 0, sizeof(used));
+    for (i = 0; i < set->n; ++i) {
+        if ((lit = set->patterns[i].literal) == NULL) continue;
+        for (j = 0; j < lit->len; ++j) used[lit->data[j]] = 1;
+        max += lit->len;
+        ++nout;
+    }
+    if (!nout) return 0;
+
+    /*bytes that are in no literal share class 0*/
+    for (c = 0, j = 0; c < 256; ++c)
+        ac->byte_class[c] = used[c]? ++j: 0;
+    nbc = ac->nbyte_classes = j + 1;
+    stride = nbc + 1;
+
+    ac->trans = (mln_s32_t *)malloc((mln_size_t)max * stride * sizeof(mln_s32_t));
+    ac->out = (mln_u32_t *)malloc(max * sizeof(mln_u32_t));
+    ac->dict = (mln_u32_t *)malloc(max * sizeof(mln_u32_t));
+    ac->out_id = (mln_u32_t *)malloc(nout * sizeof(mln_u32_t));
+    ac->out_next = (mln_u32_t *)malloc(nout * sizeof(mln_u32_t));
+    fail = (mln_u32_t *)malloc(max * sizeof(mln_u32_t));
+    queue = (mln_u32_t *)malloc(max * sizeof(mln_u32_t));
+    if (ac->trans == NULL || ac->out == NULL || ac->dict == NULL || \
+        ac->out_id == NULL || ac->out_next == NULL || fail == NULL || queue == NULL)
+    {
+        free(fail);
+        free(queue);
+        return -1;
+    }
+
+    ac->nnodes = 1;
+    for (c = 0; c < stride; ++c) ac->trans[c] = -1;
+    ac->out[0] = ac->dict[0] = M_REG_NIL;
+    for (i = 0, nout = 0; i < set->n; ++i) {
+        if ((lit = set->patterns[i].literal) == NULL) continue;
+        for (u = 0, j = 0; j < lit->len; ++j) {
+            row = ac->trans + u * stride + ac->byte_class[lit->data[j]];
+            if (*row < 0) {
+                v = ac->nnodes++;
+                for (c = 0; c < stride; ++c) ac->trans[v * stride + c] = -1;
+                ac->out[v] = ac->dict[v] = M_REG_NIL;
+                *row = v;
+            }
+            u = *row;
+        }
+        ac->out_id[nout] = i;
+        ac->out_next[nout] = ac->out[u];
+        ac->out[u] = nout++;
+    }
+
+    /*breadth first, so the failure node of a node is done before the node*/
+    fail[0] = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        u = queue[head++];
+        row = ac->trans + u * stride;
+        for (c = 0; c < nbc; ++c) {
+            if (row[c] < 0) {
+                row[c] = u? ac->trans[fail[u] * stride + c]: 0;
+                continue;
+            }
+            v = row[c];
+            fail[v] = u? (mln_u32_t)ac->trans[fail[u] * stride + c]: 0;
+            ac->dict[v] = ac->out[fail[v]] != M_REG_NIL? fail[v]: ac->dict[fail[v]];
+            queue[tail++] = v;
+        }
+    }
+    for (u = 0; u < ac->nnodes; ++u) {
+        row = ac->trans + u * stride;
+        for (c = 0; c < nbc; ++c) row[c] *= stride;
+        row[nbc] = ac->out[u] != M_REG_NIL || ac->dict[u] != M_REG_NIL;
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+static inline void mln_reg_set_ac_output(mln_reg_set_t *set, mln_u32_t u)
+{
+    mln_reg_ac_t *ac = &set->ac;
+    mln_u32_t o;
+
+    for (; u != M_REG_NIL; u = ac->dict[u]) {
+        for (o = ac->out[u]; o != M_REG_NIL; o = ac->out_next[o])
+            set->matched[ac->out_id[o] >> 6] |= (mln_u64_t)1 << (ac->out_id[o] & 63);
+    }
+}
+
+static void mln_reg_set_ac_run(mln_reg_set_t *set, mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    mln_reg_ac_t *ac = &set->ac;
+    mln_u32_t nbc = ac->nbyte_classes, stride = nbc + 1;
+    mln_u8ptr_t bc = ac->byte_class;
+    mln_s32_t *trans = ac->trans, s = 0;
+
+    if (trans[nbc]) mln_reg_set_ac_output(set, 0);
+    for (; p < end; ++p) {
+        s = trans[s + bc[*p]];
+        if (trans[s + nbc]) mln_reg_set_ac_output(set, s / stride);
+    }
+}
+
+/*
+ * One program for all regular expressions: a chain of SPLITs
+ * starts every expression, whose MATCH holds its pattern index.
+ */
+static int mln_reg_set_prog_build(mln_reg_set_t *set)
+{
+    mln_u32_t i, j, nregs = 0, ninst = 0, nclasses = 0, base;
+    mln_reg_inst_t *in;
+    mln_reg_t *reg, *prog;
+
+    for (i = 0; i < set->n; ++i) {
+        if ((reg = set->patterns[i].reg) == NULL) continue;
+        ninst += reg->ninst + 1;
+        nclasses += reg->nclasses;
+        ++nregs;
+    }
+    if (!nregs) return 0;
+
+    if ((prog = set->prog = (mln_reg_t *)calloc(1, sizeof(mln_reg_t))) == NULL) return -1;
+    /*a set has more states than a single expression, about two for each instruction*/
+    prog->search.unanchored = 1;
+    prog->search.max_states = M_REG_DFA_MAX_STATES;
+    while (prog->search.max_states < (ninst << 1) && prog->search.max_states < M_REG_SET_DFA_MAX_STATES)
+        prog->search.max_states <<= 1;
+    prog->insts = (mln_reg_inst_t *)malloc(ninst * sizeof(mln_reg_inst_t));
+    if (nclasses) prog->classes = (mln_u8_t (*)[32])malloc(nclasses * 32);
+    if (prog->insts == NULL || (nclasses && prog->classes == NULL)) return -1;
+
+    for (i = 0; i < set->n; ++i) {
+        if ((reg = set->patterns[i].reg) == NULL) continue;
+        if (--nregs) {
+            in = &prog->insts[prog->ninst++];
+            in->op = M_REG_OP_SPLIT;
+            in->c = 0;
+            in->x = prog->ninst;
+            in->y = prog->ninst + reg->ninst;
+        }
+        base = prog->ninst;
+        for (j = 0; j < reg->ninst; ++j) {
+            in = &prog->insts[prog->ninst++];
+            *in = reg->insts[j];
+            switch (in->op) {
+                case M_REG_OP_SPLIT:
+                    in->y += base;
+                    /* fall through */
+                case M_REG_OP_JMP:
+                    in->x += base;
+                    break;
+                case M_REG_OP_CLASS:
+                    in->x += prog->nclasses;
+                    break;
+                case M_REG_OP_MATCH:
+                    in->x = i;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (reg->nclasses) {
+            memcpy(prog->classes + prog->nclasses, reg->classes, reg->nclasses * 32);
+            prog->nclasses += reg->nclasses;
+        }
+    }
+    return mln_reg_prepare(prog);
+}
+
+int mln_reg_set_compile(mln_reg_set_t *set)
+{
+    mln_reg_set_reset(set);
+    if ((set->matched = (mln_u64_t *)calloc((set->n >> 6) + 1, sizeof(mln_u64_t))) == NULL || \
+        mln_reg_set_ac_build(set) < 0 || \
+        mln_reg_set_prog_build(set) < 0)
+    {
+        mln_reg_set_reset(set);
+        return -1;
+    }
+    set->compiled = 1;
+    return 0;
+}
+
+/*
+ * Unlike mln_reg_dfa_run, the scan goes on after a match,
+ * the patterns of every matching state are collected.
+ */
+static int mln_reg_set_dfa_run(mln_reg_set_t *set, mln_u8ptr_t p, mln_u8ptr_t end)
+{
+    mln_reg_t *reg = set->prog;
+    mln_reg_dfa_t *dfa = &reg->search;
+    mln_u32_t i, pc, nbc = reg->nbyte_classes, stride = nbc + 1;
+    mln_u8ptr_t bc = reg->byte_class;
+    mln_s32_t s, t, f, last = -1, *trans;
+    mln_reg_dfa_state_t *st;
+    mln_u32_t *ids;
+
+    if (dfa->states == NULL && mln_reg_dfa_init(reg, dfa) < 0) return -1;
+    if ((s = mln_reg_dfa_start(reg, dfa, 1)) < 0) return -1;
+    if (mln_reg_dfa_start(reg, dfa, 0) < 0) return -1;
+    s *= stride;
+    trans = dfa->trans;
+
+    for (; p < end; ++p) {
+        if ((f = trans[s + nbc]) != 0) {
+            if ((f & M_REG_DFA_MATCH) && s != last) {
+                st = &dfa->states[s / stride];
+                ids = dfa->pcs + st->off + st->npcs;
+                for (i = 0; i < st->nids; ++i) set->matched[ids[i] >> 6] |= (mln_u64_t)1 << (ids[i] & 63);
+                last = s;
+            }
+            if (f & M_REG_DFA_DEAD) return 0;
+        }
+        if (s == dfa->start[0] * (mln_s32_t)stride && reg->prefix_len) {
+            if ((p = mln_reg_prefix_find(reg, p, end)) == NULL) return 0;
+        }
+        if ((t = trans[s + bc[*p]]) < 0) {
+            if ((t = mln_reg_dfa_step(reg, dfa, s / stride, *p)) < 0) return -1;
+            if (dfa->start[0] < 0 && mln_reg_dfa_start(reg, dfa, 0) < 0) return -1;
+            t *= stride;
+            trans = dfa->trans;
+            last = -1;
+        }
+        s = t;
+    }
+
+    if (trans[s + nbc] & M_REG_DFA_MATCH_END) {
+        st = &dfa->states[s / stride];
+        for (i = 0; i < st->npcs + dfa->nstart_pcs; ++i) {
+            pc = i < st->npcs? dfa->pcs[st->off + i]: dfa->start_pcs[i - st->npcs];
+            if (reg->insts[pc].op == M_REG_OP_MATCH) {
+                set->matched[reg->insts[pc].x >> 6] |= (mln_u64_t)1 << (reg->insts[pc].x & 63);
+            } else if (reg->insts[pc].op == M_REG_OP_EOL) {
+                mln_reg_matched_at_end(reg, pc, set->matched);
+            }
+        }
+    }
+    return 0;
+}
+
+int mln_reg_set_match(mln_reg_set_t *set, mln_string_t *text, mln_u32_t *ids, mln_u32_t nids)
+{
+    mln_u32_t i, n = 0, nwords = (set->n >> 6) + 1;
+    mln_u64_t w;
+
+    if (!set->compiled) return -1;
+
+    memset(set->matched, 0, nwords * sizeof(mln_u64_t));
+    if (set->ac.trans != NULL) mln_reg_set_ac_run(set, text->data, text->data + text->len);
+    if (set->prog != NULL && mln_reg_set_dfa_run(set, text->data, text->data + text->len) < 0) return -1;
+
+    for (i = 0; i < nwords; ++i) {
+        for (w = set->matched[i]; w; w &= w - 1) {
+            if (n < nids) ids[n] = (i << 6) + __builtin_ctzll(w);
+            ++n;
+        }
+    }
+    return n;
+}
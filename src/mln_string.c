@@ -7,12 +7,25 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include "mln_string.h"
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__wasm__)
+#include <immintrin.h>
+#define MLN_STRING_SIMD
+#endif
 
+#define M_STRING_KMP_STACK    256
+#define M_STRING_SHORT        16 /*compared without the vector handlers*/
+#define M_STRING_SCAN_SHORT   32 /*scanned without the vector handlers*/
+#define M_STRING_SEARCH_SHORT 64 /*searched without the vector handlers*/
 
-static inline int *compute_prefix_function(const char *pattern, int m);
+typedef struct {
+    mln_u8_t     map[256];
+    mln_u8_t     chars[16];
+    mln_u32_t    n;/*number of distinct bytes, more than 16 are only looked up in map*/
+} mln_string_charset_t;
+
+static inline void compute_prefix_function(mln_u8ptr_t pattern, mln_size_t m, mln_u32_t *shift);
 static inline char *
-kmp_string_match(char *text, const char *pattern, int text_len, int pattern_len) __NONNULL2(1,2);
-static mln_string_t *mln_string_slice_recursive(char *s, mln_u64_t len, mln_u8ptr_t ascii, int cnt, mln_string_t *save) __NONNULL3(1,3,5);
+kmp_string_match(mln_u8ptr_t text, mln_u8ptr_t pattern, mln_size_t text_len, mln_size_t pattern_len) __NONNULL2(1,2);
 static inline mln_string_t *mln_string_assign(char *s, mln_u32_t len);
 
 static inline mln_string_t *mln_string_assign(char *s, mln_u32_t len)
@@ -28,6 +41,27 @@ static inline mln_string_t *mln_string_assign(char *s, mln_u32_t len)
     return str;
 }
 
+/*
+ * The data is kept right after the header, in the same allocation.
+ * data_ref is set, so mln_string_free releases both with the header.
+ */
+static inline mln_string_t *mln_string_inline_new(mln_alloc_t *pool, mln_u8ptr_t data, mln_u64_t len)
+{
+    mln_string_t *str;
+
+    if (pool != NULL) str = (mln_string_t *)mln_alloc_m(pool, sizeof(mln_string_t) + len + 1);
+    else str = (mln_string_t *)malloc(sizeof(mln_string_t) + len + 1);
+    if (str == NULL) return NULL;
+    str->data = (mln_u8ptr_t)(str + 1);
+    if (data != NULL && len) memcpy(str->data, data, len);
+    str->data[len] = 0;
+    str->len = len;
+    str->data_ref = 1;
+    str->pool = pool != NULL;
+    str->ref = 1;
+    return str;
+}
+
 mln_string_t *mln_string_buf_new(mln_u8ptr_t buf, mln_u64_t len)
 {
     mln_string_t *str = (mln_string_t *)malloc(sizeof(mln_string_t));
@@ -56,9 +90,9 @@ mln_string_t *mln_string_buf_pool_new(mln_alloc_t *pool, mln_u8ptr_t buf, mln_u6
 
 mln_string_t *mln_string_pool_new(mln_alloc_t *pool, const char *s)
 {
-    mln_string_t *str = (mln_string_t *)mln_alloc_m(pool, sizeof(mln_string_t));
-    if (str == NULL) return NULL;
     if (s == NULL) {
+        mln_string_t *str = (mln_string_t *)mln_alloc_m(pool, sizeof(mln_string_t));
+        if (str == NULL) return NULL;
         str->data = NULL;
         str->len = 0;
         str->data_ref = 0;
@@ -66,25 +100,14 @@ mln_string_t *mln_string_pool_new(mln_alloc_t *pool, const char *s)
         str->ref = 1;
         return str;
     }
-    mln_s32_t len = strlen(s);
-    if ((str->data = (mln_u8ptr_t)mln_alloc_m(pool, len + 1)) == NULL) {
-        mln_alloc_free(str);
-        return NULL;
-    }
-    memcpy(str->data, s, len);
-    str->data[len] = 0;
-    str->len = len;
-    str->data_ref = 0;
-    str->pool = 1;
-    str->ref = 1;
-    return str;
+    return mln_string_inline_new(pool, (mln_u8ptr_t)s, strlen(s));
 }
 
 mln_string_t *mln_string_new(const char *s)
 {
-    mln_string_t *str = (mln_string_t *)malloc(sizeof(mln_string_t));
-    if (str == NULL) return NULL;
     if (s == NULL) {
+        mln_string_t *str = (mln_string_t *)malloc(sizeof(mln_string_t));
+        if (str == NULL) return NULL;
         str->data = NULL;
         str->len = 0;
         str->data_ref = 0;
@@ -92,89 +115,29 @@ mln_string_t *mln_string_new(const char *s)
         str->ref = 1;
         return str;
     }
-    mln_s32_t len = strlen(s);
-    if ((str->data = (mln_u8ptr_t)malloc(len + 1)) == NULL) {
-        free(str);
-        return NULL;
-    }
-    memcpy(str->data, s, len);
-    str->data[len] = 0;
-    str->len = len;
-    str->data_ref = 0;
-    str->pool = 0;
-    str->ref = 1;
-    return str;
+    return mln_string_inline_new(NULL, (mln_u8ptr_t)s, strlen(s));
 }
 
 mln_string_t *mln_string_dup(mln_string_t *str)
 {
-    mln_string_t *s = (mln_string_t *)malloc(sizeof(mln_string_t));
-    if (s == NULL) return NULL;
-    if ((s->data = (mln_u8ptr_t)malloc(str->len + 1)) == NULL) {
-        free(s);
-        return NULL;
-    }
-    memcpy(s->data, str->data, str->len);
-    s->data[str->len] = 0;
-    s->len = str->len;
-    s->data_ref = 0;
-    s->pool = 0;
-    s->ref = 1;
-    return s;
+    return mln_string_inline_new(NULL, str->data, str->len);
 }
 
 mln_string_t *mln_string_pool_dup(mln_alloc_t *pool, mln_string_t *str)
 {
-    mln_string_t *s = (mln_string_t *)mln_alloc_m(pool, sizeof(mln_string_t));
-    if (s == NULL) return NULL;
-    if ((s->data = (mln_u8ptr_t)mln_alloc_m(pool, str->len + 1)) == NULL) {
-        mln_alloc_free(s);
-        return NULL;
-    }
-    memcpy(s->data, str->data, str->len);
-    s->data[str->len] = 0;
-    s->len = str->len;
-    s->data_ref = 0;
-    s->pool = 1;
-    s->ref = 1;
-    return s;
+    return mln_string_inline_new(pool, str->data, str->len);
 }
 
 mln_string_t *mln_string_ndup(mln_string_t *str, mln_s32_t size)
 {
     if (size < 0) return NULL;
-    mln_string_t *s = (mln_string_t *)malloc(sizeof(mln_string_t));
-    if (s == NULL) return NULL;
-    mln_s32_t min = size > str->len ? str->len : size;
-    if ((s->data = (mln_u8ptr_t)malloc(min + 1)) == NULL) {
-        free(s);
-        return NULL;
-    }
-    memcpy(s->data, str->data, min);
-    s->data[min] = 0;
-    s->len = min;
-    s->data_ref = 0;
-    s->pool = 0;
-    s->ref = 1;
-    return s;
+    return mln_string_inline_new(NULL, str->data, size > str->len? str->len: size);
 }
 
 mln_string_t *mln_string_const_ndup(char *str, mln_s32_t size)
 {
     if (size < 0) return NULL;
-    mln_string_t *s = (mln_string_t *)malloc(sizeof(mln_string_t));
-    if (s == NULL) return NULL;
-    if ((s->data = (mln_u8ptr_t)malloc(size + 1)) == NULL) {
-        free(s);
-        return NULL;
-    }
-    memcpy(s->data, str, size);
-    s->data[size] = 0;
-    s->len = size;
-    s->data_ref = 0;
-    s->pool = 0;
-    s->ref = 1;
-    return s;
+    return mln_string_inline_new(NULL, (mln_u8ptr_t)str, size);
 }
 
 mln_string_t *mln_string_ref_dup(mln_string_t *str)
@@ -201,6 +164,540 @@ mln_string_t *mln_string_const_ref_dup(char *s)
     return str;
 }
 
+/*
+ * Byte scanning helpers.
+ * search finds a pattern, checking two of its bytes at every position before
+ * comparing the whole pattern. scan finds the first byte that is (in = 1) or
+ * is not (in = 0) in a set, rscan the last one. On x86-64 the SSE2 or AVX2
+ * version is chosen at the first call.
+ */
+#define mln_string_tolower(c) ((mln_u8_t)((c) - 'A') < 26? (c) | 0x20: (c))
+#define mln_string_toupper(c) ((mln_u8_t)((c) - 'a') < 26? (c) & ~0x20: (c))
+
+static void mln_string_charset_init(mln_string_charset_t *cs, mln_u8ptr_t chars, mln_size_t n)
+{
+    mln_size_t i;
+
+    memset(cs->map, 0, sizeof(cs->map));
+    cs->n = 0;
+    for (i = 0; i < n; ++i) {
+        if (cs->map[chars[i]]) continue;
+        cs->map[chars[i]] = 1;
+        if (cs->n < sizeof(cs->chars)) cs->chars[cs->n] = chars[i];
+        ++(cs->n);
+    }
+}
+
+static mln_u8ptr_t
+mln_string_search_scalar(mln_u8ptr_t p, mln_size_t n, mln_u8ptr_t pat, mln_size_t m, mln_size_t i1, mln_size_t i2)
+{
+    mln_u8ptr_t q, last = p + (n - m);
+
+    for (q = p; q <= last; ++q) {
+        if ((q = (mln_u8ptr_t)memchr(q + i1, pat[i1], last - q + 1)) == NULL) return NULL;
+        q -= i1;
+        if (q[i2] == pat[i2] && !memcmp(q, pat, m)) return q;
+    }
+    return NULL;
+}
+
+static mln_u8ptr_t mln_string_scan_scalar(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    for (; p < end && cs->map[*p] != in; ++p)
+        ;
+    return p;
+}
+
+static mln_u8ptr_t mln_string_rscan_scalar(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    for (; end > p && cs->map[*(end - 1)] != in; --end)
+        ;
+    return end;
+}
+
+static int mln_string_casecmp_bytes(mln_u8ptr_t a, mln_u8ptr_t b, mln_size_t n)
+{
+    mln_u8_t c1, c2;
+
+    for (; n; --n, ++a, ++b) {
+        c1 = mln_string_tolower(*a);
+        c2 = mln_string_tolower(*b);
+        if (c1 != c2) return (int)c1 - (int)c2;
+    }
+    return 0;
+}
+
+/*
+ * Eight bytes are folded at once: bit 7 of a byte is set by the additions
+ * if its low 7 bits are in 'A'-'Z', bytes above 0x7f are left as they are.
+ */
+static inline mln_u64_t mln_string_lower_word(mln_u64_t x)
+{
+    mln_u64_t h = 0x8080808080808080ULL, ones = 0x0101010101010101ULL, low = x & ~h;
+    mln_u64_t upper = (low + ones * (0x80 - 'A')) & ~(low + ones * (0x80 - 'Z' - 1)) & ~x & h;
+    return x | (upper >> 2);
+}
+
+#if !defined(MLN_STRING_SIMD)
+/*
+ * The last word overlaps the previous one rather than going byte by byte.
+ */
+static int mln_string_casecmp_scalar(mln_u8ptr_t a, mln_u8ptr_t b, mln_size_t n)
+{
+    mln_u64_t w1, w2;
+    mln_size_t off;
+
+    if (n < 8) return mln_string_casecmp_bytes(a, b, n);
+    for (off = 0; ; off += 8) {
+        if (off + 8 > n) off = n - 8;
+        memcpy(&w1, a + off, 8);
+        memcpy(&w2, b + off, 8);
+        if (mln_string_lower_word(w1) != mln_string_lower_word(w2))
+            return mln_string_casecmp_bytes(a + off, b + off, 8);
+        if (off + 8 == n) return 0;
+    }
+}
+#endif
+
+static void mln_string_casefold_scalar(mln_u8ptr_t p, mln_size_t n, int upper)
+{
+    mln_u8ptr_t end = p + n;
+
+    if (upper) {
+        for (; p < end; ++p) *p = mln_string_toupper(*p);
+    } else {
+        for (; p < end; ++p) *p = mln_string_tolower(*p);
+    }
+}
+
+#if defined(MLN_STRING_SIMD)
+/*
+ * Kept out of the scanning loops, so that they do not spill their registers.
+ */
+__attribute__((noinline))
+static mln_u8ptr_t mln_string_search_verify(mln_u8ptr_t p, mln_u64_t mask, mln_u8ptr_t pat, mln_size_t m)
+{
+    for (; mask; mask &= mask - 1) {
+        if (!memcmp(p + __builtin_ctzll(mask), pat, m)) return p + __builtin_ctzll(mask);
+    }
+    return NULL;
+}
+
+/*
+ * _mm_set1_epi8 of a variable byte is compiled to a byte store and a wider
+ * load, which stalls on store forwarding.
+ */
+#define mln_string_splat_sse2(c) _mm_shuffle_epi32(_mm_cvtsi32_si128((mln_u32_t)(c) * 0x01010101U), 0)
+
+#define mln_string_search_block_sse2(p,f,l,i1,i2) \
+    _mm_and_si128(_mm_cmpeq_epi8((f), _mm_loadu_si128((const __m128i *)((p) + (i1)))), \
+                  _mm_cmpeq_epi8((l), _mm_loadu_si128((const __m128i *)((p) + (i2)))))
+
+/*
+ * 64 candidate positions are checked in each round, a hit is rare.
+ */
+static mln_u8ptr_t
+mln_string_search_sse2(mln_u8ptr_t p, mln_size_t n, mln_u8ptr_t pat, mln_size_t m, mln_size_t i1, mln_size_t i2)
+{
+    const __m128i f = mln_string_splat_sse2(pat[i1]), l = mln_string_splat_sse2(pat[i2]);
+    __m128i v0, v1, v2, v3;
+    mln_u8ptr_t q;
+    mln_size_t i;
+    mln_u64_t mask;
+
+    for (i = 0; i + m + 63 <= n; i += 64) {
+        v0 = mln_string_search_block_sse2(p + i, f, l, i1, i2);
+        v1 = mln_string_search_block_sse2(p + i + 16, f, l, i1, i2);
+        v2 = mln_string_search_block_sse2(p + i + 32, f, l, i1, i2);
+        v3 = mln_string_search_block_sse2(p + i + 48, f, l, i1, i2);
+        if (!_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3)))) continue;
+        mask = (mln_u64_t)(mln_u32_t)_mm_movemask_epi8(v0) | \
+               ((mln_u64_t)(mln_u32_t)_mm_movemask_epi8(v1) << 16) | \
+               ((mln_u64_t)(mln_u32_t)_mm_movemask_epi8(v2) << 32) | \
+               ((mln_u64_t)(mln_u32_t)_mm_movemask_epi8(v3) << 48);
+        if ((q = mln_string_search_verify(p + i, mask, pat, m)) != NULL) return q;
+    }
+    for (; i + m + 15 <= n; i += 16) {
+        mask = (mln_u32_t)_mm_movemask_epi8(mln_string_search_block_sse2(p + i, f, l, i1, i2));
+        if (mask && (q = mln_string_search_verify(p + i, mask, pat, m)) != NULL) return q;
+    }
+    if (i + m > n) return NULL;
+    if (!i) return mln_string_search_scalar(p, n, pat, m, i1, i2);
+    /*
+     * The last block overlaps the previous one, positions already checked are masked off.
+     */
+    n -= m + 15;
+    mask = (mln_u32_t)_mm_movemask_epi8(mln_string_search_block_sse2(p + n, f, l, i1, i2)) & (0xffffU << (i - n));
+    return mask? mln_string_search_verify(p + n, mask, pat, m): NULL;
+}
+
+/*
+ * Texts shorter than M_STRING_SEARCH_SHORT are searched here without an
+ * indirect call, and candidates are compared in place.
+ */
+static inline mln_u8ptr_t
+mln_string_search_short(mln_u8ptr_t p, mln_size_t n, mln_u8ptr_t pat, mln_size_t m, mln_size_t i1, mln_size_t i2)
+{
+    __m128i f, l;
+    mln_size_t i, last;
+    mln_u32_t mask;
+
+    if (n < m + 15) return mln_string_search_scalar(p, n, pat, m, i1, i2);
+    f = mln_string_splat_sse2(pat[i1]);
+    l = mln_string_splat_sse2(pat[i2]);
+    last = n - m - 15;
+    for (i = 0; ; i += 16) {
+        if (i > last) {
+            if (i > last + 15) return NULL;
+            mask = (mln_u32_t)_mm_movemask_epi8(mln_string_search_block_sse2(p + last, f, l, i1, i2)) & (0xffffU << (i - last));
+            i = last;
+        } else {
+            mask = (mln_u32_t)_mm_movemask_epi8(mln_string_search_block_sse2(p + i, f, l, i1, i2));
+        }
+        for (; mask; mask &= mask - 1) {
+            if (!memcmp(p + i + __builtin_ctz(mask), pat, m)) return p + i + __builtin_ctz(mask);
+        }
+        if (i == last) return NULL;
+    }
+}
+
+static mln_u8ptr_t mln_string_scan_sse2(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_u32_t i, mask, inv = in? 0: 0xffff;
+    __m128i v, m;
+
+    if (cs->n > sizeof(cs->chars)) return mln_string_scan_scalar(p, end, cs, in);
+    for (; end - p >= 16; p += 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        m = _mm_setzero_si128();
+        for (i = 0; i < cs->n; ++i) m = _mm_or_si128(m, _mm_cmpeq_epi8(v, mln_string_splat_sse2(cs->chars[i])));
+        mask = (mln_u32_t)_mm_movemask_epi8(m) ^ inv;
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return mln_string_scan_scalar(p, end, cs, in);
+}
+
+static mln_u8ptr_t mln_string_rscan_sse2(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_u32_t i, mask, inv = in? 0: 0xffff;
+    __m128i v, m;
+
+    if (cs->n > sizeof(cs->chars)) return mln_string_rscan_scalar(p, end, cs, in);
+    for (; end - p >= 16; end -= 16) {
+        v = _mm_loadu_si128((const __m128i *)(end - 16));
+        m = _mm_setzero_si128();
+        for (i = 0; i < cs->n; ++i) m = _mm_or_si128(m, _mm_cmpeq_epi8(v, mln_string_splat_sse2(cs->chars[i])));
+        mask = (mln_u32_t)_mm_movemask_epi8(m) ^ inv;
+        if (mask) return end - 16 + (32 - __builtin_clz(mask));
+    }
+    return mln_string_rscan_scalar(p, end, cs, in);
+}
+
+/*
+ * 'A'-'Z' are moved to the lowest signed bytes, so one signed compare finds them.
+ */
+static inline __m128i mln_string_lower_sse2(__m128i v)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8((char)('A' + 128)));
+    return _mm_or_si128(v, _mm_and_si128(_mm_cmplt_epi8(t, _mm_set1_epi8(-128 + 26)), _mm_set1_epi8(0x20)));
+}
+
+static inline __m128i mln_string_upper_sse2(__m128i v)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8((char)('a' + 128)));
+    return _mm_xor_si128(v, _mm_and_si128(_mm_cmplt_epi8(t, _mm_set1_epi8(-128 + 26)), _mm_set1_epi8(0x20)));
+}
+
+static int mln_string_casecmp_sse2(mln_u8ptr_t a, mln_u8ptr_t b, mln_size_t n)
+{
+    mln_size_t off;
+    mln_u32_t mask;
+
+    if (n < M_STRING_SHORT) return mln_string_casecmp_bytes(a, b, n);
+    for (off = 0; ; off += 16) {
+        if (off + 16 > n) off = n - 16;
+        mask = (mln_u32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(mln_string_lower_sse2(_mm_loadu_si128((const __m128i *)(a + off))), \
+                                                           mln_string_lower_sse2(_mm_loadu_si128((const __m128i *)(b + off)))));
+        if (mask != 0xffff) return mln_string_casecmp_bytes(a + off, b + off, 16);
+        if (off + 16 == n) return 0;
+    }
+}
+
+static void mln_string_casefold_sse2(mln_u8ptr_t p, mln_size_t n, int upper)
+{
+    __m128i v;
+
+    for (; n >= 16; n -= 16, p += 16) {
+        v = _mm_loadu_si128((const __m128i *)p);
+        _mm_storeu_si128((__m128i *)p, upper? mln_string_upper_sse2(v): mln_string_lower_sse2(v));
+    }
+    mln_string_casefold_scalar(p, n, upper);
+}
+
+#define mln_string_search_block_avx2(p,f,l,i1,i2) \
+    _mm256_and_si256(_mm256_cmpeq_epi8((f), _mm256_loadu_si256((const __m256i *)((p) + (i1)))), \
+                     _mm256_cmpeq_epi8((l), _mm256_loadu_si256((const __m256i *)((p) + (i2)))))
+
+__attribute__((target("avx2")))
+static mln_u8ptr_t
+mln_string_search_avx2(mln_u8ptr_t p, mln_size_t n, mln_u8ptr_t pat, mln_size_t m, mln_size_t i1, mln_size_t i2)
+{
+    __m256i f, l, v0, v1, v;
+    mln_u8ptr_t q;
+    mln_size_t i;
+    mln_u64_t mask;
+
+    if (n < m + 63) return mln_string_search_sse2(p, n, pat, m, i1, i2);
+    f = _mm256_set1_epi8(pat[i1]);
+    l = _mm256_set1_epi8(pat[i2]);
+    for (i = 0; ; i += 64) {
+        if (i + m + 63 > n) {
+            if (i + m > n) return NULL;
+            /*
+             * The same overlapping last round as the SSE2 version.
+             */
+            mask = ~0ULL << (i - (n - m - 63));
+            i = n - m - 63;
+        } else {
+            mask = ~0ULL;
+        }
+        v0 = mln_string_search_block_avx2(p + i, f, l, i1, i2);
+        v1 = mln_string_search_block_avx2(p + i + 32, f, l, i1, i2);
+        v = _mm256_or_si256(v0, v1);
+        if (!_mm256_testz_si256(v, v)) {
+            mask &= (mln_u64_t)(mln_u32_t)_mm256_movemask_epi8(v0) | \
+                    ((mln_u64_t)(mln_u32_t)_mm256_movemask_epi8(v1) << 32);
+            if (mask && (q = mln_string_search_verify(p + i, mask, pat, m)) != NULL) return q;
+        }
+        if (i + m + 63 == n) return NULL;
+    }
+}
+
+__attribute__((target("avx2")))
+static mln_u8ptr_t mln_string_scan_avx2(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_u32_t i, mask, inv = in? 0: 0xffffffff;
+    __m256i v, m;
+
+    if (cs->n > sizeof(cs->chars)) return mln_string_scan_scalar(p, end, cs, in);
+    for (; end - p >= 32; p += 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        m = _mm256_setzero_si256();
+        for (i = 0; i < cs->n; ++i) m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(cs->chars[i])));
+        mask = (mln_u32_t)_mm256_movemask_epi8(m) ^ inv;
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return mln_string_scan_sse2(p, end, cs, in);
+}
+
+__attribute__((target("avx2")))
+static mln_u8ptr_t mln_string_rscan_avx2(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_u32_t i, mask, inv = in? 0: 0xffffffff;
+    __m256i v, m;
+
+    if (cs->n > sizeof(cs->chars)) return mln_string_rscan_scalar(p, end, cs, in);
+    for (; end - p >= 32; end -= 32) {
+        v = _mm256_loadu_si256((const __m256i *)(end - 32));
+        m = _mm256_setzero_si256();
+        for (i = 0; i < cs->n; ++i) m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(cs->chars[i])));
+        mask = (mln_u32_t)_mm256_movemask_epi8(m) ^ inv;
+        if (mask) return end - 32 + (32 - __builtin_clz(mask));
+    }
+    return mln_string_rscan_sse2(p, end, cs, in);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mln_string_lower_avx2(__m256i v)
+{
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8((char)('A' + 128)));
+    return _mm256_or_si256(v, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), t), _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i mln_string_upper_avx2(__m256i v)
+{
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8((char)('a' + 128)));
+    return _mm256_xor_si256(v, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), t), _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static int mln_string_casecmp_avx2(mln_u8ptr_t a, mln_u8ptr_t b, mln_size_t n)
+{
+    mln_size_t off;
+    mln_u32_t mask;
+
+    if (n < M_STRING_SHORT) return mln_string_casecmp_bytes(a, b, n);
+    if (n < 32) return mln_string_casecmp_sse2(a, b, n);
+    for (off = 0; off + 64 <= n; off += 64) {
+        __m256i x0 = _mm256_cmpeq_epi8(mln_string_lower_avx2(_mm256_loadu_si256((const __m256i *)(a + off))), \
+                                       mln_string_lower_avx2(_mm256_loadu_si256((const __m256i *)(b + off))));
+        __m256i x1 = _mm256_cmpeq_epi8(mln_string_lower_avx2(_mm256_loadu_si256((const __m256i *)(a + off + 32))), \
+                                       mln_string_lower_avx2(_mm256_loadu_si256((const __m256i *)(b + off + 32))));
+        if ((mln_u32_t)_mm256_movemask_epi8(_mm256_and_si256(x0, x1)) != 0xffffffff) {
+            if ((mln_u32_t)_mm256_movemask_epi8(x0) != 0xffffffff)
+                return mln_string_casecmp_bytes(a + off, b + off, 32);
+            return mln_string_casecmp_bytes(a + off + 32, b + off + 32, 32);
+        }
+    }
+    if (off == n) return 0;
+    for (; ; off += 32) {
+        if (off + 32 > n) off = n - 32;
+        mask = (mln_u32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(mln_string_lower_avx2(_mm256_loadu_si256((const __m256i *)(a + off))), \
+                                                                 mln_string_lower_avx2(_mm256_loadu_si256((const __m256i *)(b + off)))));
+        if (mask != 0xffffffff) return mln_string_casecmp_bytes(a + off, b + off, 32);
+        if (off + 32 == n) return 0;
+    }
+}
+
+__attribute__((target("avx2")))
+static void mln_string_casefold_avx2(mln_u8ptr_t p, mln_size_t n, int upper)
+{
+    __m256i v;
+
+    for (; n >= 32; n -= 32, p += 32) {
+        v = _mm256_loadu_si256((const __m256i *)p);
+        _mm256_storeu_si256((__m256i *)p, upper? mln_string_upper_avx2(v): mln_string_lower_avx2(v));
+    }
+    mln_string_casefold_sse2(p, n, upper);
+}
+#endif
+
+static mln_u8ptr_t
+mln_string_search_init(mln_u8ptr_t p, mln_size_t n, mln_u8ptr_t pat, mln_size_t m, mln_size_t i1, mln_size_t i2);
+static mln_u8ptr_t mln_string_scan_init(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in);
+static mln_u8ptr_t mln_string_rscan_init(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in);
+static int mln_string_casecmp_init(mln_u8ptr_t a, mln_u8ptr_t b, mln_size_t n);
+static void mln_string_casefold_init(mln_u8ptr_t p, mln_size_t n, int upper);
+static mln_u8ptr_t (*mln_string_search_handler)(mln_u8ptr_t, mln_size_t, mln_u8ptr_t, mln_size_t, mln_size_t, mln_size_t) = mln_string_search_init;
+static mln_u8ptr_t (*mln_string_scan_handler)(mln_u8ptr_t, mln_u8ptr_t, mln_string_charset_t *, int) = mln_string_scan_init;
+static mln_u8ptr_t (*mln_string_rscan_handler)(mln_u8ptr_t, mln_u8ptr_t, mln_string_charset_t *, int) = mln_string_rscan_init;
+static int (*mln_string_casecmp_handler)(mln_u8ptr_t, mln_u8ptr_t, mln_size_t) = mln_string_casecmp_init;
+static void (*mln_string_casefold_handler)(mln_u8ptr_t, mln_size_t, int) = mln_string_casefold_init;
+
+static void mln_string_scan_select(void)
+{
+#if defined(MLN_STRING_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        mln_string_search_handler = mln_string_search_avx2;
+        mln_string_scan_handler = mln_string_scan_avx2;
+        mln_string_rscan_handler = mln_string_rscan_avx2;
+        mln_string_casecmp_handler = mln_string_casecmp_avx2;
+        mln_string_casefold_handler = mln_string_casefold_avx2;
+    } else {
+        mln_string_search_handler = mln_string_search_sse2;
+        mln_string_scan_handler = mln_string_scan_sse2;
+        mln_string_rscan_handler = mln_string_rscan_sse2;
+        mln_string_casecmp_handler = mln_string_casecmp_sse2;
+        mln_string_casefold_handler = mln_string_casefold_sse2;
+    }
+#else
+    mln_string_search_handler = mln_string_search_scalar;
+    mln_string_scan_handler = mln_string_scan_scalar;
+    mln_string_rscan_handler = mln_string_rscan_scalar;
+    mln_string_casecmp_handler = mln_string_casecmp_scalar;
+    mln_string_casefold_handler = mln_string_casefold_scalar;
+#endif
+}
+
+static mln_u8ptr_t
+mln_string_search_init(mln_u8ptr_t p, mln_size_t n, mln_u8ptr_t pat, mln_size_t m, mln_size_t i1, mln_size_t i2)
+{
+    mln_string_scan_select();
+    return mln_string_search_handler(p, n, pat, m, i1, i2);
+}
+
+static mln_u8ptr_t mln_string_scan_init(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_string_scan_select();
+    return mln_string_scan_handler(p, end, cs, in);
+}
+
+static mln_u8ptr_t mln_string_rscan_init(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_string_scan_select();
+    return mln_string_rscan_handler(p, end, cs, in);
+}
+
+static int mln_string_casecmp_init(mln_u8ptr_t a, mln_u8ptr_t b, mln_size_t n)
+{
+    mln_string_scan_select();
+    return mln_string_casecmp_handler(a, b, n);
+}
+
+static void mln_string_casefold_init(mln_u8ptr_t p, mln_size_t n, int upper)
+{
+    mln_string_scan_select();
+    mln_string_casefold_handler(p, n, upper);
+}
+
+/*
+ * Short inputs cost more in the indirect call than in the loop, so they
+ * are handled here without it.
+ */
+static inline int mln_string_casecmp(mln_u8ptr_t a, mln_u8ptr_t b, mln_size_t n)
+{
+    mln_u64_t w1, w2, w3, w4;
+
+    if (n >= M_STRING_SHORT) return mln_string_casecmp_handler(a, b, n);
+    if (n < 8) return mln_string_casecmp_bytes(a, b, n);
+    /*
+     * Two words cover 8 to 15 bytes, bytes are only compared on a mismatch.
+     */
+    memcpy(&w1, a, 8);
+    memcpy(&w2, b, 8);
+    memcpy(&w3, a + n - 8, 8);
+    memcpy(&w4, b + n - 8, 8);
+    if ((mln_string_lower_word(w1) ^ mln_string_lower_word(w2)) | (mln_string_lower_word(w3) ^ mln_string_lower_word(w4)))
+        return mln_string_casecmp_bytes(a, b, n);
+    return 0;
+}
+
+static inline mln_u8ptr_t
+mln_string_search(mln_u8ptr_t p, mln_size_t n, mln_u8ptr_t pat, mln_size_t m, mln_size_t i1, mln_size_t i2)
+{
+    if (!m) return p;
+    if (m > n) return NULL;
+    if (m == 1) return (mln_u8ptr_t)memchr(p, pat[0], n);
+#if defined(MLN_STRING_SIMD)
+    if (n < M_STRING_SEARCH_SHORT) return mln_string_search_short(p, n, pat, m, i1, i2);
+#else
+    if (n < M_STRING_SEARCH_SHORT) return mln_string_search_scalar(p, n, pat, m, i1, i2);
+#endif
+    return mln_string_search_handler(p, n, pat, m, i1, i2);
+}
+
+/*
+ * A single separator is what memchr is best at. Otherwise most runs are
+ * short, so the first bytes of a long text are checked inline.
+ */
+static inline mln_u8ptr_t mln_string_scan(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_u8ptr_t q;
+
+    if (in && cs->n == 1) {
+        q = (mln_u8ptr_t)memchr(p, cs->chars[0], end - p);
+        return q == NULL? end: q;
+    }
+    if (end - p < M_STRING_SCAN_SHORT) return mln_string_scan_scalar(p, end, cs, in);
+    for (q = p + 8; p < q; ++p) {
+        if (cs->map[*p] == in) return p;
+    }
+    return mln_string_scan_handler(p, end, cs, in);
+}
+
+static inline mln_u8ptr_t mln_string_rscan(mln_u8ptr_t p, mln_u8ptr_t end, mln_string_charset_t *cs, int in)
+{
+    mln_u8ptr_t q;
+
+    if (end - p < M_STRING_SCAN_SHORT) return mln_string_rscan_scalar(p, end, cs, in);
+    for (q = end - 8; end > q; --end) {
+        if (cs->map[*(end - 1)] == in) return end;
+    }
+    return mln_string_rscan_handler(p, end, cs, in);
+}
+
 int mln_string_strseqcmp(mln_string_t *s1, mln_string_t *s2)
 {
     int ret;
@@ -292,14 +789,14 @@ int mln_string_strcasecmp(mln_string_t *s1, mln_string_t *s2)
     if (s1 == s2 || s1->data == s2->data) return 0;
     if (s1->len > s2->len) return 1;
     if (s1->len < s2->len) return -1;
-    return strncasecmp((char *)(s1->data), (char *)(s2->data), s1->len);
+    return mln_string_casecmp(s1->data, s2->data, s1->len);
 }
 
 int mln_string_strncasecmp(mln_string_t *s1, mln_string_t *s2, mln_u32_t n)
 {
     if (s1 == s2 || s1->data == s2->data) return 0;
     if (s1->len < n || s2->len < n) return -1;
-    return strncasecmp((char *)(s1->data), (char *)(s2->data), n);
+    return mln_string_casecmp(s1->data, s2->data, n);
 }
 
 int mln_string_const_strcasecmp(mln_string_t *s1, char *s2)
@@ -308,7 +805,7 @@ int mln_string_const_strcasecmp(mln_string_t *s1, char *s2)
     mln_u32_t len = strlen(s2);
     if (s1->len > len) return 1;
     if (s1->len < len) return -1;
-    return strncasecmp((char *)(s1->data), s2, len);
+    return mln_string_casecmp(s1->data, (mln_u8ptr_t)s2, len);
 }
 
 int mln_string_const_strncasecmp(mln_string_t *s1, char *s2, mln_u32_t n)
@@ -316,21 +813,22 @@ int mln_string_const_strncasecmp(mln_string_t *s1, char *s2, mln_u32_t n)
     if (s1->data == (mln_u8ptr_t)s2) return 0;
     mln_u32_t len = strlen(s2);
     if (s1->len < n || len < n) return -1;
-    return strncasecmp((char *)(s1->data), s2, n);
+    return mln_string_casecmp(s1->data, (mln_u8ptr_t)s2, n);
 }
 
 char *mln_string_strstr(mln_string_t *text, mln_string_t *pattern)
 {
     if (text == pattern || text->data == pattern->data)
         return (char *)(text->data);
-    return strstr((char *)(text->data), (char *)(pattern->data));
+    return (char *)mln_string_search(text->data, text->len, pattern->data, pattern->len, 0, pattern->len - 1);
 }
 
 char *mln_string_const_strstr(mln_string_t *text, char *pattern)
 {
     if (text->data == (mln_u8ptr_t)pattern)
         return (char *)(text->data);
-    return strstr((char *)(text->data), pattern);
+    mln_size_t len = strlen(pattern);
+    return (char *)mln_string_search(text->data, text->len, (mln_u8ptr_t)pattern, len, 0, len - 1);
 }
 
 mln_string_t *mln_string_new_strstr(mln_string_t *text, mln_string_t *pattern)
@@ -351,14 +849,14 @@ char *mln_string_kmp(mln_string_t *text, mln_string_t *pattern)
 {
     if (text == pattern || text->data == pattern->data)
         return (char *)(text->data);
-    return kmp_string_match((char *)(text->data), (char *)(pattern->data), text->len, pattern->len);
+    return kmp_string_match(text->data, pattern->data, text->len, pattern->len);
 }
 
 char *mln_string_const_kmp(mln_string_t *text, char *pattern)
 {
     if (text->data == (mln_u8ptr_t)pattern)
         return (char *)(text->data);
-    return kmp_string_match((char *)(text->data), pattern, text->len, strlen(pattern));
+    return kmp_string_match(text->data, (mln_u8ptr_t)pattern, text->len, strlen(pattern));
 }
 
 mln_string_t *mln_string_new_kmp(mln_string_t *text, mln_string_t *pattern)
@@ -380,21 +878,26 @@ mln_string_t *mln_string_new_const_kmp(mln_string_t *text, char *pattern)
  * components of KMP algorithm.
  * The longer pattern's prefix matched and existed
  * the higher performance of KMP algorithm made.
+ * The prefix function of a short pattern is kept on the stack.
  */
 
-static inline char *
-kmp_string_match(char *text, const char *pattern, int text_len, int pattern_len)
+static mln_u8ptr_t
+mln_string_kmp_search(mln_u8ptr_t text, mln_size_t text_len, mln_u8ptr_t pattern, mln_size_t pattern_len, mln_u32_t *shift)
 {
-    int *shift = compute_prefix_function(pattern, pattern_len);
-    if (shift == NULL) return NULL;
-    int q = 0, i;
-    for (i = 0; i<text_len; ++i) {
+    mln_size_t q = 0, i;
+    mln_u8ptr_t p;
+
+    for (i = 0; i < text_len; ++i) {
+        /*nothing matched, the next match starts with the first byte of pattern*/
+        if (!q) {
+            if ((p = (mln_u8ptr_t)memchr(text + i, pattern[0], text_len - i)) == NULL) return NULL;
+            i = p - text;
+        }
         while (q > 0 && pattern[q] != text[i])
             q = shift[q - 1];
         if (pattern[q] == text[i])
             ++q;
         if (q == pattern_len) {
-            free(shift);
             return &text[i-pattern_len+1];
           /*
            * we just return the first position.
@@ -402,16 +905,31 @@ kmp_string_match(char *text, const char *pattern, int text_len, int pattern_len)
            /*q = shift[q];*/
         }
     }
-    free(shift);
     return NULL;
 }
 
-static inline int *compute_prefix_function(const char *pattern, int m)
+static inline char *
+kmp_string_match(mln_u8ptr_t text, mln_u8ptr_t pattern, mln_size_t text_len, mln_size_t pattern_len)
 {
-    int *shift = (int *)malloc(sizeof(int)*m);
-    if (shift == NULL) return NULL;
+    mln_u32_t stack_shift[M_STRING_KMP_STACK], *shift = stack_shift;
+    mln_u8ptr_t p;
+
+    if (!pattern_len) return (char *)text;
+    if (pattern_len > text_len) return NULL;
+    if (pattern_len > M_STRING_KMP_STACK) {
+        if ((shift = (mln_u32_t *)malloc(sizeof(mln_u32_t)*pattern_len)) == NULL) return NULL;
+    }
+    compute_prefix_function(pattern, pattern_len, shift);
+    p = mln_string_kmp_search(text, text_len, pattern, pattern_len, shift);
+    if (shift != stack_shift) free(shift);
+    return (char *)p;
+}
+
+static inline void compute_prefix_function(mln_u8ptr_t pattern, mln_size_t m, mln_u32_t *shift)
+{
+    mln_size_t k = 0, q;
+
     shift[0] = 0;
-    int k = 0, q;
     for (q = 1; q<m; ++q) {
         while (k > 0 && pattern[k] != pattern[q])
             k = shift[k - 1];
@@ -419,52 +937,150 @@ static inline int *compute_prefix_function(const char *pattern, int m)
             ++k;
         shift[q] = k;
     }
-    return shift;
 }
 
-mln_string_t *mln_string_slice(mln_string_t *s, const char *sep_array/*ended by \0*/)
+/*
+ * Precompiled pattern. The two bytes checked first by the search are its
+ * least common ones: lowercase letters, digits and URL punctuation are
+ * assumed to be common.
+ */
+static inline int mln_string_byte_rank(mln_u8_t c)
 {
-    const char *ps;
-    mln_string_t *tmp = mln_string_dup(s);
-    mln_u8_t ascii[256] = {0};
+    if (islower(c) || c == ' ') return 2;
+    if (isdigit(c) || c == '/' || c == '.' || c == '-' || c == '_') return 1;
+    return 0;
+}
 
-    if (tmp == NULL) return NULL;
+static void mln_string_pattern_init(mln_string_pattern_t *pat, mln_string_t *pattern)
+{
+    mln_size_t i, m = pattern->len;
+    int rank, best = 3;
 
-    for (ps = sep_array; *ps != 0; ++ps) {
-        ascii[(mln_u8_t)(*ps)] = 1;
+    pat->next = (mln_u32_t *)(pat + 1);
+    pat->data = (mln_u8ptr_t)(pat->next + m);
+    pat->len = m;
+    if (m) {
+        memcpy(pat->data, pattern->data, m);
+        compute_prefix_function(pat->data, m, pat->next);
+    }
+    pat->data[m] = 0;
+
+    for (i = 0; i < 256; ++i) pat->skip[i] = m;
+    for (i = 0; i + 1 < m; ++i) pat->skip[pat->data[i]] = m - 1 - i;
+
+    pat->rare[0] = 0;
+    pat->rare[1] = m? m - 1: 0;
+    for (i = 0; i < m; ++i) {
+        if ((rank = mln_string_byte_rank(pat->data[i])) < best) {
+            best = rank;
+            pat->rare[0] = i;
+        }
+    }
+    for (i = 0, best = 3; i < m; ++i) {
+        if (pat->data[i] == pat->data[pat->rare[0]]) continue;
+        if ((rank = mln_string_byte_rank(pat->data[i])) < best) {
+            best = rank;
+            pat->rare[1] = i;
+        }
     }
-    return mln_string_slice_recursive((char *)(tmp->data), tmp->len, ascii, 1, tmp);
 }
 
-static mln_string_t *mln_string_slice_recursive(char *s, mln_u64_t len, mln_u8ptr_t ascii, int cnt, mln_string_t *save)
+mln_string_pattern_t *mln_string_pattern_new(mln_string_t *pattern)
 {
-    char *jmp_ascii, *end = s + len;
-    for (jmp_ascii = s; jmp_ascii < end; ++jmp_ascii) {
-        if (!ascii[(mln_u8_t)(*jmp_ascii)]) break;
-        *jmp_ascii = 0;
+    mln_string_pattern_t *pat;
+
+    if (pattern->len > (mln_u32_t)-1) return NULL;
+    pat = (mln_string_pattern_t *)malloc(sizeof(mln_string_pattern_t) + pattern->len * sizeof(mln_u32_t) + pattern->len + 1);
+    if (pat == NULL) return NULL;
+    pat->pool = 0;
+    mln_string_pattern_init(pat, pattern);
+    return pat;
+}
+
+mln_string_pattern_t *mln_string_pattern_pool_new(mln_alloc_t *pool, mln_string_t *pattern)
+{
+    mln_string_pattern_t *pat;
+
+    if (pattern->len > (mln_u32_t)-1) return NULL;
+    pat = (mln_string_pattern_t *)mln_alloc_m(pool, sizeof(mln_string_pattern_t) + pattern->len * sizeof(mln_u32_t) + pattern->len + 1);
+    if (pat == NULL) return NULL;
+    pat->pool = 1;
+    mln_string_pattern_init(pat, pattern);
+    return pat;
+}
+
+void mln_string_pattern_free(mln_string_pattern_t *pat)
+{
+    if (pat == NULL) return;
+    if (pat->pool) mln_alloc_free(pat);
+    else free(pat);
+}
+
+char *mln_string_pattern_search(mln_string_pattern_t *pat, mln_string_t *text)
+{
+    return (char *)mln_string_search(text->data, text->len, pat->data, pat->len, pat->rare[0], pat->rare[1]);
+}
+
+char *mln_string_pattern_kmp(mln_string_pattern_t *pat, mln_string_t *text)
+{
+    if (!pat->len) return (char *)(text->data);
+    if (pat->len > text->len) return NULL;
+    return (char *)mln_string_kmp_search(text->data, text->len, pat->data, pat->len, pat->next);
+}
+
+char *mln_string_pattern_bmh(mln_string_pattern_t *pat, mln_string_t *text)
+{
+    mln_u8ptr_t p = text->data, last = pat->data + pat->len - 1;
+    mln_size_t i, m = pat->len;
+
+    if (!m) return (char *)p;
+    for (i = 0; i + m <= text->len; i += pat->skip[p[i + m - 1]]) {
+        if (p[i + m - 1] == *last && !memcmp(p + i, pat->data, m - 1))
+            return (char *)(p + i);
     }
-    if (jmp_ascii >= end) {
-        mln_string_t *ret = (mln_string_t *)malloc(sizeof(mln_string_t)*cnt);
-        if (ret == NULL) return NULL;
-        ret[cnt-1].data = (mln_u8ptr_t)save;
-        ret[cnt-1].len = 0;
-        ret[cnt-1].data_ref = 0;
-        ret[cnt-1].pool = 0;
-        ret[cnt-1].ref = 1;
-        return ret;
+    return NULL;
+}
+
+mln_string_t *mln_string_slice(mln_string_t *s, const char *sep_array/*ended by \0*/)
+{
+    mln_string_charset_t cs;
+    mln_string_t *tmp, *array, *arr;
+    mln_u8ptr_t p, q, end;
+    mln_size_t cnt, cap = 16;
+
+    if ((tmp = mln_string_dup(s)) == NULL) return NULL;
+    if ((array = (mln_string_t *)malloc(sizeof(mln_string_t)*cap)) == NULL) {
+        mln_string_free(tmp);
+        return NULL;
     }
-    ++cnt;
-    char *jmp_valid;
-    for (jmp_valid = jmp_ascii; jmp_valid < end; ++jmp_valid) {
-        if (ascii[(mln_u8_t)(*jmp_valid)]) break;
-    }
-    mln_string_t *array = mln_string_slice_recursive(jmp_valid, len-(jmp_valid-s), ascii, cnt, save);
-    if (array == NULL) return NULL;
-    array[cnt-2].data = (mln_u8ptr_t)jmp_ascii;
-    array[cnt-2].len = jmp_valid - jmp_ascii;
-    array[cnt-2].data_ref = 1;
-    array[cnt-2].pool = 0;
-    array[cnt-2].ref = 1;
+    mln_string_charset_init(&cs, (mln_u8ptr_t)sep_array, strlen(sep_array));
+    end = tmp->data + tmp->len;
+
+    for (cnt = 0, p = tmp->data; ; ++cnt) {
+        q = mln_string_scan(p, end, &cs, 0);
+        if (q > p) memset(p, 0, q - p);
+        if (q >= end) break;
+        p = mln_string_scan(q, end, &cs, 1);
+        if (cnt + 1 >= cap) {
+            if ((arr = (mln_string_t *)realloc(array, sizeof(mln_string_t)*(cap << 1))) == NULL) {
+                free(array);
+                mln_string_free(tmp);
+                return NULL;
+            }
+            array = arr;
+            cap <<= 1;
+        }
+        array[cnt].data = q;
+        array[cnt].len = p - q;
+        array[cnt].data_ref = 1;
+        array[cnt].pool = 0;
+        array[cnt].ref = 1;
+    }
+    array[cnt].data = (mln_u8ptr_t)tmp;
+    array[cnt].len = 0;
+    array[cnt].data_ref = 0;
+    array[cnt].pool = 0;
+    array[cnt].ref = 1;
     return array;
 }
 
@@ -479,10 +1095,10 @@ void mln_string_slice_free(mln_string_t *array)
 
 mln_string_t *mln_string_strcat(mln_string_t *s1, mln_string_t *s2)
 {
-    mln_string_t *ret = (mln_string_t *)malloc(sizeof(mln_string_t));
-    if (ret == NULL) return NULL;
+    mln_string_t *ret;
     mln_u64_t len = s1->len + s2->len;
     if (len == 0) {
+        if ((ret = (mln_string_t *)malloc(sizeof(mln_string_t))) == NULL) return NULL;
         ret->data = NULL;
         ret->len = 0;
         ret->data_ref = 0;
@@ -490,26 +1106,18 @@ mln_string_t *mln_string_strcat(mln_string_t *s1, mln_string_t *s2)
         ret->ref = 1;
         return ret;
     }
-    if ((ret->data = (mln_u8ptr_t)malloc(len + 1)) == NULL) {
-        free(ret);
-        return NULL;
-    }
+    if ((ret = mln_string_inline_new(NULL, NULL, len)) == NULL) return NULL;
     if (s1->len > 0) memcpy(ret->data, s1->data, s1->len);
     if (s2->len > 0) memcpy(ret->data+s1->len, s2->data, s2->len);
-    ret->data[len] = 0;
-    ret->len = len;
-    ret->data_ref = 0;
-    ret->pool = 0;
-    ret->ref = 1;
     return ret;
 }
 
 mln_string_t *mln_string_pool_strcat(mln_alloc_t *pool, mln_string_t *s1, mln_string_t *s2)
 {
-    mln_string_t *ret = (mln_string_t *)mln_alloc_m(pool, sizeof(mln_string_t));
-    if (ret == NULL) return NULL;
+    mln_string_t *ret;
     mln_u64_t len = s1->len + s2->len;
     if (len == 0) {
+        if ((ret = (mln_string_t *)mln_alloc_m(pool, sizeof(mln_string_t))) == NULL) return NULL;
         ret->data = NULL;
         ret->len = 0;
         ret->data_ref = 0;
@@ -517,89 +1125,188 @@ mln_string_t *mln_string_pool_strcat(mln_alloc_t *pool, mln_string_t *s1, mln_st
         ret->ref = 1;
         return ret;
     }
-    if ((ret->data = (mln_u8ptr_t)mln_alloc_m(pool, len + 1)) == NULL) {
-        mln_alloc_free(ret);
-        return NULL;
-    }
+    if ((ret = mln_string_inline_new(pool, NULL, len)) == NULL) return NULL;
     if (s1->len > 0) memcpy(ret->data, s1->data, s1->len);
     if (s2->len > 0) memcpy(ret->data+s1->len, s2->data, s2->len);
-    ret->data[len] = 0;
-    ret->len = len;
-    ret->data_ref = 0;
-    ret->pool = 1;
-    ret->ref = 1;
     return ret;
 }
 
 mln_string_t *mln_string_trim(mln_string_t *s, mln_string_t *mask)
 {
-    mln_u8_t chars[256] = {0};
+    mln_string_charset_t cs;
     mln_string_t tmp;
-    mln_size_t i, j;
+    mln_u8ptr_t p, q;
 
-    for (i = 0; i < mask->len; ++i) {
-        chars[mask->data[i]] = 1;
-    }
-    for (i = 0; i < s->len; ++i) {
-        if (!chars[s->data[i]]) break;
-    }
-    for (j = s->len; j > i; --j) {
-        if (!chars[s->data[j - 1]]) break;
-    }
+    mln_string_charset_init(&cs, mask->data, mask->len);
+    p = mln_string_scan(s->data, s->data + s->len, &cs, 0);
+    q = mln_string_rscan(p, s->data + s->len, &cs, 0);
 
-    mln_string_nset(&tmp, &(s->data[i]), j - i);
+    mln_string_nset(&tmp, p, q - p);
     return mln_string_dup(&tmp);
 }
 
 mln_string_t *mln_string_pool_trim(mln_alloc_t *pool, mln_string_t *s, mln_string_t *mask)
 {
-    mln_u8_t chars[256] = {0};
+    mln_string_charset_t cs;
     mln_string_t tmp;
-    mln_size_t i, j;
+    mln_u8ptr_t p, q;
+
+    mln_string_charset_init(&cs, mask->data, mask->len);
+    p = mln_string_scan(s->data, s->data + s->len, &cs, 0);
+    q = mln_string_rscan(p, s->data + s->len, &cs, 0);
+
+    mln_string_nset(&tmp, p, q - p);
+    return mln_string_pool_dup(pool, &tmp);
+}
+
+void mln_string_upper(mln_string_t *s)
+{
+    mln_string_casefold_handler(s->data, s->len, 1);
+}
 
-    for (i = 0; i < mask->len; ++i) {
-        chars[mask->data[i]] = 1;
+void mln_string_lower(mln_string_t *s)
+{
+    mln_string_casefold_handler(s->data, s->len, 0);
+}
+
+
+/*
+ * intern table
+ * Open addressing with linear probing, kept at most half full.
+ * The hash of each entry is stored, so growing never rehashes the data.
+ */
+static inline mln_u64_t mln_string_intern_hash(mln_u8ptr_t p, mln_u64_t len, int icase)
+{
+    mln_u64_t h = len * 0x9e3779b97f4a7c15ULL, w;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, 8);
+        if (icase) w = mln_string_lower_word(w);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
     }
-    for (i = 0; i < s->len; ++i) {
-        if (!chars[s->data[i]]) break;
+    if (len) {
+        w = 0;
+        memcpy(&w, p, len);
+        if (icase) w = mln_string_lower_word(w);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
     }
-    for (j = s->len; j > i; --j) {
-        if (!chars[s->data[j - 1]]) break;
+    return h ^ (h >> 29);
+}
+
+static inline mln_string_intern_slot_t *
+mln_string_intern_lookup(mln_string_intern_t *tbl, mln_u8ptr_t data, mln_u64_t len, mln_u64_t hash)
+{
+    mln_string_intern_slot_t *slot;
+    mln_u64_t i;
+
+    for (i = hash & tbl->mask; ; i = (i + 1) & tbl->mask) {
+        slot = &tbl->slots[i];
+        if (slot->str == NULL) return slot;
+        if (slot->hash != hash || slot->str->len != len) continue;
+        if (!len) return slot;
+        if (tbl->icase) {
+            if (!mln_string_casecmp(slot->str->data, data, len)) return slot;
+        } else {
+            if (!memcmp(slot->str->data, data, len)) return slot;
+        }
     }
+}
 
-    mln_string_nset(&tmp, &(s->data[i]), j - i);
-    return mln_string_pool_dup(pool, &tmp);
+static inline void *mln_string_intern_alloc(mln_string_intern_t *tbl, mln_size_t size)
+{
+    void *p;
+
+    if (tbl->pool != NULL) p = mln_alloc_m(tbl->pool, size);
+    else p = malloc(size);
+    if (p != NULL) memset(p, 0, size);
+    return p;
 }
 
-void mln_string_upper(mln_string_t *s)
+static inline void mln_string_intern_dealloc(mln_string_intern_t *tbl, void *p)
 {
-    mln_u8_t chars[256] = {0};
-    mln_u8_t upper[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    mln_u8_t lower[] = "abcdefghijklmnopqrstuvwxyz";
-    mln_size_t i;
+    if (tbl->pool != NULL) mln_alloc_free(p);
+    else free(p);
+}
+
+static int mln_string_intern_grow(mln_string_intern_t *tbl)
+{
+    mln_string_intern_slot_t *slots = tbl->slots, *slot, *end = slots + tbl->mask + 1;
+    mln_u64_t i, mask = (tbl->mask << 1) | 1;
 
-    for (i = 0; i < sizeof(lower) - 1; ++i) {
-        chars[lower[i]] = upper[i];
+    if ((tbl->slots = (mln_string_intern_slot_t *)mln_string_intern_alloc(tbl, (mask + 1) * sizeof(*slots))) == NULL) {
+        tbl->slots = slots;
+        return -1;
     }
-    for (i = 0; i < s->len; ++i) {
-        if (chars[s->data[i]])
-            s->data[i] = chars[s->data[i]];
+    tbl->mask = mask;
+    for (slot = slots; slot < end; ++slot) {
+        if (slot->str == NULL) continue;
+        for (i = slot->hash & mask; tbl->slots[i].str != NULL; i = (i + 1) & mask)
+            ;
+        tbl->slots[i] = *slot;
     }
+    mln_string_intern_dealloc(tbl, slots);
+    return 0;
 }
 
-void mln_string_lower(mln_string_t *s)
+mln_string_intern_t *mln_string_intern_new(mln_alloc_t *pool, mln_u32_t flags)
 {
-    mln_u8_t chars[256] = {0};
-    mln_u8_t upper[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    mln_u8_t lower[] = "abcdefghijklmnopqrstuvwxyz";
-    mln_size_t i;
+    mln_string_intern_t *tbl;
 
-    for (i = 0; i < sizeof(upper) - 1; ++i) {
-        chars[upper[i]] = lower[i];
+    if (pool != NULL) tbl = (mln_string_intern_t *)mln_alloc_m(pool, sizeof(mln_string_intern_t));
+    else tbl = (mln_string_intern_t *)malloc(sizeof(mln_string_intern_t));
+    if (tbl == NULL) return NULL;
+    tbl->pool = pool;
+    tbl->mask = M_STRING_INTERN_INIT_LEN - 1;
+    tbl->nr = 0;
+    tbl->icase = (flags & M_STRING_INTERN_ICASE)? 1: 0;
+    if ((tbl->slots = (mln_string_intern_slot_t *)mln_string_intern_alloc(tbl, M_STRING_INTERN_INIT_LEN * sizeof(mln_string_intern_slot_t))) == NULL) {
+        mln_string_intern_dealloc(tbl, tbl);
+        return NULL;
     }
-    for (i = 0; i < s->len; ++i) {
-        if (chars[s->data[i]])
-            s->data[i] = chars[s->data[i]];
+    return tbl;
+}
+
+void mln_string_intern_free(mln_string_intern_t *tbl)
+{
+    mln_string_intern_slot_t *slot, *end;
+
+    if (tbl == NULL) return;
+    for (slot = tbl->slots, end = slot + tbl->mask + 1; slot < end; ++slot) {
+        if (slot->str != NULL) mln_string_free(slot->str);
+    }
+    mln_string_intern_dealloc(tbl, tbl->slots);
+    mln_string_intern_dealloc(tbl, tbl);
+}
+
+static mln_string_t *mln_string_intern_add(mln_string_intern_t *tbl, mln_u8ptr_t data, mln_u64_t len)
+{
+    mln_u64_t hash = mln_string_intern_hash(data, len, tbl->icase);
+    mln_string_intern_slot_t *slot = mln_string_intern_lookup(tbl, data, len, hash);
+
+    if (slot->str != NULL) return slot->str;
+    if ((tbl->nr + 1) << 1 > tbl->mask + 1) {
+        if (mln_string_intern_grow(tbl) < 0) return NULL;
+        slot = mln_string_intern_lookup(tbl, data, len, hash);
     }
+    if ((slot->str = mln_string_inline_new(tbl->pool, data, len)) == NULL) return NULL;
+    slot->hash = hash;
+    ++(tbl->nr);
+    return slot->str;
+}
+
+mln_string_t *mln_string_intern(mln_string_intern_t *tbl, mln_string_t *s)
+{
+    return mln_string_intern_add(tbl, s->data, s->len);
 }
 
+mln_string_t *mln_string_const_intern(mln_string_intern_t *tbl, char *s)
+{
+    return mln_string_intern_add(tbl, (mln_u8ptr_t)s, strlen(s));
+}
+
+mln_string_t *mln_string_intern_search(mln_string_intern_t *tbl, mln_string_t *s)
+{
+    return mln_string_intern_lookup(tbl, s->data, s->len, mln_string_intern_hash(s->data, s->len, tbl->icase))->str;
+}
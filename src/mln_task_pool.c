@@ -0,0 +1,583 @@
+
+/*
+ * Copyright (C) Niklaus F.Schen.
+ */
+#if defined(__linux__)
+  #ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+  #endif
+  #include <sched.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "mln_task_pool.h"
+#include "mln_log.h"
+
+/*
+ * Unlike mln_thread_pool, workers are created up front and keep running
+ * until the pool quits. Each of them has a Chase-Lev deque per priority,
+ * tasks a worker submits go to its own deques and the main thread has
+ * deques of its own, so a submission takes no lock. An idle worker steals
+ * from the others, starting at a random one, and sleeps on the pool's
+ * condition variable after M_TASK_POOL_SPIN fruitless rounds.
+ *
+ * Sleeping and waking form a Dekker pair: a submitter publishes the task,
+ * then reads sleepers; a worker increments sleepers, then looks for tasks.
+ * With a full fence between each store and load, at least one side sees
+ * the other, so no wakeup is lost.
+ */
+
+__thread mln_task_pool_member_t *m_task_pool_self = NULL;
+
+static void *mln_task_pool_launcher(void *arg);
+
+#define mln_task_pool_fatal() \
+    ({\
+        mln_log(error, "Fatal error, thread messed up.\n");\
+        abort();\
+    })
+
+/*
+ * deque
+ */
+static mln_task_pool_array_t *mln_task_pool_array_new(mln_s64_t len)
+{
+    mln_task_pool_array_t *a;
+
+    if ((a = (mln_task_pool_array_t *)malloc(sizeof(mln_task_pool_array_t) + len * sizeof(void *))) == NULL)
+        return NULL;
+    a->mask = len - 1;
+    a->prev = NULL;
+    return a;
+}
+
+static int mln_task_pool_deque_init(mln_task_pool_deque_t *q)
+{
+    q->top = q->bottom = 0;
+    if ((q->array = mln_task_pool_array_new(M_TASK_POOL_DEQUE_LEN)) == NULL) return -1;
+    return 0;
+}
+
+static void mln_task_pool_deque_destroy(mln_task_pool_deque_t *q, mln_thread_data_free free_handler)
+{
+    mln_task_pool_array_t *a = q->array, *prev;
+    mln_s64_t i;
+
+    if (a == NULL) return;
+    if (free_handler != NULL) {
+        for (i = q->top; i < q->bottom; ++i) free_handler(a->slots[i & a->mask]);
+    }
+    for (; a != NULL; a = prev) {
+        prev = a->prev;
+        free(a);
+    }
+    q->array = NULL;
+}
+
+/*
+ * Owner only.
+ */
+static mln_task_pool_array_t *
+mln_task_pool_deque_grow(mln_task_pool_deque_t *q, mln_task_pool_array_t *a, mln_s64_t t, mln_s64_t b)
+{
+    mln_task_pool_array_t *n;
+    mln_s64_t i;
+
+    if ((n = mln_task_pool_array_new((a->mask + 1) << 1)) == NULL) return NULL;
+    for (i = t; i < b; ++i)
+        n->slots[i & n->mask] = __atomic_load_n(&a->slots[i & a->mask], __ATOMIC_RELAXED);
+    n->prev = a;
+    __atomic_store_n(&q->array, n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ * Owner only. The new bottom is published with release semantics,
+ * so a thief that sees it also sees the task.
+ */
+static inline int mln_task_pool_deque_push(mln_task_pool_deque_t *q, void **data, mln_size_t n)
+{
+    mln_s64_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED);
+    mln_s64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    mln_task_pool_array_t *a = __atomic_load_n(&q->array, __ATOMIC_RELAXED);
+    mln_size_t i;
+
+    while (b - t + (mln_s64_t)n > a->mask + 1) {
+        if ((a = mln_task_pool_deque_grow(q, a, t, b)) == NULL) return -1;
+    }
+    for (i = 0; i < n; ++i, ++b)
+        __atomic_store_n(&a->slots[b & a->mask], data[i], __ATOMIC_RELAXED);
+    __atomic_store_n(&q->bottom, b, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Owner only, LIFO. Only the last task can be contended with a thief.
+ */
+static inline void *mln_task_pool_deque_take(mln_task_pool_deque_t *q)
+{
+    mln_s64_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED) - 1, t;
+    mln_task_pool_array_t *a = __atomic_load_n(&q->array, __ATOMIC_RELAXED);
+    void *data = NULL;
+
+    __atomic_store_n(&q->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+    if (t <= b) {
+        data = __atomic_load_n(&a->slots[b & a->mask], __ATOMIC_RELAXED);
+        if (t == b) {
+            if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+                data = NULL;
+            __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return data;
+}
+
+/*
+ * Any thread, FIFO. Returns NULL if the deque is empty or the CAS was lost,
+ * *retry tells the two apart.
+ */
+static inline void *mln_task_pool_deque_steal(mln_task_pool_deque_t *q, int *retry)
+{
+    mln_s64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE), b;
+    mln_task_pool_array_t *a;
+    void *data;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return NULL;
+    a = __atomic_load_n(&q->array, __ATOMIC_ACQUIRE);
+    data = __atomic_load_n(&a->slots[t & a->mask], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        *retry = 1;
+        return NULL;
+    }
+    return data;
+}
+
+static inline mln_size_t mln_task_pool_deque_size(mln_task_pool_deque_t *q)
+{
+    mln_s64_t n = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED) - __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+    return n > 0? (mln_size_t)n: 0;
+}
+
+/*
+ * mailbox, protected by mbox_lock
+ */
+static int mln_task_pool_ring_push(mln_task_pool_ring_t *r, void **data, mln_size_t n)
+{
+    mln_size_t len = r->mask + 1, i;
+    void **slots;
+
+    if (r->slots == NULL || r->tail - r->head + n > len) {
+        if (r->slots == NULL) len = M_TASK_POOL_DEQUE_LEN;
+        while (r->tail - r->head + n > len) len <<= 1;
+        if ((slots = (void **)malloc(len * sizeof(void *))) == NULL) return -1;
+        for (i = r->head; i < r->tail; ++i) slots[i & (len - 1)] = r->slots[i & r->mask];
+        free(r->slots);
+        r->slots = slots;
+        r->mask = len - 1;
+    }
+    for (i = 0; i < n; ++i) r->slots[(r->tail)++ & r->mask] = data[i];
+    return 0;
+}
+
+static inline void *mln_task_pool_ring_pop(mln_task_pool_ring_t *r)
+{
+    if (r->head == r->tail) return NULL;
+    return r->slots[(r->head)++ & r->mask];
+}
+
+static void *mln_task_pool_mbox_take(mln_task_pool_member_t *m, mln_u32_t prio)
+{
+    void *data;
+
+    if (!__atomic_load_n(&m->n_mbox, __ATOMIC_ACQUIRE)) return NULL;
+    pthread_mutex_lock(&m->mbox_lock);
+    if ((data = mln_task_pool_ring_pop(&m->mbox[prio])) != NULL)
+        __atomic_fetch_sub(&m->n_mbox, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&m->mbox_lock);
+    return data;
+}
+
+/*
+ * member
+ */
+static int mln_task_pool_member_init(mln_task_pool_t *tp, mln_task_pool_member_t *m, mln_s32_t id)
+{
+    int rc;
+    mln_u32_t i;
+
+    memset(m, 0, sizeof(*m));
+    m->pool = tp;
+    m->id = id;
+    m->seed = ((mln_u64_t)(id + 2) * 0x9e3779b97f4a7c15ULL) | 1;
+    if ((rc = pthread_mutex_init(&m->mbox_lock, NULL)) != 0) return rc;
+    for (i = 0; i < M_TASK_POOL_PRIO_NUM; ++i) {
+        if (mln_task_pool_deque_init(&m->deque[i]) < 0) {
+            for (; i > 0; --i) mln_task_pool_deque_destroy(&m->deque[i - 1], NULL);
+            pthread_mutex_destroy(&m->mbox_lock);
+            return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+static void mln_task_pool_member_destroy(mln_task_pool_member_t *m)
+{
+    mln_thread_data_free free_handler = m->pool->free_handler;
+    mln_u32_t i;
+    void *data;
+
+    for (i = 0; i < M_TASK_POOL_PRIO_NUM; ++i) {
+        mln_task_pool_deque_destroy(&m->deque[i], free_handler);
+        while ((data = mln_task_pool_ring_pop(&m->mbox[i])) != NULL) {
+            if (free_handler != NULL) free_handler(data);
+        }
+        free(m->mbox[i].slots);
+    }
+    pthread_mutex_destroy(&m->mbox_lock);
+}
+
+/*
+ * task pool
+ */
+static void mln_task_pool_free(mln_task_pool_t *tp)
+{
+    mln_u32_t i;
+
+    if (tp == NULL) return;
+    for (i = 0; i <= tp->nr_workers; ++i) {
+        if (tp->members[i].pool != NULL) mln_task_pool_member_destroy(&tp->members[i]);
+    }
+    free(tp->members);
+    pthread_cond_destroy(&tp->cond);
+    pthread_mutex_destroy(&tp->mutex);
+    free(tp);
+}
+
+static mln_task_pool_t *mln_task_pool_new(struct mln_task_pool_attr *tpattr, int *err)
+{
+    int rc;
+    mln_u32_t i;
+    long ncpu;
+    mln_task_pool_t *tp;
+
+    if ((tp = (mln_task_pool_t *)malloc(sizeof(mln_task_pool_t))) == NULL) {
+        *err = ENOMEM;
+        return NULL;
+    }
+    if ((rc = pthread_mutex_init(&tp->mutex, NULL)) != 0) {
+        free(tp);
+        *err = rc;
+        return NULL;
+    }
+    if ((rc = pthread_cond_init(&tp->cond, NULL)) != 0) {
+        pthread_mutex_destroy(&tp->mutex);
+        free(tp);
+        *err = rc;
+        return NULL;
+    }
+    tp->nr_workers = tpattr->nr_workers;
+    if (!tp->nr_workers) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        tp->nr_workers = ncpu > 0? (mln_u32_t)ncpu: 1;
+    }
+    tp->sleepers = tp->n_high = tp->quit = 0;
+    tp->cond_timeout = tpattr->cond_timeout;
+    tp->process_handler = tpattr->child_process_handler;
+    tp->free_handler = tpattr->free_handler;
+    if (posix_memalign((void **)&tp->members, 64, (tp->nr_workers + 1) * sizeof(mln_task_pool_member_t))) {
+        pthread_cond_destroy(&tp->cond);
+        pthread_mutex_destroy(&tp->mutex);
+        free(tp);
+        *err = ENOMEM;
+        return NULL;
+    }
+    for (i = 0; i <= tp->nr_workers; ++i) tp->members[i].pool = NULL;
+    for (i = 0; i <= tp->nr_workers; ++i) {
+        if ((rc = mln_task_pool_member_init(tp, &tp->members[i], (mln_s32_t)i - 1)) != 0) {
+            tp->members[i].pool = NULL;
+            mln_task_pool_free(tp);
+            *err = rc;
+            return NULL;
+        }
+    }
+    return tp;
+}
+
+static inline void mln_task_pool_wakeup(mln_task_pool_t *tp, int all)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&tp->sleepers, __ATOMIC_RELAXED)) return;
+    pthread_mutex_lock(&tp->mutex);
+    if (all) pthread_cond_broadcast(&tp->cond);
+    else pthread_cond_signal(&tp->cond);
+    pthread_mutex_unlock(&tp->mutex);
+}
+
+/*
+ * resource
+ */
+int mln_task_pool_resource_add_batch(void **data, mln_size_t n, mln_u32_t prio, mln_s32_t worker)
+{
+    /*
+     * Only the main thread and workers can call this function
+     */
+    mln_task_pool_member_t *self = m_task_pool_self, *m;
+    mln_task_pool_t *tp;
+    mln_size_t i;
+
+    if (self == NULL) mln_task_pool_fatal();
+    tp = self->pool;
+    if (prio >= M_TASK_POOL_PRIO_NUM || worker < M_TASK_POOL_ANY || worker >= (mln_s32_t)tp->nr_workers)
+        return EINVAL;
+    for (i = 0; i < n; ++i) {
+        if (data[i] == NULL) return EINVAL;
+    }
+    if (!n) return 0;
+
+    if (worker != M_TASK_POOL_ANY) {
+        m = &tp->members[worker + 1];
+        pthread_mutex_lock(&m->mbox_lock);
+        if (mln_task_pool_ring_push(&m->mbox[prio], data, n) < 0) {
+            pthread_mutex_unlock(&m->mbox_lock);
+            return ENOMEM;
+        }
+        __atomic_fetch_add(&m->n_mbox, n, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&m->mbox_lock);
+        /*
+         * All sleepers are woken up, since the signal may not reach the right one.
+         */
+        mln_task_pool_wakeup(tp, 1);
+        return 0;
+    }
+
+    if (prio == M_TASK_POOL_PRIO_HIGH) __atomic_fetch_add(&tp->n_high, n, __ATOMIC_RELAXED);
+    if (mln_task_pool_deque_push(&self->deque[prio], data, n) < 0) {
+        if (prio == M_TASK_POOL_PRIO_HIGH) __atomic_fetch_sub(&tp->n_high, n, __ATOMIC_RELAXED);
+        return ENOMEM;
+    }
+    mln_task_pool_wakeup(tp, n > 1);
+    return 0;
+}
+
+int mln_task_pool_resource_add_ex(void *data, mln_u32_t prio, mln_s32_t worker)
+{
+    return mln_task_pool_resource_add_batch(&data, 1, prio, worker);
+}
+
+int mln_task_pool_resource_add(void *data)
+{
+    return mln_task_pool_resource_add_batch(&data, 1, M_TASK_POOL_PRIO_NORMAL, M_TASK_POOL_ANY);
+}
+
+static void *mln_task_pool_steal(mln_task_pool_member_t *self, mln_u32_t prio, int *retry)
+{
+    mln_task_pool_t *tp = self->pool;
+    mln_u32_t n = tp->nr_workers + 1, i, v;
+    mln_u64_t x = self->seed;
+    void *data;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    self->seed = x;
+    for (i = 0, v = (mln_u32_t)(x % n); i < n; ++i, v = v + 1 == n? 0: v + 1) {
+        if (&tp->members[v] == self) continue;
+        if ((data = mln_task_pool_deque_steal(&tp->members[v].deque[prio], retry)) != NULL) {
+            __atomic_store_n(&self->n_stolen, self->n_stolen + 1, __ATOMIC_RELAXED);
+            return data;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Higher priorities first. For each priority: the mailbox, the worker's own
+ * deque, then the other deques. High priority deques of others are only
+ * scanned while n_high says there is something in them.
+ */
+static void *mln_task_pool_resource_remove(mln_task_pool_member_t *self, int *retry)
+{
+    mln_task_pool_t *tp = self->pool;
+    mln_u32_t prio;
+    void *data;
+
+    for (prio = 0; prio < M_TASK_POOL_PRIO_NUM; ++prio) {
+        if ((data = mln_task_pool_mbox_take(self, prio)) != NULL) return data;
+        if ((data = mln_task_pool_deque_take(&self->deque[prio])) == NULL) {
+            if (prio == M_TASK_POOL_PRIO_HIGH && !__atomic_load_n(&tp->n_high, __ATOMIC_RELAXED)) continue;
+            if ((data = mln_task_pool_steal(self, prio, retry)) == NULL) continue;
+        }
+        if (prio == M_TASK_POOL_PRIO_HIGH) __atomic_fetch_sub(&tp->n_high, 1, __ATOMIC_RELAXED);
+        return data;
+    }
+    return NULL;
+}
+
+static int mln_task_pool_has_work(mln_task_pool_member_t *self)
+{
+    mln_task_pool_t *tp = self->pool;
+    mln_u32_t i, prio;
+
+    if (__atomic_load_n(&self->n_mbox, __ATOMIC_RELAXED)) return 1;
+    for (i = 0; i <= tp->nr_workers; ++i) {
+        for (prio = 0; prio < M_TASK_POOL_PRIO_NUM; ++prio) {
+            if (mln_task_pool_deque_size(&tp->members[i].deque[prio])) return 1;
+        }
+    }
+    return 0;
+}
+
+static void mln_task_pool_sleep(mln_task_pool_member_t *self)
+{
+    mln_task_pool_t *tp = self->pool;
+    struct timespec ts;
+
+    pthread_mutex_lock(&tp->mutex);
+    __atomic_fetch_add(&tp->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&tp->quit, __ATOMIC_RELAXED) && !mln_task_pool_has_work(self)) {
+        if (tp->cond_timeout) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += tp->cond_timeout / 1000;
+            ts.tv_nsec += (tp->cond_timeout % 1000) * 1000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ++(ts.tv_sec);
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&tp->cond, &tp->mutex, &ts);
+        } else {
+            pthread_cond_wait(&tp->cond, &tp->mutex);
+        }
+    }
+    __atomic_fetch_sub(&tp->sleepers, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&tp->mutex);
+}
+
+/*
+ * launcher
+ */
+int mln_task_pool_run(struct mln_task_pool_attr *tpattr)
+{
+    int rc;
+    mln_u32_t i;
+    mln_task_pool_t *tp;
+    mln_task_pool_member_t *m;
+
+    if (tpattr->child_process_handler == NULL || \
+        tpattr->main_process_handler == NULL)
+    {
+        return EINVAL;
+    }
+    if (m_task_pool_self != NULL) return EBUSY;
+
+    if ((tp = mln_task_pool_new(tpattr, &rc)) == NULL) {
+        return rc;
+    }
+    for (i = 1; i <= tp->nr_workers; ++i) {
+        m = &tp->members[i];
+        if ((rc = pthread_create(&m->tid, NULL, mln_task_pool_launcher, m)) != 0) break;
+        m->started = 1;
+#if defined(__linux__)
+        if (tpattr->pin_cpu) {
+            cpu_set_t set;
+            long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+            CPU_ZERO(&set);
+            CPU_SET((i - 1) % (ncpu > 0? ncpu: 1), &set);
+            pthread_setaffinity_np(m->tid, sizeof(set), &set);
+        }
+#endif
+    }
+
+    m_task_pool_self = &tp->members[0];
+    if (i > tp->nr_workers) rc = tpattr->main_process_handler(tpattr->main_data);
+
+    __atomic_store_n(&tp->quit, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&tp->mutex);
+    pthread_cond_broadcast(&tp->cond);
+    pthread_mutex_unlock(&tp->mutex);
+    for (i = 1; i <= tp->nr_workers; ++i) {
+        if (tp->members[i].started) pthread_join(tp->members[i].tid, NULL);
+    }
+    m_task_pool_self = NULL;
+    mln_task_pool_free(tp);
+    return rc;
+}
+
+static void *mln_task_pool_launcher(void *arg)
+{
+    int rc, retry;
+    mln_u32_t spin = 0;
+    void *data;
+    mln_task_pool_member_t *self = (mln_task_pool_member_t *)arg;
+    mln_task_pool_t *tp = self->pool;
+
+    m_task_pool_self = self;
+
+    while (!__atomic_load_n(&tp->quit, __ATOMIC_RELAXED)) {
+        retry = 0;
+        if ((data = mln_task_pool_resource_remove(self, &retry)) == NULL) {
+            if (retry || ++spin < M_TASK_POOL_SPIN) {
+                sched_yield();
+                continue;
+            }
+            spin = 0;
+            mln_task_pool_sleep(self);
+            continue;
+        }
+        spin = 0;
+        if ((rc = tp->process_handler(data)) != 0) {
+            mln_log(error, "child process return %d, %s\n", rc, strerror(rc));
+        }
+    }
+
+    m_task_pool_self = NULL;
+    return NULL;
+}
+
+mln_s32_t mln_task_pool_worker_id(void)
+{
+    if (m_task_pool_self == NULL) mln_task_pool_fatal();
+    return m_task_pool_self->id;
+}
+
+void mln_task_pool_quit(void)
+{
+    if (m_task_pool_self == NULL) mln_task_pool_fatal();
+    mln_task_pool_t *tp = m_task_pool_self->pool;
+    __atomic_store_n(&tp->quit, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&tp->mutex);
+    pthread_cond_broadcast(&tp->cond);
+    pthread_mutex_unlock(&tp->mutex);
+}
+
+void mln_task_pool_resource_info(struct mln_task_pool_info *info)
+{
+    mln_task_pool_member_t *m;
+    mln_task_pool_t *tp;
+    mln_u32_t i, prio;
+
+    if (info == NULL) return;
+    if (m_task_pool_self == NULL) mln_task_pool_fatal();
+    tp = m_task_pool_self->pool;
+    info->nr_workers = tp->nr_workers;
+    info->idle_num = __atomic_load_n(&tp->sleepers, __ATOMIC_RELAXED);
+    info->res_num = 0;
+    info->stolen_num = 0;
+    for (i = 0; i <= tp->nr_workers; ++i) {
+        m = &tp->members[i];
+        for (prio = 0; prio < M_TASK_POOL_PRIO_NUM; ++prio)
+            info->res_num += mln_task_pool_deque_size(&m->deque[prio]);
+        info->res_num += __atomic_load_n(&m->n_mbox, __ATOMIC_RELAXED);
+        info->stolen_num += __atomic_load_n(&m->n_stolen, __ATOMIC_RELAXED);
+    }
+}
+
@@ -11,6 +11,21 @@
 #include "mln_sha.h"
 #include "mln_base64.h"
 #include <sys/time.h>
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__wasm__)
+#include <immintrin.h>
+#define MLN_WEBSOCKET_SIMD
+#endif
+#if defined(MLN_ZLIB)
+#include <zlib.h>
+#endif
+
+struct mln_websocket_frame_s {
+    mln_u64_t                len;
+    mln_u32_t                masking_key;
+    mln_u32_t                hlen;
+    mln_u8_t                 b1;
+    mln_u8_t                 b2;
+};
 
 static mln_u64_t mln_websocket_hash_calc(mln_hash_t *h, void *key);
 static int mln_websocket_hash_cmp(mln_hash_t *h, void *key1, void *key2);
@@ -20,8 +35,125 @@ static int mln_websocket_validate_accept(mln_http_t *http, mln_string_t *wskey);
 static mln_string_t *mln_websocket_accept_field(mln_http_t *http);
 static int mln_websocket_iterate_set_fields(void *key, void *val, void *data);
 static mln_string_t *mln_websocket_client_handshake_key_generate(mln_alloc_t *pool);
-static mln_string_t *mln_websocket_extension_tokens(mln_alloc_t *pool, mln_string_t *in);
+static int
+mln_websocket_extension_tokens(mln_alloc_t *pool, mln_string_t *in, mln_string_t *deflate, mln_string_t **out);
 static mln_u32_t mln_websocket_masking_key_generate(void);
+static void mln_websocket_deflate_free(mln_websocket_t *ws);
+static mln_string_t *mln_websocket_deflate_offer(mln_websocket_t *ws);
+static int mln_websocket_deflate_accept(mln_websocket_t *ws, mln_string_t *offers, mln_string_t **out);
+static int mln_websocket_deflate_confirm(mln_websocket_t *ws, mln_string_t *resp);
+static int mln_websocket_deflate_frame(mln_websocket_t *ws);
+static int mln_websocket_inflate_frame(mln_websocket_t *ws);
+static int mln_websocket_inflate_message(mln_websocket_t *ws);
+
+/*
+ * masking
+ */
+static void mln_websocket_mask_word(mln_u8ptr_t dst, mln_u8ptr_t src, mln_u64_t len, mln_u8_t key[4])
+{
+    mln_u8_t kw[8];
+    mln_u64_t w, v, i = 0;
+
+    memcpy(kw, key, 4);
+    memcpy(kw + 4, key, 4);
+    memcpy(&w, kw, 8);
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&v, src + i, 8);
+        v ^= w;
+        memcpy(dst + i, &v, 8);
+    }
+    for (; i < len; ++i) {
+        dst[i] = src[i] ^ key[i & 3];
+    }
+}
+
+#if defined(MLN_WEBSOCKET_SIMD)
+static void mln_websocket_mask_sse2(mln_u8ptr_t dst, mln_u8ptr_t src, mln_u64_t len, mln_u8_t key[4])
+{
+    mln_u32_t k;
+    __m128i vk;
+    mln_u64_t i = 0;
+
+    memcpy(&k, key, 4);
+    vk = _mm_set1_epi32((int)k);
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, vk));
+        _mm_storeu_si128((__m128i *)(dst + i + 16), _mm_xor_si128(b, vk));
+        _mm_storeu_si128((__m128i *)(dst + i + 32), _mm_xor_si128(c, vk));
+        _mm_storeu_si128((__m128i *)(dst + i + 48), _mm_xor_si128(d, vk));
+    }
+    for (; i + 16 <= len; i += 16) {
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), vk));
+    }
+    mln_websocket_mask_word(dst + i, src + i, len - i, key);
+}
+
+__attribute__((target("avx2")))
+static void mln_websocket_mask_avx2(mln_u8ptr_t dst, mln_u8ptr_t src, mln_u64_t len, mln_u8_t key[4])
+{
+    mln_u32_t k;
+    __m256i vk;
+    mln_u64_t i = 0;
+
+    memcpy(&k, key, 4);
+    vk = _mm256_set1_epi32((int)k);
+    for (; i + 128 <= len; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, vk));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_xor_si256(b, vk));
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), _mm256_xor_si256(c, vk));
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), _mm256_xor_si256(d, vk));
+    }
+    for (; i + 32 <= len; i += 32) {
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + i)), vk));
+    }
+    mln_websocket_mask_sse2(dst + i, src + i, len - i, key);
+}
+#endif
+
+static void mln_websocket_mask_init(mln_u8ptr_t dst, mln_u8ptr_t src, mln_u64_t len, mln_u8_t key[4]);
+static void (*mln_websocket_mask_handler)(mln_u8ptr_t, mln_u8ptr_t, mln_u64_t, mln_u8_t *) = mln_websocket_mask_init;
+
+static void mln_websocket_mask_init(mln_u8ptr_t dst, mln_u8ptr_t src, mln_u64_t len, mln_u8_t key[4])
+{
+#if defined(MLN_WEBSOCKET_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        mln_websocket_mask_handler = mln_websocket_mask_avx2;
+    } else {
+        mln_websocket_mask_handler = mln_websocket_mask_sse2;
+    }
+#else
+    mln_websocket_mask_handler = mln_websocket_mask_word;
+#endif
+    mln_websocket_mask_handler(dst, src, len, key);
+}
+
+/*
+ * XOR len bytes of src with the masking key into dst (may be src), starting at
+ * byte 'phase' of the key. Return the phase of the byte following them.
+ */
+static inline mln_u32_t
+mln_websocket_mask(mln_u8ptr_t dst, mln_u8ptr_t src, mln_u64_t len, mln_u32_t masking_key, mln_u32_t phase)
+{
+    mln_u8_t key[4];
+    mln_u32_t i;
+
+    if (!len) return phase;
+    for (i = 0; i < 4; ++i) {
+        key[i] = (masking_key >> ((3 - ((phase + i) & 3)) << 3)) & 0xff;
+    }
+    mln_websocket_mask_handler(dst, src, len, key);
+    return (phase + len) & 3;
+}
+
 
 int mln_websocket_init(mln_websocket_t *ws, mln_http_t *http)
 {
@@ -36,6 +168,7 @@ int mln_websocket_init(mln_websocket_t *ws, mln_http_t *http)
     hattr.len_base = 37;
     hattr.expandable = 0;
     hattr.calc_prime = 0;
+    hattr.incremental = 0;
 
     ws->http = http;
     ws->pool = mln_http_get_pool(http);
@@ -54,6 +187,13 @@ int mln_websocket_init(mln_websocket_t *ws, mln_http_t *http)
     ws->mask = 0;
     ws->status = 0;
     ws->masking_key = 0;
+    ws->pinned = NULL;
+    ws->msg_head = ws->msg_tail = NULL;
+    ws->msg_len = 0;
+    ws->msg_opcode = 0;
+    ws->msg_rsv = 0;
+    ws->msg_done = 0;
+    ws->deflate = NULL;
 
     return 0;
 }
@@ -101,6 +241,9 @@ void mln_websocket_destroy(mln_websocket_t *ws)
     if (ws->args != NULL) mln_string_free(ws->args);
     if (ws->key != NULL) mln_string_free(ws->key);
     if (ws->content_free) mln_alloc_free(ws->content);
+    if (ws->pinned != NULL) mln_chain_pool_release_all(ws->pinned);
+    if (ws->msg_head != NULL) mln_chain_pool_release_all(ws->msg_head);
+    mln_websocket_deflate_free(ws);
 }
 
 void mln_websocket_free(mln_websocket_t *ws)
@@ -144,6 +287,19 @@ void mln_websocket_reset(mln_websocket_t *ws)
     ws->mask = 0;
     ws->status = 0;
     ws->masking_key = 0;
+    if (ws->pinned != NULL) {
+        mln_chain_pool_release_all(ws->pinned);
+        ws->pinned = NULL;
+    }
+    if (ws->msg_head != NULL) {
+        mln_chain_pool_release_all(ws->msg_head);
+        ws->msg_head = ws->msg_tail = NULL;
+    }
+    ws->msg_len = 0;
+    ws->msg_opcode = 0;
+    ws->msg_rsv = 0;
+    ws->msg_done = 0;
+    mln_websocket_deflate_free(ws);
 }
 
 
@@ -174,6 +330,11 @@ int mln_websocket_validate(mln_websocket_t *ws)
     int ret = mln_websocket_validate_accept(http, ws->key);
     if (ret != M_WS_RET_OK) return ret;
     if (mln_http_get_type(http) != M_HTTP_RESPONSE) return M_WS_RET_ERROR;
+    if (ws->deflate != NULL) {
+        mln_string_t extension_key = mln_string("Sec-WebSocket-Extensions");
+        if ((ret = mln_websocket_deflate_confirm(ws, mln_http_get_field(http, &extension_key))) != M_WS_RET_OK)
+            return ret;
+    }
 
     return M_WS_RET_OK;
 }
@@ -255,14 +416,21 @@ int mln_websocket_handshake_response_generate(mln_websocket_t *ws, mln_chain_t *
     }
 
     mln_string_t extension_key = mln_string("Sec-WebSocket-Extensions");
-    mln_string_t *extension_val = NULL;
+    mln_string_t *extension_val = NULL, *deflate_val = NULL;
     tmp = mln_http_field_iterator(http, &extension_key);
     if (tmp) {
-        extension_val = mln_websocket_extension_tokens(ws->pool, tmp);
-        if (extension_val == NULL) {
+        if (ws->deflate != NULL && mln_websocket_deflate_accept(ws, tmp, &deflate_val) != M_WS_RET_OK) {
+            if (protocol_val != NULL) mln_string_free(protocol_val);
+            return M_WS_RET_FAILED;
+        }
+        if (mln_websocket_extension_tokens(ws->pool, tmp, deflate_val, &extension_val) < 0) {
             if (protocol_val != NULL) mln_string_free(protocol_val);
+            if (deflate_val != NULL) mln_string_free(deflate_val);
             return M_WS_RET_FAILED;
         }
+        if (deflate_val != NULL) mln_string_free(deflate_val);
+    } else {
+        mln_websocket_deflate_free(ws);
     }
 
     mln_string_t *accept = mln_websocket_accept_field(http);
@@ -314,51 +482,47 @@ int mln_websocket_handshake_response_generate(mln_websocket_t *ws, mln_chain_t *
     return M_WS_RET_OK;
 }
 
-static mln_string_t *mln_websocket_extension_tokens(mln_alloc_t *pool, mln_string_t *in)
+/*
+ * Echo the names of the offered extensions. Offers of permessage-deflate are
+ * dropped, and the negotiated one (if any) is put first.
+ */
+static int
+mln_websocket_extension_tokens(mln_alloc_t *pool, mln_string_t *in, mln_string_t *deflate, mln_string_t **out)
 {
-    mln_string_t *tmp = mln_string_pool_dup(pool, in);
-    if (tmp == NULL) return NULL;
-    mln_string_t *array = mln_string_slice(tmp, ",");
-    if (array == NULL) {
-        mln_string_free(tmp);
-        return NULL;
-    }
-    mln_string_t *p = array;
-    mln_s8ptr_t pos, buf;
-    mln_uauto_t size = 0;
-    for (; p->len; ++p) {
-        if ((pos = strchr((char *)(p->data), ';')) == NULL) {
-            size += (p->len + 1);
-        } else {
-            size += (pos - (char *)(p->data) + 1);
-        }
-    }
-    --size;
-    buf = (mln_s8ptr_t)mln_alloc_m(pool, size);
-    if (buf == NULL) {
-        mln_string_slice_free(array);
-        mln_string_free(tmp);
-        return NULL;
+    mln_u8ptr_t p = in->data, end = in->data + in->len, name, buf;
+    mln_size_t n, size = 0;
+    mln_string_t tmp, dname = mln_string("permessage-deflate");
+    int quoted;
+
+    *out = NULL;
+    buf = (mln_u8ptr_t)mln_alloc_m(pool, in->len + (deflate != NULL? deflate->len: 0) + 2);
+    if (buf == NULL) return -1;
+    if (deflate != NULL) {
+        memcpy(buf, deflate->data, deflate->len);
+        size = deflate->len;
     }
-    for (size = 0, p = array; p->len; ++p) {
-        if ((pos = strchr((char *)(p->data), ';')) == NULL) {
-            memcpy(buf+size, p->data, p->len);
-            size += p->len;
-        } else {
-            memcpy(buf+size, p->data, pos-(char *)(p->data));
-            size += (pos - (char *)(p->data));
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) ++p;
+        for (name = p; p < end && *p != ';' && *p != ',' && *p != ' ' && *p != '\t'; ++p)
+            ;
+        n = p - name;
+        for (quoted = 0; p < end && (quoted || *p != ','); ++p) {
+            if (*p == '"') quoted = !quoted;
         }
-        buf[size++] = ',';
+        if (!n) continue;
+        mln_string_nset(&tmp, name, n);
+        if (!mln_string_strcasecmp(&tmp, &dname)) continue;
+        if (size) buf[size++] = ',';
+        memcpy(buf + size, name, n);
+        size += n;
     }
-    buf[--size] = '0';
-    mln_string_slice_free(array);
-    mln_string_free(tmp);
 
-    mln_string_t t;
-    mln_string_nset(&t, buf, size);
-    tmp = mln_string_pool_dup(pool, &t);
+    if (size) {
+        mln_string_nset(&tmp, buf, size);
+        *out = mln_string_pool_dup(pool, &tmp);
+    }
     mln_alloc_free(buf);
-    return tmp;
+    return size && *out == NULL? -1: 0;
 }
 
 static int mln_websocket_iterate_set_fields(void *key, void *val, void *data)
@@ -437,6 +601,15 @@ int mln_websocket_handshake_request_generate(mln_websocket_t *ws, mln_chain_t **
     if (mln_http_set_field(http, &upgrade_key, &upgrade_val) < 0) return M_WS_RET_FAILED;
     if (mln_http_set_field(http, &connection_key, &upgrade_key) < 0) return M_WS_RET_FAILED;
     if (mln_http_set_field(http, &version_key, &version_val) < 0) return M_WS_RET_FAILED;
+    if (ws->deflate != NULL) {
+        mln_string_t extension_key = mln_string("Sec-WebSocket-Extensions");
+        mln_string_t *extension_val = mln_websocket_deflate_offer(ws);
+        if (extension_val == NULL) return M_WS_RET_FAILED;
+        if (mln_http_set_field(http, &extension_key, extension_val) < 0) {
+            mln_string_free(extension_val);
+            return M_WS_RET_FAILED;
+        }
+    }
 
     if (mln_hash_iterate(ws->fields, mln_websocket_iterate_set_fields, http) < 0)
         return M_WS_RET_FAILED;
@@ -630,14 +803,47 @@ static mln_u32_t mln_websocket_masking_key_generate(void)
     return ((mln_u32_t)tmp | (mln_u32_t)rand());
 }
 
+/*
+ * Frame header encoding, shared by the per-connection generator and broadcast.
+ */
+static inline mln_size_t mln_websocket_header_size(mln_u64_t clen)
+{
+    if (clen <= 125) return 2;
+    return (clen >> 16)? 10: 4;
+}
+
+static inline mln_u8ptr_t
+mln_websocket_header_write(mln_u8ptr_t p, mln_u8_t b1, mln_u8_t maskbit, mln_u64_t clen)
+{
+    *p++ = b1;
+    if (clen <= 125) {
+        *p++ = maskbit | (mln_u8_t)clen;
+    } else if (!(clen >> 16)) {
+        *p++ = maskbit | 126;
+        *p++ = ((clen >> 8) & 0xff);
+        *p++ = (clen & 0xff);
+    } else {
+        *p++ = maskbit | 127;
+        *p++ = ((clen >> 56) & 0xff);
+        *p++ = ((clen >> 48) & 0xff);
+        *p++ = ((clen >> 40) & 0xff);
+        *p++ = ((clen >> 32) & 0xff);
+        *p++ = ((clen >> 24) & 0xff);
+        *p++ = ((clen >> 16) & 0xff);
+        *p++ = ((clen >> 8) & 0xff);
+        *p++ = (clen & 0xff);
+    }
+    return p;
+}
+
 int mln_websocket_generate(mln_websocket_t *ws, mln_chain_t **out_cnode)
 {
-    mln_size_t size = 2;
+    mln_size_t size;
     mln_u8ptr_t buf, p;
     mln_buf_t *b;
     mln_chain_t *c;
     mln_alloc_t *pool = ws->pool;
-    mln_u8_t payload_length = 0;
+    mln_u8_t b1;
     mln_u8ptr_t content = NULL;
     mln_u64_t clen = 0;
     mln_u32_t opcode = mln_websocket_get_opcode(ws);
@@ -646,6 +852,10 @@ int mln_websocket_generate(mln_websocket_t *ws, mln_chain_t **out_cnode)
         int ret = mln_websocket_get_ext_handler(ws)(ws);
         if (ret != M_WS_RET_OK) return ret;
     }
+    if (ws->deflate != NULL) {
+        int ret = mln_websocket_deflate_frame(ws);
+        if (ret != M_WS_RET_OK) return ret;
+    }
 
     content = (mln_u8ptr_t)mln_websocket_get_content(ws);
     clen = mln_websocket_get_content_len(ws);
@@ -660,18 +870,7 @@ int mln_websocket_generate(mln_websocket_t *ws, mln_chain_t **out_cnode)
         clen > 125)
         return M_WS_RET_ERROR;
 
-    if (clen > 125) {
-        if ((clen >> 16)) {
-            size += 8;
-            payload_length = 127;
-        } else {
-            size += 2;
-            payload_length = 126;
-        }
-    } else {
-        payload_length = clen;
-    }
-    size += clen;
+    size = mln_websocket_header_size(clen) + clen;
 
     if (mln_websocket_get_maskbit(ws)) size += 4;
 
@@ -695,54 +894,31 @@ int mln_websocket_generate(mln_websocket_t *ws, mln_chain_t **out_cnode)
     if (mln_websocket_get_fin(ws)) b->last_in_chain = 1;
     *out_cnode = c;
 
-    p = buf;
-    *p = 0;
-    if (mln_websocket_get_fin(ws)) *p |= 0x80;
-    if (mln_websocket_get_rsv1(ws)) *p |= 0x40;
-    if (mln_websocket_get_rsv2(ws)) *p |= 0x20;
-    if (mln_websocket_get_rsv3(ws)) *p |= 0x10;
-    *p++ |= (opcode & 0xf);
-
-    *p = 0;
-    if (mln_websocket_get_maskbit(ws)) *p |= 0x80;
-    *p++ |= (payload_length & 0x7f);
-
-    if (payload_length == 126) {
-        *p++ = ((clen >> 8) & 0xff);
-        *p++ = (clen & 0xff);
-    } else if (payload_length == 127) {
-        *p++ = ((clen >> 56) & 0xff);
-        *p++ = ((clen >> 48) & 0xff);
-        *p++ = ((clen >> 40) & 0xff);
-        *p++ = ((clen >> 32) & 0xff);
-        *p++ = ((clen >> 24) & 0xff);
-        *p++ = ((clen >> 16) & 0xff);
-        *p++ = ((clen >> 8) & 0xff);
-        *p++ = (clen & 0xff);
-    }
+    b1 = opcode & 0xf;
+    if (mln_websocket_get_fin(ws)) b1 |= 0x80;
+    if (mln_websocket_get_rsv1(ws)) b1 |= 0x40;
+    if (mln_websocket_get_rsv2(ws)) b1 |= 0x20;
+    if (mln_websocket_get_rsv3(ws)) b1 |= 0x10;
+    p = mln_websocket_header_write(buf, b1, mln_websocket_get_maskbit(ws)? 0x80: 0, clen);
 
+    if (opcode == M_WS_OPCODE_CLOSE) clen -= 2;
     if (mln_websocket_get_maskbit(ws)) {
-        mln_u8_t tmpkey[4];
-        mln_u32_t i, j, m = mln_websocket_get_masking_key(ws);
-        mln_u8ptr_t pc = (mln_u8ptr_t)content;
-        *p++ = tmpkey[0] = ((m >> 24) & 0xff);
-        *p++ = tmpkey[1] = ((m >> 16) & 0xff);
-        *p++ = tmpkey[2] = ((m >> 8) & 0xff);
-        *p++ = tmpkey[3] = (m & 0xff);
-
-        i = 0;
+        mln_u32_t phase = 0, m = mln_websocket_get_masking_key(ws);
+        *p++ = ((m >> 24) & 0xff);
+        *p++ = ((m >> 16) & 0xff);
+        *p++ = ((m >> 8) & 0xff);
+        *p++ = (m & 0xff);
+
         if (opcode == M_WS_OPCODE_CLOSE) {
-            *p++ = ((mln_websocket_get_status(ws) >> 8) & 0xff) ^ tmpkey[i++%4];
-            *p++ = (mln_websocket_get_status(ws) & 0xff) ^ tmpkey[i++%4];
-        }
-        for (j = 0; i < clen; ++i, ++j) {
-            *p++ = pc[j] ^ tmpkey[i%4];
+            *p++ = (mln_websocket_get_status(ws) >> 8) & 0xff;
+            *p++ = mln_websocket_get_status(ws) & 0xff;
+            phase = mln_websocket_mask(p - 2, p - 2, 2, m, phase);
         }
+        if (content != NULL) mln_websocket_mask(p, content, clen, m, phase);
     } else {
         if (opcode == M_WS_OPCODE_CLOSE) {
             *p++ = (mln_websocket_get_status(ws) >> 8) & 0xff;
             *p++ = mln_websocket_get_status(ws) & 0xff;
-            clen -= 2;
         }
         if (content != NULL) memcpy(p, content, clen);
     }
@@ -750,155 +926,226 @@ int mln_websocket_generate(mln_websocket_t *ws, mln_chain_t **out_cnode)
     return M_WS_RET_OK;
 }
 
-int mln_websocket_parse(mln_websocket_t *ws, mln_chain_t **in)
+/*
+ * Broadcast
+ */
+mln_buf_t *mln_websocket_broadcast_frame_new(mln_alloc_t *pool, \
+                                             mln_u8_t opcode, \
+                                             void *data, \
+                                             mln_size_t len, \
+                                             mln_u32_t flags)
 {
-    mln_chain_t *c = *in;
-    mln_u8ptr_t p = NULL, end = NULL, content = NULL;
-    mln_u64_t len, i, tmp;
-    mln_u32_t masking_key = 0;
-    mln_u8_t b1 = 0, b2 = 0;
-
-    for (i = 0; c != NULL; c = c->next) {
-        if (c->buf == NULL || mln_buf_left_size(c->buf) == 0) continue;
-        p = c->buf->left_pos;
-        for (end = c->buf->end; p < end; ++p) {
-             if (i == 0) {
-                 b1 = *p;
-                 ++i;
-             } else {
-                 b2 = *p++;
-                 ++i;
-                 break;
-             }
-        }
-        if (i >= 2) break;
-    }
-    if (i < 2) return M_WS_RET_NOTYET;
-
-    len = b2 & 0x7f;
-    if (len == 127) {
-        tmp = p - end;
-        if (tmp > 8) tmp = 8;
-        len = 0;
-        i = 0;
-again127:
-        for (; i < tmp; ++i) {
-            len |= ((*p++) << ((7 - i)<<3));
-        }
-        if (tmp < 8) {
-            for (c = c->next; c != NULL; c = c->next) {
-                if (c->buf == NULL || mln_buf_left_size(c->buf) == 0) continue;
-                p = c->buf->left_pos;
-                end = c->buf->end;
-                break;
-            }
-            if (c == NULL) return M_WS_RET_NOTYET;
-            tmp = (8-tmp > p-end)? tmp+(mln_u32_t)(p-end): 8;
-            goto again127;
-        }
-    } else if (len == 126) {
-        tmp = p - end;
-        if (tmp > 2) tmp = 2;
-        len = 0;
-        i = 0;
-again126:
-        for (; i < tmp; ++i) {
-            len |= ((*p++) << ((1 - i)<<3));
-        }
-        if (tmp < 2) {
-            for (c = c->next; c != NULL; c = c->next) {
-                if (c->buf == NULL || mln_buf_left_size(c->buf) == 0) continue;
-                p = c->buf->left_pos;
-                end = c->buf->end;
-                break;
-            }
-            if (c == NULL) return M_WS_RET_NOTYET;
-            tmp = (2-tmp > p-end)? tmp+(mln_u32_t)(p-end): 2;
-            goto again126;
-        }
+    mln_buf_t *b;
+    mln_u8ptr_t buf, p;
+    mln_size_t size;
+    mln_u8_t b1;
+
+    if (data == NULL && len) return NULL;
+    if (opcode & 0x8) {
+        /*control frames can be neither fragmented nor longer than 125 bytes*/
+        if (!(flags & M_WS_FLAG_END) || len > 125) return NULL;
+    } else if (!(flags & M_WS_FLAG_NEW)) {
+        opcode = M_WS_OPCODE_CONTINUE;
     }
+    b1 = opcode & 0xf;
+    if (flags & M_WS_FLAG_END) b1 |= 0x80;
+
+    size = mln_websocket_header_size(len) + len;
+    if ((b = mln_buf_new(pool)) == NULL) return NULL;
+    if ((buf = (mln_u8ptr_t)mln_alloc_m(pool, size)) == NULL) {
+        mln_buf_pool_release(b);
+        return NULL;
+    }
+    b->left_pos = b->pos = b->start = buf;
+    b->end = b->last = buf + size;
+    b->in_memory = 1;
+    b->last_buf = 1;
+    if (flags & M_WS_FLAG_END) b->last_in_chain = 1;
 
-    if (b2 & 0x80) {
-        tmp = p - end;
-        if (tmp > 4) tmp = 4;
-        i = 0;
-againm:
-        for (; i < tmp; ++i) {
-            masking_key |= ((*p++) << ((3 - i) << 3));
+    p = mln_websocket_header_write(buf, b1, 0, len);
+    if (len) memcpy(p, data, len);
+
+    return b;
+}
+
+mln_size_t mln_websocket_broadcast(mln_buf_t *frame, mln_tcp_conn_t **conns, mln_size_t n)
+{
+    mln_size_t i, len = mln_buf_left_size(frame);
+    mln_alloc_t *pool;
+    mln_chain_t *c;
+    mln_buf_t *b;
+
+    for (i = 0; i < n; ++i) {
+        /*
+         * Each receiver gets its own slice to keep its send position,
+         * the encoded frame itself is only referred to.
+         */
+        pool = mln_tcp_conn_get_pool(conns[i]);
+        if ((c = mln_chain_new(pool)) == NULL) break;
+        if ((b = mln_buf_slice(pool, frame, 0, len)) == NULL) {
+            mln_chain_pool_release(c);
+            break;
         }
-        if (tmp < 4) {
-            for (c = c->next; c != NULL; c = c->next) {
-                if (c->buf == NULL || mln_buf_left_size(c->buf) == 0) continue;
-                p = c->buf->left_pos;
-                end = c->buf->end;
-                break;
+        b->last_in_chain = frame->last_in_chain;
+        c->buf = b;
+        mln_tcp_conn_append(conns[i], c, M_C_SEND);
+    }
+
+    return i;
+}
+
+/*
+ * Decode the frame header at the front of the chain without consuming anything.
+ * M_WS_RET_NOTYET is returned until the whole frame has been received.
+ */
+static int mln_websocket_frame_header(mln_chain_t *in, struct mln_websocket_frame_s *f)
+{
+    mln_u8_t h[14];
+    mln_u8ptr_t p;
+    mln_chain_t *c;
+    mln_u64_t size, total = 0;
+    mln_u32_t i, n = 0, need = 2;
+
+    for (c = in; c != NULL; c = c->next) {
+        if (c->buf == NULL || (size = mln_buf_left_size(c->buf)) == 0) continue;
+        for (p = c->buf->left_pos, i = 0; i < size && n < need; ++i) {
+            h[n++] = p[i];
+            if (n == 2) {
+                if ((h[1] & 0x7f) == 126) need += 2;
+                else if ((h[1] & 0x7f) == 127) need += 8;
+                if (h[1] & 0x80) need += 4;
             }
-            if (c == NULL) return M_WS_RET_NOTYET;
-            tmp = (4-tmp > p-end)? tmp+(mln_u32_t)(p-end): 4;
-            goto againm;
         }
+        total += size;
+        if (n == need) break;
+    }
+    if (n < need) return M_WS_RET_NOTYET;
+
+    f->b1 = h[0];
+    f->b2 = h[1];
+    f->len = h[1] & 0x7f;
+    p = h + 2;
+    if (f->len == 126) {
+        f->len = ((mln_u64_t)p[0] << 8) | p[1];
+        p += 2;
+    } else if (f->len == 127) {
+        for (f->len = 0, i = 0; i < 8; ++i) f->len = (f->len << 8) | *p++;
+        if (f->len >> 63) return M_WS_RET_ERROR;
+    }
+    f->masking_key = 0;
+    if (h[1] & 0x80) {
+        f->masking_key = ((mln_u32_t)p[0] << 24) | ((mln_u32_t)p[1] << 16) | ((mln_u32_t)p[2] << 8) | p[3];
     }
+    f->hlen = need;
 
-    if (len) {
-        if ((b1&0xf) == M_WS_OPCODE_CLOSE && len > 1) {
-            mln_u16_t status = 0;
-
-            tmp = p - end;
-            if (tmp > 2) tmp = 2;
-            i = 0;
-against:
-            for (; i < tmp; ++i) {
-                status |= ((*p++) << ((1 - i)<<3));
-            }
-            if (tmp < 2) {
-                for (c = c->next; c != NULL; c = c->next) {
-                    if (c->buf == NULL || mln_buf_left_size(c->buf) == 0) continue;
-                    p = c->buf->left_pos;
-                    end = c->buf->end;
-                    break;
-                }
-                if (c == NULL) return M_WS_RET_NOTYET;
-                tmp = (2-tmp > p-end)? tmp+(mln_u32_t)(p-end): 2;
-                goto against;
-            }
+    for (c = c->next; c != NULL && total - need < f->len; c = c->next) {
+        if (c->buf == NULL) continue;
+        total += mln_buf_left_size(c->buf);
+    }
+    if (total - need < f->len) return M_WS_RET_NOTYET;
+    return M_WS_RET_OK;
+}
 
-            mln_websocket_set_status(ws, status);
-            len -= 2;
-        } else {
-            mln_websocket_set_status(ws, 0);
+/*
+ * Move (*c, *off) forward to the first payload byte that is not processed yet.
+ */
+static inline void mln_websocket_seek(mln_chain_t **c, mln_u64_t *off)
+{
+    for (; *c != NULL; *c = (*c)->next) {
+        if ((*c)->buf == NULL) continue;
+        if (*off < mln_buf_left_size((*c)->buf)) break;
+        *off -= mln_buf_left_size((*c)->buf);
+    }
+}
+
+/*
+ * Consume n bytes from the chain and release the nodes which are drained.
+ */
+static void mln_websocket_consume(mln_chain_t **in, mln_u64_t n)
+{
+    mln_u64_t size;
+    mln_chain_t *c = *in, *tmp;
+
+    for (; c != NULL; c = c->next) {
+        if (c->buf == NULL || (size = mln_buf_left_size(c->buf)) == 0) continue;
+        if (size > n) {
+            c->buf->left_pos += n;
+            break;
         }
-        content = (mln_u8ptr_t)mln_alloc_m(mln_websocket_get_pool(ws), len);
-        if (content == NULL) return M_WS_RET_FAILED;
-        tmp = p - end;
-        if (tmp > len) tmp = len;
-        i = 0;
-againc:
-        if (tmp > 0) memcpy(content+i, p, tmp);
-        i += tmp;
-        p += tmp;
-        if (tmp < len) {
-            for (c = c->next; c != NULL; c = c->next) {
-                if (c->buf == NULL || mln_buf_left_size(c->buf) == 0) continue;
-                p = c->buf->left_pos;
-                end = c->buf->end;
-                break;
-            }
-            if (c == NULL) {
-                mln_alloc_free(content);
-                return M_WS_RET_NOTYET;
-            }
-            tmp = (len-tmp > p-end)? p-end: len-tmp;
-            goto againc;
+        c->buf->left_pos += size;
+        n -= size;
+    }
+    for (; c != NULL; c = c->next) {
+        if (c->buf != NULL && mln_buf_left_size(c->buf)) break;
+    }
+
+    if (c == NULL) {
+        mln_chain_pool_release_all(*in);
+        *in = NULL;
+    } else if (c != *in) {
+        tmp = *in;
+        *in = c;
+        for (c = tmp; c->next != *in; c = c->next)
+            ;
+        c->next = NULL;
+        mln_chain_pool_release_all(tmp);
+    }
+}
+
+/*
+ * Unmask len payload bytes starting at (*c, *off) in place and move forward.
+ * If 'copy' is not NULL, the bytes are copied into it as well.
+ */
+static inline mln_u32_t mln_websocket_unmask_in_place(mln_chain_t **c, mln_u64_t *off, mln_u64_t len, \
+                                                     mln_u32_t masking_key, mln_u32_t phase, mln_u8ptr_t copy)
+{
+    mln_u64_t n;
+    mln_u8ptr_t p;
+
+    while (len) {
+        mln_websocket_seek(c, off);
+        p = (*c)->buf->left_pos + *off;
+        n = mln_buf_left_size((*c)->buf) - *off;
+        if (n > len) n = len;
+        if (masking_key) phase = mln_websocket_mask(p, p, n, masking_key, phase);
+        if (copy != NULL) {
+            memcpy(copy, p, n);
+            copy += n;
         }
+        *off += n;
+        len -= n;
     }
+    return phase;
+}
 
-    if (mln_websocket_get_content_free(ws)) {
-        mln_alloc_free(mln_websocket_get_content(ws));
-        mln_websocket_reset_content_free(ws);
+/*
+ * Zero the masking key of the frame at the front of the chain once its payload
+ * has been unmasked in place, so that parsing the frame again leaves it as is.
+ */
+static inline void mln_websocket_clear_masking_key(mln_chain_t *c, mln_u64_t hlen)
+{
+    mln_u64_t off = hlen - 4;
+    mln_u32_t i;
+
+    for (i = 0; i < 4; ++i, ++off) {
+        mln_websocket_seek(&c, &off);
+        c->buf->left_pos[off] = 0;
     }
-    mln_websocket_set_content(ws, content);
-    if (content != NULL) mln_websocket_set_content_free(ws);
-    mln_websocket_set_content_len(ws, len);
+}
+
+/*
+ * Return 1 if the buf owns its data, so that a slice can keep it alive.
+ */
+static inline int mln_websocket_buf_owned(mln_buf_t *b)
+{
+    mln_buf_t *origin = b->origin != NULL? b->origin: b;
+
+    while (origin->shadow != NULL) origin = origin->shadow;
+    return origin->in_memory && !origin->temporary && !origin->in_file;
+}
+
+static inline void mln_websocket_set_frame_bits(mln_websocket_t *ws, mln_u8_t b1, struct mln_websocket_frame_s *f)
+{
     if (b1 & 0x80) mln_websocket_set_fin(ws);
     else mln_websocket_reset_fin(ws);
     if (b1 & 0x40) mln_websocket_set_rsv1(ws);
@@ -908,56 +1155,747 @@ againc:
     if (b1 & 0x10) mln_websocket_set_rsv3(ws);
     else mln_websocket_reset_rsv3(ws);
     mln_websocket_set_opcode(ws, b1&0xf);
-    if (b2 & 0x80) mln_websocket_set_maskbit(ws);
+    if (f->b2 & 0x80) mln_websocket_set_maskbit(ws);
     else mln_websocket_reset_maskbit(ws);
-    if (b2 & 0x80) mln_websocket_set_masking_key(ws, masking_key);
-    else mln_websocket_set_masking_key(ws, 0);
+    mln_websocket_set_masking_key(ws, f->masking_key);
+}
 
-    if (mln_websocket_get_maskbit(ws)) {
-        mln_u8_t tmpkey[4];
-        mln_u16_t status = mln_websocket_get_status(ws);
-        tmpkey[0] = (masking_key >> 24) & 0xff;
-        tmpkey[1] = (masking_key >> 16) & 0xff;
-        tmpkey[2] = (masking_key >> 8) & 0xff;
-        tmpkey[3] = masking_key & 0xff;
-        i = 0;
-        if (mln_websocket_get_opcode(ws) == M_WS_OPCODE_CLOSE && status != 0) {
-            status = ((((status >> 8) & 0xff) ^ tmpkey[i++%4]) << 8) | (status & 0xff);
-            status = (((status >> 8) & 0xff) << 8) | ((status & 0xff) ^ tmpkey[i++%4]);
-            mln_websocket_set_status(ws, status);
+static inline void mln_websocket_content_release(mln_websocket_t *ws)
+{
+    if (mln_websocket_get_content_free(ws)) {
+        mln_alloc_free(mln_websocket_get_content(ws));
+        mln_websocket_reset_content_free(ws);
+    }
+    mln_websocket_set_content(ws, NULL);
+    if (ws->pinned != NULL) {
+        mln_chain_pool_release_all(ws->pinned);
+        ws->pinned = NULL;
+    }
+}
+
+int mln_websocket_parse(mln_websocket_t *ws, mln_chain_t **in)
+{
+    int ret;
+    mln_u16_t status = 0;
+    mln_u32_t phase = 0;
+    mln_u64_t len, off;
+    mln_chain_t *c;
+    mln_buf_t *b;
+    mln_u8ptr_t content = NULL;
+    mln_u8_t st[2], has_status;
+    struct mln_websocket_frame_s f;
+    mln_alloc_t *pool = mln_websocket_get_pool(ws);
+
+    if ((ret = mln_websocket_frame_header(*in, &f)) != M_WS_RET_OK) return ret;
+
+    mln_websocket_content_release(ws);
+
+    len = f.len;
+    has_status = (f.b1 & 0xf) == M_WS_OPCODE_CLOSE && len > 1;
+    if (has_status) len -= 2;
+
+    /*
+     * Everything that may fail is done before the payload is touched,
+     * so the frame is still intact if the caller tries again.
+     */
+    if (len) {
+        c = *in;
+        off = f.hlen + (has_status? 2: 0);
+        mln_websocket_seek(&c, &off);
+        b = c->buf;
+        if (mln_buf_left_size(b) - off >= len && mln_websocket_buf_owned(b)) {
+            /*
+             * The payload is in one buf, unmask it in place and keep the buf alive
+             * by a slice instead of copying it.
+             */
+            if ((ws->pinned = mln_chain_new(pool)) == NULL) return M_WS_RET_FAILED;
+            if ((ws->pinned->buf = mln_buf_slice(pool, b, off, len)) == NULL) {
+                mln_chain_pool_release(ws->pinned);
+                ws->pinned = NULL;
+                return M_WS_RET_FAILED;
+            }
+            content = b->left_pos + off;
+        } else {
+            if ((content = (mln_u8ptr_t)mln_alloc_m(pool, len)) == NULL) return M_WS_RET_FAILED;
+            mln_websocket_set_content_free(ws);
+        }
+    }
+
+    c = *in;
+    off = f.hlen;
+    if (has_status) {
+        phase = mln_websocket_unmask_in_place(&c, &off, 2, f.masking_key, phase, st);
+        status = ((mln_u16_t)st[0] << 8) | st[1];
+    }
+    if (len) {
+        mln_websocket_unmask_in_place(&c, &off, len, f.masking_key, phase, \
+                                      ws->pinned != NULL? NULL: content);
+    }
+    if (f.masking_key) mln_websocket_clear_masking_key(*in, f.hlen);
+
+    mln_websocket_set_status(ws, status);
+    mln_websocket_set_content(ws, content);
+    mln_websocket_set_content_len(ws, len);
+    mln_websocket_set_frame_bits(ws, f.b1, &f);
+
+    if (ws->deflate != NULL && (ret = mln_websocket_inflate_frame(ws)) != M_WS_RET_OK) return ret;
+    if (mln_websocket_get_ext_handler(ws) != NULL) {
+        if ((ret = mln_websocket_get_ext_handler(ws)(ws)) != M_WS_RET_OK) return ret;
+    }
+
+    mln_websocket_consume(in, f.hlen + f.len);
+
+    return M_WS_RET_OK;
+}
+
+int mln_websocket_message_parse(mln_websocket_t *ws, mln_chain_t **in)
+{
+    int ret;
+    mln_u8_t op;
+    mln_u32_t phase;
+    mln_u64_t off, len, n;
+    mln_chain_t *c, *nc, *head, *tail;
+    mln_buf_t *b;
+    mln_u8ptr_t data;
+    struct mln_websocket_frame_s f;
+    mln_alloc_t *pool = mln_websocket_get_pool(ws);
+
+    if (ws->msg_done) {
+        if (ws->msg_head != NULL) mln_chain_pool_release_all(ws->msg_head);
+        ws->msg_head = ws->msg_tail = NULL;
+        ws->msg_len = 0;
+        ws->msg_done = 0;
+    }
+
+    while (1) {
+        if ((ret = mln_websocket_frame_header(*in, &f)) != M_WS_RET_OK) return ret;
+
+        op = f.b1 & 0xf;
+        if (op & 0x8) return mln_websocket_parse(ws, in);/*control frames may be interleaved*/
+        if (op == M_WS_OPCODE_CONTINUE) {
+            if (!ws->msg_opcode) return M_WS_RET_ERROR;
+            if (ws->deflate != NULL && (f.b1 & 0x40)) return M_WS_RET_ERROR;
+        } else if (ws->msg_opcode) {
+            return M_WS_RET_ERROR;
+        }
+
+        /*
+         * Take the payload into a chain of its own first, and unmask it only
+         * when nothing can fail any more, so a failed frame is left intact.
+         */
+        head = tail = NULL;
+        c = *in;
+        off = f.hlen;
+        for (len = f.len; len; len -= n) {
+            mln_websocket_seek(&c, &off);
+            b = c->buf;
+            n = mln_buf_left_size(b) - off;
+            if (n > len) n = len;
+
+            if ((nc = mln_chain_new(pool)) == NULL) goto failed;
+            if (mln_websocket_buf_owned(b)) {
+                nc->buf = mln_buf_slice(pool, b, off, n);
+            } else if ((nc->buf = mln_buf_new(pool)) != NULL) {
+                if ((nc->buf->start = (mln_u8ptr_t)mln_alloc_m(pool, n)) == NULL) {
+                    mln_buf_pool_release(nc->buf);
+                    nc->buf = NULL;
+                } else {
+                    memcpy(nc->buf->start, b->left_pos + off, n);
+                    nc->buf->left_pos = nc->buf->pos = nc->buf->start;
+                    nc->buf->last = nc->buf->end = nc->buf->start + n;
+                    nc->buf->in_memory = 1;
+                    nc->buf->last_buf = 1;
+                }
+            }
+            if (nc->buf == NULL) {
+                mln_chain_pool_release(nc);
+                goto failed;
+            }
+            mln_chain_add(&head, &tail, nc);
+            off += n;
         }
-        if (content != NULL) {
-            for (tmp = 0; tmp < len; ++tmp) {
-                content[tmp] ^= tmpkey[i++%4];
+        if (f.masking_key) {
+            for (phase = 0, nc = head; nc != NULL; nc = nc->next) {
+                data = nc->buf->left_pos;
+                phase = mln_websocket_mask(data, data, mln_buf_left_size(nc->buf), f.masking_key, phase);
             }
         }
+        if (head != NULL) {
+            mln_chain_add(&ws->msg_head, &ws->msg_tail, head);
+            ws->msg_tail = tail;
+        }
+        if (op != M_WS_OPCODE_CONTINUE) {
+            ws->msg_opcode = op;
+            ws->msg_rsv = (f.b1 >> 4) & 0x7;
+        }
+        ws->msg_len += f.len;
+
+        mln_websocket_consume(in, f.hlen + f.len);
+
+        if (f.b1 & 0x80) break;
     }
 
+    mln_websocket_content_release(ws);
+    mln_websocket_set_status(ws, 0);
+    mln_websocket_set_content_len(ws, ws->msg_len);
+    mln_websocket_set_frame_bits(ws, (mln_u8_t)(0x80 | (ws->msg_rsv << 4) | ws->msg_opcode), &f);
+    ws->msg_opcode = 0;
+    ws->msg_done = 1;
+
+    if (ws->deflate != NULL && (ret = mln_websocket_inflate_message(ws)) != M_WS_RET_OK) return ret;
     if (mln_websocket_get_ext_handler(ws) != NULL) {
-        int ret = mln_websocket_get_ext_handler(ws)(ws);
-        if (ret != M_WS_RET_OK) return ret;
+        return mln_websocket_get_ext_handler(ws)(ws);
     }
 
-    if (c != NULL && c->buf != NULL) c->buf->left_pos = p;
-    for (; c != NULL; c = c->next) {
-        if (c->buf == NULL || mln_buf_left_size(c->buf)==0) continue;
-        break;
+    return M_WS_RET_OK;
+
+failed:
+    if (head != NULL) mln_chain_pool_release_all(head);
+    return M_WS_RET_FAILED;
+}
+
+/*
+ * permessage-deflate
+ */
+struct mln_websocket_deflate_params_s {
+    mln_u32_t                server_nct:1;
+    mln_u32_t                client_nct:1;
+    mln_u32_t                client_bits_offered:1;
+    mln_u32_t                server_bits;/*0 if absent*/
+    mln_u32_t                client_bits;/*0 if absent or no value*/
+};
+
+#if defined(MLN_ZLIB)
+static mln_string_t mln_websocket_deflate_name = mln_string("permessage-deflate");
+static mln_u8_t mln_websocket_deflate_trailer[4] = {0x0, 0x0, 0xff, 0xff};
+
+struct mln_websocket_deflate_s {
+    struct mln_websocket_deflate_attr attr;
+    mln_alloc_t             *pool;
+    z_stream                 deflater;
+    z_stream                 inflater;
+    mln_u64_t                in_len;/*inflated size of the message being received*/
+    mln_u32_t                deflate_bits;
+    mln_u32_t                deflate_nct:1;/*reset the deflater after each message*/
+    mln_u32_t                inflate_nct:1;
+    mln_u32_t                deflater_ready:1;
+    mln_u32_t                inflater_ready:1;
+    mln_u32_t                out_msg:1;/*sending a compressed fragmented message*/
+    mln_u32_t                in_msg:1;/*receiving a compressed fragmented message*/
+};
+
+static voidpf mln_websocket_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    return mln_alloc_m((mln_alloc_t *)opaque, (mln_size_t)items * size);
+}
+
+static void mln_websocket_zfree(voidpf opaque, voidpf ptr)
+{
+    mln_alloc_free(ptr);
+}
+
+int mln_websocket_deflate_enable(mln_websocket_t *ws, struct mln_websocket_deflate_attr *attr)
+{
+    mln_websocket_deflate_t *d;
+
+    if (attr != NULL) {
+        if ((attr->server_max_window_bits && (attr->server_max_window_bits < 9 || attr->server_max_window_bits > 15)) || \
+            (attr->client_max_window_bits && (attr->client_max_window_bits < 9 || attr->client_max_window_bits > 15)) || \
+            attr->level < -1 || attr->level > 9 || attr->mem_level < 0 || attr->mem_level > 9)
+        {
+            return M_WS_RET_ERROR;
+        }
     }
 
-    if (c == NULL) {
-        mln_chain_pool_release_all(*in);
-        *in = NULL;
+    mln_websocket_deflate_free(ws);
+    if ((d = (mln_websocket_deflate_t *)mln_alloc_c(ws->pool, sizeof(mln_websocket_deflate_t))) == NULL)
+        return M_WS_RET_FAILED;
+    if (attr != NULL) {
+        d->attr = *attr;
     } else {
-        if (c != *in) {
-            mln_chain_t *tmpc = *in;
-            *in = c;
-            for (c = tmpc; c->next != *in; c = c->next)
+        d->attr.level = Z_DEFAULT_COMPRESSION;
+    }
+    if (!d->attr.server_max_window_bits) d->attr.server_max_window_bits = 15;
+    if (!d->attr.client_max_window_bits) d->attr.client_max_window_bits = 15;
+    if (!d->attr.mem_level) d->attr.mem_level = 8;
+    d->deflate_bits = 15;
+    d->pool = ws->pool;
+    ws->deflate = d;
+
+    return M_WS_RET_OK;
+}
+
+static void mln_websocket_deflate_free(mln_websocket_t *ws)
+{
+    mln_websocket_deflate_t *d = ws->deflate;
+
+    if (d == NULL) return;
+    if (d->deflater_ready) deflateEnd(&d->deflater);
+    if (d->inflater_ready) inflateEnd(&d->inflater);
+    mln_alloc_free(d);
+    ws->deflate = NULL;
+}
+
+/*
+ * Parse one extension of a Sec-WebSocket-Extensions value starting at *pos, and move *pos
+ * behind it. Return 1 if it is a permessage-deflate with valid parameters, -1 if its
+ * parameters are invalid, and 0 if it is another extension.
+ */
+static int mln_websocket_deflate_params_parse(mln_u8ptr_t *pos, mln_u8ptr_t end, struct mln_websocket_deflate_params_s *p)
+{
+    mln_u8ptr_t s = *pos, k, v;
+    mln_size_t klen, vlen;
+    mln_u32_t n, valid = 1, seen = 0, deflate;
+    mln_string_t tmp;
+
+    memset(p, 0, sizeof(*p));
+    while (s < end && (*s == ' ' || *s == '\t')) ++s;
+    for (k = s; s < end && *s != ';' && *s != ',' && *s != ' ' && *s != '\t'; ++s)
+        ;
+    mln_string_nset(&tmp, k, s - k);
+    deflate = !mln_string_strcasecmp(&tmp, &mln_websocket_deflate_name);
+
+    while (1) {
+        while (s < end && (*s == ' ' || *s == '\t')) ++s;
+        if (s >= end || *s == ',') break;
+        if (*s != ';') {
+            valid = 0;
+            ++s;
+            continue;
+        }
+        for (++s; s < end && (*s == ' ' || *s == '\t'); ++s)
+            ;
+        for (k = s; s < end && *s != '=' && *s != ';' && *s != ',' && *s != ' ' && *s != '\t'; ++s)
+            ;
+        klen = s - k;
+        v = NULL;
+        vlen = 0;
+        while (s < end && (*s == ' ' || *s == '\t')) ++s;
+        if (s < end && *s == '=') {
+            for (++s; s < end && (*s == ' ' || *s == '\t'); ++s)
                 ;
-            c->next = NULL;
-            mln_chain_pool_release_all(tmpc);
+            if (s < end && *s == '"') {
+                for (v = ++s; s < end && *s != '"'; ++s)
+                    ;
+                vlen = s - v;
+                if (s < end) ++s;
+            } else {
+                for (v = s; s < end && *s != ';' && *s != ',' && *s != ' ' && *s != '\t'; ++s)
+                    ;
+                vlen = s - v;
+            }
+        }
+        if (!deflate || !valid) continue;
+
+        if (v != NULL) {
+            if (vlen == 1 && v[0] >= '8' && v[0] <= '9') n = v[0] - '0';
+            else if (vlen == 2 && v[0] == '1' && v[1] >= '0' && v[1] <= '5') n = 10 + v[1] - '0';
+            else n = 0;
+        } else {
+            n = 0;
+        }
+
+        if (klen == 26 && !strncasecmp((char *)k, "server_no_context_takeover", klen)) {
+            if (v != NULL || (seen & 0x1)) valid = 0;
+            seen |= 0x1;
+            p->server_nct = 1;
+        } else if (klen == 26 && !strncasecmp((char *)k, "client_no_context_takeover", klen)) {
+            if (v != NULL || (seen & 0x2)) valid = 0;
+            seen |= 0x2;
+            p->client_nct = 1;
+        } else if (klen == 22 && !strncasecmp((char *)k, "server_max_window_bits", klen)) {
+            if (!n || (seen & 0x4)) valid = 0;
+            seen |= 0x4;
+            p->server_bits = n;
+        } else if (klen == 22 && !strncasecmp((char *)k, "client_max_window_bits", klen)) {
+            if ((v != NULL && !n) || (seen & 0x8)) valid = 0;
+            seen |= 0x8;
+            p->client_bits_offered = 1;
+            p->client_bits = n;
+        } else {
+            valid = 0;
+        }
+    }
+
+    *pos = s < end? s + 1: s;
+    if (!deflate) return 0;
+    return valid? 1: -1;
+}
+
+static mln_string_t *mln_websocket_deflate_offer(mln_websocket_t *ws)
+{
+    mln_websocket_deflate_t *d = ws->deflate;
+    char buf[160];
+    int n;
+    mln_string_t tmp;
+
+    n = snprintf(buf, sizeof(buf), "permessage-deflate%s%s",
+                 d->attr.server_no_context_takeover? "; server_no_context_takeover": "",
+                 d->attr.client_no_context_takeover? "; client_no_context_takeover": "");
+    if (d->attr.server_max_window_bits < 15)
+        n += snprintf(buf + n, sizeof(buf) - n, "; server_max_window_bits=%u", d->attr.server_max_window_bits);
+    if (d->attr.client_max_window_bits < 15)
+        n += snprintf(buf + n, sizeof(buf) - n, "; client_max_window_bits=%u", d->attr.client_max_window_bits);
+    else
+        n += snprintf(buf + n, sizeof(buf) - n, "; client_max_window_bits");
+
+    mln_string_nset(&tmp, buf, n);
+    return mln_string_pool_dup(ws->pool, &tmp);
+}
+
+/*
+ * Server side. Accept the first acceptable offer and build the response in *out,
+ * or free the deflate state if there is none.
+ */
+static int mln_websocket_deflate_accept(mln_websocket_t *ws, mln_string_t *offers, mln_string_t **out)
+{
+    mln_websocket_deflate_t *d = ws->deflate;
+    struct mln_websocket_deflate_params_s p;
+    mln_u8ptr_t pos = offers->data, end = offers->data + offers->len;
+    mln_u32_t sbits, cbits;
+    char buf[160];
+    int n;
+    mln_string_t tmp;
+
+    *out = NULL;
+    while (pos < end) {
+        if (mln_websocket_deflate_params_parse(&pos, end, &p) <= 0) continue;
+        if (p.server_bits == 8) continue;/*zlib can not make a raw deflate stream with a 256-byte window*/
+
+        sbits = d->attr.server_max_window_bits;
+        if (p.server_bits && p.server_bits < sbits) sbits = p.server_bits;
+        cbits = d->attr.client_max_window_bits;
+        if (!p.client_bits_offered) cbits = 15;
+        else if (p.client_bits && p.client_bits < cbits) cbits = p.client_bits;
+
+        d->deflate_bits = sbits;
+        d->deflate_nct = p.server_nct | d->attr.server_no_context_takeover;
+        d->inflate_nct = p.client_nct | d->attr.client_no_context_takeover;
+
+        n = snprintf(buf, sizeof(buf), "permessage-deflate%s%s",
+                     d->deflate_nct? "; server_no_context_takeover": "",
+                     d->inflate_nct? "; client_no_context_takeover": "");
+        if (p.server_bits || sbits < 15)
+            n += snprintf(buf + n, sizeof(buf) - n, "; server_max_window_bits=%u", sbits);
+        if (cbits < 15)
+            n += snprintf(buf + n, sizeof(buf) - n, "; client_max_window_bits=%u", cbits);
+
+        mln_string_nset(&tmp, buf, n);
+        if ((*out = mln_string_pool_dup(ws->pool, &tmp)) == NULL) return M_WS_RET_FAILED;
+        return M_WS_RET_OK;
+    }
+
+    mln_websocket_deflate_free(ws);
+    return M_WS_RET_OK;
+}
+
+/*
+ * Client side. Check the response of the server.
+ */
+static int mln_websocket_deflate_confirm(mln_websocket_t *ws, mln_string_t *resp)
+{
+    mln_websocket_deflate_t *d = ws->deflate;
+    struct mln_websocket_deflate_params_s p;
+    mln_u8ptr_t pos, end;
+    int rc;
+
+    if (resp != NULL) {
+        for (pos = resp->data, end = resp->data + resp->len; pos < end; ) {
+            if ((rc = mln_websocket_deflate_params_parse(&pos, end, &p)) < 0) return M_WS_RET_ERROR;
+            if (rc > 0) {
+                if (p.client_bits == 8) return M_WS_RET_ERROR;
+                if (p.server_bits && p.server_bits > d->attr.server_max_window_bits) return M_WS_RET_ERROR;
+                d->deflate_bits = d->attr.client_max_window_bits;
+                if (p.client_bits && p.client_bits < d->deflate_bits) d->deflate_bits = p.client_bits;
+                d->deflate_nct = p.client_nct | d->attr.client_no_context_takeover;
+                d->inflate_nct = p.server_nct;
+                return M_WS_RET_OK;
+            }
+        }
+    }
+
+    mln_websocket_deflate_free(ws);
+    return M_WS_RET_OK;
+}
+
+static int mln_websocket_deflate_run(mln_websocket_deflate_t *d, mln_u8ptr_t in, mln_u64_t len, mln_u8ptr_t *out, mln_u64_t *olen)
+{
+    z_stream *z = &d->deflater;
+    mln_u64_t size;
+    mln_u8ptr_t buf, tmp;
+    int rc;
+
+    if (len > (uInt)-1) return M_WS_RET_ERROR;
+    if (!d->deflater_ready) {
+        z->zalloc = mln_websocket_zalloc;
+        z->zfree = mln_websocket_zfree;
+        z->opaque = d->pool;
+        if (deflateInit2(z, d->attr.level, Z_DEFLATED, -(int)d->deflate_bits, d->attr.mem_level, Z_DEFAULT_STRATEGY) != Z_OK)
+            return M_WS_RET_FAILED;
+        d->deflater_ready = 1;
+    }
+
+    size = deflateBound(z, len) + 16;
+    if ((buf = (mln_u8ptr_t)mln_alloc_m(d->pool, size)) == NULL) return M_WS_RET_FAILED;
+    z->next_in = in;
+    z->avail_in = len;
+    z->next_out = buf;
+    z->avail_out = size;
+    while (1) {
+        rc = deflate(z, Z_SYNC_FLUSH);
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            mln_alloc_free(buf);
+            return M_WS_RET_FAILED;
+        }
+        if (z->avail_out) break;
+        if ((tmp = (mln_u8ptr_t)mln_alloc_re(d->pool, buf, size << 1)) == NULL) {
+            mln_alloc_free(buf);
+            return M_WS_RET_FAILED;
+        }
+        buf = tmp;
+        z->next_out = buf + size;
+        z->avail_out = size;
+        size <<= 1;
+    }
+
+    *out = buf;
+    *olen = size - z->avail_out;
+    return M_WS_RET_OK;
+}
+
+/*
+ * Inflate len bytes of in and append the output to *out, whose length and size are *olen and *osize.
+ */
+static int mln_websocket_inflate_run(mln_websocket_deflate_t *d, mln_u8ptr_t in, mln_u64_t len, \
+                                     mln_u8ptr_t *out, mln_u64_t *olen, mln_u64_t *osize)
+{
+    z_stream *z = &d->inflater;
+    mln_u8ptr_t tmp;
+    mln_u64_t size;
+    int rc;
+
+    if (len > (uInt)-1) return M_WS_RET_ERROR;
+    if (!d->inflater_ready) {
+        z->zalloc = mln_websocket_zalloc;
+        z->zfree = mln_websocket_zfree;
+        z->opaque = d->pool;
+        if (inflateInit2(z, -15) != Z_OK) return M_WS_RET_FAILED;
+        d->inflater_ready = 1;
+    }
+
+    z->next_in = in;
+    z->avail_in = len;
+    while (1) {
+        if (*olen == *osize) {
+            size = *osize? *osize << 1: (len << 2 > 1024? len << 2: 1024);
+            if (*out == NULL) tmp = (mln_u8ptr_t)mln_alloc_m(d->pool, size);
+            else tmp = (mln_u8ptr_t)mln_alloc_re(d->pool, *out, size);
+            if (tmp == NULL) return M_WS_RET_FAILED;
+            *out = tmp;
+            *osize = size;
+        }
+        z->next_out = *out + *olen;
+        z->avail_out = *osize - *olen;
+        rc = inflate(z, Z_SYNC_FLUSH);
+        *olen = *osize - z->avail_out;
+        if (rc == Z_STREAM_END) {
+            /*the peer closed the stream with a final block, the next message starts a new one*/
+            inflateReset(z);
+        } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            return M_WS_RET_ERROR;
+        }
+        if (d->attr.max_message_size && d->in_len + *olen > d->attr.max_message_size)
+            return M_WS_RET_ERROR;
+        if (z->avail_out) {
+            if (!z->avail_in || rc == Z_BUF_ERROR) break;
         }
     }
 
     return M_WS_RET_OK;
 }
 
+/*
+ * Compress the content of a text or binary frame to be generated.
+ */
+static int mln_websocket_deflate_frame(mln_websocket_t *ws)
+{
+    mln_websocket_deflate_t *d = ws->deflate;
+    mln_u32_t opcode = mln_websocket_get_opcode(ws);
+    mln_u8ptr_t out;
+    mln_u64_t olen;
+    int ret;
+
+    if (opcode & 0x8) return M_WS_RET_OK;
+    if (opcode == M_WS_OPCODE_CONTINUE) {
+        if (!d->out_msg) return M_WS_RET_OK;
+        mln_websocket_reset_rsv1(ws);
+    } else {
+        if (d->out_msg) return M_WS_RET_ERROR;
+        if (mln_websocket_get_fin(ws) && mln_websocket_get_content_len(ws) < d->attr.threshold)
+            return M_WS_RET_OK;
+        d->out_msg = 1;
+        mln_websocket_set_rsv1(ws);
+    }
+    if (mln_websocket_get_content(ws) == NULL && mln_websocket_get_content_len(ws)) return M_WS_RET_ERROR;
+
+    ret = mln_websocket_deflate_run(d, (mln_u8ptr_t)mln_websocket_get_content(ws), mln_websocket_get_content_len(ws), &out, &olen);
+    if (ret != M_WS_RET_OK) return ret;
+
+    if (mln_websocket_get_fin(ws)) {
+        /*
+         * The sync flush ends with an empty stored block, whose last 4 bytes are stripped.
+         * If nothing is flushed (no new input since the last flush), send the header of
+         * an empty stored block, so that the peer can append the 4 bytes.
+         */
+        if (olen >= 4 && !memcmp(out + olen - 4, mln_websocket_deflate_trailer, 4)) olen -= 4;
+        else if (olen == 0) out[olen++] = 0;
+        d->out_msg = 0;
+        if (d->deflate_nct) deflateReset(&d->deflater);
+    }
+
+    if (mln_websocket_get_content_free(ws)) mln_alloc_free(mln_websocket_get_content(ws));
+    mln_websocket_set_content(ws, out);
+    mln_websocket_set_content_len(ws, olen);
+    mln_websocket_set_content_free(ws);
+
+    return M_WS_RET_OK;
+}
+
+/*
+ * Decompress the content of a parsed text, binary or continuation frame.
+ */
+static int mln_websocket_inflate_frame(mln_websocket_t *ws)
+{
+    mln_websocket_deflate_t *d = ws->deflate;
+    mln_u32_t opcode = mln_websocket_get_opcode(ws);
+    mln_u8ptr_t out = NULL;
+    mln_u64_t olen = 0, osize = 0;
+    int ret;
+
+    if (opcode & 0x8) return mln_websocket_get_rsv1(ws)? M_WS_RET_ERROR: M_WS_RET_OK;
+    if (opcode == M_WS_OPCODE_CONTINUE) {
+        if (mln_websocket_get_rsv1(ws)) return M_WS_RET_ERROR;
+        if (!d->in_msg) return M_WS_RET_OK;
+    } else {
+        if (!mln_websocket_get_rsv1(ws)) return M_WS_RET_OK;
+        d->in_msg = 1;
+        d->in_len = 0;
+    }
+
+    ret = mln_websocket_inflate_run(d, (mln_u8ptr_t)mln_websocket_get_content(ws), mln_websocket_get_content_len(ws), &out, &olen, &osize);
+    if (ret == M_WS_RET_OK && mln_websocket_get_fin(ws))
+        ret = mln_websocket_inflate_run(d, mln_websocket_deflate_trailer, 4, &out, &olen, &osize);
+    if (ret != M_WS_RET_OK) {
+        if (out != NULL) mln_alloc_free(out);
+        return ret;
+    }
+    d->in_len += olen;
+    if (mln_websocket_get_fin(ws)) {
+        d->in_msg = 0;
+        if (d->inflate_nct) inflateReset(&d->inflater);
+    }
+
+    mln_websocket_content_release(ws);
+    mln_websocket_set_content(ws, out);
+    mln_websocket_set_content_len(ws, olen);
+    mln_websocket_set_content_free(ws);
+    mln_websocket_reset_rsv1(ws);
+
+    return M_WS_RET_OK;
+}
+
+/*
+ * Decompress a message reassembled by mln_websocket_message_parse.
+ */
+static int mln_websocket_inflate_message(mln_websocket_t *ws)
+{
+    mln_websocket_deflate_t *d = ws->deflate;
+    mln_u8ptr_t out = NULL;
+    mln_u64_t olen = 0, osize = 0;
+    mln_chain_t *c;
+    mln_buf_t *b;
+    int ret = M_WS_RET_OK;
+
+    if (!(ws->msg_rsv & 0x4)) return M_WS_RET_OK;
+
+    d->in_len = 0;
+    for (c = ws->msg_head; c != NULL && ret == M_WS_RET_OK; c = c->next) {
+        ret = mln_websocket_inflate_run(d, c->buf->left_pos, mln_buf_left_size(c->buf), &out, &olen, &osize);
+    }
+    if (ret == M_WS_RET_OK)
+        ret = mln_websocket_inflate_run(d, mln_websocket_deflate_trailer, 4, &out, &olen, &osize);
+    if (ret != M_WS_RET_OK) {
+        if (out != NULL) mln_alloc_free(out);
+        return ret;
+    }
+    if (d->inflate_nct) inflateReset(&d->inflater);
+
+    if ((c = mln_chain_new(ws->pool)) == NULL) {
+        mln_alloc_free(out);
+        return M_WS_RET_FAILED;
+    }
+    if ((b = mln_buf_new(ws->pool)) == NULL) {
+        mln_chain_pool_release(c);
+        mln_alloc_free(out);
+        return M_WS_RET_FAILED;
+    }
+    c->buf = b;
+    b->left_pos = b->pos = b->start = out;
+    b->last = out + olen;
+    b->end = out + osize;
+    b->in_memory = 1;
+    b->last_buf = 1;
+
+    if (ws->msg_head != NULL) mln_chain_pool_release_all(ws->msg_head);
+    ws->msg_head = ws->msg_tail = c;
+    ws->msg_len = olen;
+    ws->msg_rsv &= ~0x4;
+    mln_websocket_set_content_len(ws, olen);
+    mln_websocket_reset_rsv1(ws);
+
+    return M_WS_RET_OK;
+}
+
+#else
+
+int mln_websocket_deflate_enable(mln_websocket_t *ws, struct mln_websocket_deflate_attr *attr)
+{
+    return M_WS_RET_FAILED;
+}
+
+static void mln_websocket_deflate_free(mln_websocket_t *ws)
+{
+}
+
+static mln_string_t *mln_websocket_deflate_offer(mln_websocket_t *ws)
+{
+    return NULL;
+}
+
+static int mln_websocket_deflate_accept(mln_websocket_t *ws, mln_string_t *offers, mln_string_t **out)
+{
+    *out = NULL;
+    return M_WS_RET_OK;
+}
+
+static int mln_websocket_deflate_confirm(mln_websocket_t *ws, mln_string_t *resp)
+{
+    return M_WS_RET_OK;
+}
+
+static int mln_websocket_deflate_frame(mln_websocket_t *ws)
+{
+    return M_WS_RET_OK;
+}
+
+static int mln_websocket_inflate_frame(mln_websocket_t *ws)
+{
+    return M_WS_RET_OK;
+}
+
+static int mln_websocket_inflate_message(mln_websocket_t *ws)
+{
+    return M_WS_RET_OK;
+}
+
+#endif